@@ -0,0 +1,620 @@
+/*
+ *    Copyright 2010 INRIA, Planete Team
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <dtn-config.h>
+#endif
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <oasys/io/NetUtils.h>
+
+#include "APIReactor.h"
+#include "APIServer.h"
+
+namespace dtn {
+
+// the epoll events of a client's socket carry the client pointer, and
+// those of the notifiers of its parked request carry the same pointer
+// with the low bit set
+#define NOTIFIER_TAG ((uintptr_t)1)
+
+//----------------------------------------------------------------------
+APIReactor::APIReactor(APIServer* server, int id)
+      // the APIServer joins and deletes the reactors at shutdown
+    : Thread("APIReactor", CREATE_JOINABLE),
+      Logger("APIReactor", "/dtn/apiserver/reactor/%d", id),
+      server_(server)
+{
+    epoll_fd_ = epoll_create(MAX_EVENTS);
+    if (epoll_fd_ < 0) {
+        PANIC("can't create the reactor epoll set: %s", strerror(errno));
+    }
+
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK);
+    if (wakeup_fd_ < 0) {
+        PANIC("can't create the reactor eventfd: %s", strerror(errno));
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev) != 0) {
+        PANIC("can't watch the reactor eventfd: %s", strerror(errno));
+    }
+}
+
+//----------------------------------------------------------------------
+APIReactor::~APIReactor()
+{
+    close(wakeup_fd_);
+    close(epoll_fd_);
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::add_client(APIClient* client)
+{
+    {
+        oasys::ScopeLock l(&lock_, "APIReactor::add_client");
+        new_clients_.push_back(client);
+    }
+
+    wakeup();
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::wakeup()
+{
+    u_int64_t one = 1;
+    if (write(wakeup_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_err("can't wake up the reactor: %s", strerror(errno));
+    }
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::run()
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while (! should_stop()) {
+        int nready = epoll_wait(epoll_fd_, events, MAX_EVENTS,
+                                next_timeout());
+        if (nready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_err("error waiting for events: %s", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < nready; ++i) {
+            uintptr_t tag = (uintptr_t)events[i].data.ptr;
+
+            if (tag == 0) {
+                u_int64_t count;
+                if (read(wakeup_fd_, &count, sizeof(count)) < 0 &&
+                    errno != EAGAIN)
+                {
+                    log_err("can't clear the reactor eventfd: %s",
+                            strerror(errno));
+                }
+                accept_new_clients();
+                continue;
+            }
+
+            // skip the clients closed while handling the previous
+            // events, which are only deleted at the end of the round
+            APIClient* client = (APIClient*)(tag & ~NOTIFIER_TAG);
+            if (client->fd() < 0) {
+                continue;
+            }
+
+            if (tag & NOTIFIER_TAG) {
+                wake_parked(client);
+                continue;
+            }
+
+            if (events[i].events & EPOLLOUT) {
+                handle_output(client);
+            }
+
+            if (client->fd() >= 0 &&
+                (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+            {
+                handle_input(client);
+            }
+        }
+
+        run_expired();
+
+        std::vector<APIClient*>::iterator iter;
+        for (iter = closed_clients_.begin();
+             iter != closed_clients_.end(); ++iter)
+        {
+            delete *iter;
+        }
+        closed_clients_.clear();
+    }
+
+    log_debug("reactor stopping, closing %zu clients", clients_.size());
+
+    accept_new_clients();
+    std::vector<APIClient*> clients(clients_.begin(), clients_.end());
+    std::vector<APIClient*>::iterator iter;
+    for (iter = clients.begin(); iter != clients.end(); ++iter) {
+        close_client(*iter);
+    }
+    for (iter = closed_clients_.begin(); iter != closed_clients_.end(); ++iter) {
+        delete *iter;
+    }
+    closed_clients_.clear();
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::accept_new_clients()
+{
+    std::vector<APIClient*> clients;
+    {
+        oasys::ScopeLock l(&lock_, "APIReactor::accept_new_clients");
+        clients.swap(new_clients_);
+    }
+
+    std::vector<APIClient*>::iterator iter;
+    for (iter = clients.begin(); iter != clients.end(); ++iter) {
+        APIClient* client = *iter;
+        client->reactor_ = this;
+        clients_.insert(client);
+
+        log_info("new session %s:%d -> %s:%d",
+                 intoa(client->local_addr()), client->local_port(),
+                 intoa(client->remote_addr()), client->remote_port());
+
+        int flags = fcntl(client->fd(), F_GETFL);
+        if (flags < 0 ||
+            fcntl(client->fd(), F_SETFL, flags | O_NONBLOCK) != 0)
+        {
+            log_err("can't make the client socket non-blocking: %s",
+                    strerror(errno));
+            close_client(client);
+            continue;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events   = EPOLLIN;
+        ev.data.ptr = client;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client->fd(), &ev) != 0) {
+            log_err("can't watch the client socket: %s", strerror(errno));
+            close_client(client);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::handle_input(APIClient* client)
+{
+    char buf[16384];
+    bool eof = false;
+
+    while (true) {
+        int cc = read(client->fd(), buf, sizeof(buf));
+        if (cc > 0) {
+            client->rcvbuf_.append(buf, cc);
+            continue;
+        }
+
+        if (cc < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (cc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+
+        if (cc < 0) {
+            log_err("error reading from the client: %s", strerror(errno));
+        }
+        eof = true;
+        break;
+    }
+
+    process(client);
+
+    if (eof && client->fd() >= 0) {
+        if (client->parked_type_ != 0) {
+            log_info("IPC socket closed while blocked in %s... "
+                     "application must have exited",
+                     dtnipc_msgtoa(client->parked_type_));
+        } else {
+            log_warn("client disconnected without calling dtn_close");
+        }
+        close_client(client);
+    }
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::handle_output(APIClient* client)
+{
+    std::string* sndbuf = &client->sndbuf_;
+    size_t sent = 0;
+
+    while (sent < sndbuf->size()) {
+        int cc = ::send(client->fd(), sndbuf->data() + sent,
+                        sndbuf->size() - sent, MSG_NOSIGNAL);
+        if (cc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            log_err("error sending reply: %s", strerror(errno));
+            close_client(client);
+            return;
+        }
+        sent += cc;
+    }
+
+    sndbuf->erase(0, sent);
+    if (sndbuf->empty()) {
+        set_events(client, EPOLLIN);
+    }
+}
+
+//----------------------------------------------------------------------
+int
+APIReactor::send(APIClient* client, const char* bp, size_t len)
+{
+    size_t sent = 0;
+
+    // keep the replies ordered behind the data already waiting
+    while (client->sndbuf_.empty() && sent < len) {
+        int cc = ::send(client->fd(), bp + sent, len - sent, MSG_NOSIGNAL);
+        if (cc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            log_err("error sending to the client: %s", strerror(errno));
+            return -1;
+        }
+        sent += cc;
+    }
+
+    if (sent < len) {
+        client->sndbuf_.append(bp + sent, len - sent);
+        set_events(client, EPOLLIN | EPOLLOUT);
+    }
+
+    return len;
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::process(APIClient* client)
+{
+    std::string* rcvbuf = &client->rcvbuf_;
+    u_int8_t type;
+    u_int32_t len;
+
+    if (! client->opened_) {
+        u_int32_t handshake;
+        if (rcvbuf->size() < sizeof(handshake)) {
+            return;
+        }
+
+        memcpy(&handshake, rcvbuf->data(), sizeof(handshake));
+        rcvbuf->erase(0, sizeof(handshake));
+        client->total_rcvd_ += sizeof(handshake);
+
+        if (client->check_handshake(handshake) != 0) {
+            close_client(client);
+            return;
+        }
+        client->opened_ = true;
+    }
+
+    // a parked poll may only be cancelled, while any data arriving
+    // during another parked request is a protocol error (see
+    // APIClient::handle_begin_poll)
+    if (client->parked_type_ != 0 && ! rcvbuf->empty()) {
+        if (client->parked_type_ != DTN_BEGIN_POLL) {
+            log_err("protocol error -- data arrived while blocked in %s",
+                    dtnipc_msgtoa(client->parked_type_));
+            unpark(client);
+            client->finish_request(DTN_ECOMM);
+
+        } else if (rcvbuf->size() >= 5) {
+            type = (*rcvbuf)[0];
+            memcpy(&len, rcvbuf->data() + 1, sizeof(len));
+            unpark(client);
+
+            if (type != DTN_CANCEL_POLL || len != 0) {
+                log_err("protocol error -- got unexpected message '%s' "
+                        "while blocked in poll", dtnipc_msgtoa(type));
+                client->finish_request(DTN_ECOMM);
+            } else {
+                rcvbuf->erase(0, 5);
+                client->total_rcvd_ += 5;
+
+                log_debug("got DTN_CANCEL_POLL while blocked in poll");
+                // answer the cancel, then the original poll request
+                if (client->send_response(DTN_SUCCESS) == 0) {
+                    client->finish_request(DTN_SUCCESS);
+                }
+            }
+        }
+    }
+
+    // NOTE: this follows the protocol of APIClient::run
+    while (client->fd() >= 0 && client->parked_type_ == 0) {
+        if (rcvbuf->size() < 5) {
+            break;
+        }
+
+        type = (*rcvbuf)[0];
+        memcpy(&len, rcvbuf->data() + 1, sizeof(len));
+        len = ntohl(len);
+
+        if (len > DTN_MAX_API_MSG - 8) {
+            log_err("protocol error -- message length %u too long", len);
+            close_client(client);
+            return;
+        }
+
+        if (rcvbuf->size() < 5 + len) {
+            break;
+        }
+
+        memcpy(&client->buf_[3], rcvbuf->data(), 5 + len);
+        rcvbuf->erase(0, 5 + len);
+        client->total_rcvd_ += 5 + len;
+
+        log_debug("got %s (%u bytes)", dtnipc_msgtoa(type), len);
+
+        dispatch(client, type);
+    }
+
+    if (client->fd() < 0) {
+        close_client(client);
+    }
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::dispatch(APIClient* client, u_int8_t type)
+{
+    xdr_setpos(&client->xdr_encode_, 0);
+    xdr_setpos(&client->xdr_decode_, 0);
+
+    int ret = client->dispatch(type);
+    if (ret == APIClient::PARKED) {
+        return;
+    }
+
+    unpark(client);
+    client->finish_request(ret);
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::wake_parked(APIClient* client)
+{
+    if (client->parked_type_ == 0) {
+        return;
+    }
+
+    log_debug("dispatching parked %s again",
+              dtnipc_msgtoa(client->parked_type_));
+
+    dispatch(client, client->parked_type_);
+
+    // handle the requests that were received in the meantime
+    if (client->parked_type_ == 0) {
+        process(client);
+    }
+}
+
+//----------------------------------------------------------------------
+int
+APIReactor::park(APIClient* client, const std::vector<int>& fds, int timeout)
+{
+    // dispatched again but still waiting: the request keeps its
+    // deadline, but waits for the notifiers of its registrations as
+    // they are now
+    if (client->parked_type_ != 0) {
+        unwatch_notifiers(client);
+        watch_notifiers(client, fds);
+        return APIClient::PARKED;
+    }
+
+    client->parked_type_ = client->buf_[3];
+    watch_notifiers(client, fds);
+
+    if (timeout > 0) {
+        client->parked_until_ = now_ms() + timeout;
+        deadlines_.insert(DeadlineMap::value_type(client->parked_until_,
+                                                  client));
+    }
+
+    return APIClient::PARKED;
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::unpark(APIClient* client)
+{
+    if (client->parked_type_ == 0) {
+        return;
+    }
+
+    unwatch_notifiers(client);
+
+    if (client->parked_until_ != 0) {
+        std::pair<DeadlineMap::iterator, DeadlineMap::iterator> range =
+            deadlines_.equal_range(client->parked_until_);
+        for (DeadlineMap::iterator i = range.first; i != range.second; ++i) {
+            if (i->second == client) {
+                deadlines_.erase(i);
+                break;
+            }
+        }
+    }
+
+    client->parked_type_    = 0;
+    client->parked_until_   = 0;
+    client->parked_expired_ = false;
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::watch_notifiers(APIClient* client, const std::vector<int>& fds)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.ptr = (void*)((uintptr_t)client | NOTIFIER_TAG);
+
+    // the reactor watches its own copies of the notifier fds, which
+    // stay valid even if a registration and its notifier are destroyed
+    // while the request is parked, so that unwatch_notifiers never
+    // removes an fd number reused by another client
+    std::vector<int>::const_iterator iter;
+    for (iter = fds.begin(); iter != fds.end(); ++iter) {
+        int fd = dup(*iter);
+        if (fd < 0) {
+            log_err("can't copy notifier fd %d: %s", *iter, strerror(errno));
+            continue;
+        }
+
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            log_err("can't watch notifier fd %d: %s",
+                    *iter, strerror(errno));
+            close(fd);
+            continue;
+        }
+        client->parked_fds_.push_back(fd);
+    }
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::unwatch_notifiers(APIClient* client)
+{
+    std::vector<int>::iterator iter;
+    for (iter = client->parked_fds_.begin();
+         iter != client->parked_fds_.end(); ++iter)
+    {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, *iter, NULL);
+        close(*iter);
+    }
+    client->parked_fds_.clear();
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::set_events(APIClient* client, u_int32_t events)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = events;
+    ev.data.ptr = client;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, client->fd(), &ev) != 0) {
+        log_err("can't change the client socket events: %s",
+                strerror(errno));
+    }
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::close_client(APIClient* client)
+{
+    if (clients_.erase(client) == 0) {
+        return;
+    }
+
+    // the notifiers go away with the registrations, so they're removed
+    // from the epoll set before the bindings are released
+    unpark(client);
+
+    // the client may have closed itself already
+    if (client->fd() >= 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client->fd(), NULL);
+        client->close_client();
+    }
+
+    closed_clients_.push_back(client);
+}
+
+//----------------------------------------------------------------------
+void
+APIReactor::run_expired()
+{
+    u_int64_t now = now_ms();
+
+    while (! deadlines_.empty() && deadlines_.begin()->first <= now) {
+        APIClient* client = deadlines_.begin()->second;
+        deadlines_.erase(deadlines_.begin());
+
+        client->parked_until_   = 0;
+        client->parked_expired_ = true;
+        wake_parked(client);
+    }
+}
+
+//----------------------------------------------------------------------
+int
+APIReactor::next_timeout()
+{
+    if (deadlines_.empty()) {
+        return -1;
+    }
+
+    u_int64_t now = now_ms();
+    u_int64_t when = deadlines_.begin()->first;
+    return (when <= now) ? 0 : (int)(when - now);
+}
+
+//----------------------------------------------------------------------
+u_int64_t
+APIReactor::now_ms()
+{
+    struct timeval now;
+    ::gettimeofday(&now, 0);
+    return (u_int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+} // namespace dtn
+
+#endif /* __linux__ */
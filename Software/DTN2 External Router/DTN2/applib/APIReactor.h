@@ -0,0 +1,154 @@
+/*
+ *    Copyright 2010 INRIA, Planete Team
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef _APIREACTOR_H_
+#define _APIREACTOR_H_
+
+#ifdef __linux__
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <oasys/compat/inttypes.h>
+#include <oasys/debug/Logger.h>
+#include <oasys/thread/SpinLock.h>
+#include <oasys/thread/Thread.h>
+
+namespace dtn {
+
+class APIClient;
+class APIServer;
+
+/**
+ * A thread serving many API clients from a single epoll set, used by
+ * the APIServer instead of a thread per client when the "reactors"
+ * parameter is set.
+ *
+ * The client sockets are non-blocking. The dtn_ipc messages are
+ * framed out of each client's receive buffer and dispatched to the
+ * usual APIClient handlers, and the replies that can't be written
+ * right away are kept in the client's send buffer until the socket
+ * becomes writable.
+ *
+ * The requests waiting for bundles (recv, poll and session updates)
+ * are parked instead of blocking the thread: copies of the notifier
+ * pipes of the client's BlockingBundleLists are added to the epoll
+ * set, and the request is dispatched again when one of them becomes
+ * readable or when its timeout expires.
+ */
+class APIReactor : public oasys::Thread, public oasys::Logger {
+public:
+    APIReactor(APIServer* server, int id);
+    virtual ~APIReactor();
+
+    /**
+     * Hand a newly accepted client over to the reactor.
+     */
+    void add_client(APIClient* client);
+
+    /**
+     * Wake up the reactor thread, e.g. after set_should_stop().
+     */
+    void wakeup();
+
+    /**
+     * Send data to a client, keeping what can't be written now until
+     * the socket is writable.
+     *
+     * @return len, or -1 on error
+     */
+    int send(APIClient* client, const char* bp, size_t len);
+
+    /**
+     * Park the request held in the client's buffer until one of the
+     * notifier fds is readable, or the timeout (in ms, -1 for none)
+     * expires.
+     *
+     * @return APIClient::PARKED
+     */
+    int park(APIClient* client, const std::vector<int>& fds, int timeout);
+
+protected:
+    virtual void run();
+
+private:
+    /// Maximum number of events handled per epoll_wait call
+    static const int MAX_EVENTS = 64;
+
+    void accept_new_clients();
+    void handle_input(APIClient* client);
+    void handle_output(APIClient* client);
+
+    /**
+     * Handle the complete messages of the client's receive buffer.
+     */
+    void process(APIClient* client);
+
+    /**
+     * Dispatch the message held in the client's buffer and send the
+     * response, unless the request is parked.
+     */
+    void dispatch(APIClient* client, u_int8_t type);
+
+    /**
+     * Dispatch a parked request again.
+     */
+    void wake_parked(APIClient* client);
+
+    void unpark(APIClient* client);
+
+    /**
+     * Add copies of the notifier fds of a parked request to the epoll
+     * set, or remove them.
+     */
+    void watch_notifiers(APIClient* client, const std::vector<int>& fds);
+    void unwatch_notifiers(APIClient* client);
+
+    void set_events(APIClient* client, u_int32_t events);
+    void close_client(APIClient* client);
+
+    /**
+     * Wake up the parked requests whose timeout expired.
+     */
+    void run_expired();
+
+    /**
+     * Return the number of milliseconds until the next parked request
+     * timeout, -1 if there is none.
+     */
+    int next_timeout();
+
+    static u_int64_t now_ms();
+
+    APIServer* server_;
+    int        epoll_fd_;
+    int        wakeup_fd_;              ///< eventfd for add_client and wakeup
+
+    oasys::SpinLock         lock_;      ///< lock for new_clients_
+    std::vector<APIClient*> new_clients_;    ///< clients not yet added
+    std::set<APIClient*>    clients_;        ///< clients served
+    std::vector<APIClient*> closed_clients_; ///< clients to delete
+
+    typedef std::multimap<u_int64_t, APIClient*> DeadlineMap;
+    DeadlineMap deadlines_;             ///< timeouts of the parked requests
+};
+
+} // namespace dtn
+
+#endif /* __linux__ */
+
+#endif /* _APIREACTOR_H_ */
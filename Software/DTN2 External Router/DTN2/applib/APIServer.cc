@@ -30,6 +30,7 @@
 #include <oasys/util/ScratchBuffer.h>
 #include <oasys/util/XDRUtils.h>
 
+#include "APIReactor.h"
 #include "APIServer.h"
 #include "bundling/APIBlockProcessor.h"
 #include "bundling/Bundle.h"
@@ -60,6 +61,10 @@ APIServer::APIServer()
     enabled_    = true;
     local_addr_ = htonl(INADDR_LOOPBACK);
     local_port_ = DTN_IPC_PORT;
+    reactors_   = 0;
+
+    next_reactor_ = 0;
+    stopped_      = false;
 
     // override the defaults via environment variables, if given
     char *env;
@@ -109,7 +114,51 @@ APIServer::accepted(int fd, in_addr_t addr, u_int16_t port)
 {
     APIClient* c = new APIClient(fd, addr, port, this);
     register_client(c);
+
+    if (! add_to_reactor(c)) {
+        log_debug("server stopped, closing the new client");
+        c->close_client();
+        delete c;
+    }
+}
+
+//----------------------------------------------------------------------
+bool
+APIServer::add_to_reactor(APIClient* c)
+{
+    // the client is handed to its reactor under the pool lock, so
+    // shutdown_hook can't delete the reactor in between
+    oasys::ScopeLock l(&reactor_pool_lock_, "APIServer::add_to_reactor");
+
+    if (stopped_) {
+        return false;
+    }
+    
+    if (reactors_ == 0) {
+        c->start();
+        return true;
+    }
+
+#ifdef __linux__
+    // the reactors are started with the first client, once the
+    // configuration has been read
+    if (reactor_pool_.empty()) {
+        log_info("starting %u API reactors", reactors_);
+        for (u_int16_t i = 0; i < reactors_; ++i) {
+            APIReactor* reactor = new APIReactor(this, i);
+            reactor->start();
+            reactor_pool_.push_back(reactor);
+        }
+    }
+
+    reactor_pool_[next_reactor_++ % reactor_pool_.size()]->add_client(c);
+#else
+    log_warn("API reactors are only supported on Linux, "
+             "running a thread per client");
+    reactors_ = 0;
     c->start();
+#endif
+    return true;
 }
 
 //----------------------------------------------------------------------
@@ -131,6 +180,25 @@ APIServer::accepted(int fd, in_addr_t addr, u_int16_t port)
 void
 APIServer::shutdown_hook()
 {
+    // the reactors close their clients as they exit, and are deleted
+    // once they are done. clients accepted from now on are closed
+    // rather than starting a new pool.
+    std::vector<APIReactor*> reactors;
+    reactor_pool_lock_.lock("APIServer::shutdown");
+    stopped_ = true;
+    reactors.swap(reactor_pool_);
+    reactor_pool_lock_.unlock();
+    
+    std::vector<APIReactor*>::iterator ri;
+    for (ri = reactors.begin(); ri != reactors.end(); ++ri) {
+        (*ri)->set_should_stop();
+        (*ri)->wakeup();
+    }
+    for (ri = reactors.begin(); ri != reactors.end(); ++ri) {
+        (*ri)->join();
+        delete *ri;
+    }
+
     // tell the clients to shut down
     std::list<APIClient *>::iterator ci;
     client_list_lock.lock("APIServer::shutdown");
@@ -188,7 +256,12 @@ APIClient::APIClient(int fd, in_addr_t addr, u_int16_t port, APIServer *parent)
       notifier_(logpath_),
       parent_(parent),
       total_sent_(0),
-      total_rcvd_(0)
+      total_rcvd_(0),
+      reactor_(NULL),
+      opened_(false),
+      parked_type_(0),
+      parked_until_(0),
+      parked_expired_(false)
 {
     // note that we skip space for the message length and code/status
     xdrmem_create(&xdr_encode_, buf_ + 8, DTN_MAX_API_MSG - 8, XDR_ENCODE);
@@ -236,7 +309,6 @@ int
 APIClient::handle_handshake()
 {
     u_int32_t handshake;
-    u_int16_t message_type, ipc_version;
     
     int ret = readall((char*)&handshake, sizeof(handshake));
     if (ret != sizeof(handshake)) {
@@ -247,6 +319,15 @@ APIClient::handle_handshake()
 
     total_rcvd_ += ret;
 
+    return check_handshake(handshake);
+}
+
+//----------------------------------------------------------------------
+int
+APIClient::check_handshake(u_int32_t handshake)
+{
+    u_int16_t message_type, ipc_version;
+
     message_type = ntohl(handshake) >> 16;
     ipc_version = (u_int16_t) (ntohl(handshake) & 0x0ffff);
 
@@ -261,7 +342,7 @@ APIClient::handle_handshake()
     // the client, then if there's a mismatch, close the channel
     handshake = htonl(DTN_OPEN << 16 | DTN_IPC_VERSION);
     
-    ret = writeall((char*)&handshake, sizeof(handshake));
+    int ret = send_data((char*)&handshake, sizeof(handshake));
     if (ret != sizeof(handshake)) {
         log_err("error writing handshake: %s", strerror(errno));
         return -1;
@@ -329,8 +410,9 @@ APIClient::run()
 
         // NOTE: this protocol is duplicated in the implementation of
         // handle_begin_poll to take care of a cancel_poll request
-        // coming in while the thread is waiting for bundles so any
-        // modifications must be propagated there
+        // coming in while the thread is waiting for bundles, and in
+        // APIReactor::process, so any modifications must be
+        // propagated there
         type = buf_[3];
         memcpy(&len, &buf_[4], sizeof(len));
 
@@ -361,55 +443,76 @@ APIClient::run()
             return;
         }
 
-        // dispatch to the handler routine
-        switch(type) {
+        // dispatch to the handler routine and send the response
+        ret = dispatch(type);
+        if (! finish_request(ret)) {
+            return;
+        }
+        
+    } // while(1)
+}
+
+//----------------------------------------------------------------------
+int
+APIClient::dispatch(u_int8_t type)
+{
+    int ret;
+
+    switch(type) {
 #define DISPATCH(_type, _fn)                    \
-        case _type:                             \
-            ret = _fn();                        \
-            break;
+    case _type:                                 \
+        ret = _fn();                            \
+        break;
             
-            DISPATCH(DTN_LOCAL_EID,         handle_local_eid);
-            DISPATCH(DTN_REGISTER,          handle_register);
-            DISPATCH(DTN_UNREGISTER,        handle_unregister);
-            DISPATCH(DTN_FIND_REGISTRATION, handle_find_registration);
-            DISPATCH(DTN_SEND,              handle_send);
-            DISPATCH(DTN_CANCEL,            handle_cancel);
-            DISPATCH(DTN_BIND,              handle_bind);
-            DISPATCH(DTN_UNBIND,            handle_unbind);
-            DISPATCH(DTN_RECV,              handle_recv);
-            DISPATCH(DTN_BEGIN_POLL,        handle_begin_poll);
-            DISPATCH(DTN_CANCEL_POLL,       handle_cancel_poll);
-            DISPATCH(DTN_CLOSE,             handle_close);
-            DISPATCH(DTN_SESSION_UPDATE,    handle_session_update);
+        DISPATCH(DTN_LOCAL_EID,         handle_local_eid);
+        DISPATCH(DTN_REGISTER,          handle_register);
+        DISPATCH(DTN_UNREGISTER,        handle_unregister);
+        DISPATCH(DTN_FIND_REGISTRATION, handle_find_registration);
+        DISPATCH(DTN_SEND,              handle_send);
+        DISPATCH(DTN_CANCEL,            handle_cancel);
+        DISPATCH(DTN_BIND,              handle_bind);
+        DISPATCH(DTN_UNBIND,            handle_unbind);
+        DISPATCH(DTN_RECV,              handle_recv);
+        DISPATCH(DTN_BEGIN_POLL,        handle_begin_poll);
+        DISPATCH(DTN_CANCEL_POLL,       handle_cancel_poll);
+        DISPATCH(DTN_CLOSE,             handle_close);
+        DISPATCH(DTN_SESSION_UPDATE,    handle_session_update);
 #undef DISPATCH
 
-        default:
-            log_err("unknown message type code 0x%x", type);
-            ret = DTN_EMSGTYPE;
-            break;
-        }
+    default:
+        log_err("unknown message type code 0x%x", type);
+        ret = DTN_EMSGTYPE;
+        break;
+    }
 
-        // if the handler returned -1, then the session should be
-        // immediately terminated
-        if (ret == -1) {
-            close_client();
-            return;
-        }
-        
-        // send the response
-        if (send_response(ret) != 0) {
-            return;
-        }
+    return ret;
+}
 
-        // if there was an IPC communication error or unknown message
-        // type, close terminate the session
-        // XXX/matt we could potentially close on all errors, not just these 2
-        if (ret == DTN_ECOMM || ret == DTN_EMSGTYPE) {
-            close_client();
-            return;
-        }
+//----------------------------------------------------------------------
+bool
+APIClient::finish_request(int ret)
+{
+    // if the handler returned -1, then the session should be
+    // immediately terminated
+    if (ret == -1) {
+        close_client();
+        return false;
+    }
         
-    } // while(1)
+    // send the response
+    if (send_response(ret) != 0) {
+        return false;
+    }
+
+    // if there was an IPC communication error or unknown message
+    // type, close terminate the session
+    // XXX/matt we could potentially close on all errors, not just these 2
+    if (ret == DTN_ECOMM || ret == DTN_EMSGTYPE) {
+        close_client();
+        return false;
+    }
+
+    return true;
 }
 
 //----------------------------------------------------------------------
@@ -440,7 +543,7 @@ APIClient::send_response(int ret)
     log_debug("sending %d byte reply message... total sent/rcvd: %zu/%zu",
               msglen, total_sent_, total_rcvd_);
     
-    if (writeall(buf_, msglen) != (int)msglen) {
+    if (send_data(buf_, msglen) != (int)msglen) {
         log_err("error sending reply: %s", strerror(errno));
         close_client();
         return -1;
@@ -450,6 +553,17 @@ APIClient::send_response(int ret)
 
     return 0;
 }
+
+//----------------------------------------------------------------------
+int
+APIClient::send_data(const char* bp, size_t len)
+{
+    if (reactor_ != NULL) {
+        return reactor_->send(this, bp, len);
+    }
+
+    return writeall(bp, len);
+}
         
 //----------------------------------------------------------------------
 bool
@@ -1070,6 +1184,20 @@ APIClient::handle_send()
         u_char buffer[4096];
         size_t offset;
 
+        // the application keeps its file, so it can't be linked in
+        // the store, but it is copied (or cloned) by the kernel
+        // instead of through the buffer below when possible. the copy
+        // fails if the file no longer has the accepted length.
+        if (b->payload().location() == BundlePayload::DISK) {
+            if (! b->mutable_payload()->replace_with_copy(filename,
+                                                          payload_len))
+            {
+                log_err("payload file %s can't be copied", filename);
+                return DTN_EINVAL;
+            }
+            break;
+        }
+
         if ((file = fopen(filename, "r")) == NULL)
         {
             log_err("payload file %s can't be opened: %s",
@@ -1726,6 +1854,26 @@ APIClient::wait_for_notify(const char*       operation,
                   operation, timeout);
         return DTN_ETIMEOUT;
     }
+
+    // a reactor client parks the request on the notifiers instead,
+    // the socket being watched by the reactor
+    if (reactor_ != NULL) {
+        if (parked_expired_) {
+            log_debug("wait_for_notify(%s): timeout waiting for events",
+                      operation);
+            return DTN_ETIMEOUT;
+        }
+
+        std::vector<int> fds;
+        for (unsigned int j = 1; j < i; ++j) {
+            fds.push_back(pollfds[j].fd);
+        }
+
+        log_debug("wait_for_notify(%s): "
+                  "parking to get events from %zu sources (timeout %d)",
+                  operation, fds.size(), timeout);
+        return reactor_->park(this, fds, timeout);
+    }
     
     log_debug("wait_for_notify(%s): "
               "blocking to get events from %zu sources (timeout %d)",
@@ -18,6 +18,8 @@
 #define _APISERVER_H_
 
 #include <list>
+#include <string>
+#include <vector>
 
 #include <oasys/compat/rpc.h>
 #include <oasys/debug/Log.h>
@@ -33,6 +35,7 @@
 namespace dtn {
 
 class APIClient;
+class APIReactor;
 class APIRegistration;
 class APIRegistrationList;
 
@@ -64,13 +67,29 @@ public:
     u_int16_t  local_port() const { return local_port_; }
     u_int16_t* local_port_ptr() { return &local_port_; }
 
+    u_int16_t  reactors() const { return reactors_; }
+    u_int16_t* reactors_ptr() { return &reactors_; }
+
     void register_client(APIClient *);
     void unregister_client(APIClient *);
 
 protected:
+    // hand the new client to the next reactor, starting the pool if
+    // needed, or run it in its own thread. returns false once the
+    // server is stopped, the client then being left to the caller
+    bool add_to_reactor(APIClient* c);
+
     bool      enabled_;       ///< whether or not to enable it
     in_addr_t local_addr_;    ///< local address to bind to
     u_int16_t local_port_;    ///< local port to use for api
+    u_int16_t reactors_;      ///< number of reactor threads serving the
+                              ///  clients, 0 for a thread per client
+
+    std::vector<APIReactor*> reactor_pool_; ///< running reactors
+    size_t next_reactor_;                   ///< reactor of the next client
+    bool stopped_;                          ///< set by shutdown_hook
+    oasys::SpinLock reactor_pool_lock_;     ///< lock for reactor_pool_
+                                            ///  and stopped_
 
     std::list<APIClient *> client_list; ///<  active clients
     oasys::SpinLock client_list_lock;   ///< synchronizer
@@ -87,9 +106,25 @@ public:
     virtual void run();
 
     void close_client();
+
+    /// Returned by the blocking handlers of a client served by an
+    /// APIReactor, when the request waits for its registrations
+    static const int PARKED = -2;
     
 protected:
+    friend class APIReactor;
+
     int handle_handshake();
+    int check_handshake(u_int32_t handshake);
+
+    // dispatch the message held in buf_ to its handler routine
+    int dispatch(u_int8_t type);
+
+    // send the response to the request that returned ret and close
+    // the session if needed. returns false if the session was closed
+    bool finish_request(int ret);
+
+
     int handle_local_eid();
     int handle_register();
     int handle_unregister();
@@ -112,6 +147,10 @@ protected:
     // internal error. returns 0 if there is a bundle waiting or
     // socket data on the channel, and assigns the reg or sock_ready
     // pointers appropriately
+    //
+    // a client served by an APIReactor never blocks: PARKED is
+    // returned instead, and the request is dispatched again once the
+    // registrations are notified or the timeout expired
     int wait_for_notify(const char*       operation,
                         dtn_timeval_t     timeout,
                         APIRegistration** recv_ready_reg,
@@ -121,6 +160,7 @@ protected:
     int handle_unexpected_data(const char* operation);
 
     int send_response(int ret);
+    int send_data(const char* bp, size_t len);
 
     bool is_bound(u_int32_t regid);
     
@@ -133,6 +173,17 @@ protected:
     APIServer* parent_;
     size_t total_sent_;
     size_t total_rcvd_;
+
+    /// @{ State of a client served by an APIReactor
+    APIReactor*      reactor_;        ///< the reactor, NULL for a thread
+    std::string      rcvbuf_;         ///< data not yet handled
+    std::string      sndbuf_;         ///< data not yet sent
+    bool             opened_;         ///< handshake done
+    u_int8_t         parked_type_;    ///< parked request type, 0 if none
+    std::vector<int> parked_fds_;     ///< watched copies of the notifier fds
+    u_int64_t        parked_until_;   ///< parked request deadline (ms), 0 if none
+    bool             parked_expired_; ///< parked request timed out
+    /// @}
 };
 
 } // namespace dtn
@@ -64,7 +64,9 @@ BundleDaemon::Params::Params()
        reactive_frag_enabled_(true),
        retry_reliable_unacked_(true),
        test_permuted_delivery_(false),
-       injected_bundles_in_memory_(false) {}
+       injected_bundles_in_memory_(false),
+       event_batch_size_(32),
+       event_batch_time_(50) {}
 
 BundleDaemon::Params BundleDaemon::params_;
 
@@ -80,6 +82,7 @@ BundleDaemon::BundleDaemon()
 
     actions_ = NULL;
     eventq_ = NULL;
+    timer_wheel_ = new BundleTimerWheel();
     
     memset(&stats_, 0, sizeof(stats_));
 
@@ -87,6 +90,16 @@ BundleDaemon::BundleDaemon()
     pending_bundles_ = new BundleList("pending_bundles");
     custody_bundles_ = new BundleList("custody_bundles");
 
+    // external routers and the API look bundles up on these lists,
+    // and the table based routers reroute pending bundles by
+    // destination
+    all_bundles_->set_indexes(BundleList::INDEX_BUNDLEID);
+    pending_bundles_->set_indexes(BundleList::INDEX_BUNDLEID |
+                                  BundleList::INDEX_GBOFID |
+                                  BundleList::INDEX_DEST);
+    custody_bundles_->set_indexes(BundleList::INDEX_BUNDLEID |
+                                  BundleList::INDEX_GBOFID);
+
     contactmgr_ = new ContactManager();
     fragmentmgr_ = new FragmentManager();
     reg_table_ = new RegistrationTable();
@@ -113,6 +126,7 @@ BundleDaemon::~BundleDaemon()
 
     delete actions_;
     delete eventq_;
+    delete timer_wheel_;
 }
 
 //----------------------------------------------------------------------
@@ -120,8 +134,7 @@ void
 BundleDaemon::do_init()
 {
     actions_ = new BundleActions();
-    eventq_ = new oasys::MsgQueue<BundleEvent*>(logpath_);
-    eventq_->notify_when_empty();
+    eventq_ = new BundleEventQueue(logpath_);
     BundleProtocol::init_default_processors();
 #ifdef BSP_ENABLED
     Ciphersuite::init_default_ciphersuites();
@@ -216,10 +229,39 @@ BundleDaemon::get_daemon_stats(oasys::StringBuffer* buf)
 {
     buf->appendf("%zu pending_events -- "
                  "%u processed_events -- "
-                 "%zu pending_timers",
+                 "%u event_batches -- "
+                 "%zu pending_timers -- "
+                 "%zu bundle_timers",
                  event_queue_size(),
                  stats_.events_processed_,
-                 oasys::TimerSystem::instance()->num_pending_timers());
+                 stats_.event_batches_,
+                 oasys::TimerSystem::instance()->num_pending_timers(),
+                 timer_wheel_->num_pending_timers());
+}
+
+//----------------------------------------------------------------------
+void
+BundleDaemon::get_event_stats(oasys::StringBuffer* buf)
+{
+    buf->appendf("event: count avg_us max_us "
+                 "[<10us <100us <1ms <10ms <100ms <1s >=1s]\n");
+    
+    for (int type = 0; type < NUM_EVENT_TYPES; ++type) {
+        const EventStats* es = &stats_.events_[type];
+        if (es->count_ == 0) {
+            continue;
+        }
+
+        buf->appendf("%s: %u %llu %u [",
+                     event_to_str((event_type_t)type),
+                     es->count_,
+                     (unsigned long long)(es->total_usec_ / es->count_),
+                     es->max_usec_);
+        for (int i = 0; i < EVENT_TIME_BUCKETS; ++i) {
+            buf->appendf(i == 0 ? "%u" : " %u", es->buckets_[i]);
+        }
+        buf->appendf("]\n");
+    }
 }
 
 
@@ -297,8 +339,8 @@ BundleDaemon::cancel_custody_timers(Bundle* bundle)
                      bundle);
         }
         
-        // the timer will be deleted when it bubbles to the top of the
-        // timer queue
+        // the timer is out of the wheel, so it can go right away
+        delete *iter;
     }
     
     bundle->custody_timers()->clear();
@@ -1023,6 +1065,21 @@ BundleDaemon::handle_bundle_expired(BundleExpiredEvent* event)
     // fall through to notify the routers
 }
 
+//----------------------------------------------------------------------
+void
+BundleDaemon::handle_bundle_expired_batch(BundleExpiredBatchEvent* event)
+{
+    log_debug("BUNDLE_EXPIRED_BATCH of %zu bundles", event->bundles_.size());
+
+    // the routers expect one event per bundle
+    std::vector<BundleRef>::iterator iter;
+    for (iter = event->bundles_.begin(); iter != event->bundles_.end(); ++iter)
+    {
+        BundleExpiredEvent e(iter->object());
+        handle_event(&e);
+    }
+}
+
 //----------------------------------------------------------------------
 void
 BundleDaemon::handle_bundle_send(BundleSendRequest* event)
@@ -2190,14 +2247,15 @@ BundleDaemon::delete_from_pending(const BundleRef& bundle)
         log_debug("cancelling expiration timer for bundle id %d",
                   bundle->bundleid());
         
-        bool cancelled = bundle->expiration_timer()->cancel();
+        ExpirationTimer* timer = bundle->expiration_timer();
+        bool cancelled = timer->cancel();
         if (!cancelled) {
             log_crit("unexpected error cancelling expiration timer "
                      "for bundle *%p", bundle.object());
         }
         
-        bundle->expiration_timer()->bundleref_.release();
         bundle->set_expiration_timer(NULL);
+        delete timer;
     }
 
     // XXX/demmer the whole BundleDaemon core should be changed to use
@@ -2339,11 +2397,15 @@ BundleDaemon::find_duplicate(Bundle* b)
     oasys::ScopeLock l(pending_bundles_->lock(), 
                        "BundleDaemon::find_duplicate");
     log_debug("pending_bundles size %zd", pending_bundles_->size());
+
+    // only the bundles sharing the source and creation timestamp can
+    // be duplicates
+    std::vector<Bundle*> candidates;
+    pending_bundles_->find_all(b->source(), b->creation_ts(), &candidates);
+
     Bundle *found = NULL;
-    BundleList::iterator iter;
-    for (iter = pending_bundles_->begin();
-         iter != pending_bundles_->end();
-         ++iter)
+    std::vector<Bundle*>::iterator iter;
+    for (iter = candidates.begin(); iter != candidates.end(); ++iter)
     {
         Bundle* b2 = *iter;
         
@@ -2547,6 +2609,88 @@ BundleDaemon::init_idle_shutdown(int interval)
     idle_exit_ = new DaemonIdleExit(interval);
 }
 
+//----------------------------------------------------------------------
+void
+BundleDaemon::process_event(BundleEvent* event)
+{
+    static const char* LOOP_LOG = "/dtn/bundle/daemon/loop";
+    
+    oasys::Time now;
+    now.get_time();
+
+    if (now >= event->posted_time_) {
+        oasys::Time in_queue;
+        in_queue = now - event->posted_time_;
+        if (in_queue.sec_ > 2) {
+            log_warn_p(LOOP_LOG, "event %s was in queue for %u.%u seconds",
+                       event->type_str(), in_queue.sec_, in_queue.usec_);
+        }
+    } else {
+        log_warn_p(LOOP_LOG, "time moved backwards: "
+                   "now %u.%u, event posted_time %u.%u",
+                   now.sec_, now.usec_,
+                   event->posted_time_.sec_, event->posted_time_.usec_);
+    }
+    
+    log_debug_p(LOOP_LOG, "BundleDaemon: handling event %s",
+                event->type_str());
+    // handle the event
+    event_type_t type = event->type_;
+    handle_event(event);
+
+    oasys::Time done;
+    done.get_time();
+    oasys::Time elapsed;
+    if (done >= now) {
+        elapsed = done - now;
+    }
+    
+    if (elapsed.in_milliseconds() > 2000) {
+        log_warn_p(LOOP_LOG, "event %s took %u ms to process",
+                   event->type_str(), elapsed.in_milliseconds());
+    }
+
+    // account the handling time to the event type
+    u_int32_t usec = elapsed.sec_ * 1000000 + elapsed.usec_;
+    if (type >= 0 && type < NUM_EVENT_TYPES) {
+        EventStats* es = &stats_.events_[type];
+        es->count_++;
+        es->total_usec_ += usec;
+        if (usec > es->max_usec_) {
+            es->max_usec_ = usec;
+        }
+        
+        int bucket = 0;
+        for (u_int32_t limit = 10;
+             bucket < EVENT_TIME_BUCKETS - 1 && usec >= limit;
+             limit *= 10)
+        {
+            ++bucket;
+        }
+        es->buckets_[bucket]++;
+    }
+
+    // record the last event time
+    last_event_ = done;
+
+    log_debug_p(LOOP_LOG, "BundleDaemon: deleting event %s",
+                event->type_str());
+    // clean up the event
+    delete event;
+}
+
+//----------------------------------------------------------------------
+int
+BundleDaemon::run_expired_bundle_timers()
+{
+    int timeout = timer_wheel_->run_expired_timers();
+
+    // the bundles whose timers just fired are handled as one event
+    ExpirationTimer::post_expired();
+
+    return timeout;
+}
+
 //----------------------------------------------------------------------
 void
 BundleDaemon::run()
@@ -2586,52 +2730,45 @@ BundleDaemon::run()
         }
 
         int timeout = timersys->run_expired_timers();
+        int wheel_timeout = run_expired_bundle_timers();
+        if (wheel_timeout != -1 && (timeout == -1 || wheel_timeout < timeout)) {
+            timeout = wheel_timeout;
+        }
 
         log_debug_p(LOOP_LOG, 
                     "BundleDaemon: checking eventq_->size() > 0, its size is %zu", 
                     eventq_->size());
 
         if (eventq_->size() > 0) {
-            bool ok = eventq_->try_pop(&event);
-            ASSERT(ok);
+            // drain a batch of events before checking the timers
+            // again, bounded both in count and in time so that timers
+            // aren't starved under a burst of events
+            oasys::Time batch_start;
+            batch_start.get_time();
             
-            oasys::Time now;
-            now.get_time();
-
-            
-            if (now >= event->posted_time_) {
-                oasys::Time in_queue;
-                in_queue = now - event->posted_time_;
-                if (in_queue.sec_ > 2) {
-                    log_warn_p(LOOP_LOG, "event %s was in queue for %u.%u seconds",
-                               event->type_str(), in_queue.sec_, in_queue.usec_);
+            u_int handled = 0;
+            while (eventq_->try_pop(&event)) {
+                process_event(event);
+                ++handled;
+
+                if (should_stop() ||
+                    handled >= params_.event_batch_size_ ||
+                    batch_start.elapsed_ms() >= params_.event_batch_time_)
+                {
+                    break;
                 }
-            } else {
-                log_warn_p(LOOP_LOG, "time moved backwards: "
-                           "now %u.%u, event posted_time %u.%u",
-                           now.sec_, now.usec_,
-                           event->posted_time_.sec_, event->posted_time_.usec_);
-            }
-            
-            
-            log_debug_p(LOOP_LOG, "BundleDaemon: handling event %s",
-                        event->type_str());
-            // handle the event
-            handle_event(event);
-
-            int elapsed = now.elapsed_ms();
-            if (elapsed > 2000) {
-                log_warn_p(LOOP_LOG, "event %s took %u ms to process",
-                           event->type_str(), elapsed);
             }
 
-            // record the last event time
-            last_event_.get_time();
+            if (handled == 0) {
+                // the next event is still being posted by another
+                // thread, give it a chance to finish
+                oasys::Thread::yield();
+                continue;
+            }
 
-            log_debug_p(LOOP_LOG, "BundleDaemon: deleting event %s",
-                        event->type_str());
-            // clean up the event
-            delete event;
+            stats_.event_batches_++;
+            log_debug_p(LOOP_LOG, "BundleDaemon: handled a batch of %u events",
+                        handled);
             
             continue; // no reason to poll
         }
@@ -2657,6 +2794,7 @@ BundleDaemon::run()
         // loop to drain the queue
         if (event_poll->revents != 0) {
             log_debug_p(LOOP_LOG, "poll returned new event to handle");
+            eventq_->clear();
         }
 
         // if the timer notifier fired, then someone just scheduled a
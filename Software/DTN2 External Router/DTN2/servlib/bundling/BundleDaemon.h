@@ -30,6 +30,8 @@
 
 #include "BundleEvent.h"
 #include "BundleEventHandler.h"
+#include "BundleEventQueue.h"
+#include "BundleTimerWheel.h"
 #include "BundleProtocol.h"
 #include "BundleActions.h"
 #include "BundleStatusReport.h"
@@ -93,7 +95,7 @@ public:
     /**
      * Return the number of events currently waiting for processing.
      * This is overridden in the simulator since it doesn't use a
-     * MsgQueue.
+     * BundleEventQueue.
      */
     virtual size_t event_queue_size()
     {
@@ -150,6 +152,19 @@ public:
      */
     FragmentManager* fragmentmgr() { return fragmentmgr_; }
 
+    /**
+     * Accessor for the wheel of bundle expiration and custody timers.
+     */
+    BundleTimerWheel* timer_wheel() { return timer_wheel_; }
+
+    /**
+     * Run the expired bundle timers and post the bundles that expired.
+     *
+     * @return the number of milliseconds until the wheel needs to be
+     * run again, -1 if it is empty
+     */
+    int run_expired_bundle_timers();
+
     /**
      * Accessor for the registration table.
      */
@@ -187,6 +202,11 @@ public:
      */
     void get_daemon_stats(oasys::StringBuffer* buf);
 
+    /**
+     * Format the handling time histograms of the event types.
+     */
+    void get_event_stats(oasys::StringBuffer* buf);
+
     /**
      * Reset all internal stats.
      */
@@ -233,6 +253,14 @@ public:
 
         /// Whether or not injected bundles are held in memory by default
         bool injected_bundles_in_memory_;
+
+        /// Maximum number of events handled per wake-up of the daemon
+        /// thread before checking the timers again
+        u_int event_batch_size_;
+
+        /// Maximum time (in ms) spent on a batch of events before
+        /// checking the timers again
+        u_int event_batch_time_;
     };
 
     static Params params_;
@@ -298,6 +326,12 @@ protected:
      */
     void run();
 
+    /**
+     * Handle an event popped from the event queue, timing it, then
+     * delete it.
+     */
+    void process_event(BundleEvent* event);
+
     /**
      * Main event handling function.
      */
@@ -311,6 +345,7 @@ protected:
     void handle_bundle_transmitted(BundleTransmittedEvent* event);
     void handle_bundle_delivered(BundleDeliveredEvent* event);
     void handle_bundle_expired(BundleExpiredEvent* event);
+    void handle_bundle_expired_batch(BundleExpiredBatchEvent* event);
     void handle_bundle_free(BundleFreeEvent* event);
     void handle_bundle_send(BundleSendRequest* event);
     void handle_bundle_cancel(BundleCancelRequest* event);
@@ -486,12 +521,30 @@ protected:
     BundleList* custody_bundles_;
     
     /// The event queue
-    oasys::MsgQueue<BundleEvent*>* eventq_;
+    BundleEventQueue* eventq_;
+
+    /// The bundle expiration and custody timers
+    BundleTimerWheel* timer_wheel_;
 
     /// The default endpoint id for reaching this daemon, used for
     /// bundle status reports, routing, etc.
     EndpointID local_eid_;
 
+    /// Number of event types (the event type codes start at 1)
+    static const int NUM_EVENT_TYPES = CLA_PARAMS_REPORT + 1;
+
+    /// Number of buckets of the event handling time histograms, one
+    /// per decade starting below 10us, the last one above 1s
+    static const int EVENT_TIME_BUCKETS = 7;
+
+    /// Handling time statistics of an event type
+    struct EventStats {
+        u_int32_t count_;
+        u_int64_t total_usec_;
+        u_int32_t max_usec_;
+        u_int32_t buckets_[EVENT_TIME_BUCKETS];
+    };
+
     /// Statistics structure definition
     struct Stats {
         u_int32_t received_bundles_;
@@ -503,6 +556,8 @@ protected:
         u_int32_t duplicate_bundles_;
         u_int32_t injected_bundles_;
         u_int32_t events_processed_;
+        u_int32_t event_batches_;
+        EventStats events_[NUM_EVENT_TYPES];
     };
 
     /// Stats instance
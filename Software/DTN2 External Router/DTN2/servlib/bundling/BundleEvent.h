@@ -49,6 +49,7 @@ typedef enum {
     BUNDLE_DELIVERED,           ///< Bundle locally delivered
     BUNDLE_DELIVERY,            ///< Bundle delivery (with payload)
     BUNDLE_EXPIRED,             ///< Bundle expired
+    BUNDLE_EXPIRED_BATCH,       ///< Bundles expired in the same timer tick
     BUNDLE_NOT_NEEDED,          ///< Bundle no longer needed
     BUNDLE_FREE,                ///< No more references to the bundle
     BUNDLE_FORWARD_TIMEOUT,     ///< A Mapping timed out
@@ -133,6 +134,7 @@ event_to_str(event_type_t event)
     case BUNDLE_DELIVERED:      return "BUNDLE_DELIVERED";
     case BUNDLE_DELIVERY:       return "BUNDLE_DELIVERY";
     case BUNDLE_EXPIRED:        return "BUNDLE_EXPIRED";
+    case BUNDLE_EXPIRED_BATCH:  return "BUNDLE_EXPIRED_BATCH";
     case BUNDLE_FREE:           return "BUNDLE_FREE";
     case BUNDLE_NOT_NEEDED:     return "BUNDLE_NOT_NEEDED";
     case BUNDLE_FORWARD_TIMEOUT:return "BUNDLE_FORWARD_TIMEOUT";
@@ -282,6 +284,12 @@ public:
      */
     oasys::Time posted_time_;
 
+    /**
+     * Link to the next event in the daemon's event queue (see
+     * BundleEventQueue).
+     */
+    BundleEvent* volatile next_event_;
+
     /**
      * Used for printing
      */
@@ -303,7 +311,8 @@ protected:
     BundleEvent(event_type_t type)
         : type_(type),
           daemon_only_(false),
-          processed_notifier_(NULL) {}
+          processed_notifier_(NULL),
+          next_event_(NULL) {}
 };
 
 /**
@@ -467,6 +476,23 @@ public:
     BundleRef bundleref_;
 };
 
+/**
+ * Event class for the bundles whose expiration timers fired in the
+ * same tick of the timer wheel. It is only handled by the daemon,
+ * which dispatches a BundleExpiredEvent for each bundle.
+ */
+class BundleExpiredBatchEvent : public BundleEvent {
+public:
+    BundleExpiredBatchEvent()
+        : BundleEvent(BUNDLE_EXPIRED_BATCH)
+    {
+        daemon_only_ = true;
+    }
+
+    /// The expired bundles
+    std::vector<BundleRef> bundles_;
+};
+
 /**
  * Event class for bundles that have no more references to them.
  */
@@ -48,6 +48,10 @@ BundleEventHandler::dispatch_event(BundleEvent* e)
     case BUNDLE_EXPIRED:
         handle_bundle_expired((BundleExpiredEvent*)e);
         break;
+
+    case BUNDLE_EXPIRED_BATCH:
+        handle_bundle_expired_batch((BundleExpiredBatchEvent*)e);
+        break;
         
     case BUNDLE_FREE:
         handle_bundle_free((BundleFreeEvent*)e);
@@ -306,6 +310,14 @@ BundleEventHandler::handle_bundle_expired(BundleExpiredEvent*)
 {
 }
 
+/**
+ * Default event handler when a batch of bundles expire.
+ */
+void
+BundleEventHandler::handle_bundle_expired_batch(BundleExpiredBatchEvent*)
+{
+}
+
 /**
  * Default event handler when bundles are free (i.e. no more
  * references).
@@ -77,6 +77,11 @@ protected:
      */
     virtual void handle_bundle_expired(BundleExpiredEvent* event);
 
+    /**
+     * Default event handler when a batch of bundles expire.
+     */
+    virtual void handle_bundle_expired_batch(BundleExpiredBatchEvent* event);
+
     /**
      * Default event handler when bundles are free (i.e. no more
      * references).
@@ -0,0 +1,204 @@
+/*
+ *    Copyright 2010 INRIA, Planete Team
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <dtn-config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "BundleEventQueue.h"
+
+namespace dtn {
+
+//----------------------------------------------------------------------
+BundleEventQueue::BundleEventQueue(const char* logpath)
+    : Logger("BundleEventQueue", "%s/eventq", logpath),
+      head_(&stub_),
+      tail_(&stub_),
+      size_(0),
+      priority_size_(0)
+{
+#ifdef __linux__
+    wakeup_fd_[0] = eventfd(0, EFD_NONBLOCK);
+    if (wakeup_fd_[0] < 0) {
+        PANIC("can't create the event queue eventfd: %s", strerror(errno));
+    }
+    wakeup_fd_[1] = wakeup_fd_[0];
+#else
+    if (pipe(wakeup_fd_) != 0) {
+        PANIC("can't create the event queue pipe: %s", strerror(errno));
+    }
+    fcntl(wakeup_fd_[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakeup_fd_[1], F_SETFL, O_NONBLOCK);
+#endif
+}
+
+//----------------------------------------------------------------------
+BundleEventQueue::~BundleEventQueue()
+{
+    BundleEvent* event;
+    while (try_pop(&event)) {
+        delete event;
+    }
+
+    close(wakeup_fd_[0]);
+    if (wakeup_fd_[1] != wakeup_fd_[0]) {
+        close(wakeup_fd_[1]);
+    }
+}
+
+//----------------------------------------------------------------------
+void
+BundleEventQueue::push(BundleEvent* event, bool at_back)
+{
+    // count the event before linking it so that the size never goes
+    // below zero. only the first event posted on an empty queue wakes
+    // up the consumer, which drains the queue before waiting again.
+    bool was_empty = (__sync_fetch_and_add(&size_, 1) == 0);
+
+    if (at_back) {
+        link_event(event);
+    } else {
+        oasys::ScopeLock l(&priority_lock_, "BundleEventQueue::push");
+        priority_events_.push_back(event);
+        __sync_fetch_and_add(&priority_size_, 1);
+    }
+
+    if (was_empty) {
+        notify();
+    }
+}
+
+//----------------------------------------------------------------------
+bool
+BundleEventQueue::try_pop(BundleEvent** eventp)
+{
+    BundleEvent* event = NULL;
+
+    if (priority_size_ != 0) {
+        oasys::ScopeLock l(&priority_lock_, "BundleEventQueue::try_pop");
+        if (!priority_events_.empty()) {
+            event = priority_events_.front();
+            priority_events_.pop_front();
+            __sync_fetch_and_sub(&priority_size_, 1);
+        }
+    }
+
+    if (event == NULL) {
+        event = unlink_event();
+    }
+
+    if (event == NULL) {
+        return false;
+    }
+
+    __sync_fetch_and_sub(&size_, 1);
+    *eventp = event;
+    return true;
+}
+
+//----------------------------------------------------------------------
+void
+BundleEventQueue::link_event(BundleEvent* event)
+{
+    event->next_event_ = NULL;
+
+    // make the new event the head first, then link the previous head
+    // to it. until the link is made, the consumer sees the list as
+    // ending at the previous head.
+    __sync_synchronize();
+    BundleEvent* prev = __sync_lock_test_and_set(&head_, event);
+    prev->next_event_ = event;
+}
+
+//----------------------------------------------------------------------
+BundleEvent*
+BundleEventQueue::unlink_event()
+{
+    BundleEvent* tail = tail_;
+    BundleEvent* next = tail->next_event_;
+
+    // skip over the stub
+    if (tail == &stub_) {
+        if (next == NULL) {
+            return NULL;
+        }
+        tail_ = next;
+        tail  = next;
+        next  = next->next_event_;
+    }
+
+    if (next != NULL) {
+        tail_ = next;
+        return tail;
+    }
+
+    // tail is the last linked event. if it isn't the head, a producer
+    // is in the middle of linking the next one.
+    if (tail != head_) {
+        return NULL;
+    }
+
+    // put the stub back behind the last event so it can be unlinked
+    link_event(&stub_);
+
+    next = tail->next_event_;
+    if (next != NULL) {
+        tail_ = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+void
+BundleEventQueue::notify()
+{
+#ifdef __linux__
+    u_int64_t one = 1;
+    int cc = write(wakeup_fd_[1], &one, sizeof(one));
+#else
+    char byte = 0;
+    int cc = write(wakeup_fd_[1], &byte, 1);
+#endif
+    if (cc < 0 && errno != EAGAIN) {
+        log_err("can't notify the event queue: %s", strerror(errno));
+    }
+}
+
+//----------------------------------------------------------------------
+void
+BundleEventQueue::clear()
+{
+#ifdef __linux__
+    u_int64_t count;
+    if (read(wakeup_fd_[0], &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        log_err("can't clear the event queue eventfd: %s", strerror(errno));
+    }
+#else
+    char buf[64];
+    while (read(wakeup_fd_[0], buf, sizeof(buf)) > 0) {}
+#endif
+}
+
+} // namespace dtn
@@ -0,0 +1,131 @@
+/*
+ *    Copyright 2010 INRIA, Planete Team
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef _BUNDLE_EVENT_QUEUE_H_
+#define _BUNDLE_EVENT_QUEUE_H_
+
+#include <deque>
+#include <oasys/debug/Logger.h>
+#include <oasys/thread/SpinLock.h>
+
+#include "BundleEvent.h"
+
+namespace dtn {
+
+/**
+ * The queue of events handled by the daemon thread.
+ *
+ * Any number of threads (convergence layers, API clients, external
+ * routers, timers) post events, while only the daemon thread pops
+ * them. Events posted at the tail go through an intrusive lock-free
+ * list linked through BundleEvent::next_event_, so posting an event
+ * takes no lock and allocates nothing. The few events posted at the
+ * head (e.g. shutdown) go through a small locked priority lane that
+ * is always drained first.
+ *
+ * The consumer waits on read_fd(), which only becomes readable when
+ * the queue goes from empty to non-empty, and must call clear() once
+ * it has been woken up. On Linux this is an eventfd, elsewhere a
+ * pipe.
+ */
+class BundleEventQueue : public oasys::Logger {
+public:
+    BundleEventQueue(const char* logpath);
+    ~BundleEventQueue();
+
+    /**
+     * Queue an event at the tail, or at the head of the queue.
+     */
+    void push(BundleEvent* event, bool at_back = true);
+
+    /**
+     * Pop the next event, only to be called by the consumer thread.
+     *
+     * @return false if the queue is empty, or if the next event is
+     * still being posted
+     */
+    bool try_pop(BundleEvent** eventp);
+
+    /**
+     * Return the number of queued events.
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * Return the file descriptor to poll to be woken up when the
+     * queue becomes non-empty.
+     */
+    int read_fd() const { return wakeup_fd_[0]; }
+
+    /**
+     * Clear the wake-up file descriptor.
+     */
+    void clear();
+
+private:
+    /**
+     * The placeholder event kept in the lock-free list so that it is
+     * never empty.
+     */
+    class StubEvent : public BundleEvent {
+    public:
+        StubEvent() : BundleEvent(DAEMON_STATUS) {}
+    };
+
+    /**
+     * Link an event to the lock-free list.
+     */
+    void link_event(BundleEvent* event);
+
+    /**
+     * Unlink the oldest event from the lock-free list.
+     */
+    BundleEvent* unlink_event();
+
+    /**
+     * Make read_fd() readable.
+     */
+    void notify();
+
+    /// Most recently posted event of the lock-free list
+    BundleEvent* volatile head_;
+
+    /// Next event to pop from the lock-free list (consumer only)
+    BundleEvent* tail_;
+
+    /// Placeholder event
+    StubEvent stub_;
+
+    /// Number of queued events, both lanes included
+    volatile int size_;
+
+    /// Events posted at the head of the queue
+    std::deque<BundleEvent*> priority_events_;
+
+    /// Number of events in priority_events_
+    volatile int priority_size_;
+
+    /// Lock for priority_events_
+    oasys::SpinLock priority_lock_;
+
+    /// Wake-up file descriptors (read and write ends), both the same
+    /// eventfd on Linux
+    int wakeup_fd_[2];
+};
+
+} // namespace dtn
+
+#endif /* _BUNDLE_EVENT_QUEUE_H_ */
@@ -32,7 +32,7 @@ namespace dtn {
 //----------------------------------------------------------------------
 BundleList::BundleList(const std::string& name, oasys::SpinLock* lock)
     : Logger("BundleList", "/dtn/bundle/list/%s", name.c_str()),
-      name_(name), notifier_(NULL)
+      name_(name), indexes_(INDEX_NONE), notifier_(NULL)
 {
     if (lock != NULL) {
         lock_     = lock;
@@ -107,6 +107,10 @@ BundleList::add_bundle(Bundle* b, const iterator& pos)
     iterator new_pos = list_.insert(pos, b);
     b->mappings()->push_back(BundleMapping(this, new_pos));
     b->add_ref("bundle_list", name_.c_str());
+
+    if (indexes_ != INDEX_NONE) {
+        index_bundle(b);
+    }
     
     if (notifier_ != 0) {
         notifier_->notify();
@@ -218,6 +222,10 @@ BundleList::del_bundle(const iterator& pos, bool used_notifier)
     
     // remove the bundle from the list
     list_.erase(pos);
+
+    if (indexes_ != INDEX_NONE) {
+        unindex_bundle(b);
+    }
     
     // drain one element from the semaphore
     if (notifier_ && !used_notifier) {
@@ -230,6 +238,117 @@ BundleList::del_bundle(const iterator& pos, bool used_notifier)
     return b;
 }
 
+//----------------------------------------------------------------------
+void
+BundleList::get_gbofid_key(const EndpointID& source_eid,
+                           const BundleTimestamp& creation_ts,
+                           std::string* key)
+{
+    char buf[64];
+    snprintf(buf, 64, "%llu.%llu.",
+             U64FMT(creation_ts.seconds_), U64FMT(creation_ts.seqno_));
+    
+    key->append(buf);
+    key->append(source_eid.c_str());
+}
+
+//----------------------------------------------------------------------
+void
+BundleList::index_bundle(Bundle* b)
+{
+    ASSERT(lock_->is_locked_by_me());
+
+    if (indexes_ & INDEX_BUNDLEID) {
+        id_index_[b->bundleid()] = b;
+    }
+
+    if (indexes_ & INDEX_GBOFID) {
+        std::string key;
+        get_gbofid_key(b->source(), b->creation_ts(), &key);
+        gbofid_index_.insert(GbofIdIndex::value_type(key, b));
+    }
+
+    if (indexes_ & INDEX_DEST) {
+        dest_index_[b->dest().str()][b->bundleid()] = b;
+    }
+}
+
+//----------------------------------------------------------------------
+void
+BundleList::unindex_bundle(Bundle* b)
+{
+    ASSERT(lock_->is_locked_by_me());
+
+    if (indexes_ & INDEX_BUNDLEID) {
+        BundleIdIndex::iterator iter = id_index_.find(b->bundleid());
+        if (iter != id_index_.end() && iter->second == b) {
+            id_index_.erase(iter);
+        } else {
+            log_err("ERROR in unindex bundle: "
+                    "bundle id %d not indexed on list [%s]",
+                    b->bundleid(), name_.c_str());
+        }
+    }
+
+    if (indexes_ & INDEX_DEST) {
+        DestIndex::iterator iter = dest_index_.find(b->dest().str());
+        if (iter != dest_index_.end() &&
+            iter->second.erase(b->bundleid()) == 1)
+        {
+            if (iter->second.empty()) {
+                dest_index_.erase(iter);
+            }
+        } else {
+            log_err("ERROR in unindex bundle: "
+                    "bundle id %d not found under its destination on list [%s]",
+                    b->bundleid(), name_.c_str());
+        }
+    }
+
+    if (indexes_ & INDEX_GBOFID) {
+        std::string key;
+        get_gbofid_key(b->source(), b->creation_ts(), &key);
+        
+        std::pair<GbofIdIndex::iterator, GbofIdIndex::iterator> range =
+            gbofid_index_.equal_range(key);
+        GbofIdIndex::iterator iter;
+        for (iter = range.first; iter != range.second; ++iter) {
+            if (iter->second == b) {
+                gbofid_index_.erase(iter);
+                return;
+            }
+        }
+
+        // the source or the timestamp changed while the bundle was
+        // on the list, so look for it the hard way
+        log_err("ERROR in unindex bundle: "
+                "bundle id %d not found under its GBOF ID on list [%s]",
+                b->bundleid(), name_.c_str());
+        for (iter = gbofid_index_.begin(); iter != gbofid_index_.end(); ++iter) {
+            if (iter->second == b) {
+                gbofid_index_.erase(iter);
+                return;
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+void
+BundleList::set_indexes(int indexes)
+{
+    oasys::ScopeLock l(lock_, "BundleList::set_indexes");
+
+    indexes_ = indexes;
+    id_index_.clear();
+    gbofid_index_.clear();
+    dest_index_.clear();
+    
+    for (iterator iter = list_.begin(); iter != list_.end(); ++iter) {
+        index_bundle(*iter);
+    }
+}
+
 //----------------------------------------------------------------------
 BundleRef
 BundleList::pop_front(bool used_notifier)
@@ -351,6 +470,15 @@ BundleList::find(u_int32_t bundle_id) const
 {
     oasys::ScopeLock l(lock_, "BundleList::find");
     BundleRef ret("BundleList::find() temporary");
+
+    if (indexes_ & INDEX_BUNDLEID) {
+        BundleIdIndex::const_iterator iter = id_index_.find(bundle_id);
+        if (iter != id_index_.end()) {
+            ret = iter->second;
+        }
+        return ret;
+    }
+    
     for (iterator iter = begin(); iter != end(); ++iter) {
         if ((*iter)->bundleid() == bundle_id) {
             ret = *iter;
@@ -368,6 +496,15 @@ BundleList::find(const EndpointID& source_eid,
 {
     oasys::ScopeLock l(lock_, "BundleList::find");
     BundleRef ret("BundleList::find() temporary");
+
+    if (indexes_ & INDEX_GBOFID) {
+        std::vector<Bundle*> bundles;
+        find_all(source_eid, creation_ts, &bundles);
+        if (!bundles.empty()) {
+            ret = bundles.front();
+        }
+        return ret;
+    }
     
     for (iterator iter = begin(); iter != end(); ++iter) {
         if ((*iter)->creation_ts().seconds_ == creation_ts.seconds_ &&
@@ -388,6 +525,25 @@ BundleList::find(GbofId& gbof_id) const
 {
     oasys::ScopeLock l(lock_, "BundleList::find");
     BundleRef ret("BundleList::find() temporary");
+
+    if (indexes_ & INDEX_GBOFID) {
+        std::vector<Bundle*> bundles;
+        find_all(gbof_id.source_, gbof_id.creation_ts_, &bundles);
+        for (std::vector<Bundle*>::iterator iter = bundles.begin();
+             iter != bundles.end(); ++iter)
+        {
+            if (gbof_id.equals((*iter)->source(),
+                               (*iter)->creation_ts(),
+                               (*iter)->is_fragment(),
+                               (*iter)->payload().length(),
+                               (*iter)->frag_offset()))
+            {
+                ret = *iter;
+                break;
+            }
+        }
+        return ret;
+    }
     
     for (iterator iter = begin(); iter != end(); ++iter) {
         if (gbof_id.equals((*iter)->source(),
@@ -410,6 +566,26 @@ BundleList::find(const GbofId& gbof_id, const BundleTimestamp& extended_id) cons
 {
     oasys::ScopeLock l(lock_, "BundleList::find");
     BundleRef ret("BundleList::find() temporary");
+
+    if (indexes_ & INDEX_GBOFID) {
+        std::vector<Bundle*> bundles;
+        find_all(gbof_id.source_, gbof_id.creation_ts_, &bundles);
+        for (std::vector<Bundle*>::iterator iter = bundles.begin();
+             iter != bundles.end(); ++iter)
+        {
+            if (extended_id == (*iter)->extended_id() &&
+                gbof_id.equals((*iter)->source(),
+                               (*iter)->creation_ts(),
+                               (*iter)->is_fragment(),
+                               (*iter)->payload().length(),
+                               (*iter)->frag_offset()))
+            {
+                ret = *iter;
+                break;
+            }
+        }
+        return ret;
+    }
     
     for (iterator iter = begin(); iter != end(); ++iter) {
         if (extended_id == (*iter)->extended_id() &&
@@ -427,6 +603,94 @@ BundleList::find(const GbofId& gbof_id, const BundleTimestamp& extended_id) cons
     return ret;
 }
 
+//----------------------------------------------------------------------
+void
+BundleList::find_all(const EndpointID& source_eid,
+                     const BundleTimestamp& creation_ts,
+                     std::vector<Bundle*>* bundles) const
+{
+    oasys::ScopeLock l(lock_, "BundleList::find_all");
+
+    if (indexes_ & INDEX_GBOFID) {
+        std::string key;
+        get_gbofid_key(source_eid, creation_ts, &key);
+
+        std::pair<GbofIdIndex::const_iterator, GbofIdIndex::const_iterator>
+            range = gbofid_index_.equal_range(key);
+        for (GbofIdIndex::const_iterator iter = range.first;
+             iter != range.second; ++iter)
+        {
+            // the key is only a hint, so check the fields themselves
+            Bundle* b = iter->second;
+            if (b->creation_ts().seconds_ == creation_ts.seconds_ &&
+                b->creation_ts().seqno_ == creation_ts.seqno_ &&
+                b->source().equals(source_eid))
+            {
+                bundles->push_back(b);
+            }
+        }
+        return;
+    }
+    
+    for (iterator iter = begin(); iter != end(); ++iter) {
+        if ((*iter)->creation_ts().seconds_ == creation_ts.seconds_ &&
+            (*iter)->creation_ts().seqno_ == creation_ts.seqno_ &&
+            (*iter)->source().equals(source_eid))
+        {
+            bundles->push_back(*iter);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+void
+BundleList::find_all(const EndpointID& dest_eid,
+                     std::vector<Bundle*>* bundles) const
+{
+    oasys::ScopeLock l(lock_, "BundleList::find_all");
+
+    if (indexes_ & INDEX_DEST) {
+        DestIndex::const_iterator iter = dest_index_.find(dest_eid.str());
+        if (iter == dest_index_.end()) {
+            return;
+        }
+
+        BundleIdMap::const_iterator b;
+        for (b = iter->second.begin(); b != iter->second.end(); ++b) {
+            bundles->push_back(b->second);
+        }
+        return;
+    }
+
+    BundleIdMap found;
+    for (iterator iter = begin(); iter != end(); ++iter) {
+        if ((*iter)->dest().equals(dest_eid)) {
+            found[(*iter)->bundleid()] = *iter;
+        }
+    }
+
+    BundleIdMap::const_iterator b;
+    for (b = found.begin(); b != found.end(); ++b) {
+        bundles->push_back(b->second);
+    }
+}
+
+//----------------------------------------------------------------------
+void
+BundleList::get_dests(std::vector<EndpointID>* dests) const
+{
+    oasys::ScopeLock l(lock_, "BundleList::get_dests");
+
+    ASSERTF(indexes_ & INDEX_DEST,
+            "list [%s] has no destination index", name_.c_str());
+
+    DestIndex::const_iterator iter;
+    for (iter = dest_index_.begin(); iter != dest_index_.end(); ++iter) {
+        ASSERT(!iter->second.empty());
+        dests->push_back(iter->second.begin()->second->dest());
+    }
+}
+
 //----------------------------------------------------------------------
 void
 BundleList::move_contents(BundleList* other)
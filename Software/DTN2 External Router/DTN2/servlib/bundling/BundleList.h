@@ -18,8 +18,11 @@
 #define _BUNDLE_LIST_H_
 
 #include <list>
+#include <map>
+#include <vector>
 #include <oasys/compat/inttypes.h>
 #include <oasys/thread/Notifier.h>
+#include <oasys/util/StringUtils.h>
 
 #include "BundleRef.h"
 #include "naming/EndpointID.h"
@@ -56,6 +59,12 @@ class BundleTimestamp;
  * List methods also maintain mappings (i.e. "back pointers") in each
  * Bundle instance to the set of lists that contain the bundle.
  *
+ * Long lived lists can also keep hash indexes by bundle id, by
+ * source eid / creation timestamp and by destination eid (see
+ * set_indexes()) so that the find() variants don't have to scan the
+ * list. The indexed fields
+ * must not change while the bundle is on the list.
+ *
  * Lists follow the reference counting rules for bundles. In
  * particular, the push*() methods increment the reference count, and
  * erase() decrements it. In particular, the pop() variants (as well
@@ -80,6 +89,16 @@ public:
      */
     typedef List::iterator iterator;
 
+    /**
+     * Type codes for the secondary indexes of the list
+     */
+    typedef enum {
+        INDEX_NONE     = 0x0,
+        INDEX_BUNDLEID = 0x1,	///< Index by bundle id
+        INDEX_GBOFID   = 0x2,	///< Index by source eid and creation timestamp
+        INDEX_DEST     = 0x4	///< Index by destination eid
+    } index_t;
+
     /**
      * Constructor
      */
@@ -245,6 +264,36 @@ public:
     BundleRef find(const GbofId& gbof_id,
                    const BundleTimestamp& extended_id) const;
 
+    /**
+     * Collect all the bundles with the given source eid and creation
+     * timestamp, i.e. the duplicates and fragments of a bundle. The
+     * list lock must be held as long as the returned bundles are
+     * used.
+     */
+    void find_all(const EndpointID& source_eid,
+                  const BundleTimestamp& creation_ts,
+                  std::vector<Bundle*>* bundles) const;
+
+    /**
+     * Collect all the bundles with the given destination eid, ordered
+     * by bundle id. The list lock must be held as long as the
+     * returned bundles are used.
+     */
+    void find_all(const EndpointID& dest_eid,
+                  std::vector<Bundle*>* bundles) const;
+
+    /**
+     * Collect the distinct destination eids of the bundles on the
+     * list. Requires the destination index.
+     */
+    void get_dests(std::vector<EndpointID>* dests) const;
+
+    /**
+     * Enable the given secondary indexes (a mask of index_t values),
+     * indexing the bundles already on the list.
+     */
+    void set_indexes(int indexes);
+
     /**
      * Move all bundles from this list to another.
      */
@@ -311,9 +360,40 @@ private:
      * @returns the bundle that, before this call, was at the position
      */
     Bundle* del_bundle(const iterator& pos, bool used_notifier);
+
+    /**
+     * Helper routines to add and remove a bundle from the enabled
+     * indexes.
+     */
+    void index_bundle(Bundle* bundle);
+    void unindex_bundle(Bundle* bundle);
+
+    /**
+     * Build the key of a bundle in the GBOF ID index.
+     */
+    static void get_gbofid_key(const EndpointID& source_eid,
+                               const BundleTimestamp& creation_ts,
+                               std::string* key);
+
+    /// Type for the bundle id index
+    typedef _std::hash_map<u_int32_t, Bundle*> BundleIdIndex;
+
+    /// Type for the GBOF ID index, fragments and duplicates share a key
+    typedef _std::hash_multimap<std::string, Bundle*,
+                                oasys::StringHash,
+                                oasys::StringEquals> GbofIdIndex;
+
+    /// Type for the destination index, each destination maps the
+    /// bundle ids to the bundles
+    typedef std::map<u_int32_t, Bundle*> BundleIdMap;
+    typedef oasys::StringHashMap<BundleIdMap> DestIndex;
     
     std::string      name_;	///< name of the list
     List             list_;	///< underlying list data structure
+    int              indexes_;	///< mask of the enabled indexes
+    BundleIdIndex    id_index_;	///< bundles by id
+    GbofIdIndex      gbofid_index_; ///< bundles by source and timestamp
+    DestIndex        dest_index_; ///< bundles by destination
     
 protected:
     oasys::SpinLock* lock_;	///< lock for notifier
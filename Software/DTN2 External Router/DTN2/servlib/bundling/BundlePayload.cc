@@ -19,8 +19,14 @@
 #endif
 
 #include <errno.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 #include <oasys/debug/DebugUtils.h>
 #include <oasys/io/FileUtils.h>
 #include <oasys/thread/SpinLock.h>
@@ -34,6 +40,51 @@ namespace dtn {
 
 //----------------------------------------------------------------------
 bool BundlePayload::test_no_remove_ = false;
+bool BundlePayload::test_no_kernel_copy_ = false;
+
+//----------------------------------------------------------------------
+/**
+ * Copy up to len bytes of a file without reading them into user
+ * space. Returns the number of bytes the kernel copied, the rest
+ * should be copied from the current file offsets.
+ */
+static size_t
+kernel_copy(int src_fd, int dst_fd, size_t len)
+{
+    if (BundlePayload::test_no_kernel_copy_) {
+        return 0;
+    }
+    
+#if defined(__linux__) && defined(FICLONE)
+    // share the extents of the source file, if all of it is copied
+    struct stat st;
+    if (fstat(src_fd, &st) == 0 && (size_t)st.st_size == len &&
+        ioctl(dst_fd, FICLONE, src_fd) == 0)
+    {
+        return len;
+    }
+#endif
+
+#if defined(__linux__) && defined(__NR_copy_file_range)
+    // copy the data within the kernel, which advances both offsets.
+    // this fails with EXDEV across filesystems on older kernels.
+    size_t copied = 0;
+    while (copied < len) {
+        ssize_t cc = syscall(__NR_copy_file_range,
+                             src_fd, NULL, dst_fd, NULL, len - copied, 0);
+        if (cc <= 0) {
+            break;
+        }
+        copied += cc;
+    }
+    return copied;
+#else
+    (void)src_fd;
+    (void)dst_fd;
+    (void)len;
+    return 0;
+#endif
+}
 
 //----------------------------------------------------------------------
 BundlePayload::BundlePayload(oasys::SpinLock* lock)
@@ -248,6 +299,20 @@ BundlePayload::copy_file(oasys::FileIOClient* dst) const
 //----------------------------------------------------------------------
 bool
 BundlePayload::replace_with_file(const char* path)
+{
+    return replace_file(path, true, -1);
+}
+
+//----------------------------------------------------------------------
+bool
+BundlePayload::replace_with_copy(const char* path, size_t len)
+{
+    return replace_file(path, false, len);
+}
+
+//----------------------------------------------------------------------
+bool
+BundlePayload::replace_file(const char* path, bool allow_link, ssize_t len)
 {
     oasys::ScopeLock l(lock_, "BundlePayload::replace_with_file");
     
@@ -260,7 +325,7 @@ BundlePayload::replace_with_file(const char* path)
     file_.unlink();
 
     // now try to make the hard link
-    int err = ::link(path, payload_path.c_str());
+    int err = allow_link ? ::link(path, payload_path.c_str()) : -1;
     if (err == 0) {
         log_debug("replace_with_file: successfully created link to %s", path);
 
@@ -274,16 +339,18 @@ BundlePayload::replace_with_file(const char* path)
         }
         
     } else {
-        // ::link failed
-        err = errno;
-        if (err != EXDEV) {
-            log_err("error linking to path '%s': %s", path, strerror(err));
-            return false;
+        if (allow_link) {
+            // ::link failed
+            err = errno;
+            if (err != EXDEV) {
+                log_err("error linking to path '%s': %s", path, strerror(err));
+                return false;
+            }
+
+            // copy the contents if they're on different filesystems
+            log_debug("replace_with_file: link failed: %s", strerror(err));
         }
         
-        // copy the contents if they're on different filesystems
-        log_debug("replace_with_file: link failed: %s", strerror(err));
-        
         oasys::FileIOClient src;
         int fd = src.open(path, O_RDONLY, &err);
         if (fd < 0) {
@@ -291,6 +358,22 @@ BundlePayload::replace_with_file(const char* path)
                     path, strerror(err));
             return false;
         }
+
+        // the copy is never longer than the file was when it was
+        // opened, or than the length asked for
+        struct stat st;
+        if (src.stat(&st) != 0) {
+            log_err("error getting the size of '%s': %s",
+                    path, strerror(errno));
+            return false;
+        }
+        
+        if (len >= 0 && st.st_size != len) {
+            log_err("replace_with_file: %s has %llu bytes, expected %zd",
+                    path, (unsigned long long)st.st_size, len);
+            return false;
+        }
+        size_t copy_len = st.st_size;
         
         file_.set_path(payload_path);
         if (file_.reopen(O_RDWR | O_CREAT, S_IRUSR | S_IWUSR) < 0) {
@@ -298,9 +381,27 @@ BundlePayload::replace_with_file(const char* path)
                     strerror(err));
             return false;
         }
+
+        size_t copied = kernel_copy(src.fd(), file_.fd(), copy_len);
+        if (copied != 0) {
+            log_debug("replace_with_file: copied %zu bytes of %s in the kernel",
+                      copied, path);
+        }
         
-        src.copy_contents(&file_);
+        // the file may also have changed while it was copied
+        if ((copied < copy_len &&
+             src.copy_contents(&file_, copy_len - copied) < 0) ||
+            oasys::FileUtils::size(file_.path()) != (int)copy_len)
+        {
+            log_err("replace_with_file: error copying %s", path);
+            file_.close();
+            file_.unlink();
+            return false;
+        }
         src.close();
+
+        file_.lseek(0, SEEK_SET);
+        cur_offset_ = 0;
     }
 
     set_length(oasys::FileUtils::size(file_.path()));
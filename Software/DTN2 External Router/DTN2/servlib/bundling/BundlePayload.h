@@ -118,9 +118,21 @@ public:
     /**
      * Replace the underlying file with a hard link to the given path
      * or a copy of the file contents if the link can't be created.
+     *
+     * Copies are made by the kernel when possible, either by cloning
+     * the file (on filesystems with copy on write) or with
+     * copy_file_range, and only otherwise through a buffer.
      */
     bool replace_with_file(const char* path);
 
+    /**
+     * Replace the underlying file with a copy of the file at the given
+     * path, which is never linked since it still belongs to an
+     * application. Fails unless the copy has exactly len bytes, e.g.
+     * if the file changed since its size was checked.
+     */
+    bool replace_with_copy(const char* path, size_t len);
+
     /**
      * Return the filename.
      */
@@ -172,12 +184,17 @@ public:
     virtual void serialize(oasys::SerializeAction* a);
 
     static bool test_no_remove_;    ///< test: don't rm payload files
+    static bool test_no_kernel_copy_; ///< test: copy files through a buffer
 
 protected:
     void pin_file() const;
     void unpin_file() const;
     void internal_write(const u_char* bp, size_t offset, size_t len);
 
+    /// Implementation of replace_with_file and replace_with_copy, a
+    /// negative len accepts a file of any length
+    bool replace_file(const char* path, bool allow_link, ssize_t len);
+
     location_t location_;	///< location of the data 
     oasys::ScratchBuffer<u_char*> data_; ///< payload data if in memory
     size_t length_;     	///< the payload length
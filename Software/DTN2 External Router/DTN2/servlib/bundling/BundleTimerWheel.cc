@@ -0,0 +1,327 @@
+/*
+ *    Copyright 2010 INRIA, Planete Team
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <dtn-config.h>
+#endif
+
+#include <climits>
+#include <string.h>
+
+#include "BundleDaemon.h"
+#include "BundleTimerWheel.h"
+
+namespace dtn {
+
+//----------------------------------------------------------------------
+BundleTimerWheel::Timer::Timer()
+    : next_(NULL),
+      prev_(NULL),
+      slot_(NULL),
+      expires_(0),
+      pending_(false),
+      cancelled_(false)
+{
+}
+
+//----------------------------------------------------------------------
+BundleTimerWheel::Timer::~Timer()
+{
+    ASSERTF(pending_ == false, "can't delete a pending timer");
+}
+
+//----------------------------------------------------------------------
+void
+BundleTimerWheel::Timer::schedule_at(struct timeval* when)
+{
+    BundleDaemon::instance()->timer_wheel()->schedule_at(this, *when);
+}
+
+//----------------------------------------------------------------------
+bool
+BundleTimerWheel::Timer::cancel()
+{
+    return BundleDaemon::instance()->timer_wheel()->cancel(this);
+}
+
+//----------------------------------------------------------------------
+BundleTimerWheel::BundleTimerWheel()
+    : Logger("BundleTimerWheel", "/dtn/bundle/timer_wheel"),
+      overdue_(NULL),
+      now_(0),
+      num_timers_(0)
+{
+    memset(root_, 0, sizeof(root_));
+    memset(levels_, 0, sizeof(levels_));
+}
+
+//----------------------------------------------------------------------
+BundleTimerWheel::~BundleTimerWheel()
+{
+}
+
+//----------------------------------------------------------------------
+void
+BundleTimerWheel::get_time(struct timeval* now)
+{
+    ::gettimeofday(now, 0);
+}
+
+//----------------------------------------------------------------------
+void
+BundleTimerWheel::schedule_at(Timer* timer, const struct timeval& when)
+{
+    oasys::ScopeLock l(&lock_, "BundleTimerWheel::schedule_at");
+
+    ASSERTF(timer->pending_ == false, "timer is already pending");
+
+    // an empty wheel may be far behind, so restart it from the
+    // current time instead of running all the ticks in between
+    if (num_timers_ == 0) {
+        struct timeval now;
+        get_time(&now);
+        now_ = now.tv_sec;
+    }
+
+    // round up so that timers never fire early
+    timer->expires_ = when.tv_sec;
+    if (when.tv_usec != 0) {
+        timer->expires_++;
+    }
+    timer->pending_   = true;
+    timer->cancelled_ = false;
+
+    add_timer(timer);
+    ++num_timers_;
+}
+
+//----------------------------------------------------------------------
+bool
+BundleTimerWheel::cancel(Timer* timer)
+{
+    oasys::ScopeLock l(&lock_, "BundleTimerWheel::cancel");
+
+    if (! timer->pending_) {
+        return false;
+    }
+
+    remove_timer(timer);
+    timer->pending_   = false;
+    timer->cancelled_ = true;
+    --num_timers_;
+
+    return true;
+}
+
+//----------------------------------------------------------------------
+void
+BundleTimerWheel::add_timer(Timer* timer)
+{
+    u_int64_t expires = timer->expires_;
+    Timer** slot;
+
+    if (expires < now_) {
+        // already expired, fire it at the next run
+        slot = &overdue_;
+
+    } else if (expires - now_ < (u_int64_t)ROOT_SIZE) {
+        slot = &root_[expires & ROOT_MASK];
+
+    } else {
+        u_int64_t delta = expires - now_;
+        int level = 0;
+        int shift = ROOT_BITS;
+        while (level < NUM_LEVELS - 1 &&
+               delta >= (1ULL << (shift + LEVEL_BITS)))
+        {
+            ++level;
+            shift += LEVEL_BITS;
+        }
+
+        // timers beyond the span of the wheels are parked in the
+        // farthest slot, and placed again when it is cascaded
+        if (delta >= (1ULL << (shift + LEVEL_BITS))) {
+            expires = now_ + (1ULL << (shift + LEVEL_BITS)) - 1;
+        }
+
+        slot = &levels_[level][(expires >> shift) & LEVEL_MASK];
+    }
+
+    timer->slot_ = slot;
+    timer->prev_ = NULL;
+    timer->next_ = *slot;
+    if (*slot != NULL) {
+        (*slot)->prev_ = timer;
+    }
+    *slot = timer;
+}
+
+//----------------------------------------------------------------------
+void
+BundleTimerWheel::remove_timer(Timer* timer)
+{
+    if (timer->prev_ != NULL) {
+        timer->prev_->next_ = timer->next_;
+    } else {
+        *timer->slot_ = timer->next_;
+    }
+
+    if (timer->next_ != NULL) {
+        timer->next_->prev_ = timer->prev_;
+    }
+
+    timer->next_ = NULL;
+    timer->prev_ = NULL;
+    timer->slot_ = NULL;
+}
+
+//----------------------------------------------------------------------
+int
+BundleTimerWheel::cascade(int level, int index)
+{
+    Timer* timer = levels_[level][index];
+    levels_[level][index] = NULL;
+
+    while (timer != NULL) {
+        Timer* next = timer->next_;
+        add_timer(timer);
+        timer = next;
+    }
+
+    return index;
+}
+
+//----------------------------------------------------------------------
+void
+BundleTimerWheel::take_timers(Timer** slot, Timer** expired,
+                              Timer** expired_tail)
+{
+    Timer* timer = *slot;
+    *slot = NULL;
+
+    while (timer != NULL) {
+        Timer* next = timer->next_;
+
+        timer->next_    = NULL;
+        timer->prev_    = NULL;
+        timer->slot_    = NULL;
+        timer->pending_ = false;
+        --num_timers_;
+
+        if (*expired_tail == NULL) {
+            *expired = timer;
+        } else {
+            (*expired_tail)->next_ = timer;
+        }
+        *expired_tail = timer;
+
+        timer = next;
+    }
+}
+
+//----------------------------------------------------------------------
+int
+BundleTimerWheel::run_expired_timers()
+{
+    struct timeval now;
+    get_time(&now);
+
+    Timer* expired = NULL;
+    Timer* expired_tail = NULL;
+    int timeout;
+
+    {
+        oasys::ScopeLock l(&lock_, "BundleTimerWheel::run_expired_timers");
+
+        if (num_timers_ == 0) {
+            return -1;
+        }
+
+        // timers scheduled for a tick that was already run
+        take_timers(&overdue_, &expired, &expired_tail);
+
+        while (now_ <= (u_int64_t)now.tv_sec) {
+            int index = now_ & ROOT_MASK;
+
+            // when the root wheel wraps, bring the timers of the next
+            // slot of each upper wheel down, as long as that wheel
+            // wraps too
+            if (index == 0) {
+                for (int level = 0; level < NUM_LEVELS; ++level) {
+                    int shift = ROOT_BITS + level * LEVEL_BITS;
+                    if (cascade(level, (now_ >> shift) & LEVEL_MASK) != 0) {
+                        break;
+                    }
+                }
+            }
+
+            ++now_;
+
+            take_timers(&root_[index], &expired, &expired_tail);
+        }
+
+        timeout = next_timeout(now);
+    }
+
+    // the timers may delete themselves (or schedule new timers), so
+    // they're fired without holding the lock
+    while (expired != NULL) {
+        Timer* next = expired->next_;
+        expired->next_ = NULL;
+        expired->timeout(now);
+        expired = next;
+    }
+
+    return timeout;
+}
+
+//----------------------------------------------------------------------
+int
+BundleTimerWheel::next_timeout(const struct timeval& now)
+{
+    if (num_timers_ == 0) {
+        return -1;
+    }
+
+    if (overdue_ != NULL) {
+        return 0;
+    }
+
+    // look for the next tick with timers in the root wheel, stopping
+    // at the next wrap since timers may be cascaded there
+    u_int64_t tick = now_;
+    if ((tick & ROOT_MASK) != 0) {
+        while (root_[tick & ROOT_MASK] == NULL) {
+            ++tick;
+            if ((tick & ROOT_MASK) == 0) {
+                break;
+            }
+        }
+    }
+
+    if (tick <= (u_int64_t)now.tv_sec) {
+        return 0;
+    }
+
+    u_int64_t ms = (tick - now.tv_sec) * 1000 - now.tv_usec / 1000;
+    if (ms > INT_MAX) {
+        return INT_MAX;
+    }
+
+    return (int)ms;
+}
+
+} // namespace dtn
@@ -0,0 +1,165 @@
+/*
+ *    Copyright 2010 INRIA, Planete Team
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef _BUNDLE_TIMER_WHEEL_H_
+#define _BUNDLE_TIMER_WHEEL_H_
+
+#include <sys/time.h>
+#include <oasys/compat/inttypes.h>
+#include <oasys/debug/Logger.h>
+#include <oasys/thread/SpinLock.h>
+
+namespace dtn {
+
+/**
+ * A hierarchical timer wheel with a one second resolution for the
+ * per-bundle expiration and custody timers, which are far too many
+ * for the oasys::TimerSystem priority queue.
+ *
+ * Timers are kept in intrusive doubly linked lists, so scheduling and
+ * cancelling them is O(1). The root wheel has one slot per second for
+ * the next 256 seconds, and each of the four upper wheels has 64
+ * slots covering 64 slots of the wheel below. When the root wheel
+ * wraps, the timers of the next slot of the upper wheel are
+ * redistributed (cascaded) into the lower wheels. Timers scheduled
+ * for a tick that was already run fire at the next run.
+ *
+ * The wheel is run by the daemon thread, which also schedules and
+ * cancels the timers.
+ */
+class BundleTimerWheel : public oasys::Logger {
+public:
+    /**
+     * Base class for the timers kept in the wheel. Derived classes
+     * must override the timeout() method.
+     */
+    class Timer {
+    public:
+        Timer();
+        virtual ~Timer();
+
+        /**
+         * Schedule the timer in the daemon's wheel. The timer fires
+         * at the first tick following the given time.
+         */
+        void schedule_at(struct timeval* when);
+
+        /**
+         * Remove the timer from the daemon's wheel.
+         *
+         * @return false if the timer isn't pending
+         */
+        bool cancel();
+
+        bool pending()   { return pending_; }
+        bool cancelled() { return cancelled_; }
+
+        virtual void timeout(const struct timeval& now) = 0;
+
+    protected:
+        friend class BundleTimerWheel;
+
+        Timer*     next_;      ///< Next timer in the slot
+        Timer*     prev_;      ///< Previous timer in the slot
+        Timer**    slot_;      ///< Slot holding the timer
+        u_int64_t  expires_;   ///< Tick at which the timer fires
+        bool       pending_;   ///< Is the timer currently pending
+        bool       cancelled_; ///< Was the timer cancelled
+    };
+
+    BundleTimerWheel();
+    virtual ~BundleTimerWheel();
+
+    /**
+     * Schedule a timer to fire at the first tick following when.
+     */
+    void schedule_at(Timer* timer, const struct timeval& when);
+
+    /**
+     * Remove a pending timer from the wheel.
+     */
+    bool cancel(Timer* timer);
+
+    /**
+     * Advance the wheel to the current time and fire the expired
+     * timers.
+     *
+     * @return the number of milliseconds until the next tick with
+     * timers to fire (or to cascade), -1 if the wheel is empty
+     */
+    int run_expired_timers();
+
+    /**
+     * Return the number of pending timers.
+     */
+    size_t num_pending_timers() { return num_timers_; }
+
+protected:
+    /**
+     * Get the current time, overridden by the unit tests to drive the
+     * wheel from a fake clock.
+     */
+    virtual void get_time(struct timeval* now);
+
+private:
+    static const int ROOT_BITS  = 8;
+    static const int ROOT_SIZE  = 1 << ROOT_BITS;
+    static const int ROOT_MASK  = ROOT_SIZE - 1;
+    static const int LEVEL_BITS = 6;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int LEVEL_MASK = LEVEL_SIZE - 1;
+    static const int NUM_LEVELS = 4;
+
+    /**
+     * Link a timer in the slot matching its expiration tick.
+     */
+    void add_timer(Timer* timer);
+
+    /**
+     * Unlink a timer from its slot.
+     */
+    void remove_timer(Timer* timer);
+
+    /**
+     * Move the timers of the given upper wheel slot down the wheels.
+     *
+     * @return the slot index
+     */
+    int cascade(int level, int index);
+
+    /**
+     * Unlink all the timers of a slot and append them to the expired
+     * list.
+     */
+    void take_timers(Timer** slot, Timer** expired, Timer** expired_tail);
+
+    /**
+     * Return the number of milliseconds until the next tick that has
+     * timers to fire or to cascade.
+     */
+    int next_timeout(const struct timeval& now);
+
+    oasys::SpinLock lock_;
+    Timer*    root_[ROOT_SIZE];               ///< Root wheel
+    Timer*    levels_[NUM_LEVELS][LEVEL_SIZE]; ///< Upper wheels
+    Timer*    overdue_;    ///< Timers scheduled for a tick already run
+    u_int64_t now_;        ///< Next tick to run
+    size_t    num_timers_; ///< Number of pending timers
+};
+
+} // namespace dtn
+
+#endif /* _BUNDLE_TIMER_WHEEL_H_ */
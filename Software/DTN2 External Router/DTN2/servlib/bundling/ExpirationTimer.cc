@@ -24,6 +24,8 @@
 
 namespace dtn {
 
+BundleExpiredBatchEvent* ExpirationTimer::expired_ = NULL;
+
 ExpirationTimer::ExpirationTimer(Bundle* bundle)
     : bundleref_(bundle, "expiration timer")
 {
@@ -38,11 +40,23 @@ ExpirationTimer::timeout(const struct timeval& now)
     // null out the pointer to ourself in the bundle class
     bundleref_->set_expiration_timer(NULL);
     
-    // post the expiration event
-    BundleDaemon::post_at_head(new BundleExpiredEvent(bundleref_.object()));
+    // add the bundle to the batch of expired bundles
+    if (expired_ == NULL) {
+        expired_ = new BundleExpiredBatchEvent();
+    }
+    expired_->bundles_.push_back(bundleref_);
 
     // clean ourselves up
     delete this;
 }
 
+void
+ExpirationTimer::post_expired()
+{
+    if (expired_ != NULL) {
+        BundleDaemon::post_at_head(expired_);
+        expired_ = NULL;
+    }
+}
+
 } // namespace dtn
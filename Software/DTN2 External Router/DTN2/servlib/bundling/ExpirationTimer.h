@@ -17,30 +17,42 @@
 #ifndef _EXPIRATION_TIMER_H_
 #define _EXPIRATION_TIMER_H_
 
-#include <oasys/thread/Timer.h>
 #include "BundleRef.h"
+#include "BundleTimerWheel.h"
 
 namespace dtn {
 
+class BundleExpiredBatchEvent;
+
 /**
  * Bundle expiration timer class.
  *
  * The timer is started when the bundle first arrives at the daemon,
  * and is cancelled when the daemon removes it from the pending list.
  *
+ * The bundles whose timers fire in the same run of the timer wheel
+ * are collected and posted as a single BundleExpiredBatchEvent by
+ * post_expired().
  */
-class ExpirationTimer : public oasys::Timer {
+class ExpirationTimer : public BundleTimerWheel::Timer {
 public:
     ExpirationTimer(Bundle* bundle);
 
     virtual ~ExpirationTimer() {} 
 
+    /**
+     * Post the bundles expired since the last call, if any.
+     */
+    static void post_expired();
+
     /// The reference to the bundle, which is public since 
     BundleRef bundleref_;
     
 protected:
     void timeout(const struct timeval& now);
 
+    /// Bundles expired since the last post_expired()
+    static BundleExpiredBatchEvent* expired_;
 };
 
 } // namespace dtn
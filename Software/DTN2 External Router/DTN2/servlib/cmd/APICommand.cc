@@ -40,6 +40,13 @@ APICommand::APICommand(APIServer* server)
                                   "The TCP port on which the "
                                   "API Server will listen. "
                                   "Default is 5010."));
+
+    bind_var(new oasys::UInt16Opt("reactors", server->reactors_ptr(),
+                                  "count",
+                                  "The number of epoll reactor threads "
+                                  "serving the API clients, or 0 to run "
+                                  "a thread per client. "
+                                  "Default is 0."));
 }
 
 } // namespace dtn
@@ -48,6 +48,7 @@ BundleCommand::BundleCommand()
                 "            length=integer\n");
     add_to_help("stats", "get statistics on the bundles");
     add_to_help("daemon_stats", "daemon stats");
+    add_to_help("event_stats", "handling time histograms of the daemon events");
     add_to_help("reset_stats", "reset currently maintained statistics");
     add_to_help("list", "list all of the bundles in the system");
     add_to_help("ids", "list the ids of all bundles the system");
@@ -261,6 +262,11 @@ BundleCommand::exec(int objc, Tcl_Obj** objv, Tcl_Interp* interp)
         BundleDaemon::instance()->get_daemon_stats(&buf);
         set_result(buf.c_str());
         return TCL_OK;
+    } else if (!strcmp(cmd, "event_stats")) {
+        oasys::StringBuffer buf("Bundle Daemon Event Statistics:\n");
+        BundleDaemon::instance()->get_event_stats(&buf);
+        set_result(buf.c_str());
+        return TCL_OK;
     } else if (!strcmp(cmd, "daemon_status")) {
         BundleDaemon::post_and_wait(new StatusRequest(),
                                     CompletionNotifier::notifier());
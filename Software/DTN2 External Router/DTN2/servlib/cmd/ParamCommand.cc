@@ -71,6 +71,19 @@ ParamCommand::ParamCommand()
                                 "Injected bundles are held in memory by default"
                                 "(default is false)"));
 
+    bind_var(new oasys::UIntOpt("event_batch_size",
+                                &BundleDaemon::params_.event_batch_size_,
+                                "count",
+                                "Maximum number of events handled by the "
+                                "daemon between two timer checks "
+                                "(default is 32)"));
+
+    bind_var(new oasys::UIntOpt("event_batch_time",
+                                &BundleDaemon::params_.event_batch_time_,
+                                "ms",
+                                "Maximum time spent handling events "
+                                "between two timer checks (default is 50)"));
+
     static oasys::EnumOpt::Case IsSingletonCases[] = {
         {"unknown",   EndpointID::UNKNOWN},
         {"singleton", EndpointID::SINGLETON},
@@ -128,6 +128,23 @@ DTNScheme::match(const EndpointIDPattern& pattern, const EndpointID& eid)
     return true;
 }
 
+//----------------------------------------------------------------------
+bool
+DTNScheme::has_wildcard(const URI& uri)
+{
+    return uri.host().find('*') != std::string::npos ||
+        uri.path().find('*') != std::string::npos;
+}
+
+//----------------------------------------------------------------------
+std::string
+DTNScheme::exact_key(const URI& uri)
+{
+    char port[16];
+    snprintf(port, sizeof(port), ":%u", uri.port_num());
+    return uri.host() + port + uri.path();
+}
+
 //----------------------------------------------------------------------
 bool
 DTNScheme::append_service_tag(URI* uri, const char* tag)
@@ -90,6 +90,21 @@ public:
      * Check if the given URI is a singleton EID.
      */
     virtual singleton_info_t is_singleton(const URI& uri);
+
+    /**
+     * Return whether the host or the path of the uri has a wildcard.
+     * Since match() globs in both directions, such an eid may match
+     * any dtn pattern, so it can't be looked up in an index of the
+     * patterns.
+     */
+    static bool has_wildcard(const URI& uri);
+
+    /**
+     * Return the key under which a pattern without wildcards is
+     * indexed, and under which the eids it matches are looked up:
+     * the host, port and path of the uri, ignoring the query.
+     */
+    static std::string exact_key(const URI& uri);
     
 private:
     friend class oasys::Singleton<DTNScheme>;
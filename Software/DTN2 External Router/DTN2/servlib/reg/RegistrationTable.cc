@@ -18,17 +18,29 @@
 #  include <dtn-config.h>
 #endif
 
+#include <algorithm>
+
 #include "APIRegistration.h"
 #include "RegistrationTable.h"
 #include "bundling/BundleEvent.h"
 #include "bundling/BundleDaemon.h"
+#include "naming/DTNScheme.h"
 #include "storage/RegistrationStore.h"
 
 namespace dtn {
 
+//----------------------------------------------------------------------
+static bool
+is_dtn_uri(const EndpointID& eid)
+{
+    return eid.known_scheme() && eid.scheme() == DTNScheme::instance() &&
+        eid.uri().valid();
+}
+
 //----------------------------------------------------------------------
 RegistrationTable::RegistrationTable()
-    : Logger("RegistrationTable", "/dtn/registration/table")
+    : Logger("RegistrationTable", "/dtn/registration/table"),
+      next_seqno_(0)
 {
 }
 
@@ -45,17 +57,13 @@ RegistrationTable::~RegistrationTable()
 bool
 RegistrationTable::find(u_int32_t regid, RegistrationList::iterator* iter)
 {
-    Registration* reg;
-
-    for (*iter = reglist_.begin(); *iter != reglist_.end(); ++(*iter)) {
-        reg = *(*iter);
-
-        if (reg->regid() == regid) {
-            return true;
-        }
+    RegIdIndex::iterator i = regid_index_.find(regid);
+    if (i == regid_index_.end()) {
+        return false;
     }
 
-    return false;
+    *iter = i->second;
+    return true;
 }
 
 //----------------------------------------------------------------------
@@ -78,17 +86,100 @@ RegistrationTable::get(u_int32_t regid) const
 Registration*
 RegistrationTable::get(const EndpointIDPattern& eid) const
 {
-    Registration* reg;
-    RegistrationList::const_iterator iter;
+    oasys::ScopeLock l(&lock_, "RegistrationTable");
+
+    // the index buckets are in table order, so the front is the first
+    // matching registration
+    EidIndex::const_iterator iter = endpoint_index_.find(eid.str());
+    if (iter == endpoint_index_.end()) {
+        return NULL;
+    }
     
-    for (iter = reglist_.begin(); iter != reglist_.end(); ++iter) {
-        reg = *iter;
-        if (reg->endpoint().equals(eid)) {
-            return reg;
-        }
+    ASSERT(!iter->second.empty());
+    return iter->second.front().reg_;
+}
+
+//----------------------------------------------------------------------
+bool
+RegistrationTable::index_key(const EndpointIDPattern& pattern,
+                             EidIndex** index, std::string* key)
+{
+    if (! is_dtn_uri(pattern) ||
+        pattern.uri().host().find('*') != std::string::npos)
+    {
+        return false;
+    }
+
+    if (pattern.uri().path().find('*') == std::string::npos) {
+        *index = &exact_index_;
+        *key   = DTNScheme::exact_key(pattern.uri());
+    } else {
+        *index = &host_index_;
+        *key   = pattern.uri().host();
     }
     
-    return NULL;
+    return true;
+}
+
+//----------------------------------------------------------------------
+void
+RegistrationTable::unindex(EidIndex* index, const std::string& key,
+                           Registration* reg)
+{
+    EidIndex::iterator iter = index->find(key);
+    ASSERT(iter != index->end());
+    
+    IndexEntryVec::iterator entry;
+    for (entry = iter->second.begin(); entry != iter->second.end(); ++entry) {
+        if (entry->reg_ == reg) {
+            iter->second.erase(entry);
+            break;
+        }
+    }
+
+    if (iter->second.empty()) {
+        index->erase(iter);
+    }
+}
+
+//----------------------------------------------------------------------
+void
+RegistrationTable::get_candidates(const EndpointID& eid,
+                                  IndexEntryVec* candidates) const
+{
+    // dtn registrations never match eids of other schemes
+    if (! is_dtn_uri(eid)) {
+        candidates->insert(candidates->end(),
+                           other_entries_.begin(), other_entries_.end());
+        return;
+    }
+
+    if (DTNScheme::has_wildcard(eid.uri())) {
+        u_int64_t seqno = 0;
+        RegistrationList::const_iterator iter;
+        for (iter = reglist_.begin(); iter != reglist_.end(); ++iter) {
+            candidates->push_back(IndexEntry(seqno++, *iter));
+        }
+        return;
+    }
+
+    candidates->insert(candidates->end(),
+                       other_entries_.begin(), other_entries_.end());
+
+    EidIndex::const_iterator iter =
+        exact_index_.find(DTNScheme::exact_key(eid.uri()));
+    if (iter != exact_index_.end()) {
+        candidates->insert(candidates->end(),
+                           iter->second.begin(), iter->second.end());
+    }
+
+    iter = host_index_.find(eid.uri().host());
+    if (iter != host_index_.end()) {
+        candidates->insert(candidates->end(),
+                           iter->second.begin(), iter->second.end());
+    }
+
+    std::sort(candidates->begin(), candidates->end());
 }
 
 //----------------------------------------------------------------------
@@ -97,9 +188,27 @@ RegistrationTable::add(Registration* reg, bool add_to_store)
 {
     oasys::ScopeLock l(&lock_, "RegistrationTable");
 
-    // put it in the list
+    // put it in the list and the indexes
     reglist_.push_back(reg);
 
+    RegistrationList::iterator last = reglist_.end();
+    --last;
+    if (! regid_index_.insert(RegIdIndex::value_type(reg->regid(), last)).second) {
+        log_warn("registration id %d is already in the table", reg->regid());
+    }
+
+    IndexEntry entry(next_seqno_++, reg);
+    endpoint_index_[reg->endpoint().str()].push_back(entry);
+
+    EidIndex* index;
+    std::string key;
+    if (index_key(reg->endpoint(), &index, &key)) {
+        (*index)[key].push_back(entry);
+    } else {
+        other_entries_.push_back(entry);
+    }
+    demux_cache_.clear();
+
     // don't store (or log) default registrations 
     if (!add_to_store || reg->regid() <= Registration::MAX_RESERVED_REGID) {
         return true;
@@ -147,7 +256,29 @@ RegistrationTable::del(u_int32_t regid)
         return false;
     }
 
+    Registration* reg = *iter;
     reglist_.erase(iter);
+    regid_index_.erase(regid);
+
+    unindex(&endpoint_index_, reg->endpoint().str(), reg);
+
+    EidIndex* index;
+    std::string key;
+    if (index_key(reg->endpoint(), &index, &key)) {
+        unindex(index, key, reg);
+    } else {
+        IndexEntryVec::iterator entry;
+        for (entry = other_entries_.begin();
+             entry != other_entries_.end(); ++entry)
+        {
+            if (entry->reg_ == reg) {
+                other_entries_.erase(entry);
+                break;
+            }
+        }
+    }
+    
+    demux_cache_.clear();
 
     return true;
 }
@@ -186,20 +317,36 @@ RegistrationTable::get_matching(const EndpointID& demux,
 
     int count = 0;
     
-    RegistrationList::const_iterator iter;
-    Registration* reg;
-
     log_debug("get_matching %s", demux.c_str());
 
-    for (iter = reglist_.begin(); iter != reglist_.end(); ++iter) {
-        reg = *iter;
+    DemuxCache::iterator cached = demux_cache_.find(demux.str());
+    if (cached == demux_cache_.end()) {
+        if (demux_cache_.size() >= MAX_CACHED_DEMUX) {
+            demux_cache_.clear();
+        }
 
-        if (reg->endpoint().match(demux)) {
-            log_debug("matched registration %d %s",
-                      reg->regid(), reg->endpoint().c_str());
-            count++;
-            reg_list->push_back(reg);
+        IndexEntryVec candidates;
+        get_candidates(demux, &candidates);
+
+        std::vector<Registration*> matches;
+        IndexEntryVec::const_iterator iter;
+        for (iter = candidates.begin(); iter != candidates.end(); ++iter) {
+            Registration* reg = iter->reg_;
+            if (reg->endpoint().match(demux)) {
+                log_debug("matched registration %d %s",
+                          reg->regid(), reg->endpoint().c_str());
+                matches.push_back(reg);
+            }
         }
+
+        cached = demux_cache_.insert(
+            DemuxCache::value_type(demux.str(), matches)).first;
+    }
+
+    std::vector<Registration*>::const_iterator iter;
+    for (iter = cached->second.begin(); iter != cached->second.end(); ++iter) {
+        count++;
+        reg_list->push_back(*iter);
     }
 
     log_debug("get_matching %s: returned %d matches", demux.c_str(), count);
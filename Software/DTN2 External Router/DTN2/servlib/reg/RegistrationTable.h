@@ -18,8 +18,10 @@
 #define _REGISTRATION_TABLE_H_
 
 #include <string>
+#include <vector>
 #include <oasys/debug/DebugUtils.h>
 #include <oasys/util/StringBuffer.h>
+#include <oasys/util/StringUtils.h>
 
 #include "Registration.h"
 
@@ -28,6 +30,14 @@ namespace dtn {
 /**
  * Class for the in-memory registration table. All changes to the
  * table are made persistent via the RegistrationStore.
+ *
+ * Besides the flat list, the registrations are indexed by id and by
+ * endpoint, and get_matching() only checks the registrations that
+ * can match the bundle demux eid: dtn registrations without wildcards
+ * are hashed by host, port and path, dtn registrations with a
+ * wildcard path are hashed by host, and the others (wildcard hosts,
+ * other schemes) are always checked. The matches are also cached per
+ * demux eid until a registration is added or removed.
  */
 class RegistrationTable : public oasys::Logger {
 public:
@@ -112,13 +122,72 @@ protected:
      */
     bool find(u_int32_t regid, RegistrationList::iterator* iter);
 
+    /// Maximum number of demux eids whose matches are cached
+    static const size_t MAX_CACHED_DEMUX = 4096;
+
+    /// Indexed registration, with its sequence number in the table
+    struct IndexEntry {
+        IndexEntry(u_int64_t seqno, Registration* reg)
+            : seqno_(seqno), reg_(reg) {}
+
+        bool operator<(const IndexEntry& other) const
+        {
+            return seqno_ < other.seqno_;
+        }
+
+        u_int64_t     seqno_;
+        Registration* reg_;
+    };
+
+    /// Index entries, always kept in table order
+    typedef std::vector<IndexEntry> IndexEntryVec;
+    
+    typedef oasys::StringHashMap<IndexEntryVec> EidIndex;
+    typedef _std::hash_map<u_int32_t, RegistrationList::iterator> RegIdIndex;
+    typedef oasys::StringHashMap<std::vector<Registration*> > DemuxCache;
+
+    /**
+     * Find the demux index and key of a registration endpoint.
+     * Returns false if the registration goes in other_entries_.
+     */
+    bool index_key(const EndpointIDPattern& pattern,
+                   EidIndex** index, std::string* key);
+
+    /// Remove a registration from an index bucket, erasing the
+    /// bucket if it becomes empty
+    void unindex(EidIndex* index, const std::string& key, Registration* reg);
+
+    /// Collect the indexed registrations that may match the eid
+    void get_candidates(const EndpointID& eid,
+                        IndexEntryVec* candidates) const;
+
     /**
-     * All registrations are tabled in-memory in a flat list. It's
-     * non-obvious what else would be better since we need to do a
-     * prefix match on demux strings in matching_registrations.
+     * All registrations are tabled in-memory in a flat list, in the
+     * order in which they were added.
      */
     RegistrationList reglist_;
 
+    /// Registrations by id, pointing into reglist_
+    RegIdIndex regid_index_;
+
+    /// Registrations by endpoint pattern string
+    EidIndex endpoint_index_;
+
+    /// dtn registrations without wildcards, by host, port and path
+    EidIndex exact_index_;
+
+    /// dtn registrations with a wildcard path only, by host
+    EidIndex host_index_;
+
+    /// Registrations that have to be checked for every demux eid
+    IndexEntryVec other_entries_;
+
+    /// Sequence number of the next registration added
+    u_int64_t next_seqno_;
+
+    /// Cached get_matching results, by demux eid
+    mutable DemuxCache demux_cache_;
+
     /**
      * Lock to protect internal data structures.
      */
@@ -18,11 +18,23 @@
 #  include <dtn-config.h>
 #endif
 
+#include <algorithm>
+
 #include "BundleRouter.h"
 #include "RouteTable.h"
+#include "naming/DTNScheme.h"
 
 namespace dtn {
 
+//----------------------------------------------------------------------
+RouteTable::HostNode::~HostNode()
+{
+    std::map<char, HostNode*>::iterator iter;
+    for (iter = children_.begin(); iter != children_.end(); ++iter) {
+        delete iter->second;
+    }
+}
+
 //----------------------------------------------------------------------
 RouteTable::RouteTable(const std::string& router_name)
     : Logger("RouteTable", "/dtn/routing/%s/table", router_name.c_str())
@@ -43,6 +55,8 @@ RouteTable::add_entry(RouteEntry* entry)
     log_debug("add_route *%p", entry);
 
     route_table_.push_back(entry);
+    index_entry(route_table_.size() - 1, entry);
+    lookup_cache_.clear();
     
     return true;
 }
@@ -64,6 +78,7 @@ RouteTable::del_entry(const EndpointIDPattern& dest, const LinkRef& next_hop)
             
             route_table_.erase(iter);
             delete entry;
+            rebuild_index();
             return true;
         }
     }    
@@ -100,6 +115,129 @@ RouteTable::clear()
         delete *iter;
     }
     route_table_.clear();
+    rebuild_index();
+}
+
+//----------------------------------------------------------------------
+void
+RouteTable::index_entry(size_t pos, RouteEntry* entry)
+{
+    const EndpointIDPattern& pattern = entry->dest_pattern();
+
+    if (! pattern.known_scheme() ||
+        pattern.scheme() != DTNScheme::instance() ||
+        ! pattern.uri().valid())
+    {
+        other_entries_.push_back(IndexEntry(pos, entry));
+        return;
+    }
+
+    std::string host = pattern.uri().host();
+    size_t wildcard = host.find('*');
+
+    if (wildcard == std::string::npos &&
+        pattern.uri().path().find('*') == std::string::npos)
+    {
+        exact_index_[DTNScheme::exact_key(pattern.uri())].push_back(IndexEntry(pos, entry));
+        return;
+    }
+
+    // walk (and grow) the trie along the literal part of the host
+    size_t len = (wildcard == std::string::npos) ? host.length() : wildcard;
+    HostNode* node = &host_trie_;
+    for (size_t i = 0; i < len; ++i) {
+        HostNode*& child = node->children_[host[i]];
+        if (child == NULL) {
+            child = new HostNode();
+        }
+        node = child;
+    }
+
+    if (wildcard == std::string::npos) {
+        node->host_entries_.push_back(IndexEntry(pos, entry));
+    } else {
+        node->prefix_entries_.push_back(IndexEntry(pos, entry));
+    }
+}
+
+//----------------------------------------------------------------------
+void
+RouteTable::rebuild_index()
+{
+    exact_index_.clear();
+    other_entries_.clear();
+    
+    std::map<char, HostNode*>::iterator iter;
+    for (iter = host_trie_.children_.begin();
+         iter != host_trie_.children_.end(); ++iter)
+    {
+        delete iter->second;
+    }
+    host_trie_.children_.clear();
+    host_trie_.prefix_entries_.clear();
+    host_trie_.host_entries_.clear();
+
+    for (size_t pos = 0; pos < route_table_.size(); ++pos) {
+        index_entry(pos, route_table_[pos]);
+    }
+
+    lookup_cache_.clear();
+}
+
+//----------------------------------------------------------------------
+void
+RouteTable::get_candidates(const EndpointID& eid,
+                           IndexEntryVec* candidates) const
+{
+    candidates->insert(candidates->end(),
+                       other_entries_.begin(), other_entries_.end());
+
+    // dtn patterns never match eids of other schemes
+    if (! eid.known_scheme() || eid.scheme() != DTNScheme::instance() ||
+        ! eid.uri().valid())
+    {
+        return;
+    }
+
+    if (DTNScheme::has_wildcard(eid.uri())) {
+        candidates->clear();
+        for (size_t pos = 0; pos < route_table_.size(); ++pos) {
+            candidates->push_back(IndexEntry(pos, route_table_[pos]));
+        }
+        return;
+    }
+
+    ExactIndex::const_iterator exact =
+        exact_index_.find(DTNScheme::exact_key(eid.uri()));
+    if (exact != exact_index_.end()) {
+        candidates->insert(candidates->end(),
+                           exact->second.begin(), exact->second.end());
+    }
+
+    std::string host = eid.uri().host();
+    const HostNode* node = &host_trie_;
+    size_t i = 0;
+    while (true) {
+        candidates->insert(candidates->end(),
+                           node->prefix_entries_.begin(),
+                           node->prefix_entries_.end());
+        if (i == host.length()) {
+            candidates->insert(candidates->end(),
+                               node->host_entries_.begin(),
+                               node->host_entries_.end());
+            break;
+        }
+
+        std::map<char, HostNode*>::const_iterator child =
+            node->children_.find(host[i]);
+        if (child == node->children_.end()) {
+            break;
+        }
+        node = child->second;
+        ++i;
+    }
+
+    std::sort(candidates->begin(), candidates->end());
 }
 
 //----------------------------------------------------------------------
@@ -110,11 +248,39 @@ RouteTable::get_matching(const EndpointID& eid,
 {
     oasys::ScopeLock l(&lock_, "RouteTable::get_matching");
 
-    bool loop = false;
     log_debug("get_matching %s (link %s)...", eid.c_str(),
               next_hop != NULL ? next_hop->name() : "NULL");
-    size_t ret = get_matching_helper(eid, next_hop, entry_vec, &loop, 0);
-    if (loop) {
+
+    // the matches for a given next hop are the ones for all links
+    // that use it, so only the latter are cached
+    LookupCache::iterator cached = lookup_cache_.find(eid.str());
+    if (cached == lookup_cache_.end()) {
+        if (lookup_cache_.size() >= MAX_CACHED_LOOKUPS) {
+            lookup_cache_.clear();
+        }
+
+        CachedLookup lookup;
+        lookup.loop_ = false;
+        LinkRef null_link("RouteTable::get_matching: null");
+        get_matching_helper(eid, null_link, &lookup.entries_, &lookup.loop_, 0);
+        cached = lookup_cache_.insert(std::make_pair(eid.str(), lookup)).first;
+    }
+
+    const CachedLookup& lookup = cached->second;
+    size_t ret = 0;
+    RouteEntryVec::const_iterator iter;
+    for (iter = lookup.entries_.begin(); iter != lookup.entries_.end(); ++iter) {
+        if (next_hop != NULL && (*iter)->link() != next_hop) {
+            continue;
+        }
+
+        if (std::find(entry_vec->begin(), entry_vec->end(), *iter) == entry_vec->end()) {
+            entry_vec->push_back(*iter);
+            ++ret;
+        }
+    }
+
+    if (lookup.loop_) {
         log_warn("route destination %s caused route table lookup loop",
                  eid.c_str());
     }
@@ -129,13 +295,16 @@ RouteTable::get_matching_helper(const EndpointID& eid,
                                 bool*             loop,
                                 int               level) const
 {
-    RouteEntryVec::const_iterator iter;
+    IndexEntryVec candidates;
+    IndexEntryVec::const_iterator iter;
     RouteEntry* entry;
     size_t count = 0;
 
-    for (iter = route_table_.begin(); iter != route_table_.end(); ++iter)
+    get_candidates(eid, &candidates);
+
+    for (iter = candidates.begin(); iter != candidates.end(); ++iter)
     {
-        entry = *iter;
+        entry = iter->entry_;
 
         log_debug("check entry *%p", entry);
 
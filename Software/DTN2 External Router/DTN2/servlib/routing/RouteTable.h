@@ -17,6 +17,7 @@
 #ifndef _BUNDLE_ROUTETABLE_H_
 #define _BUNDLE_ROUTETABLE_H_
 
+#include <map>
 #include <set>
 #include <oasys/debug/Log.h>
 #include <oasys/util/StringBuffer.h>
@@ -30,6 +31,15 @@ namespace dtn {
 /**
  * Class that implements the routing table, implemented
  * with an stl vector.
+ *
+ * To avoid matching every entry's pattern on each lookup, the entries
+ * with dtn scheme patterns are also indexed: patterns without any
+ * wildcard by host, port and path in a hash table, and the others by
+ * the literal prefix of their host (i.e. up to the first wildcard) in
+ * a trie. Patterns of the other schemes are always checked. Lookups
+ * only run the pattern match on the entries found this way, in table
+ * order, and their results are cached per destination until the
+ * table is modified.
  */
 class RouteTable : public oasys::Logger {
 public:
@@ -129,9 +139,72 @@ protected:
                                bool*             loop,
                                int               level) const;
     
+    /// Maximum number of destinations whose lookup results are cached
+    static const size_t MAX_CACHED_LOOKUPS = 4096;
+
+    /// Indexed route entry, with its position in the table
+    struct IndexEntry {
+        IndexEntry(size_t pos, RouteEntry* entry)
+            : pos_(pos), entry_(entry) {}
+
+        bool operator<(const IndexEntry& other) const
+        {
+            return pos_ < other.pos_;
+        }
+
+        size_t      pos_;
+        RouteEntry* entry_;
+    };
+
+    typedef std::vector<IndexEntry> IndexEntryVec;
+
+    /// Node of the host prefix trie
+    struct HostNode {
+        ~HostNode();
+
+        /// Entries whose host pattern has this literal prefix
+        IndexEntryVec prefix_entries_;
+
+        /// Entries whose (literal) host pattern ends here
+        IndexEntryVec host_entries_;
+
+        std::map<char, HostNode*> children_;
+    };
+
+    /// Cached results of a lookup
+    struct CachedLookup {
+        RouteEntryVec entries_;
+        bool          loop_;
+    };
+
+    typedef oasys::StringHashMap<IndexEntryVec> ExactIndex;
+    typedef oasys::StringHashMap<CachedLookup>  LookupCache;
+
+    /// Index an entry at the given position in the table
+    void index_entry(size_t pos, RouteEntry* entry);
+
+    /// Index all the entries again, after some were removed
+    void rebuild_index();
+
+    /// Collect the entries whose pattern may match the eid, in table
+    /// order
+    void get_candidates(const EndpointID& eid, IndexEntryVec* candidates) const;
+
     /// The routing table itself
     RouteEntryVec route_table_;
 
+    /// Entries with a dtn pattern without wildcards, by host:port/path
+    ExactIndex exact_index_;
+
+    /// Other entries with a dtn pattern, by literal host prefix
+    HostNode host_trie_;
+
+    /// Entries with a pattern of any other scheme
+    IndexEntryVec other_entries_;
+
+    /// Lookup results, by destination
+    mutable LookupCache lookup_cache_;
+
     /**
      * Lock to protect internal data structures.
      */
@@ -170,6 +243,7 @@ RouteTable::del_matching_entries(Predicate pred)
         std::remove_if(route_table_.begin(), route_table_.end(),
                        std::bind2nd(std::equal_to<RouteEntry*>(), 0));
     route_table_.erase(new_end, route_table_.end());
+    rebuild_index();
     
     return old_size - route_table_.size();
 }
@@ -18,6 +18,8 @@
 #  include <dtn-config.h>
 #endif
 
+#include <set>
+
 #include "TableBasedRouter.h"
 #include "RouteTable.h"
 #include "bundling/BundleActions.h"
@@ -52,7 +54,7 @@ void
 TableBasedRouter::add_route(RouteEntry *entry)
 {
     route_table_->add_entry(entry);
-    handle_changed_routes();
+    handle_added_route(entry);
 }
 
 //----------------------------------------------------------------------
@@ -79,6 +81,39 @@ TableBasedRouter::handle_changed_routes()
     reroute_all_sessions();
 }
 
+//----------------------------------------------------------------------
+void
+TableBasedRouter::handle_added_route(RouteEntry* entry)
+{
+    reception_cache_.evict_all();
+
+    // a route to an endpoint may now resolve through the new route,
+    // affecting bundles that don't match it, so in that case
+    // everything has to be rerouted
+    bool recursive = false;
+    {
+        oasys::ScopeLock l(route_table_->lock(),
+                           "TableBasedRouter::handle_added_route");
+        RouteEntryVec::const_iterator iter;
+        for (iter = route_table_->route_table()->begin();
+             iter != route_table_->route_table()->end(); ++iter)
+        {
+            if ((*iter)->link() == NULL) {
+                recursive = true;
+                break;
+            }
+        }
+    }
+
+    if (recursive) {
+        reroute_all_bundles();
+    } else {
+        reroute_matching_bundles(entry->dest_pattern());
+    }
+    
+    reroute_all_sessions();
+}
+
 //----------------------------------------------------------------------
 void
 TableBasedRouter::handle_event(BundleEvent* event)
@@ -728,10 +763,57 @@ int
 TableBasedRouter::route_bundle(Bundle* bundle)
 {
     RouteEntryVec matches;
-    RouteEntryVec::iterator iter;
 
     log_debug("route_bundle: checking bundle %d", bundle->bundleid());
 
+    LinkRef null_link("TableBasedRouter::route_bundle");
+    route_table_->get_matching(bundle->dest(), null_link, &matches);
+
+    return fwd_to_routes(bundle, &matches);
+}
+
+//----------------------------------------------------------------------
+int
+TableBasedRouter::route_bundles(const std::vector<Bundle*>& bundles)
+{
+    // the bundles are routed in order, and the matching routes are
+    // looked up once per destination
+    typedef oasys::StringMap<RouteEntryVec> DestMatches;
+    DestMatches dests;
+
+    LinkRef null_link("TableBasedRouter::route_bundles");
+    int count = 0;
+
+    std::vector<Bundle*>::const_iterator iter;
+    for (iter = bundles.begin(); iter != bundles.end(); ++iter)
+    {
+        Bundle* bundle = *iter;
+
+        std::pair<DestMatches::iterator, bool> dest =
+            dests.insert(DestMatches::value_type(bundle->dest().str(),
+                                                 RouteEntryVec()));
+        if (dest.second) {
+            route_table_->get_matching(bundle->dest(), null_link,
+                                       &dest.first->second);
+        }
+
+        // fwd_to_routes sorts the routes for each bundle
+        RouteEntryVec routes(dest.first->second);
+        count += fwd_to_routes(bundle, &routes);
+    }
+
+    log_debug("route_bundles: routed %zu bundles to %zu destinations",
+              bundles.size(), dests.size());
+
+    return count;
+}
+
+//----------------------------------------------------------------------
+int
+TableBasedRouter::fwd_to_routes(Bundle* bundle, RouteEntryVec* matches)
+{
+    RouteEntryVec::iterator iter;
+
     // check to see if forwarding is suppressed to all nodes
     if (bundle->fwdlog()->get_count(EndpointIDPattern::WILDCARD_EID(),
                                     ForwardingInfo::SUPPRESSED) > 0)
@@ -742,18 +824,15 @@ TableBasedRouter::route_bundle(Bundle* bundle)
         return 0;
     }
     
-    LinkRef null_link("TableBasedRouter::route_bundle");
-    route_table_->get_matching(bundle->dest(), null_link, &matches);
-
     // sort the matching routes by priority, allowing subclasses to
     // override the way in which the sorting occurs
-    sort_routes(bundle, &matches);
+    sort_routes(bundle, matches);
 
     log_debug("route_bundle bundle id %d: checking %zu route entry matches",
-              bundle->bundleid(), matches.size());
+              bundle->bundleid(), matches->size());
     
     unsigned int count = 0;
-    for (iter = matches.begin(); iter != matches.end(); ++iter)
+    for (iter = matches->begin(); iter != matches->end(); ++iter)
     {
         RouteEntry* route = *iter;
         log_debug("checking route entry %p link %s (%p)",
@@ -888,13 +967,69 @@ TableBasedRouter::reroute_all_bundles()
     // XXX/demmer this should cancel previous scheduled transmissions
     // if any decisions have changed
 
+    std::vector<Bundle*> bundles;
+    bundles.reserve(pending_bundles_->size());
+    
     BundleList::iterator iter;
     for (iter = pending_bundles_->begin();
          iter != pending_bundles_->end();
          ++iter)
     {
-        route_bundle(*iter);
+        bundles.push_back(*iter);
+    }
+
+    route_bundles(bundles);
+}
+
+//----------------------------------------------------------------------
+void
+TableBasedRouter::reroute_matching_bundles(const EndpointIDPattern& dest)
+{
+    oasys::ScopeLock l(pending_bundles_->lock(), 
+                       "TableBasedRouter::reroute_matching_bundles");
+
+    // match the pattern once per destination rather than once per
+    // bundle
+    std::vector<EndpointID> dests;
+    pending_bundles_->get_dests(&dests);
+
+    std::vector<Bundle*> matching;
+    std::vector<EndpointID>::const_iterator iter;
+    for (iter = dests.begin(); iter != dests.end(); ++iter) {
+        if (dest.match(*iter)) {
+            pending_bundles_->find_all(*iter, &matching);
+        }
+    }
+
+    log_debug("reroute_matching_bundles %s: %zu of %zu pending bundles "
+              "match", dest.c_str(), matching.size(), pending_bundles_->size());
+
+    if (matching.empty()) {
+        return;
     }
+
+    // the index groups the bundles by destination, so put them back
+    // in the order of the pending list
+    std::vector<Bundle*> bundles;
+    if (matching.size() == pending_bundles_->size()) {
+        bundles.reserve(matching.size());
+        bundles.insert(bundles.end(), pending_bundles_->begin(),
+                       pending_bundles_->end());
+    } else {
+        std::set<Bundle*> matching_set(matching.begin(), matching.end());
+        bundles.reserve(matching.size());
+
+        BundleList::iterator bundle;
+        for (bundle = pending_bundles_->begin();
+             bundle != pending_bundles_->end(); ++bundle)
+        {
+            if (matching_set.count(*bundle) != 0) {
+                bundles.push_back(*bundle);
+            }
+        }
+    }
+
+    route_bundles(bundles);
 }
 
 //----------------------------------------------------------------------
@@ -17,6 +17,7 @@
 #ifndef _TABLE_BASED_ROUTER_H_
 #define _TABLE_BASED_ROUTER_H_
 
+#include <vector>
 #include <oasys/util/StringUtils.h>
 
 #include "BundleRouter.h"
@@ -112,6 +113,14 @@ protected:
      */
     void handle_changed_routes();
 
+    /**
+     * Update forwarding state due to a new route. Only the pending
+     * bundles whose destination matches the route are rerouted,
+     * unless the table has recursive routes that the new route may
+     * resolve.
+     */
+    void handle_added_route(RouteEntry* entry);
+
     /**
      * Try to forward a bundle to a next hop route.
      */
@@ -138,6 +147,26 @@ protected:
      */
     virtual int route_bundle(Bundle* bundle);
 
+    /**
+     * Route a set of bundles in order, looking up the route table
+     * only once for all the bundles with the same destination. The
+     * bundles must stay valid during the call, i.e. the pending list
+     * lock must be held if they were found on the pending list.
+     *
+     * Returns the total number of links on which the bundles were
+     * queued.
+     */
+    virtual int route_bundles(const std::vector<Bundle*>& bundles);
+
+    /**
+     * Helper for route_bundle and route_bundles that sorts the
+     * matching routes for the bundle and calls fwd_to_nexthop on the
+     * ones it should be forwarded to.
+     *
+     * Returns the number of links on which the bundle was queued.
+     */
+    int fwd_to_routes(Bundle* bundle, RouteEntryVec* matches);
+
     /**
      * Once a vector of matching routes has been found, sort the
      * vector. The default uses the route priority, breaking ties by
@@ -160,6 +189,13 @@ protected:
      */
     virtual void reroute_all_bundles();
 
+    /**
+     * Reroute the pending bundles with a destination matching the
+     * given pattern, found through the pending list's destination
+     * index, in the order of the pending list.
+     */
+    void reroute_matching_bundles(const EndpointIDPattern& dest);
+
     /**
      * Generic hook in response to the command line indication that we
      * should reroute all bundles.
@@ -89,6 +89,15 @@ Simulator::run_node_events()
                     next_timer = std::min(next_timer, next);
                 }
             }
+
+            next = node->run_expired_bundle_timers();
+            if (next != -1) {
+                if (next_timer == -1) {
+                    next_timer = next;
+                } else {
+                    next_timer = std::min(next_timer, next);
+                }
+            }
         
             log_debug("processing all bundle events for node %s", node->name());
             if (node->process_one_bundle_event()) {
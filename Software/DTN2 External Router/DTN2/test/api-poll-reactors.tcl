@@ -0,0 +1,25 @@
+#
+#    Copyright 2010 INRIA, Planete Team
+#
+#    Licensed under the Apache License, Version 2.0 (the "License");
+#    you may not use this file except in compliance with the License.
+#    You may obtain a copy of the License at
+#
+#        http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS,
+#    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#    See the License for the specific language governing permissions and
+#    limitations under the License.
+#
+
+#
+# The api-poll test, with the api clients served by two epoll reactor
+# threads instead of a thread per client.
+#
+
+source [file join [file dirname [info script]] api-poll.tcl]
+
+test::name api-poll-reactors
+conf::add dtnd * "api set reactors 2"
@@ -0,0 +1,210 @@
+/*
+ *    Copyright 2010 INRIA, Planete Team
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <dtn-config.h>
+#endif
+
+#include <poll.h>
+#include <unistd.h>
+#include <vector>
+
+#include <oasys/thread/Thread.h>
+#include <oasys/util/UnitTest.h>
+
+#include "bundling/BundleEventQueue.h"
+
+using namespace oasys;
+using namespace dtn;
+
+#define PRODUCERS 4
+#define EVENTS    100000
+#define BURST     100
+
+/**
+ * Event tagged with its producer and its rank among the producer's
+ * events.
+ */
+class TestEvent : public BundleEvent {
+public:
+    TestEvent(int producer, int seqno)
+        : BundleEvent(DAEMON_STATUS), producer_(producer), seqno_(seqno) {}
+
+    int producer_;
+    int seqno_;
+};
+
+/**
+ * Thread posting EVENTS events at the tail of the queue, pausing after
+ * each BURST events so that the queue keeps going back to empty.
+ */
+class Producer : public Thread {
+public:
+    Producer(BundleEventQueue* q, int id)
+        : Thread("Producer", CREATE_JOINABLE), q_(q), id_(id) {}
+
+    void run() {
+        for (int i = 0; i < EVENTS; ++i) {
+            q_->push(new TestEvent(id_, i));
+            if ((i % BURST) == BURST - 1) {
+                usleep(10);
+            }
+        }
+    }
+
+    BundleEventQueue* q_;
+    int id_;
+};
+
+// Return whether the queue's file descriptor is readable
+static bool
+readable(BundleEventQueue* q, int timeout)
+{
+    struct pollfd pfd;
+    pfd.fd      = q->read_fd();
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, timeout) == 1;
+}
+
+DECLARE_TEST(Wakeup) {
+    BundleEventQueue q("/test");
+    BundleEvent* e;
+
+    CHECK(! readable(&q, 0));
+    CHECK(! q.try_pop(&e));
+
+    // only the empty to non-empty transition notifies
+    q.push(new TestEvent(0, 0));
+    CHECK(readable(&q, 0));
+    q.clear();
+    CHECK(! readable(&q, 0));
+    q.push(new TestEvent(0, 1));
+    CHECK(! readable(&q, 0));
+    CHECK_EQUAL(q.size(), 2);
+
+    CHECK(q.try_pop(&e));
+    CHECK_EQUAL(((TestEvent*)e)->seqno_, 0);
+    delete e;
+    CHECK(q.try_pop(&e));
+    CHECK_EQUAL(((TestEvent*)e)->seqno_, 1);
+    delete e;
+    CHECK(! q.try_pop(&e));
+    CHECK_EQUAL(q.size(), 0);
+
+    // the queue notifies again once drained
+    q.push(new TestEvent(0, 2));
+    CHECK(readable(&q, 0));
+    q.clear();
+    CHECK(q.try_pop(&e));
+    delete e;
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(PriorityLane) {
+    BundleEventQueue q("/test");
+    BundleEvent* e;
+
+    q.push(new TestEvent(0, 0));
+    q.push(new TestEvent(0, 1));
+    q.push(new TestEvent(1, 0), false);
+    q.push(new TestEvent(1, 1), false);
+    CHECK_EQUAL(q.size(), 4);
+
+    // the head events come first, each lane in posting order
+    int expected[4][2] = { {1, 0}, {1, 1}, {0, 0}, {0, 1} };
+    for (int i = 0; i < 4; ++i) {
+        CHECK(q.try_pop(&e));
+        CHECK_EQUAL(((TestEvent*)e)->producer_, expected[i][0]);
+        CHECK_EQUAL(((TestEvent*)e)->seqno_, expected[i][1]);
+        delete e;
+    }
+    CHECK(! q.try_pop(&e));
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(ManyProducers) {
+    BundleEventQueue q("/test");
+    Producer* producers[PRODUCERS];
+    std::vector<int> next(PRODUCERS, 0);
+    int received = 0;
+    int out_of_order = 0;
+    int waits = 0;
+
+    for (int i = 0; i < PRODUCERS; ++i) {
+        producers[i] = new Producer(&q, i);
+    }
+    for (int i = 0; i < PRODUCERS; ++i) {
+        producers[i]->start();
+    }
+
+    // consume the way the daemon does: drain while the queue is
+    // non-empty, otherwise wait for the wakeup. a lost wakeup shows
+    // as a timeout while events are still expected.
+    while (received < PRODUCERS * EVENTS) {
+        if (q.size() > 0) {
+            BundleEvent* e;
+            bool popped = false;
+            while (q.try_pop(&e)) {
+                TestEvent* te = (TestEvent*)e;
+                if (te->seqno_ != next[te->producer_]) {
+                    ++out_of_order;
+                }
+                next[te->producer_] = te->seqno_ + 1;
+                ++received;
+                popped = true;
+                delete e;
+            }
+            if (! popped) {
+                Thread::yield();
+            }
+            continue;
+        }
+
+        ++waits;
+        if (! readable(&q, 5000)) {
+            break;
+        }
+        q.clear();
+    }
+
+    for (int i = 0; i < PRODUCERS; ++i) {
+        producers[i]->join();
+        delete producers[i];
+    }
+
+    log_always_p("/test", "received %d events, waited %d times",
+                 received, waits);
+    CHECK_EQUAL(received, PRODUCERS * EVENTS);
+    CHECK_EQUAL(out_of_order, 0);
+    for (int i = 0; i < PRODUCERS; ++i) {
+        CHECK_EQUAL(next[i], EVENTS);
+    }
+    CHECK_EQUAL(q.size(), 0);
+    CHECK(waits > 1);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(BundleEventQueueTest) {
+    ADD_TEST(Wakeup);
+    ADD_TEST(PriorityLane);
+    ADD_TEST(ManyProducers);
+}
+
+DECLARE_TEST_FILE(BundleEventQueueTest, "bundle event queue test");
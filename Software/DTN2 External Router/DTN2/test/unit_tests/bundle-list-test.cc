@@ -18,11 +18,13 @@
 #  include <dtn-config.h>
 #endif
 
+#include <algorithm>
 #include <oasys/util/UnitTest.h>
 #include <oasys/util/Time.h>
 #include <oasys/util/Random.h>
 
 #include "bundling/Bundle.h"
+#include "bundling/BundleDaemon.h"
 #include "bundling/BundleList.h"
 
 using namespace oasys;
@@ -38,6 +40,10 @@ BundleMappings::iterator map_iter;
 BundleList *l1, *l2, *l3;
 
 DECLARE_TEST(Init) {
+    // the first reference puts a bundle on the daemon's all_bundles
+    // list, which then holds a reference and the bundle's first mapping
+    BundleDaemon::init();
+
     for (int i = 0; i < MANY; ++i) {
         bundles[i] = new Bundle(oasys::Builder::builder());
         bundles[i]->test_set_bundleid(i);
@@ -57,7 +63,7 @@ DECLARE_TEST(Init) {
     CHECK_EQUAL(l3->size(), 0);
 
     for (int i = 0; i < COUNT; ++i) {
-        CHECK_EQUAL(bundles[i]->num_mappings(), 0);
+        CHECK_EQUAL(bundles[i]->num_mappings(), 1);
     }
 
     return UNIT_TEST_PASSED;
@@ -73,20 +79,20 @@ DECLARE_TEST(BasicPushPop) {
     CHECK(l1->front() == bundles[0]);
     CHECK(l1->back()  == bundles[0]);
     CHECK(l1->size() == 1);
-    CHECK(bundles[0]->num_mappings() == 1);
+    CHECK(bundles[0]->num_mappings() == 2);
 
     b = l1->pop_front();
     CHECK(l1->front() == NULL);
     CHECK(l1->back() == NULL);
     CHECK(l1->size() == 0);
-    CHECK(bundles[0]->num_mappings() == 0);
+    CHECK(bundles[0]->num_mappings() == 1);
     b = NULL;
     
     for (int i = 0; i < COUNT; ++i) {
         l1->push_back(bundles[i]);
         CHECK(l1->back() == bundles[i]);
         CHECK(bundles[i]->is_queued_on(l1));
-        CHECK_EQUAL(bundles[i]->refcount(), 2);
+        CHECK_EQUAL(bundles[i]->refcount(), 3);
     }
 
     CHECK(l1->front() == bundles[0]);
@@ -95,9 +101,9 @@ DECLARE_TEST(BasicPushPop) {
     for (int i = 0; i < COUNT; ++i) {
         b = l1->pop_front();
         CHECK(b == bundles[i]);
-        CHECK_EQUAL(b->refcount(), 2);
+        CHECK_EQUAL(b->refcount(), 3);
         b = NULL;
-        CHECK_EQUAL(bundles[i]->refcount(), 1);
+        CHECK_EQUAL(bundles[i]->refcount(), 2);
     }
 
     CHECK(l1->front() == NULL);
@@ -105,7 +111,7 @@ DECLARE_TEST(BasicPushPop) {
     
     for (int i = 0; i < COUNT; ++i) {
         l1->push_front(bundles[i]);
-        CHECK_EQUAL(bundles[i]->refcount(), 2);
+        CHECK_EQUAL(bundles[i]->refcount(), 3);
     }
 
     CHECK(!l1->empty());
@@ -115,7 +121,7 @@ DECLARE_TEST(BasicPushPop) {
         b = l1->pop_back();
         CHECK(b == bundles[i]);
         b = NULL;
-        CHECK_EQUAL(bundles[i]->refcount(), 1);
+        CHECK_EQUAL(bundles[i]->refcount(), 2);
     }
 
     CHECK(l1->empty());
@@ -135,22 +141,22 @@ DECLARE_TEST(ContainsAndErase) {
 
     CHECK(l1->erase(bundles[0]));
     CHECK(! l1->contains(bundles[0]));
-    CHECK_EQUAL(bundles[0]->refcount(), 1);
-    CHECK_EQUAL(bundles[0]->num_mappings(), 0);
+    CHECK_EQUAL(bundles[0]->refcount(), 2);
+    CHECK_EQUAL(bundles[0]->num_mappings(), 1);
     CHECK(!l1->empty());
     CHECK_EQUAL(l1->size(), COUNT - 1);
     
     CHECK(! l1->erase(bundles[0]));
     CHECK(! l1->contains(bundles[0]));
-    CHECK_EQUAL(bundles[0]->refcount(), 1);
-    CHECK_EQUAL(bundles[0]->num_mappings(), 0);
+    CHECK_EQUAL(bundles[0]->refcount(), 2);
+    CHECK_EQUAL(bundles[0]->num_mappings(), 1);
     CHECK(!l1->empty());
     CHECK_EQUAL(l1->size(), 9);
 
     CHECK(l1->erase(bundles[5]));
     CHECK(! l1->contains(bundles[5]));
-    CHECK_EQUAL(bundles[5]->refcount(), 1);
-    CHECK_EQUAL(bundles[5]->num_mappings(), 0);
+    CHECK_EQUAL(bundles[5]->refcount(), 2);
+    CHECK_EQUAL(bundles[5]->num_mappings(), 1);
     CHECK(! bundles[5]->is_queued_on(l1));
     CHECK(!l1->empty());
     CHECK_EQUAL(l1->size(), COUNT - 2);
@@ -162,8 +168,8 @@ DECLARE_TEST(ContainsAndErase) {
     CHECK(*iter == bundles[4]);
     DO(l1->erase(iter));
     CHECK(! l1->contains(bundles[4]));
-    CHECK_EQUAL(bundles[4]->refcount(), 1);
-    CHECK_EQUAL(bundles[4]->num_mappings(), 0);
+    CHECK_EQUAL(bundles[4]->refcount(), 2);
+    CHECK_EQUAL(bundles[4]->num_mappings(), 1);
     CHECK(! bundles[4]->is_queued_on(l1));
     CHECK(!l1->empty());
     CHECK_EQUAL(l1->size(), COUNT - 3);
@@ -180,8 +186,8 @@ DECLARE_TEST(ContainsAndErase) {
     for (int i = 0; i < COUNT; ++i) {
         CHECK(! l1->contains(bundles[i]));
         CHECK(! l1->erase(bundles[i]));
-        CHECK_EQUAL(bundles[i]->refcount(), 1);
-        CHECK_EQUAL(bundles[i]->num_mappings(), 0);
+        CHECK_EQUAL(bundles[i]->refcount(), 2);
+        CHECK_EQUAL(bundles[i]->num_mappings(), 1);
     }
 
     return UNIT_TEST_PASSED;
@@ -208,7 +214,7 @@ DECLARE_TEST(MultipleLists) {
     }
 
     b = bundles[0];
-    CHECK_EQUAL(b->num_mappings(), 3);
+    CHECK_EQUAL(b->num_mappings(), 4);
     b->lock()->lock("test lock");
     for (map_iter = b->mappings()->begin();
          map_iter != b->mappings()->end();
@@ -219,8 +225,8 @@ DECLARE_TEST(MultipleLists) {
         CHECK(l->contains(b));
     }
 
-    while (b->num_mappings() != 0) {
-        l = b->mappings()->front().list();
+    while (b->num_mappings() != 1) {
+        l = b->mappings()->back().list();
         b->lock()->unlock();
         CHECK(l->erase(b));
         b->lock()->lock("test lock");
@@ -228,7 +234,7 @@ DECLARE_TEST(MultipleLists) {
     }
 
     b->lock()->unlock();
-    CHECK_EQUAL(b->num_mappings(), 0);
+    CHECK_EQUAL(b->num_mappings(), 1);
 
     // list contents fall through to next test
     return UNIT_TEST_PASSED;
@@ -245,10 +251,10 @@ DECLARE_TEST(MultipleListRemoval) {
         ++iter; // increment before removal
 
         b->lock()->lock("test lock");
-        CHECK_EQUAL(b->num_mappings(), 3);
+        CHECK_EQUAL(b->num_mappings(), 4);
 
-        while (b->num_mappings() != 0) {
-            l = b->mappings()->front().list();
+        while (b->num_mappings() != 1) {
+            l = b->mappings()->back().list();
             
             CHECK(l->contains(b));
             b->lock()->unlock();
@@ -268,9 +274,9 @@ DECLARE_TEST(MultipleListRemoval) {
             continue;
         
         if ((i % 3) == 2) {
-            CHECK_EQUAL(bundles[i]->num_mappings(), 2);
+            CHECK_EQUAL(bundles[i]->num_mappings(), 3);
         } else {
-            CHECK_EQUAL(bundles[i]->num_mappings(), 0);
+            CHECK_EQUAL(bundles[i]->num_mappings(), 1);
         }
     }
 
@@ -278,7 +284,7 @@ DECLARE_TEST(MultipleListRemoval) {
     l2->clear();
     
     for (int i = 0; i < COUNT; ++i) {
-        CHECK_EQUAL(bundles[i]->num_mappings(), 0);
+        CHECK_EQUAL(bundles[i]->num_mappings(), 1);
     }
 
     return UNIT_TEST_PASSED;
@@ -300,6 +306,260 @@ DECLARE_TEST(MoveContents) {
     return UNIT_TEST_PASSED;
 }
 
+// Return the number of indexes (bundle id and GBOF ID) finding the
+// bundle on the list
+static int
+index_hits(BundleList* l, Bundle* b)
+{
+    int hits = 0;
+    BundleRef ref("index_hits temporary");
+    
+    ref = l->find(b->bundleid());
+    if (ref == b) {
+        ++hits;
+    }
+    
+    ref = l->find(b->source(), b->creation_ts());
+    if (ref == b) {
+        ++hits;
+    }
+
+    return hits;
+}
+
+DECLARE_TEST(IndexedLists) {
+    BundleList indexed("indexed");
+    BundleList other("other");
+    indexed.set_indexes(BundleList::INDEX_BUNDLEID | BundleList::INDEX_GBOFID);
+    other.set_indexes(BundleList::INDEX_BUNDLEID | BundleList::INDEX_GBOFID);
+
+    for (int i = 0; i < COUNT; ++i) {
+        bundles[i]->set_creation_ts(BundleTimestamp(1000, i));
+    }
+
+    for (int i = 0; i < COUNT; ++i) {
+        if ((i % 3) == 0) {
+            indexed.push_back(bundles[i]);
+        } else if ((i % 3) == 1) {
+            indexed.push_front(bundles[i]);
+        } else {
+            indexed.insert_random(bundles[i]);
+        }
+    }
+
+    for (int i = 0; i < COUNT; ++i) {
+        CHECK_EQUAL(index_hits(&indexed, bundles[i]), 2);
+        CHECK_EQUAL(index_hits(&other, bundles[i]), 0);
+    }
+    CHECK(indexed.find(COUNT) == NULL);
+
+    // erase by bundle and by iterator
+    CHECK(indexed.erase(bundles[3]));
+    CHECK_EQUAL(index_hits(&indexed, bundles[3]), 0);
+
+    indexed.lock()->lock("test lock");
+    iter = indexed.begin();
+    ++iter;
+    Bundle* b = *iter;
+    DO(indexed.erase(iter));
+    indexed.lock()->unlock();
+    CHECK_EQUAL(index_hits(&indexed, b), 0);
+
+    // pop from both ends
+    BundleRef ref("IndexedLists temporary");
+    ref = indexed.pop_front();
+    CHECK(ref != NULL);
+    CHECK_EQUAL(index_hits(&indexed, ref.object()), 0);
+    ref = indexed.pop_back();
+    CHECK(ref != NULL);
+    CHECK_EQUAL(index_hits(&indexed, ref.object()), 0);
+    ref = NULL;
+
+    CHECK_EQUAL(indexed.size(), COUNT - 4);
+    for (int i = 0; i < COUNT; ++i) {
+        CHECK_EQUAL(index_hits(&indexed, bundles[i]),
+                    indexed.contains(bundles[i]) ? 2 : 0);
+    }
+
+    // the bundles are indexed by the list they moved to
+    indexed.move_contents(&other);
+    CHECK_EQUAL(indexed.size(), 0);
+    CHECK_EQUAL(other.size(), COUNT - 4);
+    for (int i = 0; i < COUNT; ++i) {
+        CHECK_EQUAL(index_hits(&indexed, bundles[i]), 0);
+        CHECK_EQUAL(index_hits(&other, bundles[i]),
+                    other.contains(bundles[i]) ? 2 : 0);
+    }
+
+    // duplicates share a GBOF ID, each stays reachable until erased
+    std::vector<Bundle*> dups;
+    bundles[COUNT]->set_creation_ts(BundleTimestamp(2000, 0));
+    bundles[COUNT + 1]->set_creation_ts(BundleTimestamp(2000, 0));
+    other.push_back(bundles[COUNT]);
+    other.push_back(bundles[COUNT + 1]);
+    other.find_all(bundles[COUNT]->source(), bundles[COUNT]->creation_ts(),
+                   &dups);
+    CHECK_EQUAL(dups.size(), 2);
+
+    CHECK(other.erase(bundles[COUNT]));
+    dups.clear();
+    other.find_all(bundles[COUNT]->source(), bundles[COUNT]->creation_ts(),
+                   &dups);
+    CHECK_EQUAL(dups.size(), 1);
+    CHECK(dups[0] == bundles[COUNT + 1]);
+    CHECK(other.find(COUNT) == NULL);
+    CHECK(other.find(COUNT + 1) == bundles[COUNT + 1]);
+
+    // enabling an index covers the bundles already on the list
+    other.clear();
+    for (int i = 0; i < COUNT; ++i) {
+        indexed.push_back(bundles[i]);
+    }
+    BundleList late("late");
+    for (int i = 0; i < COUNT; ++i) {
+        late.push_back(bundles[i]);
+    }
+    late.set_indexes(BundleList::INDEX_BUNDLEID | BundleList::INDEX_GBOFID);
+    for (int i = 0; i < COUNT; ++i) {
+        CHECK_EQUAL(index_hits(&late, bundles[i]), 2);
+    }
+
+    indexed.clear();
+    late.clear();
+    for (int i = 0; i < COUNT + 2; ++i) {
+        CHECK_EQUAL(bundles[i]->num_mappings(), 1);
+    }
+
+    return UNIT_TEST_PASSED;
+}
+
+// Return the destinations of the list, sorted
+static std::vector<std::string>
+dest_strs(BundleList* l)
+{
+    std::vector<EndpointID> dests;
+    l->get_dests(&dests);
+
+    std::vector<std::string> strs;
+    for (size_t i = 0; i < dests.size(); ++i) {
+        strs.push_back(dests[i].str());
+    }
+    std::sort(strs.begin(), strs.end());
+    return strs;
+}
+
+// Return whether the indexed list and the unindexed one find the same
+// bundles for the destination, in the same order
+static bool
+same_dest_bundles(BundleList* indexed, BundleList* unindexed,
+                  const EndpointID& dest)
+{
+    std::vector<Bundle*> by_index, by_scan;
+    indexed->find_all(dest, &by_index);
+    unindexed->find_all(dest, &by_scan);
+    return by_index == by_scan;
+}
+
+DECLARE_TEST(DestIndex) {
+    BundleList indexed("indexed");
+    BundleList other("other");
+    BundleList unindexed("unindexed");
+    indexed.set_indexes(BundleList::INDEX_DEST);
+    other.set_indexes(BundleList::INDEX_DEST);
+
+    EndpointID a("dtn://a.dtn/app"), b("dtn://b.dtn/app"),
+        c("dtn://c.dtn/app"), unknown("dtn://d.dtn/app");
+    for (int i = 0; i < COUNT; ++i) {
+        if (i == COUNT - 1) {
+            bundles[i]->mutable_dest()->assign(c);
+        } else if ((i % 2) == 0) {
+            bundles[i]->mutable_dest()->assign(a);
+        } else {
+            bundles[i]->mutable_dest()->assign(b);
+        }
+    }
+
+    // pushed out of id order, found in id order
+    for (int i = COUNT - 1; i >= 0; --i) {
+        if ((i % 3) == 0) {
+            indexed.push_back(bundles[i]);
+        } else {
+            indexed.push_front(bundles[i]);
+        }
+        unindexed.push_back(bundles[i]);
+    }
+
+    std::vector<Bundle*> found;
+    indexed.find_all(a, &found);
+    CHECK_EQUAL(found.size(), (COUNT - 1 + 1) / 2);
+    for (size_t i = 0; i < found.size(); ++i) {
+        CHECK(found[i] == bundles[2 * i]);
+    }
+    CHECK(same_dest_bundles(&indexed, &unindexed, a));
+    CHECK(same_dest_bundles(&indexed, &unindexed, b));
+    CHECK(same_dest_bundles(&indexed, &unindexed, c));
+    found.clear();
+    indexed.find_all(unknown, &found);
+    CHECK(found.empty());
+
+    std::vector<std::string> dests = dest_strs(&indexed);
+    CHECK_EQUAL(dests.size(), 3);
+    CHECK(dests[0] == a.str());
+    CHECK(dests[1] == b.str());
+    CHECK(dests[2] == c.str());
+
+    // a destination goes away with its last bundle
+    CHECK(indexed.erase(bundles[COUNT - 1]));
+    CHECK(unindexed.erase(bundles[COUNT - 1]));
+    CHECK_EQUAL(dest_strs(&indexed).size(), 2);
+    CHECK(same_dest_bundles(&indexed, &unindexed, c));
+
+    BundleRef ref("DestIndex temporary");
+    ref = indexed.pop_front();
+    CHECK(unindexed.erase(ref.object()));
+    ref = indexed.pop_back();
+    CHECK(unindexed.erase(ref.object()));
+    ref = NULL;
+    CHECK(same_dest_bundles(&indexed, &unindexed, a));
+    CHECK(same_dest_bundles(&indexed, &unindexed, b));
+
+    // the destinations follow the bundles to the other list
+    size_t size = indexed.size();
+    indexed.move_contents(&other);
+    CHECK_EQUAL(other.size(), size);
+    CHECK_EQUAL(dest_strs(&indexed).size(), 0);
+    CHECK_EQUAL(dest_strs(&other).size(), 2);
+    CHECK(same_dest_bundles(&other, &unindexed, a));
+    CHECK(same_dest_bundles(&other, &unindexed, b));
+    found.clear();
+    indexed.find_all(a, &found);
+    CHECK(found.empty());
+
+    // enabling the index covers the bundles already on the list
+    other.clear();
+    unindexed.clear();
+    for (int i = 0; i < COUNT; ++i) {
+        unindexed.push_back(bundles[i]);
+    }
+    BundleList late("late");
+    for (int i = 0; i < COUNT; ++i) {
+        late.push_back(bundles[i]);
+    }
+    late.set_indexes(BundleList::INDEX_DEST);
+    CHECK_EQUAL(dest_strs(&late).size(), 3);
+    CHECK(same_dest_bundles(&late, &unindexed, a));
+    CHECK(same_dest_bundles(&late, &unindexed, b));
+    CHECK(same_dest_bundles(&late, &unindexed, c));
+
+    late.clear();
+    unindexed.clear();
+    for (int i = 0; i < COUNT; ++i) {
+        CHECK_EQUAL(bundles[i]->num_mappings(), 1);
+    }
+
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TEST(ManyBundles) {
     for (int i = 0; i < MANY; ++i) {
         l1->push_back(bundles[i]);
@@ -348,6 +608,8 @@ DECLARE_TESTER(BundleListTest) {
     ADD_TEST(MultipleLists);
     ADD_TEST(MultipleListRemoval);
     ADD_TEST(MoveContents);
+    ADD_TEST(IndexedLists);
+    ADD_TEST(DestIndex);
     ADD_TEST(ManyBundles);
 }
 
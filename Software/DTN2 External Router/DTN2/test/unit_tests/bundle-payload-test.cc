@@ -91,6 +91,57 @@ payload_test(BundlePayload::location_t location)
     return UNIT_TEST_PASSED;
 }
 
+#define COPY_LEN 10000
+#define COPY_SRC ".bundle-payload-test/copy-source"
+
+int
+copy_test(bool kernel_copy)
+{
+    u_char src[COPY_LEN], buf[COPY_LEN];
+    SpinLock l;
+
+    int errno_; const char* strerror_;
+
+    BundlePayload::test_no_kernel_copy_ = ! kernel_copy;
+
+    // more than one buffer of the copy done in user space
+    for (int i = 0; i < COPY_LEN; ++i) {
+        src[i] = 'a' + (i % 26);
+    }
+    FILE* f = fopen(COPY_SRC, "w");
+    CHECK(f != NULL);
+    CHECK_EQUAL(fwrite(src, 1, COPY_LEN, f), COPY_LEN);
+    fclose(f);
+
+    log_debug_p("/test", "checking replace_with_copy");
+    BundlePayload p(&l);
+    p.init(2, BundlePayload::DISK);
+    CHECK(p.replace_with_copy(COPY_SRC, COPY_LEN));
+    CHECK_EQUAL(p.location(), BundlePayload::DISK);
+    CHECK_EQUAL(p.length(), COPY_LEN);
+    CHECK(memcmp(p.read_data(0, COPY_LEN, buf), src, COPY_LEN) == 0);
+
+    // the copy isn't a link to the application's file
+    f = fopen(COPY_SRC, "r+");
+    CHECK(f != NULL);
+    CHECK_EQUAL(fwrite("XYZ", 1, 3, f), 3);
+    fclose(f);
+    CHECK(memcmp(p.read_data(0, COPY_LEN, buf), src, COPY_LEN) == 0);
+
+    log_debug_p("/test", "checking replace_with_copy of the wrong length");
+    BundlePayload shorter(&l);
+    shorter.init(3, BundlePayload::DISK);
+    CHECK(! shorter.replace_with_copy(COPY_SRC, COPY_LEN - 1));
+    BundlePayload longer(&l);
+    longer.init(4, BundlePayload::DISK);
+    CHECK(! longer.replace_with_copy(COPY_SRC, COPY_LEN + 1));
+
+    BundlePayload::test_no_kernel_copy_ = false;
+    unlink(COPY_SRC);
+
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TEST(MemoryPayloadTest) {
     return payload_test(BundlePayload::MEMORY);
 }
@@ -99,9 +150,19 @@ DECLARE_TEST(DiskPayloadTest) {
     return payload_test(BundlePayload::DISK);
 }
 
+DECLARE_TEST(KernelCopyTest) {
+    return copy_test(true);
+}
+
+DECLARE_TEST(BufferCopyTest) {
+    return copy_test(false);
+}
+
 DECLARE_TESTER(BundlePayloadTester) {
     ADD_TEST(MemoryPayloadTest);
     ADD_TEST(DiskPayloadTest);
+    ADD_TEST(KernelCopyTest);
+    ADD_TEST(BufferCopyTest);
 }
 
 int
@@ -0,0 +1,233 @@
+/*
+ *    Copyright 2010 INRIA, Planete Team
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <dtn-config.h>
+#endif
+
+#include <oasys/util/UnitTest.h>
+
+#include "bundling/BundleTimerWheel.h"
+
+using namespace oasys;
+using namespace dtn;
+
+// An arbitrary start time, not aligned on any wheel boundary
+#define START 1000000007ULL
+
+/**
+ * Timer wheel reading the time from a clock set by the test.
+ */
+class FakeClockWheel : public BundleTimerWheel {
+public:
+    FakeClockWheel(u_int64_t start) {
+        clock_.tv_sec  = start;
+        clock_.tv_usec = 0;
+    }
+
+    /**
+     * Run the wheel the way the daemon does, moving the clock to the
+     * time returned by each run, until the clock reaches end.
+     */
+    void run_until(u_int64_t end) {
+        while (true) {
+            int timeout = run_expired_timers();
+            if ((u_int64_t)clock_.tv_sec >= end) {
+                return;
+            }
+
+            u_int64_t secs = end - clock_.tv_sec;
+            if (timeout >= 0 && (u_int64_t)timeout / 1000 < secs) {
+                secs = timeout / 1000;
+            }
+            if (secs == 0 && timeout != 0) {
+                secs = 1;
+            }
+            clock_.tv_sec += secs;
+        }
+    }
+
+    struct timeval clock_;
+
+protected:
+    void get_time(struct timeval* now) { *now = clock_; }
+};
+
+/**
+ * Timer recording when it fired.
+ */
+class TestTimer : public BundleTimerWheel::Timer {
+public:
+    TestTimer() : fired_(0), fired_at_(0) {}
+
+    void timeout(const struct timeval& now) {
+        ++fired_;
+        fired_at_ = now.tv_sec;
+    }
+
+    int       fired_;
+    u_int64_t fired_at_;
+};
+
+// Schedule a timer the given number of seconds after the clock
+static void
+schedule_in(FakeClockWheel* w, TestTimer* t, u_int64_t secs, int usecs = 0)
+{
+    struct timeval when;
+    when.tv_sec  = w->clock_.tv_sec + secs;
+    when.tv_usec = usecs;
+    w->schedule_at(t, when);
+}
+
+DECLARE_TEST(RootWheel) {
+    FakeClockWheel w(START);
+    TestTimer t1, t10, t255, trounded, tpast;
+
+    CHECK_EQUAL(w.run_expired_timers(), -1);
+
+    schedule_in(&w, &t1, 1);
+    schedule_in(&w, &t10, 10);
+    schedule_in(&w, &t255, 255);
+    schedule_in(&w, &trounded, 5, 500000);
+    CHECK_EQUAL(w.num_pending_timers(), 4);
+
+    // the wheel sleeps until the first timer
+    CHECK_EQUAL(w.run_expired_timers(), 1000);
+    CHECK_EQUAL(t1.fired_, 0);
+
+    w.run_until(START + 300);
+    CHECK_EQUAL(t1.fired_, 1);
+    CHECK_EQUAL(t1.fired_at_, START + 1);
+    CHECK_EQUAL(t10.fired_, 1);
+    CHECK_EQUAL(t10.fired_at_, START + 10);
+    CHECK_EQUAL(t255.fired_, 1);
+    CHECK_EQUAL(t255.fired_at_, START + 255);
+    CHECK_EQUAL(trounded.fired_, 1);
+    CHECK_EQUAL(trounded.fired_at_, START + 6);
+    CHECK_EQUAL(w.num_pending_timers(), 0);
+
+    // a timer scheduled for a tick already run fires at the next run
+    schedule_in(&w, &t1, 1000);
+    struct timeval past;
+    past.tv_sec  = w.clock_.tv_sec - 10;
+    past.tv_usec = 0;
+    w.schedule_at(&tpast, past);
+    CHECK(w.run_expired_timers() > 0);
+    CHECK_EQUAL(tpast.fired_, 1);
+    CHECK_EQUAL(tpast.fired_at_, (u_int64_t)w.clock_.tv_sec);
+    CHECK(w.cancel(&t1));
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(Cascade) {
+    // one start in the middle of a root wheel turn, one just before
+    // the root wheel and the first upper wheel wrap
+    u_int64_t starts[2] = { START, (START | 0x3fff) };
+    u_int64_t delays[] = { 256, 257, 300, 511, 512, 4096, 16383, 16384,
+                           16385, 20000, 262143, 262144, (1 << 20) + 7,
+                           (1 << 22) + 12345 };
+    const int count = sizeof(delays) / sizeof(delays[0]);
+
+    for (int s = 0; s < 2; ++s) {
+        FakeClockWheel w(starts[s]);
+        TestTimer timers[count];
+
+        for (int i = 0; i < count; ++i) {
+            schedule_in(&w, &timers[i], delays[i]);
+        }
+        CHECK_EQUAL(w.num_pending_timers(), (size_t)count);
+
+        w.run_until(starts[s] + (1 << 23));
+        for (int i = 0; i < count; ++i) {
+            CHECK_EQUAL(timers[i].fired_, 1);
+            CHECK_EQUAL(timers[i].fired_at_, starts[s] + delays[i]);
+        }
+        CHECK_EQUAL(w.num_pending_timers(), 0);
+    }
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(CancelAfterCascade) {
+    FakeClockWheel w(START);
+    TestTimer root_kept, root_cancelled, level_kept, level_cancelled;
+
+    // both pairs start in an upper wheel, and are cascaded down well
+    // before they expire
+    schedule_in(&w, &root_kept, 1000);
+    schedule_in(&w, &root_cancelled, 1000);
+    schedule_in(&w, &level_kept, 40000);
+    schedule_in(&w, &level_cancelled, 40000);
+
+    w.run_until(START + 990);
+    CHECK(w.cancel(&root_cancelled));
+    CHECK(! w.cancel(&root_cancelled));
+    CHECK(root_cancelled.cancelled());
+    CHECK_EQUAL(w.num_pending_timers(), 3);
+
+    w.run_until(START + 39000);
+    CHECK(w.cancel(&level_cancelled));
+    CHECK_EQUAL(w.num_pending_timers(), 1);
+
+    w.run_until(START + 50000);
+    CHECK_EQUAL(root_kept.fired_, 1);
+    CHECK_EQUAL(root_kept.fired_at_, START + 1000);
+    CHECK_EQUAL(root_cancelled.fired_, 0);
+    CHECK_EQUAL(level_kept.fired_, 1);
+    CHECK_EQUAL(level_kept.fired_at_, START + 40000);
+    CHECK_EQUAL(level_cancelled.fired_, 0);
+    CHECK_EQUAL(w.num_pending_timers(), 0);
+
+    // a fired timer can't be cancelled, but can be scheduled again
+    CHECK(! w.cancel(&root_kept));
+    schedule_in(&w, &root_kept, 300);
+    w.run_until(w.clock_.tv_sec + 300);
+    CHECK_EQUAL(root_kept.fired_, 2);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(FarFuture) {
+    FakeClockWheel w(START);
+    TestTimer top_level, beyond;
+
+    // in the last upper wheel, and beyond the span of all the wheels
+    schedule_in(&w, &top_level, (1 << 27) + 3);
+    schedule_in(&w, &beyond, 1ULL << 33);
+
+    w.run_until(START + (1 << 27) + 10);
+    CHECK_EQUAL(top_level.fired_, 1);
+    CHECK_EQUAL(top_level.fired_at_, START + (1 << 27) + 3);
+    CHECK_EQUAL(beyond.fired_, 0);
+    CHECK(beyond.pending());
+    CHECK_EQUAL(w.num_pending_timers(), 1);
+
+    CHECK(w.cancel(&beyond));
+    CHECK_EQUAL(w.num_pending_timers(), 0);
+    CHECK_EQUAL(w.run_expired_timers(), -1);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(BundleTimerWheelTest) {
+    ADD_TEST(RootWheel);
+    ADD_TEST(Cascade);
+    ADD_TEST(CancelAfterCascade);
+    ADD_TEST(FarFuture);
+}
+
+DECLARE_TEST_FILE(BundleTimerWheelTest, "bundle timer wheel test");
@@ -0,0 +1,197 @@
+/*
+ *    Copyright 2010 INRIA, Planete Team
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <dtn-config.h>
+#endif
+
+#include <vector>
+
+#include <oasys/util/UnitTest.h>
+
+#include "reg/APIRegistration.h"
+#include "reg/RegistrationTable.h"
+#include "storage/DTNStorageConfig.h"
+#include "storage/RegistrationStore.h"
+
+using namespace oasys;
+using namespace dtn;
+
+// Add an api registration for the pattern to the table
+static Registration*
+add_reg(RegistrationTable* t, u_int32_t regid, const char* pattern)
+{
+    Registration* reg = new APIRegistration(regid, EndpointIDPattern(pattern),
+                                            Registration::DEFER, 0, 0);
+    if (! t->add(reg)) {
+        delete reg;
+        return NULL;
+    }
+    return reg;
+}
+
+// Return the ids of the registrations get_matching finds for the eid
+static std::vector<u_int32_t>
+matching(RegistrationTable* t, const char* eid)
+{
+    RegistrationList regs;
+    t->get_matching(EndpointID(eid), &regs);
+
+    std::vector<u_int32_t> ids;
+    RegistrationList::const_iterator iter;
+    for (iter = regs.begin(); iter != regs.end(); ++iter) {
+        ids.push_back((*iter)->regid());
+    }
+    return ids;
+}
+
+// Return the ids of the registrations matching the eid, found by
+// checking the whole table
+static std::vector<u_int32_t>
+scan(RegistrationTable* t, const char* eid)
+{
+    ScopeLock l(t->lock(), "scan");
+
+    EndpointID demux(eid);
+    std::vector<u_int32_t> ids;
+    RegistrationList::const_iterator iter;
+    for (iter = t->reg_list()->begin(); iter != t->reg_list()->end(); ++iter) {
+        if ((*iter)->endpoint().match(demux)) {
+            ids.push_back((*iter)->regid());
+        }
+    }
+    return ids;
+}
+
+DECLARE_TEST(Demux) {
+    RegistrationTable t;
+
+    CHECK(add_reg(&t, 10, "dtn://node1.dtn/app") != NULL);
+    CHECK(add_reg(&t, 11, "dtn://node*/app") != NULL);
+    CHECK(add_reg(&t, 12, "dtn://node1.dtn/*") != NULL);
+    CHECK(add_reg(&t, 13, "dtn://node1.dtn/app") != NULL);
+    CHECK(add_reg(&t, 14, "dtn://*") != NULL);
+    CHECK(add_reg(&t, 15, "dtn://node1.dtn:4556/app") != NULL);
+    CHECK(add_reg(&t, 16, "str:node1") != NULL);
+    CHECK(add_reg(&t, 17, "dtn://node2.dtn/app") != NULL);
+
+    // matches come back in table order, whatever index they are in
+    std::vector<u_int32_t> ids = matching(&t, "dtn://node1.dtn/app");
+    CHECK_EQUAL(ids.size(), 5);
+    CHECK_EQUAL(ids[0], 10);
+    CHECK_EQUAL(ids[1], 11);
+    CHECK_EQUAL(ids[2], 12);
+    CHECK_EQUAL(ids[3], 13);
+    CHECK_EQUAL(ids[4], 14);
+
+    const char* eids[] = {
+        "dtn://node1.dtn/app",
+        "dtn://node1.dtn/app?x=1",
+        "dtn://node1.dtn:4556/app",
+        "dtn://node1.dtn/other",
+        "dtn://node2.dtn/app",
+        "dtn://other.dtn/app",
+        "dtn://node*/app",
+        "dtn://node1.dtn/a*",
+        "dtn:none",
+        "str:node1",
+        "str:node2",
+    };
+
+    // twice, to check the cached results as well
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < sizeof(eids) / sizeof(eids[0]); ++i) {
+            CHECK(matching(&t, eids[i]) == scan(&t, eids[i]));
+        }
+    }
+
+    // a wildcard in the eid may match any pattern
+    ids = matching(&t, "dtn://node*/app");
+    CHECK_EQUAL(ids.size(), 6);
+    CHECK_EQUAL(ids[5], 17);
+
+    CHECK(t.get(EndpointIDPattern("dtn://node1.dtn/app"))->regid() == 10);
+    CHECK(t.get(EndpointIDPattern("dtn://node3.dtn/app")) == NULL);
+    CHECK(t.get(14)->endpoint().str() == "dtn://*");
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(CacheInvalidation) {
+    RegistrationTable t;
+
+    CHECK(add_reg(&t, 20, "dtn://node1.dtn/app") != NULL);
+    CHECK(add_reg(&t, 21, "dtn://node1.dtn/*") != NULL);
+    CHECK_EQUAL(matching(&t, "dtn://node1.dtn/app").size(), 2);
+    CHECK_EQUAL(matching(&t, "dtn://node1.dtn/app").size(), 2);
+
+    // an added registration shows in the cached demux eids, in each
+    // of the indexes
+    CHECK(add_reg(&t, 22, "dtn://node1.dtn/app") != NULL);
+    CHECK_EQUAL(matching(&t, "dtn://node1.dtn/app").size(), 3);
+    CHECK(add_reg(&t, 23, "dtn://node1.dtn/a*") != NULL);
+    CHECK_EQUAL(matching(&t, "dtn://node1.dtn/app").size(), 4);
+    CHECK(add_reg(&t, 24, "dtn://*") != NULL);
+    std::vector<u_int32_t> ids = matching(&t, "dtn://node1.dtn/app");
+    CHECK_EQUAL(ids.size(), 5);
+    CHECK_EQUAL(ids[4], 24);
+
+    // and a removed one goes away, with its index entry
+    Registration* reg = t.get(20);
+    CHECK(t.del(20));
+    delete reg;
+    CHECK(! t.del(20));
+    ids = matching(&t, "dtn://node1.dtn/app");
+    CHECK_EQUAL(ids.size(), 4);
+    CHECK_EQUAL(ids[0], 21);
+    CHECK(t.get(EndpointIDPattern("dtn://node1.dtn/app"))->regid() == 22);
+
+    reg = t.get(24);
+    CHECK(t.del(24));
+    delete reg;
+    CHECK_EQUAL(matching(&t, "dtn://node1.dtn/app").size(), 3);
+    CHECK_EQUAL(matching(&t, "dtn://node2.dtn/app").size(), 0);
+
+    reg = t.get(22);
+    CHECK(t.del(22));
+    delete reg;
+    CHECK(t.get(EndpointIDPattern("dtn://node1.dtn/app")) == NULL);
+    CHECK(matching(&t, "dtn://node1.dtn/app") ==
+          scan(&t, "dtn://node1.dtn/app"));
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(RegistrationTableTest) {
+    ADD_TEST(Demux);
+    ADD_TEST(CacheInvalidation);
+}
+
+int
+main(int argc, const char** argv)
+{
+    RegistrationTableTest t("registration table test");
+    t.init(argc, argv, true);
+
+    DTNStorageConfig cfg("", "memorydb", "", "");
+    cfg.init_ = true;
+    cfg.leave_clean_file_ = false;
+    oasys::DurableStore ds("/test/ds");
+    ds.create_store(cfg);
+    RegistrationStore::init(cfg, &ds);
+
+    return t.run_tests();
+}
@@ -313,6 +313,60 @@ DECLARE_TEST(Recursive) {
     return UNIT_TEST_PASSED;
 }
 
+DECLARE_TEST(Index) {
+    RouteTable t("test");
+    RouteEntryVec v;
+
+    CHECK(add_entry(&t, "dtn://node1.dtn", l1));
+    CHECK(add_entry(&t, "dtn://node1.dtn/app", l2));
+    CHECK(add_entry(&t, "dtn://node*", l3));
+    CHECK(add_entry(&t, "dtn://node1.dtn/*", l1));
+    CHECK(add_entry(&t, "dtn://*", l2));
+    CHECK(add_entry(&t, "dtn://node1.dtn:4556/app", l3));
+    CHECK(add_entry(&t, "str:node1", l1));
+
+    // matches come back in table order, whatever index they are in
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://node1.dtn"), &v), 4);
+    CHECK_EQUALSTR(v[0]->dest_pattern().c_str(), "dtn://node1.dtn");
+    CHECK_EQUALSTR(v[1]->dest_pattern().c_str(), "dtn://node*");
+    CHECK_EQUALSTR(v[2]->dest_pattern().c_str(), "dtn://node1.dtn/*");
+    CHECK_EQUALSTR(v[3]->dest_pattern().c_str(), "dtn://*");
+    v.clear();
+
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://node1.dtn/app"), &v), 3);
+    CHECK_EQUALSTR(v[0]->dest_pattern().c_str(), "dtn://node1.dtn/app");
+    CHECK_EQUALSTR(v[1]->dest_pattern().c_str(), "dtn://node1.dtn/*");
+    CHECK_EQUALSTR(v[2]->dest_pattern().c_str(), "dtn://*");
+    v.clear();
+
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://node1.dtn/app?x=1"), &v), 3);
+    v.clear();
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://node1.dtn:4556/app"), &v), 2);
+    v.clear();
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://node2.dtn"), &v), 2);
+    v.clear();
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://other.dtn"), &v), 1);
+    v.clear();
+    CHECK_EQUAL(t.get_matching(EndpointID("str:node1"), &v), 1);
+    v.clear();
+
+    // cached results are filtered by next hop and dropped when the
+    // table changes
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://node1.dtn/app"), l2, &v), 2);
+    v.clear();
+    CHECK(t.del_entry(EndpointIDPattern("dtn://*"), l2));
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://node1.dtn/app"), l2, &v), 1);
+    v.clear();
+    CHECK(add_entry(&t, "dtn://node1.dtn/a*", l2));
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://node1.dtn/app"), l2, &v), 2);
+    v.clear();
+
+    t.clear();
+    CHECK_EQUAL(t.get_matching(EndpointID("dtn://node1.dtn/app"), &v), 0);
+
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TEST(Cleanup) {
 
     l1->delete_link();
@@ -333,6 +387,7 @@ DECLARE_TESTER(RouteTableTest) {
     ADD_TEST(DelEntries);
     ADD_TEST(DelEntriesForNextHop);
     ADD_TEST(Recursive);
+    ADD_TEST(Index);
     ADD_TEST(Cleanup);
 }
 
@@ -0,0 +1,169 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/**
+ * Measures the cost of refreshing the DR map of the statistics messages,
+ * DtnStatMessage::updateDrMap(), against the previous implementation that
+ * searched the elapsed time of each bin and called exp() bin by bin.
+ *
+ * Usage: DrRefreshBench [messages] [iterations]
+ * Prints one line per axe length: bins, messages, the nanoseconds per message
+ * refresh of both implementations, the speedup and the largest relative
+ * difference between their DR values.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <fstream>
+#include "HBSD.h"
+#include "ConfigFile.h"
+#include "Console_Logging.h"
+#include "StatisticsManager.h"
+using namespace std;
+
+#define BENCH_CONF_FILE "/tmp/hbsd_dr_refresh_bench.conf"
+#define BENCH_NODES 20
+#define BENCH_TTL 3600
+
+static double nowNanoseconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+// Elapsed time of a bin as previously computed, by walking the axe
+static double legacyElapsedTime(StatisticsManager * sm, int binIndex)
+{
+	if(binIndex == 0) return 0;
+	for(int i = 0; i < sm->axeLength; i++)
+	{
+		if(i == binIndex)
+			return sm->statAxe[i].minLt + 1;
+	}
+	return 0;
+}
+
+// The previous DtnStatMessage::updateDrMap() loop
+static void legacyUpdateDrMap(StatisticsManager * sm, DtnStatMessage * dm, map<int, double> & drMap)
+{
+	drMap.clear();
+	double alpha = (sm->getApproximatedNumberOfNodes() - 1) * sm->getAverageNetworkMeetingTime();
+	for(int i = 0; i < sm->axeLength; i++)
+	{
+		double lt = legacyElapsedTime(sm, i);
+		if(sm->getApproximatedNumberOfNodes() > 1 && alpha > 0)
+			drMap[i] = (1 - (dm->getNumberOfNodesThatHaveSeeniT(i) / (sm->getApproximatedNumberOfNodes()-1))) * exp(-1*(dm->ttl - lt)*dm->getNumberOfCopiesAt(i)*(1/(alpha)));
+		else
+			drMap[i] += (1-dm->getNumberOfNodesThatHaveSeeniT(i))*exp(-1*(dm->ttl - lt)*dm->getNumberOfCopiesAt(i));
+	}
+}
+
+static void runBench(int bins, int numberOfMessages, int iterations)
+{
+	ofstream conf(BENCH_CONF_FILE);
+	conf << "numberOfBins=" << bins << "\nbinSize=" << (BENCH_TTL / bins + 1) << "\nmumBufferCapacity=" << numberOfMessages << "\n";
+	conf.close();
+	delete HBSD::routerConf;
+	HBSD::routerConf = new ConfigFile(string(BENCH_CONF_FILE));
+	HBSD::routerConf->parse();
+
+	StatisticsManager * sm = new StatisticsManager();
+	vector<DtnStatMessage *> messages;
+	char messageId[64];
+	char nodeId[64];
+	srand(1);
+	for(int m = 0; m < numberOfMessages; m++)
+	{
+		sprintf(messageId, "Rbench_message_%d", m);
+		int copies = 1 + rand() % BENCH_NODES;
+		for(int n = 0; n < copies; n++)
+		{
+			sprintf(nodeId, "Rbench_node_%d", rand() % BENCH_NODES);
+			sm->addStatMessage(messageId, nodeId, 1 + rand() % (BENCH_TTL - 1), BENCH_TTL);
+		}
+		messages.push_back(sm->isBundleHere(messageId));
+	}
+
+	map<int, double> legacyDrMap;
+	double start = nowNanoseconds();
+	for(int it = 0; it < iterations; it++)
+	{
+		for(int m = 0; m < numberOfMessages; m++)
+			legacyUpdateDrMap(sm, messages[m], legacyDrMap);
+	}
+	double legacy = (nowNanoseconds() - start) / ((double)iterations * numberOfMessages);
+
+	start = nowNanoseconds();
+	for(int it = 0; it < iterations; it++)
+	{
+		for(int m = 0; m < numberOfMessages; m++)
+			messages[m]->updateDrMap();
+	}
+	double kernel = (nowNanoseconds() - start) / ((double)iterations * numberOfMessages);
+
+	double maxDifference = 0;
+	for(int m = 0; m < numberOfMessages; m++)
+	{
+		legacyUpdateDrMap(sm, messages[m], legacyDrMap);
+		messages[m]->updateDrMap();
+		for(int i = 0; i < bins; i++)
+		{
+			double expected = legacyDrMap[i];
+			double difference = fabs(messages[m]->getAvgDrAt(i) - expected);
+			if(expected != 0)
+				difference /= fabs(expected);
+			if(difference > maxDifference)
+				maxDifference = difference;
+		}
+	}
+
+	fprintf(stdout, "bins=%d messages=%d legacy_ns=%.0f kernel_ns=%.0f speedup=%.2f max_rel_diff=%.3g\n",
+		bins, numberOfMessages, legacy, kernel, legacy / kernel, maxDifference);
+	delete sm;
+}
+
+int main(int argc, char ** argv)
+{
+	int numberOfMessages = (argc > 1) ? atoi(argv[1]) : 200;
+	int iterations = (argc > 2) ? atoi(argv[2]) : 20;
+
+	HBSD::log = new Console_Logging();
+	HBSD::log->setLevel(Logging::ALL);
+	HBSD::routerEndpoint = "Rbench_node_0";
+	HBSD::routerConf = NULL;
+
+	int bins[] = {36, 360, 1000};
+	for(unsigned int i = 0; i < sizeof(bins) / sizeof(bins[0]); i++)
+		runBench(bins[i], numberOfMessages, iterations);
+
+	delete HBSD::routerConf;
+	remove(BENCH_CONF_FILE);
+	return 0;
+}
@@ -0,0 +1,477 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/**
+ * Microbenchmarks of the StatisticsManager and Bundles hot paths, swept over
+ * the axe length, the number of statistics nodes and messages and the buffer
+ * capacity.
+ *
+ * Usage: HBSDMicroBench [-quick] [-filter name]
+ * Prints one line per benchmark and parameter set, as space separated
+ * key=value pairs: the benchmark name, its parameters, the number of timed
+ * iterations and the nanoseconds per iteration. These lines start with
+ * "bench=", the configuration parser prints its own lines as well.
+ * "make microbench" keeps them in a timestamped file of ./bin so that the
+ * versions can be compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "HBSD.h"
+#include "ConfigFile.h"
+#include "Console_Logging.h"
+#include "StatisticsManager.h"
+#include "HBSD_Routing.h"
+#include "Bundles.h"
+#include "Bundle.h"
+#include "Link.h"
+#include "GBOF.h"
+#include "Requester.h"
+using namespace std;
+
+#define MICRO_CONF_FILE "/tmp/hbsd_micro_bench.conf"
+#define MICRO_SV_DIRECTORY "/tmp/"
+#define MICRO_LOCAL_EID "dtn://bench.local"
+#define MICRO_TTL 3600
+// Every measure runs for at least this long
+#define MICRO_MIN_TIME_NS 2e8
+// Copies of each statistics message, at most
+#define MICRO_MAX_COPIES 20
+// Seconds between January 1, 1970 and January 1, 2000 (DTN epoch)
+#define MICRO_DELTA1970_SECONDS 946684800
+
+static const char * filter = NULL;
+static bool quick = false;
+
+static double nowNanoseconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+/**
+ * Drops the requests of the router.
+ */
+class NullRequesterSink : public RequesterSink
+{
+public:
+	bool send(const string & msg)
+	{
+		return true;
+	}
+};
+
+/**
+ * A measured operation, repeated iterations times per call.
+ */
+class MicroBench
+{
+public:
+	virtual ~MicroBench() {}
+	virtual void iterate(int iterations) = 0;
+};
+
+static bool selected(const char * name)
+{
+	return filter == NULL || strcmp(filter, name) == 0;
+}
+
+// Grows the number of iterations until the measure lasts long enough
+static void measure(const char * name, string parameters, MicroBench & bench)
+{
+	int iterations = 1;
+	double elapsed;
+	while(true)
+	{
+		double start = nowNanoseconds();
+		bench.iterate(iterations);
+		elapsed = nowNanoseconds() - start;
+		if(elapsed >= MICRO_MIN_TIME_NS || iterations >= (1 << 30))
+			break;
+		iterations *= (elapsed < MICRO_MIN_TIME_NS / 10) ? 10 : 2;
+	}
+	fprintf(stdout, "bench=%s %s iterations=%d ns_per_op=%.1f\n", name, parameters.c_str(), iterations, elapsed / iterations);
+	fflush(stdout);
+}
+
+// Reloads the configuration used by the constructors of the router objects
+static void configure(int bins, int messages, int bufferSize, int policy)
+{
+	ofstream conf(MICRO_CONF_FILE);
+	conf << "numberOfBins=" << bins << "\nbinSize=" << (MICRO_TTL / bins + 1) << "\n";
+	conf << "mumBufferCapacity=" << messages << "\nmchBufferCapacity=" << messages << "\n";
+	conf << "bundlesActiveCapacity=" << bufferSize << "\nhbsdOptimizePerformance=" << policy << "\n";
+	conf << "enableHbsdOptimization=true\nenableMeDeHaInterface=false\nenableStatSnapshot=false\nstatisticsWorkers=1\n";
+	conf << "svDirectory=" << MICRO_SV_DIRECTORY << "\n";
+	conf.close();
+	delete HBSD::routerConf;
+	HBSD::routerConf = new ConfigFile(string(MICRO_CONF_FILE));
+	HBSD::routerConf->parse();
+}
+
+// Adds messages seen by up to MICRO_MAX_COPIES of the nodes
+static void fillMatrix(StatisticsManager * sm, int numberOfMessages, int numberOfNodes, const char * prefix)
+{
+	char messageId[64];
+	char nodeId[64];
+	for(int m = 0; m < numberOfMessages; m++)
+	{
+		sprintf(messageId, "R%s_message_%d", prefix, m);
+		int copies = 1 + rand() % min(numberOfNodes, MICRO_MAX_COPIES);
+		for(int n = 0; n < copies; n++)
+		{
+			sprintf(nodeId, "R%s_node_%d", prefix, rand() % numberOfNodes);
+			sm->addStatMessage(messageId, nodeId, 1 + rand() % (MICRO_TTL - 1), MICRO_TTL);
+		}
+	}
+}
+
+static string parameters(int bins, int nodes, int messages)
+{
+	return string("bins=") + Util::to_string(bins) + string(" nodes=") + Util::to_string(nodes) + string(" messages=") + Util::to_string(messages);
+}
+
+// A received bundle, as built by Bundle::initReceived()
+static Bundle * newBundle(Bundles * bundles, int sequence)
+{
+	long long ts = ((long long)(time(NULL) - MICRO_DELTA1970_SECONDS - rand() % (MICRO_TTL - 1)) << 32) + sequence;
+	Bundle * bundle = new Bundle(bundles);
+	bundle->localId = Util::to_string(sequence);
+	bundle->expiration = MICRO_TTL;
+	bundle->bytesReceived = 1024;
+	bundle->creationTimestamp = Util::to_string(ts);
+	bundle->creationSeconds = GBOF::creationSeconds(ts);
+	bundle->expiresAtMillis = GBOF::calculateExpiration(ts, bundle->expiration);
+	bundle->sourceURI = string("dtn://source") + Util::to_string(rand() % 100) + string("/app");
+	bundle->sourceEID = GBOF::eidFromURI(bundle->sourceURI);
+	bundle->destURI = string("dtn://dest") + Util::to_string(rand() % 100) + string("/app");
+	bundle->destEID = GBOF::eidFromURI(bundle->destURI);
+	return bundle;
+}
+
+// A router whose buffer holds numberOfBundles bundles, their GBOF keys are returned in keys
+static HBSD_Routing * newRouter(int numberOfBundles, vector<string> & keys, int & sequence)
+{
+	HBSD_Routing * router = new HBSD_Routing();
+	HBSD::handlerHBSD = router;
+	for(int i = 0; i < numberOfBundles; i++)
+	{
+		Bundle * bundle = newBundle(router->bundles, ++sequence);
+		keys.push_back(GBOF::keyFromBundle(bundle));
+		router->bundles->addIfNew(bundle, bundle->localId);
+	}
+	router->statisticsManager->publishSnapshot();
+	return router;
+}
+
+static void deleteRouter(HBSD_Routing * router)
+{
+	delete router;
+	HBSD::handlerHBSD = NULL;
+}
+
+////////////////////////////// StatisticsManager //////////////////////////////
+
+class ConvertElapsedTimeBench : public MicroBench
+{
+public:
+	ConvertElapsedTimeBench(StatisticsManager * s) : sm(s), sum(0)
+	{
+		for(int i = 0; i < 1024; i++)
+			elapsedTimes.push_back(rand() % MICRO_TTL);
+	}
+	void iterate(int iterations)
+	{
+		for(int i = 0; i < iterations; i++)
+			sum += sm->convertElapsedTimeToBinIndex(elapsedTimes[i & 1023]);
+	}
+	StatisticsManager * sm;
+	vector<double> elapsedTimes;
+	long sum;
+};
+
+class GetStatFromAxeBench : public ConvertElapsedTimeBench
+{
+public:
+	GetStatFromAxeBench(StatisticsManager * s) : ConvertElapsedTimeBench(s) {}
+	void iterate(int iterations)
+	{
+		double ni, mi, dd, dr;
+		for(int i = 0; i < iterations; i++)
+			sm->getStatFromAxe(elapsedTimes[i & 1023], (char *)"", &ni, &mi, &dd, &dr);
+	}
+};
+
+class GetDescriptionBench : public MicroBench
+{
+public:
+	void iterate(int iterations)
+	{
+		string description;
+		for(int i = 0; i < iterations; i++)
+		{
+			description.clear();
+			messages[i % messages.size()]->getDescription(description);
+		}
+	}
+	vector<DtnStatMessage *> messages;
+};
+
+class UpdateNetworkStatBench : public MicroBench
+{
+public:
+	UpdateNetworkStatBench(StatisticsManager * s, string & st) : sm(s), stat(st) {}
+	void iterate(int iterations)
+	{
+		vector<char> received(stat.length() + 1);
+		for(int i = 0; i < iterations; i++)
+		{
+			memcpy(&received[0], stat.c_str(), stat.length() + 1);
+			sm->updateNetworkStat(&received[0]);
+		}
+	}
+	StatisticsManager * sm;
+	string & stat;
+};
+
+static void statisticsBenches(vector<int> & binsSweep, vector<int> & nodesSweep, vector<int> & messagesSweep)
+{
+	for(size_t b = 0; b < binsSweep.size(); b++)
+	{
+		int bins = binsSweep[b];
+		if(selected("convertElapsedTimeToBinIndex"))
+		{
+			configure(bins, messagesSweep.back(), DEFAULT_ACTIVE_CAPACITY, 0);
+			StatisticsManager * sm = new StatisticsManager();
+			srand(1);
+			ConvertElapsedTimeBench bench(sm);
+			measure("convertElapsedTimeToBinIndex", string("bins=") + Util::to_string(bins), bench);
+			delete sm;
+		}
+
+		for(size_t n = 0; n < nodesSweep.size(); n++)
+		{
+			for(size_t m = 0; m < messagesSweep.size(); m++)
+			{
+				int nodes = nodesSweep[n];
+				int messages = messagesSweep[m];
+				configure(bins, messages, DEFAULT_ACTIVE_CAPACITY, 0);
+				StatisticsManager * sm = new StatisticsManager();
+				srand(1);
+				fillMatrix(sm, messages, nodes, "local");
+
+				if(selected("getStatFromAxe"))
+				{
+					GetStatFromAxeBench bench(sm);
+					measure("getStatFromAxe", parameters(bins, nodes, messages), bench);
+				}
+
+				if(selected("getDescription"))
+				{
+					GetDescriptionBench bench;
+					char messageId[64];
+					for(int i = 0; i < messages; i++)
+					{
+						sprintf(messageId, "Rlocal_message_%d", i);
+						bench.messages.push_back(sm->isBundleHere(messageId));
+					}
+					measure("getDescription", parameters(bins, nodes, messages), bench);
+				}
+
+				// The merge is quadratic in the number of messages, a 1000
+				// messages matrix takes tens of seconds per operation
+				if(selected("updateNetworkStat") && messages <= 100)
+				{
+					// The statistics of another node, about other messages
+					StatisticsManager * remote = new StatisticsManager();
+					fillMatrix(remote, messages, nodes, "remote");
+					string stat;
+					remote->getStatToSend(stat);
+					delete remote;
+
+					UpdateNetworkStatBench bench(sm, stat);
+					measure("updateNetworkStat", parameters(bins, nodes, messages) + string(" stat_bytes=") + Util::to_string(stat.length()), bench);
+				}
+				delete sm;
+			}
+		}
+	}
+}
+
+////////////////////////////////// Bundles //////////////////////////////////
+
+class AddIfNewBench : public MicroBench
+{
+public:
+	AddIfNewBench(HBSD_Routing * r, int & s) : router(r), sequence(s) {}
+	void iterate(int iterations)
+	{
+		for(int i = 0; i < iterations; i++)
+		{
+			Bundle * bundle = newBundle(router->bundles, ++sequence);
+			router->bundles->addIfNew(bundle, bundle->localId);
+		}
+	}
+	HBSD_Routing * router;
+	int & sequence;
+};
+
+class CreateSVBench : public MicroBench
+{
+public:
+	CreateSVBench(HBSD_Routing * r) : router(r) {}
+	void iterate(int iterations)
+	{
+		for(int i = 0; i < iterations; i++)
+		{
+			string file = router->bundles->createSV(string(EPIDEMIC_SV_1), true);
+			remove(file.c_str());
+		}
+	}
+	HBSD_Routing * router;
+};
+
+class CompareAndSendBench : public MicroBench
+{
+public:
+	CompareAndSendBench(HBSD_Routing * r, Link * l, string & sv) : router(r), link(l), remoteSv(sv) {}
+	void iterate(int iterations)
+	{
+		for(int i = 0; i < iterations; i++)
+			router->bundles->compareAndSend(remoteSv, link, false);
+	}
+	HBSD_Routing * router;
+	Link * link;
+	string & remoteSv;
+};
+
+static void bundlesBenches(vector<int> & bufferSweep)
+{
+	int bins = 360;
+	int sequence = 0;
+	for(size_t b = 0; b < bufferSweep.size(); b++)
+	{
+		int bufferSize = bufferSweep[b];
+		string bufferParameters = string("bins=") + Util::to_string(bins) + string(" buffer=") + Util::to_string(bufferSize);
+
+		if(selected("addIfNew_full"))
+		{
+			// Every new bundle goes through the drop policy
+			for(int policy = 0; policy <= 1; policy++)
+			{
+				configure(bins, bufferSize * 2, bufferSize, policy);
+				srand(1);
+				vector<string> keys;
+				HBSD_Routing * router = newRouter(bufferSize, keys, sequence);
+				AddIfNewBench bench(router, sequence);
+				measure("addIfNew_full", bufferParameters + string(" policy=") + (policy == 0 ? string("DR") : string("DD")), bench);
+				deleteRouter(router);
+			}
+		}
+
+		if(!selected("createSV") && !selected("compareAndSend"))
+			continue;
+
+		configure(bins, bufferSize * 2, bufferSize, 0);
+		srand(1);
+		vector<string> keys;
+		HBSD_Routing * router = newRouter(bufferSize, keys, sequence);
+
+		if(selected("createSV"))
+		{
+			CreateSVBench bench(router);
+			measure("createSV", bufferParameters, bench);
+		}
+
+		if(selected("compareAndSend"))
+		{
+			Link * link = new Link(router->links);
+			link->id = string("link0");
+			link->remoteEID = string("dtn://peer0");
+			// The peer has half of our bundles and as many of its own, as read by the PeerListener
+			string remoteSv;
+			for(int i = 0; i < bufferSize; i++)
+			{
+				if(i % 2 == 0)
+					remoteSv.append(keys[i]);
+				else
+					remoteSv.append(GBOF::keyFromParms(Util::to_string(i), 0, 0, false, string("dtn://peer0/app")));
+				remoteSv.append(" ");
+			}
+			CompareAndSendBench bench(router, link, remoteSv);
+			measure("compareAndSend", bufferParameters + string(" sv_size=") + Util::to_string(bufferSize), bench);
+			delete link;
+		}
+		deleteRouter(router);
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-quick") == 0)
+			quick = true;
+		else if(strcmp(argv[i], "-filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else
+		{
+			fprintf(stdout, "HBSDMicroBench [-quick] [-filter name]\n");
+			exit(1);
+		}
+	}
+
+	HBSD::InitStaticMembers();
+	HBSD::log = new Console_Logging();
+	HBSD::log->setLevel(Logging::ALL);
+	HBSD::setLocalEID(string(MICRO_LOCAL_EID));
+	NullRequesterSink sink;
+	HBSD::requester = new Requester();
+	HBSD::requester->setSink(&sink);
+
+	int binsValues[] = {36, 360};
+	int nodesValues[] = {10, 100};
+	int messagesValues[] = {100, 1000};
+	int bufferValues[] = {100, 500, 1000};
+	int sweepLength = quick ? 1 : 3;
+	vector<int> binsSweep(binsValues + (quick ? 1 : 0), binsValues + 2);
+	vector<int> nodesSweep(nodesValues, nodesValues + (quick ? 1 : 2));
+	vector<int> messagesSweep(messagesValues, messagesValues + (quick ? 1 : 2));
+	vector<int> bufferSweep(bufferValues, bufferValues + sweepLength);
+
+	statisticsBenches(binsSweep, nodesSweep, messagesSweep);
+	bundlesBenches(bufferSweep);
+
+	HBSD::requester->setSink(NULL);
+	delete HBSD::routerConf;
+	remove(MICRO_CONF_FILE);
+	return 0;
+}
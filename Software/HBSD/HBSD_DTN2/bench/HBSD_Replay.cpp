@@ -0,0 +1,457 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/**
+ * Offline replay of dtnd XML traces through the HBSD router core.
+ *
+ * The recorded <bpa> messages are parsed by HBSD_SAX and handled by
+ * HBSD_Routing exactly as in HBSD::startRouterLoop, but no multicast socket
+ * is set up: the requests built by the Requester are captured in memory and
+ * the peer bundles are processed in the replaying thread right after the
+ * message that delivered them. Reports the events rate, the per message
+ * latency percentiles and the number of allocations. The requests recorded
+ * along with the messages of a trace (enableTraceRecording) are compared
+ * with the replayed ones, the replayed request ids being built from the
+ * recorded prefix.
+ *
+ * Usage:
+ *   HBSD_Replay -trace file [-config_file file] [-log_level n] [-requests file] [-metrics file]
+ *   HBSD_Replay -generate buffer_full -trace file [-bundles n] [-burst n]
+ *   HBSD_Replay -generate summary_vector -trace file [-bundles n]
+ *               [-encounters n] [-sv_size n]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <new>
+#include <string>
+#include <vector>
+#include <list>
+#include <fstream>
+#include <algorithm>
+#include "HBSD.h"
+#include "HBSD_SAX.h"
+#include "ConfigFile.h"
+#include "Console_Logging.h"
+#include "Requester.h"
+#include "PeerListener.h"
+#include "Bundles.h"
+#include "GBOF.h"
+#include "TraceFile.h"
+#include "Metrics.h"
+#include <xercesc/framework/MemBufInputSource.hpp>
+
+using namespace std;
+using namespace xercesc;
+
+// The local node of the generated traces
+#define REPLAY_LOCAL_EID "dtn://replay.local"
+#define REPLAY_BUNDLE_EXPIRATION 3600
+#define REPLAY_BUNDLE_SIZE 1024
+// Spacing of the generated messages within a burst and between two bursts, in nanoseconds
+#define REPLAY_BURST_SPACING 10000ULL
+#define REPLAY_BURST_GAP 100000000ULL
+// Seconds between January 1, 1970 and January 1, 2000 (DTN epoch)
+#define REPLAY_DELTA1970_SECONDS 946684800
+
+// Allocations of all the threads, counted by the replacement operator new
+static unsigned long allocationCount = 0;
+static unsigned long allocationBytes = 0;
+
+void * operator new(size_t size)
+{
+	__sync_fetch_and_add(&allocationCount, 1);
+	__sync_fetch_and_add(&allocationBytes, size);
+	void * p = malloc(size > 0 ? size : 1);
+	if(p == NULL)
+		throw bad_alloc();
+	return p;
+}
+
+void * operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void * p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void * p) throw()
+{
+	free(p);
+}
+
+/**
+ * Keeps the requests sent by the router instead of sending them to dtnd.
+ */
+class MemoryRequesterSink : public RequesterSink
+{
+public:
+	MemoryRequesterSink()
+	{
+		bytes = 0;
+	}
+
+	bool send(const string & msg)
+	{
+		requests.push_back(msg);
+		bytes += msg.length();
+		return true;
+	}
+
+	list<string> requests;
+	unsigned long bytes;
+};
+
+static void usageExit()
+{
+	fprintf(stdout,"HBSD_Replay -trace file [-config_file file] [-log_level n] [-requests file] [-metrics file]\n");
+	fprintf(stdout,"HBSD_Replay -generate buffer_full|summary_vector -trace file [-bundles n] [-burst n] [-encounters n] [-sv_size n]\n");
+	fprintf(stdout,"   -trace         Trace to replay, or to generate.\n");
+	fprintf(stdout,"   -config_file   HBSD configuration file used by the router.\n");
+	fprintf(stdout,"   -log_level     Router logging level, -1 (default) silences it.\n");
+	fprintf(stdout,"   -requests      File receiving the requests sent by the router.\n");
+	fprintf(stdout,"   -metrics       File receiving the router metrics, in the Prometheus text format.\n");
+	fprintf(stdout,"   -generate      Writes a synthetic trace instead of replaying one.\n");
+	fprintf(stdout,"   -bundles       Number of received bundles (default 1000).\n");
+	fprintf(stdout,"   -burst         Bundles received back to back (default 100).\n");
+	fprintf(stdout,"   -encounters    Number of peers met, each sending a summary vector (default 50).\n");
+	fprintf(stdout,"   -sv_size       Entries of each received summary vector (default 5000).\n");
+	exit(1);
+}
+
+////////////////////////////// Trace generators //////////////////////////////
+
+static string bpaStart()
+{
+	return string("<?xml version=\"1.0\" encoding=\"UTF-8\"?><bpa eid=\"") + REPLAY_LOCAL_EID + string("\">");
+}
+
+static string creationTimestamp(long creationSeconds, int sequence)
+{
+	long long ts = ((long long)(creationSeconds - REPLAY_DELTA1970_SECONDS) << 32) + sequence;
+	return Util::to_string(ts);
+}
+
+static string gbofXML(string ts, string sourceURI)
+{
+	return string("<gbof_id creation_ts=\"") + ts + string("\" frag_length=\"0\" frag_offset=\"0\" is_fragment=\"false\"><source uri=\"") + sourceURI + string("\"/></gbof_id>");
+}
+
+// A bundle received from a random source for a remote destination, returns its GBOF key
+static string bundleReceived(string & msg, int localId, long now)
+{
+	string ts = creationTimestamp(now - rand() % (REPLAY_BUNDLE_EXPIRATION - 1), localId);
+	string source = string("dtn://source") + Util::to_string(rand() % 100) + string("/app");
+	msg = bpaStart() + string("<bundle_received_event local_id=\"") + Util::to_string(localId) +
+		string("\" expiration=\"") + Util::to_string(REPLAY_BUNDLE_EXPIRATION) +
+		string("\" bytes_received=\"") + Util::to_string(REPLAY_BUNDLE_SIZE) + string("\">") +
+		gbofXML(ts, source) +
+		string("<dest uri=\"dtn://dest") + Util::to_string(rand() % 100) + string("/app\"/>") +
+		string("<custodian uri=\"dtn:none\"/><replyto uri=\"dtn:none\"/></bundle_received_event></bpa>");
+	return GBOF::keyFromParms(ts, 0, 0, false, source);
+}
+
+static void appendRecord(TraceWriter & writer, const string & msg, uint64_t & timestamp, uint64_t spacing)
+{
+	timestamp += spacing;
+	if(!writer.append(msg.data(), msg.length(), timestamp))
+	{
+		fprintf(stderr, "Unable to write the trace\n");
+		exit(1);
+	}
+}
+
+// Bursts of received bundles, the buffer fills up and the drop policy runs for each of the next ones
+static void generateBufferFull(TraceWriter & writer, int numberOfBundles, int burst)
+{
+	long now = time(NULL);
+	uint64_t timestamp = 0;
+	string msg;
+	for(int i = 0; i < numberOfBundles; i++)
+	{
+		bundleReceived(msg, i + 1, now);
+		appendRecord(writer, msg, timestamp, (burst > 0 && i % burst == 0) ? REPLAY_BURST_GAP : REPLAY_BURST_SPACING);
+	}
+}
+
+// Fills the buffer then meets peers that send large summary vectors, half of them matching our bundles
+static void generateSummaryVectors(TraceWriter & writer, string traceFile, int numberOfBundles, int encounters, int svSize)
+{
+	long now = time(NULL);
+	uint64_t timestamp = 0;
+	string msg;
+	vector<string> keys;
+	for(int i = 0; i < numberOfBundles; i++)
+	{
+		keys.push_back(bundleReceived(msg, i + 1, now));
+		appendRecord(writer, msg, timestamp, REPLAY_BURST_SPACING);
+	}
+
+	for(int k = 0; k < encounters; k++)
+	{
+		string linkId = string("link") + Util::to_string(k);
+		string peer = string("dtn://peer") + Util::to_string(k);
+		string peerRouter = peer + string("/") + HBSD::routerEndpoint;
+		string linkAttr = string("<remote_eid uri=\"") + peer + string("\"/></link_attr>");
+
+		// The summary vector, as written by Bundles::createSV
+		string svFile = traceFile + string(".sv") + Util::to_string(k);
+		ofstream sv(svFile.c_str(), ios_base::trunc);
+		sv << EPIDEMIC_SV_1 << endl;
+		for(int i = 0; i < svSize; i++)
+		{
+			if(i % 2 == 0 && !keys.empty())
+				sv << keys[rand() % keys.size()] << endl;
+			else
+				sv << GBOF::keyFromParms(creationTimestamp(now, i), 0, 0, false, peer + string("/app")) << endl;
+		}
+		sv.close();
+
+		msg = bpaStart() + string("<link_created_event link_id=\"") + linkId + string("\" reason=\"no_info\">") +
+			string("<link_attr type=\"opportunistic\" state=\"available\">") + linkAttr + string("</link_created_event></bpa>");
+		appendRecord(writer, msg, timestamp, REPLAY_BURST_GAP);
+
+		msg = bpaStart() + string("<link_opened_event link_id=\"") + linkId + string("\">") +
+			string("<contact_attr start_time_sec=\"0\" start_time_usec=\"0\" duration=\"0\" bps=\"0\" latency=\"0\" pkt_loss_prob=\"0\">") +
+			string("<link_attr type=\"opportunistic\" state=\"open\">") + linkAttr + string("</contact_attr></link_opened_event></bpa>");
+		appendRecord(writer, msg, timestamp, REPLAY_BURST_SPACING);
+
+		string ts = creationTimestamp(now, k);
+		int localId = numberOfBundles + k + 1;
+		msg = bpaStart() + string("<bundle_delivery_event local_id=\"") + Util::to_string(localId) +
+			string("\" expiration=\"") + Util::to_string(REPLAY_BUNDLE_EXPIRATION) + string("\">") +
+			gbofXML(ts, peerRouter) +
+			string("<bundle><source uri=\"") + peerRouter + string("\"/><dest uri=\"") + REPLAY_LOCAL_EID + string("/") + HBSD::routerEndpoint +
+			string("\"/><payload_file>") + svFile + string("</payload_file></bundle></bundle_delivery_event></bpa>");
+		appendRecord(writer, msg, timestamp, REPLAY_BURST_SPACING);
+
+		msg = bpaStart() + string("<link_closed_event link_id=\"") + linkId + string("\" reason=\"no_info\">") +
+			string("<contact_attr start_time_sec=\"0\" start_time_usec=\"0\" duration=\"0\" bps=\"0\" latency=\"0\" pkt_loss_prob=\"0\">") +
+			string("<link_attr type=\"opportunistic\" state=\"available\">") + linkAttr + string("</contact_attr></link_closed_event></bpa>");
+		appendRecord(writer, msg, timestamp, REPLAY_BURST_SPACING);
+	}
+}
+
+////////////////////////////////// Replay //////////////////////////////////
+
+static double percentile(vector<uint64_t> & sorted, double p)
+{
+	if(sorted.empty())
+		return 0;
+	size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return (double)sorted[index];
+}
+
+static void replay(string traceFile, string requestsFile, string metricsFile)
+{
+	TraceReader reader;
+	if(!reader.open(traceFile))
+	{
+		fprintf(stderr, "Unable to open the trace: %s\n", traceFile.c_str());
+		exit(1);
+	}
+
+	// Set up the router as main() does, without the multicast sockets
+	MemoryRequesterSink sink;
+	HBSD::requester = new Requester();
+	HBSD::requester->setSink(&sink);
+	HBSD::setupSAX();
+
+	// The requests sent by the recorded router, compared with the replayed ones
+	vector<string> recordedRequests;
+	vector<uint64_t> latencies;
+	unsigned long numberOfPeerBundles = 0;
+	unsigned long parseErrors = 0;
+	unsigned long allocationsAtStart = allocationCount;
+	unsigned long allocatedBytesAtStart = allocationBytes;
+	string datagram;
+	uint64_t recorded;
+	uint32_t type;
+	uint64_t start = traceMonotonicTime();
+	while(reader.next(datagram, recorded, type))
+	{
+		if(type == TRACE_RECORD_SENT)
+		{
+			recordedRequests.push_back(datagram);
+			continue;
+		}
+		if(type == TRACE_RECORD_REQUEST_ID_BASE)
+		{
+			HBSD::requester->setIdBase(datagram);
+			continue;
+		}
+		uint64_t begin = traceMonotonicTime();
+		try
+		{
+			MemBufInputSource inputsource((const XMLByte*)datagram.c_str(), datagram.length(), "msg", false);
+			HBSD::saxReader->parse(inputsource);
+		}
+		catch(SAXException &e)
+		{
+			parseErrors++;
+		}
+		catch(exception &e)
+		{
+			parseErrors++;
+		}
+		// The peer bundles delivered by this message, normally handled by the PeerListener thread
+		while(HBSD::handlerHBSD->getPeerListener()->processNextMessage())
+			numberOfPeerBundles++;
+		latencies.push_back(traceMonotonicTime() - begin);
+	}
+	uint64_t elapsed = traceMonotonicTime() - start;
+	unsigned long allocations = allocationCount - allocationsAtStart;
+	unsigned long allocatedBytes = allocationBytes - allocatedBytesAtStart;
+
+	unsigned long numberOfEvents = HBSD::saxHandler->getNumberOfEvents();
+	sort(latencies.begin(), latencies.end());
+	fprintf(stdout, "messages=%lu\n", (unsigned long)latencies.size());
+	fprintf(stdout, "events=%lu\n", numberOfEvents);
+	fprintf(stdout, "peer_bundles=%lu\n", numberOfPeerBundles);
+	fprintf(stdout, "parse_errors=%lu\n", parseErrors);
+	fprintf(stdout, "elapsed_s=%.6f\n", elapsed / 1e9);
+	fprintf(stdout, "events_per_s=%.1f\n", elapsed > 0 ? numberOfEvents / (elapsed / 1e9) : 0);
+	fprintf(stdout, "latency_p50_us=%.3f\n", percentile(latencies, 0.50) / 1e3);
+	fprintf(stdout, "latency_p99_us=%.3f\n", percentile(latencies, 0.99) / 1e3);
+	fprintf(stdout, "latency_max_us=%.3f\n", latencies.empty() ? 0 : latencies.back() / 1e3);
+	fprintf(stdout, "allocations=%lu\n", allocations);
+	fprintf(stdout, "allocated_bytes=%lu\n", allocatedBytes);
+	fprintf(stdout, "allocations_per_event=%.1f\n", numberOfEvents > 0 ? (double)allocations / numberOfEvents : 0);
+	fprintf(stdout, "requests=%lu\n", (unsigned long)sink.requests.size());
+	fprintf(stdout, "request_bytes=%lu\n", sink.bytes);
+	if(!recordedRequests.empty())
+	{
+		// Requests replayed identically, in the recorded order
+		unsigned long matching = 0;
+		list<string>::iterator iter = sink.requests.begin();
+		for(size_t i = 0; i < recordedRequests.size() && iter != sink.requests.end(); i++, iter++)
+		{
+			if(recordedRequests[i].compare(*iter) == 0)
+				matching++;
+		}
+		fprintf(stdout, "recorded_requests=%lu\n", (unsigned long)recordedRequests.size());
+		fprintf(stdout, "matching_requests=%lu\n", matching);
+	}
+
+	if(!requestsFile.empty())
+	{
+		ofstream out(requestsFile.c_str(), ios_base::trunc);
+		for(list<string>::iterator iter = sink.requests.begin(); iter != sink.requests.end(); iter++)
+		{
+			out << *iter << endl;
+		}
+		out.close();
+	}
+
+	if(!metricsFile.empty())
+	{
+		string metrics;
+		Metrics::writePrometheus(metrics);
+		ofstream out(metricsFile.c_str(), ios_base::trunc);
+		out << metrics;
+		out.close();
+	}
+	HBSD::requester->setSink(NULL);
+}
+
+int main(int argc, const char** argv)
+{
+	string traceFile;
+	string requestsFile;
+	string metricsFile;
+	string generate;
+	int numberOfBundles = 1000;
+	int burst = 100;
+	int encounters = 50;
+	int svSize = 5000;
+	int logLevel = Logging::ALL;
+
+	HBSD::InitStaticMembers();
+	for(int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if(i + 1 >= argc)
+			usageExit();
+		string value = argv[++i];
+		if(arg.compare("-trace") == 0)
+			traceFile = value;
+		else if(arg.compare("-config_file") == 0)
+			HBSD::confFile = value;
+		else if(arg.compare("-log_level") == 0)
+			logLevel = atoi(value.c_str());
+		else if(arg.compare("-requests") == 0)
+			requestsFile = value;
+		else if(arg.compare("-metrics") == 0)
+			metricsFile = value;
+		else if(arg.compare("-generate") == 0)
+			generate = value;
+		else if(arg.compare("-bundles") == 0)
+			numberOfBundles = atoi(value.c_str());
+		else if(arg.compare("-burst") == 0)
+			burst = atoi(value.c_str());
+		else if(arg.compare("-encounters") == 0)
+			encounters = atoi(value.c_str());
+		else if(arg.compare("-sv_size") == 0)
+			svSize = atoi(value.c_str());
+		else
+			usageExit();
+	}
+	if(traceFile.empty())
+		usageExit();
+
+	if(!generate.empty())
+	{
+		srand(1);
+		TraceWriter writer;
+		if(!writer.open(traceFile))
+		{
+			fprintf(stderr, "Unable to create the trace: %s\n", traceFile.c_str());
+			exit(1);
+		}
+		if(generate.compare("buffer_full") == 0)
+			generateBufferFull(writer, numberOfBundles, burst);
+		else if(generate.compare("summary_vector") == 0)
+			generateSummaryVectors(writer, traceFile, numberOfBundles, encounters, svSize);
+		else
+			usageExit();
+		writer.close();
+		return 0;
+	}
+
+	HBSD::loadConfig();
+	// The MeDeHa interface would open its own sockets
+	HBSD::routerConf->setValue(string("enableMeDeHaInterface"), string("false"));
+	// Contact sessions run inline so that a replay is deterministic
+	HBSD::routerConf->setValue(string("contactWorkers"), string("0"));
+	HBSD::log = new Console_Logging();
+	HBSD::log->conf();
+	HBSD::log->setLevel(logLevel);
+
+	replay(traceFile, requestsFile, metricsFile);
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#include "Async_Logging.h"
+#include "Metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+
+using namespace std;
+
+static const char * levelNames[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+
+Async_Logging::Async_Logging(int bufferSize)
+{
+	currentLevel = DEFAULT;
+	out = stdout;
+	stop = false;
+	droppedRecords = 0;
+	enqueuePosition = 0;
+	dequeuePosition = 0;
+
+	uint64_t size = 1;
+	while(size < (uint64_t)bufferSize)
+		size <<= 1;
+	mask = size - 1;
+	ring = (AsyncLoggingRecord *)calloc(size, sizeof(AsyncLoggingRecord));
+	if(ring == NULL)
+	{
+		cerr << "Unable to allocate the logging ring buffer" << endl;
+		exit(1);
+	}
+	for(uint64_t i = 0; i < size; i++)
+		ring[i].sequence = i;
+
+	if(pthread_create(&thread, NULL, Async_Logging::run, (void *)this) != 0)
+	{
+		cerr << "Unable to create the logging thread" << endl;
+		exit(1);
+	}
+}
+
+Async_Logging::~Async_Logging()
+{
+	stop = true;
+	pthread_join(thread, NULL);
+	drain();
+	fflush(out);
+	if(out != stdout)
+		fclose(out);
+	free(ring);
+}
+
+void Async_Logging::conf()
+{
+}
+
+void Async_Logging::conf(string confFile)
+{
+	FILE * file = fopen(confFile.c_str(), "a");
+	if(file == NULL)
+	{
+		cerr << "Unable to open the log file " << confFile << ", logging to stdout" << endl;
+		return;
+	}
+	out = file;
+}
+
+bool Async_Logging::push(int level, const string & message)
+{
+	// Bounded multi-producer queue: a producer owns a record once it has moved
+	// the enqueue position past it, the record sequence then tells the writer
+	// when it is filled.
+	AsyncLoggingRecord * record;
+	uint64_t position = enqueuePosition;
+	while(true)
+	{
+		record = &ring[position & mask];
+		int64_t difference = (int64_t)record->sequence - (int64_t)position;
+		if(difference == 0)
+		{
+			if(__sync_bool_compare_and_swap(&enqueuePosition, position, position + 1))
+				break;
+			position = enqueuePosition;
+		}
+		else if(difference < 0)
+		{
+			// The writer did not free this record yet
+			__sync_fetch_and_add(&droppedRecords, 1);
+			Metrics::increment(METRIC_LOG_RECORDS_DROPPED);
+			return false;
+		}
+		else
+		{
+			position = enqueuePosition;
+		}
+	}
+
+	// The coarse clock is enough for the log and much cheaper
+	clock_gettime(CLOCK_REALTIME_COARSE, &record->timestamp);
+	record->level = level;
+	size_t length = message.length();
+	if(length >= ASYNC_LOGGING_RECORD_LENGTH)
+	{
+		length = ASYNC_LOGGING_RECORD_LENGTH - 4;
+		memcpy(record->text, message.data(), length);
+		memcpy(record->text + length, "...", 3);
+		length += 3;
+	}
+	else
+	{
+		memcpy(record->text, message.data(), length);
+	}
+	record->length = (int)length;
+
+	// Publish the content before the sequence
+	__sync_synchronize();
+	record->sequence = position + 1;
+	return true;
+}
+
+int Async_Logging::drain()
+{
+	int written = 0;
+	while(true)
+	{
+		AsyncLoggingRecord * record = &ring[dequeuePosition & mask];
+		if(record->sequence != dequeuePosition + 1)
+			break;
+		__sync_synchronize();
+		write(record);
+		__sync_synchronize();
+		// Hand the record back to the producers, one lap ahead
+		record->sequence = dequeuePosition + mask + 1;
+		dequeuePosition = dequeuePosition + 1;
+		written++;
+	}
+	return written;
+}
+
+void Async_Logging::write(AsyncLoggingRecord * record)
+{
+	struct tm timeInfo;
+	char header[64];
+	localtime_r(&record->timestamp.tv_sec, &timeInfo);
+	size_t length = strftime(header, sizeof(header), "%Y-%m-%d %H:%M:%S", &timeInfo);
+	const char * level = (record->level >= TRACE && record->level <= FATAL) ? levelNames[record->level] : "LOG";
+	snprintf(header + length, sizeof(header) - length, ".%03ld %s: ", record->timestamp.tv_nsec / 1000000, level);
+
+	fputs(header, out);
+	fwrite(record->text, 1, record->length, out);
+	fputc('\n', out);
+}
+
+void Async_Logging::flush()
+{
+	uint64_t target = enqueuePosition;
+	while(dequeuePosition < target && !stop)
+		usleep(100);
+	fflush(out);
+}
+
+unsigned long Async_Logging::getNumberOfDroppedRecords()
+{
+	return droppedRecords;
+}
+
+void * Async_Logging::run(void * arg)
+{
+	Async_Logging * logging = (Async_Logging *)arg;
+	while(!logging->stop)
+	{
+		if(logging->drain() == 0)
+		{
+			fflush(logging->out);
+			usleep(ASYNC_LOGGING_IDLE_SLEEP);
+		}
+	}
+	return NULL;
+}
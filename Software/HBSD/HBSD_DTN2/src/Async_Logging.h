@@ -0,0 +1,188 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef ASYNC_LOGGING_H
+#define ASYNC_LOGGING_H
+
+#include <string>
+#include <stdio.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "Logging.h"
+
+// Default number of records of the ring buffer, rounded up to a power of two
+#define DEFAULT_ASYNC_LOGGING_BUFFER_SIZE 4096
+// Longest message kept by a record, the longer ones are truncated
+#define ASYNC_LOGGING_RECORD_LENGTH 480
+// Microseconds the writer thread sleeps once the ring buffer is empty
+#define ASYNC_LOGGING_IDLE_SLEEP 1000
+
+typedef struct AsyncLoggingRecord
+{
+	// Position of the record in the ring, tells the producers and the writer whose turn it is
+	volatile uint64_t sequence;
+	struct timespec timestamp;
+	int level;
+	int length;
+	char text[ASYNC_LOGGING_RECORD_LENGTH];
+}AsyncLoggingRecord;
+
+/**
+ * Logging class writing from a background thread. The calling threads copy
+ * their message into a preallocated record of a lock-free ring buffer and
+ * return, the writer thread drains the ring to stdout or to the logging
+ * configuration file. The messages logged while the ring is full are
+ * dropped and counted. Selected with loggingClass=Async_Logging.
+ */
+class Async_Logging: public Logging
+{
+public:
+	const static int DEFAULT = WARN;
+
+	/**
+	 * Constructor: allocates the ring buffer and starts the writer thread.
+	 *
+	 * @param bufferSize Number of records of the ring buffer.
+	 */
+	Async_Logging(int bufferSize);
+
+	/**
+	 * Destructor: writes the pending records and stops the writer thread.
+	 */
+	~Async_Logging();
+
+	/**
+	 * Writes to stdout.
+	 */
+	void conf();
+
+	/**
+	 * Appends to the given file instead of stdout.
+	 */
+	void conf(std::string confFile);
+
+	void setLevel(int lev)
+	{
+		currentLevel = lev;
+	}
+
+	int getLevel()
+	{
+		return currentLevel;
+	}
+
+	bool enabled(int lev)
+	{
+		return (currentLevel >= lev);
+	}
+
+	void trace(const std::string & message)
+	{
+		if (currentLevel >= TRACE)
+			push(TRACE, message);
+	}
+
+	void debug(const std::string & message)
+	{
+		if (currentLevel >= DEBUG)
+			push(DEBUG, message);
+	}
+
+	void info(const std::string & message)
+	{
+		if (currentLevel >= INFO)
+			push(INFO, message);
+	}
+
+	void warn(const std::string & message)
+	{
+		if (currentLevel >= WARN)
+			push(WARN, message);
+	}
+
+	void error(const std::string & message)
+	{
+		if (currentLevel >= ERROR)
+			push(ERROR, message);
+	}
+
+	/**
+	 * The fatal messages are usually followed by exit(), they are written
+	 * before returning.
+	 */
+	void fatal(const std::string & message)
+	{
+		if (currentLevel >= FATAL)
+		{
+			// Written right away if the ring buffer is full
+			if(!push(FATAL, message))
+				fprintf(stderr, "FATAL: %s\n", message.c_str());
+			flush();
+		}
+	}
+
+	/**
+	 * Waits until the records logged so far are written.
+	 */
+	void flush();
+
+	unsigned long getNumberOfDroppedRecords();
+
+	/**
+	 * Main loop of the writer thread.
+	 */
+	static void * run(void * arg);
+
+private:
+	/**
+	 * Copies the message into the next free record.
+	 *
+	 * @return False if the ring buffer is full.
+	 */
+	bool push(int level, const std::string & message);
+
+	/**
+	 * Writes the available records.
+	 *
+	 * @return The number of records written.
+	 */
+	int drain();
+
+	void write(AsyncLoggingRecord * record);
+
+	int currentLevel;
+	AsyncLoggingRecord * ring;
+	uint64_t mask;
+	// Next record to fill, shared by the producers
+	volatile uint64_t enqueuePosition;
+	// Next record to write, only moved by the writer thread
+	volatile uint64_t dequeuePosition;
+	volatile unsigned long droppedRecords;
+	FILE * volatile out;
+	volatile bool stop;
+	pthread_t thread;
+};
+
+#endif
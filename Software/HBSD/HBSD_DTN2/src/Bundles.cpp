@@ -43,6 +43,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <iostream>
 #include <sstream>
 #include "MeDeHaInterface.h"
+#include "Metrics.h"
+#include "Tracepoints.h"
 using namespace std;
 
 
@@ -53,6 +55,7 @@ Bundles::Bundles(Handlers* router)
 	// Getting the buffer capacity, by default it is equal to 100
 	maxBufferCapacity = HBSD::routerConf->getInt(string("bundlesActiveCapacity"), DEFAULT_ACTIVE_CAPACITY);
 	assert(maxBufferCapacity > 0);
+	svDirectory = HBSD::routerConf->getstring(string("svDirectory"), string(DEFAULT_SV_DIRECTORY));
 	// Getting HBSD main optimization task, by default it is set to maximizing the network average delivery rate
 	this->hbsdOptimizePerformance = HBSD::routerConf->getInt(string("hbsdOptimizePerformance"), DEFAULT_HBSD_POLICY_PURPOSE);
 	// Initializing the bundlesLock which will be used to manage threads access to the bundles buffer
@@ -100,10 +103,7 @@ Bundle* Bundles::newBundle(XMLTree* evtBundleRcvd)
 
 		if (alreadyExists(evtBundleRcvd))
 		{
-			if (HBSD::log->enabled(Logging::DEBUG))
-			{
-				HBSD::log->debug(string("Dropping duplicate bundle"));
-			}
+			HBSD_LOG_DEBUG(string("Dropping duplicate bundle"));
 			return NULL;
 		}
 
@@ -123,7 +123,7 @@ Bundle* Bundles::newBundle(XMLTree* evtBundleRcvd)
 		if(((HBSD_Routing*)router)->localDest(bundle))
 		{
 			// It is for a local dest, remove it
-			HBSD::log->info(string("A new Bundle is delivered for a local application: ") + bundle->destURI);
+			HBSD_LOG_INFO(string("A new Bundle is delivered for a local application: ") + bundle->destURI);
 			// Verify if we should forward the bundle towards the MeDeHa Gateway
 
 			if(bundle != NULL)
@@ -180,23 +180,20 @@ bool Bundles::alreadyExists(XMLTree* evtBundleRcvd)
 		if (key.empty()) 
 		{
 			// Ignore
-			HBSD::log->error(string("Empty key in Bundles::alreadyExists"));
+			HBSD_LOG_ERROR(string("Empty key in Bundles::alreadyExists"));
 			return true;
 		}
 
-		getBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		getBundlesLock(LOCK_LOCATION);
 			map <string,Bundle *>::iterator iter = activeBundles.find(key);
 			bool exist = (iter != activeBundles.end());
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 		return exist;
 	} 
 
 	catch (exception& e) 
 	{
-		if (HBSD::log->enabled(Logging::ERROR)) 
-		{
-			HBSD::log->error(string("Ill-formed GBOF in received XML"));
-		}
+		HBSD_LOG_ERROR(string("Ill-formed GBOF in received XML"));
 		// Ill-formed: treat as a duplicate.
 		return true;
 	}
@@ -221,14 +218,14 @@ Bundle* Bundles::addIfNew(Bundle* createdBundle, string localId)
 	string gbof = GBOF::keyFromBundle(createdBundle);
 	assert(!gbof.empty());
 
-	getBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getBundlesLock(LOCK_LOCATION);
 
 	map <string, string>::iterator iter = localidGBOFMap.find(localId);
 
 	if (iter != localidGBOFMap.end()) 
 	{
 		// Already existing
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 		return NULL;
 	}
 
@@ -252,8 +249,11 @@ Bundle* Bundles::addIfNew(Bundle* createdBundle, string localId)
 		localidGBOFMap[localId] = gbof;
 		activeBundles[gbof] = createdBundle;
 		hbsdRouter = NULL;
+		Metrics::increment(METRIC_BUNDLES_ADMITTED);
+		Metrics::setGauge(METRIC_BUFFER_OCCUPANCY, activeBundles.size());
+		HBSD_TRACEPOINT2(bundle_admitted, gbof.c_str(), -1LL);
 
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 		this->changeLastTimeBundlesStoreUpdate();
 		return createdBundle;
 	}
@@ -278,22 +278,22 @@ Bundle* Bundles::addIfNew(Bundle* createdBundle, string localId)
 				break;
 			default:
 				// Wrong optimization problem selected
-				if(HBSD::log->enabled(Logging::FATAL))
-					HBSD::log->fatal(string("A wrong optimization problem selected, please be sure to correctly set the hbsdOptimizePerformance attribute in the HBSD config file"));
-				leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+				HBSD_LOG_FATAL(string("A wrong optimization problem selected, please be sure to correctly set the hbsdOptimizePerformance attribute in the HBSD config file"));
+				leaveBundlesLock(LOCK_LOCATION);
 				return NULL;
 			};
 		}else
 		{
 			// Just apply the drop last policy, delete the last received bundle
-			if(!deleteBundle(createdBundle))
+			leaveBundlesLock(LOCK_LOCATION);
+			Metrics::increment(METRIC_BUNDLES_REJECTED);
+			HBSD_TRACEPOINT2(bundle_rejected, gbof.c_str(), -1LL);
+			if(!discardBundle(createdBundle))
 			{
-				if(HBSD::log->enabled(Logging::FATAL))
-					HBSD::log->fatal(string("Unable to delete the new received bundle from the DTN2 store"));
+				HBSD_LOG_FATAL(string("Unable to delete the new received bundle from the DTN2 store"));
 			}
 
 			createdBundle = NULL;
-			leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
 			return NULL;
 		}
 	}
@@ -302,14 +302,14 @@ Bundle* Bundles::addIfNew(Bundle* createdBundle, string localId)
 // Deletes a bundle once it expires, synchronized
 Bundle* Bundles::expire(string localId)
 {
-	getBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getBundlesLock(LOCK_LOCATION);
 
 	map <string, string>::iterator iter = localidGBOFMap.find(localId);
 
 	if(iter == localidGBOFMap.end())
 	{
 		// That could be an injected bundle
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 
 		return NULL;
 	}
@@ -321,6 +321,7 @@ Bundle* Bundles::expire(string localId)
 	map <string,Bundle *>::iterator iter2 = activeBundles.find(key);
 	if(iter2 == activeBundles.end())
 	{
+		leaveBundlesLock(LOCK_LOCATION);
 		return NULL;
 	}
 	HBSD_Routing * hbsdRouter = (HBSD_Routing*)this->router;
@@ -329,7 +330,7 @@ Bundle* Bundles::expire(string localId)
 	{
 		// Updating the status of a bundle in the Statistics Matrix, Saying that the bundle has been deleted within the
 		// bin corresponding to its elapsed time
-		hbsdRouter->statisticsManager->updateBundleStatus((char*)HBSD::localEID.c_str(), (char*)localidGBOFMap[iter2->second->localId].c_str(), 0, (iter2->second)->getElapsedTimeSinceCreation(), (iter2->second)->expiration);
+		hbsdRouter->statisticsManager->updateBundleStatus((char*)HBSD::localEID.c_str(), (char*)key.c_str(), 0, (iter2->second)->getElapsedTimeSinceCreation(), (iter2->second)->expiration);
 	}
 
 	hbsdRouter = NULL;
@@ -337,10 +338,12 @@ Bundle* Bundles::expire(string localId)
 	Bundle* bundle = iter2->second;
 	iter2->second = NULL;
 	activeBundles.erase(iter2);
+	Metrics::increment(METRIC_BUNDLES_EXPIRED);
+	Metrics::setGauge(METRIC_BUFFER_OCCUPANCY, activeBundles.size());
 
 	this->changeLastTimeBundlesStoreUpdate();
 
-	leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveBundlesLock(LOCK_LOCATION);
 
 	return bundle;
 }
@@ -351,7 +354,7 @@ bool Bundles::remove(Bundle* bundle)
 {
 	assert(!bundle->injected);
 
-	getBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getBundlesLock(LOCK_LOCATION);
 
 	string gbof = localidGBOFMap[bundle->localId];
 	assert(!gbof.empty());
@@ -362,10 +365,11 @@ bool Bundles::remove(Bundle* bundle)
 	if(iter->second != NULL)
 		delete iter->second;
 	activeBundles.erase(iter);
+	Metrics::setGauge(METRIC_BUFFER_OCCUPANCY, activeBundles.size());
 
 	this->changeLastTimeBundlesStoreUpdate();
 
-	leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveBundlesLock(LOCK_LOCATION);
 
 	return true;
 }
@@ -373,11 +377,16 @@ bool Bundles::remove(Bundle* bundle)
 //Removes a bundle and asks the DTN2 to delete it
 bool Bundles::deleteBundle(Bundle* bundle) 
 {
-	if (remove(bundle))
-	{
-		return HBSD::requester->requestDeleteBundle(bundle);
-	}
-	return false;
+	// The request is built before remove() frees the bundle
+	bool requested = HBSD::requester->requestDeleteBundle(bundle);
+	return remove(bundle) && requested;
+}
+
+bool Bundles::discardBundle(Bundle* bundle) 
+{
+	bool requested = HBSD::requester->requestDeleteBundle(bundle);
+	delete bundle;
+	return requested;
 }
 
 //Removes a bundle and asks the DTN2 to delete it
@@ -389,17 +398,14 @@ void Bundles::finished(Bundle* bundle)
 	}
 	if(!HBSD::requester->requestDeleteBundle(bundle))
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-		{
-			HBSD::log->error(string("In Bundles::finished, problem occured while requesting to delete the bundle."));
-		}
+		HBSD_LOG_ERROR(string("In Bundles::finished, problem occured while requesting to delete the bundle."));
 	}
 }
 // Synchronized
 bool Bundles::isCurrent(string localId)
 {
 	bool current = false;
-	getBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getBundlesLock(LOCK_LOCATION);
 	string gbof = localidGBOFMap[localId];
 	if (!gbof.empty()) 
 	{
@@ -411,7 +417,7 @@ bool Bundles::isCurrent(string localId)
 		}
 	}
 
-	leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveBundlesLock(LOCK_LOCATION);
 
 	return current;
 }
@@ -421,14 +427,14 @@ Bundle* Bundles::bundlefromLocalId(string localId)
 {
 	Bundle* bundle = NULL;
 
-	getBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getBundlesLock(LOCK_LOCATION);
 
 	string gbof = localidGBOFMap[localId];
 	if (!gbof.empty()) 
 	{
 		bundle = activeBundles[gbof];
 	}
-	leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveBundlesLock(LOCK_LOCATION);
 
 	return bundle;
 }
@@ -464,7 +470,7 @@ Bundle* Bundles::eventDelivered(XMLTree* evtBundleDelivered)
 	// The following lookup should fail for an injected bundle. But
 	// we still check again later.
 
-	getBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getBundlesLock(LOCK_LOCATION);
 	string gbof = localidGBOFMap[localId];
 	if (!gbof.empty()) 
 	{
@@ -474,11 +480,11 @@ Bundle* Bundles::eventDelivered(XMLTree* evtBundleDelivered)
 
 	if (bundle == NULL || bundle->injected)
 	{
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 		return NULL;
 	}
 
-	leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveBundlesLock(LOCK_LOCATION);
 	return bundle;
 }
 
@@ -493,8 +499,7 @@ string Bundles::xmlLocalId(XMLTree* element)
 	}
 	catch (exception& e) 
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-			HBSD::log->error(string("Error occurred within Bundles::xmlLocalId."));
+		HBSD_LOG_ERROR(string("Error occurred within Bundles::xmlLocalId."));
 		return NULL;
 	}
 }
@@ -506,7 +511,7 @@ Bundle * Bundles::hbsdAddBundleAndMaximizeAverageDeliveryRate(Bundle *createdBun
 
 	HBSD_Routing * hbsdRouter = (HBSD_Routing*)this->router;
 
-	string newBundleUid = this->localidGBOFMap[createdBundle->localId];
+	string newBundleUid = GBOF::keyFromBundle(createdBundle);
 
 	// Getting the network average meeting time
 	double averageMeetingTime = hbsdRouter->statisticsManager->getAverageNetworkMeetingTime();
@@ -529,7 +534,7 @@ Bundle * Bundles::hbsdAddBundleAndMaximizeAverageDeliveryRate(Bundle *createdBun
 	// Getting from the buffer the bundle that has the smallest utility value
 	Bundle * bundleHavingTheSmallestUtility = NULL;
 	double smallestUtilityValue = 0;
-	string idBundleHavingTheSmallestUtility = this->getBundleWithTheSmallestDDUtilityFromTheBuffer(bundleHavingTheSmallestUtility, &smallestUtilityValue);
+	string idBundleHavingTheSmallestUtility = this->getBundleWithTheSmallestDRUtilityFromTheBuffer(bundleHavingTheSmallestUtility, &smallestUtilityValue);
 
 
 	// Getting the local EID
@@ -555,15 +560,20 @@ Bundle * Bundles::hbsdAddBundleAndMaximizeAverageDeliveryRate(Bundle *createdBun
 		localidGBOFMap[createdBundle->localId] = gbof;
 		activeBundles[gbof] = createdBundle;
 		hbsdRouter = NULL;
+		Metrics::increment(METRIC_BUNDLES_ADMITTED);
+		Metrics::increment(METRIC_BUNDLES_EVICTED);
+		Metrics::observeUtility(METRIC_ADMITTED_UTILITY, newBundleUtilityValue);
+		Metrics::observeUtility(METRIC_EVICTED_UTILITY, smallestUtilityValue);
+		HBSD_TRACEPOINT2(bundle_admitted, gbof.c_str(), HBSD_TRACE_UTILITY(newBundleUtilityValue));
+		HBSD_TRACEPOINT2(bundle_evicted, idBundleHavingTheSmallestUtility.c_str(), HBSD_TRACE_UTILITY(smallestUtilityValue));
 
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 
 		// Deleting the bundle from both HBSD buffer and DTN2 store
 		if(!this->deleteBundle(bundleHavingTheSmallestUtility))
 		{
 			// Problem occurred while trying to delete the bundle
-			if(HBSD::log->enabled(Logging::FATAL))
-				HBSD::log->fatal(string("Unable to delete the bundle having the smallest utility"));
+			HBSD_LOG_FATAL(string("Unable to delete the bundle having the smallest utility"));
 		}
 		bundleHavingTheSmallestUtility = NULL;
 
@@ -573,12 +583,13 @@ Bundle * Bundles::hbsdAddBundleAndMaximizeAverageDeliveryRate(Bundle *createdBun
 
 	} else
 	{
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 		// Just delete the new received bundle and keep the buffer as it is
-		if(!deleteBundle(createdBundle))
+		Metrics::increment(METRIC_BUNDLES_REJECTED);
+		HBSD_TRACEPOINT2(bundle_rejected, newBundleUid.c_str(), HBSD_TRACE_UTILITY(newBundleUtilityValue));
+		if(!discardBundle(createdBundle))
 		{
-			if(HBSD::log->enabled(Logging::FATAL))
-				HBSD::log->fatal(string("Unable to delete the new received bundle from the DTN2 store"));
+			HBSD_LOG_FATAL(string("Unable to delete the new received bundle from the DTN2 store"));
 		}
 		createdBundle = NULL;
 		bundleHavingTheSmallestUtility = NULL;
@@ -596,7 +607,7 @@ Bundle * Bundles::hbsdAddBundleAndMinimizeAverageDeliveryDelay(Bundle *createdBu
 
 	HBSD_Routing * hbsdRouter = (HBSD_Routing*)this->router;
 
-	string newBundleUid = this->localidGBOFMap[createdBundle->localId];
+	string newBundleUid = GBOF::keyFromBundle(createdBundle);
 
 	// Getting the network average meeting time
 	double averageMeetingTime = hbsdRouter->statisticsManager->getAverageNetworkMeetingTime();
@@ -614,7 +625,7 @@ Bundle * Bundles::hbsdAddBundleAndMinimizeAverageDeliveryDelay(Bundle *createdBu
 	hbsdRouter->statisticsManager->getStatFromAxe(createdBundle->getElapsedTimeSinceCreation(), (char*)newBundleUid.c_str(),&niAtT,&miAtT,&ddAtT,&drAtT);
 
 	// Calculating the utility of the new received bundle
-	double 	newBundleUtilityValue=((parameterAlpha/(numberOfNodes -1))*pow((double)ddAtT, 2.0))/(numberOfNodes - 1 - miAtT);
+	double 	newBundleUtilityValue=((parameterAlpha/(numberOfNodes -1))*(ddAtT * ddAtT))/(numberOfNodes - 1 - miAtT);
 
 	// Getting from the buffer the bundle that has the smallest utility value
 	Bundle * bundleHavingTheSmallestUtility = NULL;
@@ -646,15 +657,20 @@ Bundle * Bundles::hbsdAddBundleAndMinimizeAverageDeliveryDelay(Bundle *createdBu
 		localidGBOFMap[createdBundle->localId] = gbof;
 		activeBundles[gbof] = createdBundle;
 		hbsdRouter = NULL;
+		Metrics::increment(METRIC_BUNDLES_ADMITTED);
+		Metrics::increment(METRIC_BUNDLES_EVICTED);
+		Metrics::observeUtility(METRIC_ADMITTED_UTILITY, newBundleUtilityValue);
+		Metrics::observeUtility(METRIC_EVICTED_UTILITY, smallestUtilityValue);
+		HBSD_TRACEPOINT2(bundle_admitted, gbof.c_str(), HBSD_TRACE_UTILITY(newBundleUtilityValue));
+		HBSD_TRACEPOINT2(bundle_evicted, idBundleHavingTheSmallestUtility.c_str(), HBSD_TRACE_UTILITY(smallestUtilityValue));
 
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 
 		// Deleting the bundle from both HBSD buffer and DTN2 store
 		if(!this->deleteBundle(bundleHavingTheSmallestUtility))
 		{
 			// Problem occurred while trying to delete the bundle
-			if(HBSD::log->enabled(Logging::FATAL))
-				HBSD::log->fatal(string("Unable to delete the bundle having the smallest utility"));
+			HBSD_LOG_FATAL(string("Unable to delete the bundle having the smallest utility"));
 		}
 		bundleHavingTheSmallestUtility = NULL;
 
@@ -664,13 +680,14 @@ Bundle * Bundles::hbsdAddBundleAndMinimizeAverageDeliveryDelay(Bundle *createdBu
 
 	} else
 	{
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 
 		// Just delete the new received bundle and keep the buffer as it is
-		if(!deleteBundle(createdBundle))
+		Metrics::increment(METRIC_BUNDLES_REJECTED);
+		HBSD_TRACEPOINT2(bundle_rejected, newBundleUid.c_str(), HBSD_TRACE_UTILITY(newBundleUtilityValue));
+		if(!discardBundle(createdBundle))
 		{
-			if(HBSD::log->enabled(Logging::FATAL))
-				HBSD::log->fatal(string("Unable to delete the new received bundle from the DTN2 store"));
+			HBSD_LOG_FATAL(string("Unable to delete the new received bundle from the DTN2 store"));
 		}
 		createdBundle = NULL;
 		bundleHavingTheSmallestUtility = NULL;
@@ -681,7 +698,7 @@ Bundle * Bundles::hbsdAddBundleAndMinimizeAverageDeliveryDelay(Bundle *createdBu
 }
 
 
-string Bundles::getBundleWithTheSmallestDRUtilityFromTheBuffer(Bundle * sb, double * smallestUtility)
+string Bundles::getBundleWithTheSmallestDRUtilityFromTheBuffer(Bundle *& sb, double * smallestUtility)
 {
 	// The statistics manager
 	StatisticsManager * statisticsManager = ((HBSD_Routing*)this->router)->statisticsManager;
@@ -718,12 +735,12 @@ string Bundles::getBundleWithTheSmallestDRUtilityFromTheBuffer(Bundle * sb, doub
 	}
 
 	*smallestUtility = minUtility;
-	*sb = *(selectedBundle->second);
-	return sb->localId;
+	sb = selectedBundle->second;
+	return selectedBundle->first;
 }
 
 
-string Bundles::getBundleWithTheSmallestDDUtilityFromTheBuffer(Bundle * sb, double * smallestUtility)
+string Bundles::getBundleWithTheSmallestDDUtilityFromTheBuffer(Bundle *& sb, double * smallestUtility)
 {
 	// The statistics manager
 	StatisticsManager * statisticsManager = ((HBSD_Routing*)this->router)->statisticsManager;
@@ -749,7 +766,7 @@ string Bundles::getBundleWithTheSmallestDDUtilityFromTheBuffer(Bundle * sb, doub
 		Bundle * cb = iter->second;
 		statisticsManager->getStatFromAxe(cb->getElapsedTimeSinceCreation(), (char*)iter->first.c_str(),&niAtT,&miAtT,&ddAtT,&drAtT);
 
-		currentUtilityValue = ((parameterAlpha/(numberOfNodes - 1))*pow((double)ddAtT, 2.0))/(numberOfNodes - 1 - miAtT);
+		currentUtilityValue = ((parameterAlpha/(numberOfNodes - 1))*(ddAtT * ddAtT))/(numberOfNodes - 1 - miAtT);
 		// Don't consider bundles generated by local applications
 		if((currentUtilityValue < minUtility) && !((HBSD_Routing*)router)->localSource(iter->second))
 		{
@@ -760,8 +777,8 @@ string Bundles::getBundleWithTheSmallestDDUtilityFromTheBuffer(Bundle * sb, doub
 	}
 
 	*smallestUtility = minUtility;
-	*sb = *(selectedBundle->second);
-	return sb->localId;
+	sb = selectedBundle->second;
+	return selectedBundle->first;
 }
 
 
@@ -776,21 +793,20 @@ string Bundles::createSV(string type, bool lock)
 	// this should be unique per injected bundle because dtnd will delete it
 	if(lock)
 	{
-		getBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		getBundlesLock(LOCK_LOCATION);
 	}
 
 
 	try
 	{
 		string payloadFile;
-		payloadFile.assign(string("/home/amir/hbsd_dtn2_epidemic_sv_") +  Util::to_string(HBSD::requester->getAndIncrement()));
+		payloadFile.assign(svDirectory + string("hbsd_dtn2_epidemic_sv_") +  Util::to_string(HBSD::requester->getAndIncrement()));
 
 		// open and truncate the summary vector file
 		ofstream svFile;
 		svFile.open(payloadFile.c_str(), ios_base::trunc);
 
-		if(HBSD::log->enabled(Logging::INFO))
-			HBSD::log->info(string("creating the SV for transmission"));
+		HBSD_LOG_INFO(string("creating the SV for transmission"));
 
 		// Starting a new Epidemic routing session
 		if(type.compare(string(EPIDEMIC_SV_1)) == 0)
@@ -803,58 +819,51 @@ string Bundles::createSV(string type, bool lock)
 		}
 		else
 		{
-			if(HBSD::log->enabled(Logging::ERROR))
-				HBSD::log->error(string("Unknown Epidemic metadata file type: ") + type);
+			HBSD_LOG_ERROR(string("Unknown Epidemic metadata file type: ") + type);
 		}
 
+		// The keys are only logged at the trace level, once the lock is left
+		bool traceKeys = HBSD_LOG_ENABLED(Logging::TRACE);
+		string keys;
+		size_t numberOfKeys = activeBundles.size();
 		if(activeBundles.size() > 0)
 		{
 			// for every real bundle in our list..
 			for(map <std::string,Bundle *>::iterator iter = activeBundles.begin(); iter != activeBundles.end(); iter++)
 			{
 				// add the bundle's hash to the file
-				svFile << localidGBOFMap[iter->second->localId]<<endl;
+				svFile << iter->first <<endl;
+				if(traceKeys)
+					keys.append(iter->first).append(" ");
 			}
 		}
 
 		// Closing the file
 		svFile.close();
 
-		ifstream tmpFile;
-		tmpFile.open(payloadFile.c_str());
-		string tmpLine;
-
-		if(HBSD::log->enabled(Logging::INFO))
-		{
-			HBSD::log->info(string("Epidemic summary vector created of type: ") + type);
-			cout<<"---------------------------"<<endl;
-			while(tmpFile >> tmpLine)
-			{
-				cout << tmpLine<<endl;
-			}
-			cout<<"---------------------------"<<endl;
-		}
-
-		tmpFile.close();
-
-
 		string tmp(payloadFile);
 
 		if(lock)
 		{
-			leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+			leaveBundlesLock(LOCK_LOCATION);
 		}
+
+		HBSD_LOG_INFO(string("Epidemic summary vector created of type: ") + type + string(" with ") + Util::to_string(numberOfKeys) + string(" bundles"));
+		if(traceKeys)
+			HBSD::log->trace(string("Summary vector keys: ") + keys);
+
 		// Returning the path to the created bundles summary vector
 		return tmp;
 	}
 
 	catch(exception& e)
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-			HBSD::log->error(string("Error occurred @ Bundles::createSV: ") + string(e.what()));
-
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
-		return NULL;
+		if(lock)
+		{
+			leaveBundlesLock(LOCK_LOCATION);
+		}
+		HBSD_LOG_ERROR(string("Error occurred @ Bundles::createSV: ") + string(e.what()));
+		return string("");
 	}
 }
 
@@ -864,14 +873,17 @@ string Bundles::createSV(string type, bool lock)
 void Bundles::compareAndSend(string  remoteSv, Link *link, bool sendBack)
 {
 	assert(link !=NULL);
+	// Run by the contact session, the router thread may be updating the link
+	string remoteEID;
+	link->getSnapshot(remoteEID);
 	try
 	{
 
 
-		getBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		getBundlesLock(LOCK_LOCATION);
 
 
-		showAvailableBundles();
+		showAvailableBundles(false);
 
 		bool send;
 		int nbrToSend = 0;
@@ -921,8 +933,7 @@ void Bundles::compareAndSend(string  remoteSv, Link *link, bool sendBack)
 
 		if(nbrToSend > 0)
 		{
-			if(HBSD::log->enabled(Logging::INFO))
-				HBSD::log->info(string("Sending back ") + Util::to_string(listToSend.size()) + string(" bundles ") + link->remoteEID );
+			HBSD_LOG_INFO(string("Sending back ") + Util::to_string(listToSend.size()) + string(" bundles ") + remoteEID );
 
 
 			if(((HBSD_Routing*)this->router)->enableOptimization())
@@ -936,10 +947,7 @@ void Bundles::compareAndSend(string  remoteSv, Link *link, bool sendBack)
 					((HBSD_Routing*)router)->scheduleDDAndSend(listToSend, link);
 					break;
 				default:
-					if(HBSD::log->enabled(Logging::FATAL))
-					{
-						HBSD::log->fatal(string("A bad optimization problem is selected"));
-					}
+					HBSD_LOG_FATAL(string("A bad optimization problem is selected"));
 				}
 			}else
 			{
@@ -949,8 +957,7 @@ void Bundles::compareAndSend(string  remoteSv, Link *link, bool sendBack)
 		}
 		else
 		{
-			if(HBSD::log->enabled(Logging::INFO))
-				HBSD::log->info(string("0 bundles will be sent back."));
+			HBSD_LOG_INFO(string("0 bundles will be sent back."));
 		}
 
 
@@ -959,8 +966,7 @@ void Bundles::compareAndSend(string  remoteSv, Link *link, bool sendBack)
 		{
 			if(!remoteSv.empty() || !activeBundles.empty())
 			{
-				if(HBSD::log->enabled(Logging::INFO))
-					HBSD::log->info(string("Trying to send back local SV."));
+				HBSD_LOG_INFO(string("Trying to send back local SV."));
 
 				// Now we need to send our SV if they have a bundle that we don't have
 				// (re)set the file cursor to the beginning of the file
@@ -994,16 +1000,15 @@ void Bundles::compareAndSend(string  remoteSv, Link *link, bool sendBack)
 					// Sending our SV
 					// Sending the summary vector of bundles
 					string reqId;
-					string remoteRouter = link->remoteEID + string("/") + HBSD::routerEndpoint;
+					string remoteRouter = remoteEID + string("/") + HBSD::routerEndpoint;
 					if((reqId = HBSD::requester->requestInjectBundle(HBSD::hbsdRegistration, remoteRouter, link->id, createSV(string(EPIDEMIC_SV_2), false))).empty())
 					{
-						if(HBSD::log->enabled(Logging::ERROR))
-							HBSD::log->error(string("Unable to send the bundles summary vector to the remote peer"));
+						HBSD_LOG_ERROR(string("Unable to send the bundles summary vector to the remote peer"));
 					}else
 					{
 						// Informing HBSD_Policy about that
 						HBSD_Policy * policy = (HBSD_Policy*)((HBSD_Routing*)this->router)->policyMgr;
-						policy->addNewInjectedRequest(reqId, link->id, link->remoteEID);
+						policy->addNewInjectedRequest(reqId, link->id, remoteEID);
 						policy = NULL;
 					}
 				}
@@ -1011,49 +1016,62 @@ void Bundles::compareAndSend(string  remoteSv, Link *link, bool sendBack)
 				{
 					if(remoteSv.empty() && !activeBundles.empty())
 					{
-						if(HBSD::log->enabled(Logging::INFO))
-							HBSD::log->info(string("Remote Epidemic SV is empty, we will ask for nothing."));
+						HBSD_LOG_INFO(string("Remote Epidemic SV is empty, we will ask for nothing."));
 
 					}else
 					{
-						if(HBSD::log->enabled(Logging::INFO))
-							HBSD::log->info(string("Both Epidemic SV are equal, nothing to send back."));
+						HBSD_LOG_INFO(string("Both Epidemic SV are equal, nothing to send back."));
 					}
 				}
 			}
 			else
 			{
-				if(HBSD::log->enabled(Logging::INFO))
-					HBSD::log->info(string("Both the received SV and the local bundles store are empty."));
+				HBSD_LOG_INFO(string("Both the received SV and the local bundles store are empty."));
 			}
 		}
 
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveBundlesLock(LOCK_LOCATION);
 
 	}
 
 	catch(exception & e)
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-			HBSD::log->error(string("Error occurred @ Bundles::compareAndSend: ") + string(e.what()));
-		leaveBundlesLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		HBSD_LOG_ERROR(string("Error occurred @ Bundles::compareAndSend: ") + string(e.what()));
+		leaveBundlesLock(LOCK_LOCATION);
 	}
 }
 
 
-void Bundles::showAvailableBundles()
+void Bundles::showAvailableBundles(bool lock)
 {
-	if(HBSD::log->enabled(Logging::INFO))
+	if(!HBSD_LOG_ENABLED(Logging::INFO))
+		return;
+
+	// The descriptions are built under the lock and logged once it is left
+	bool describe = HBSD_LOG_ENABLED(Logging::DEBUG);
+	list<string> descriptions;
+	if(lock)
 	{
-		HBSD::log->info(string("Number of available bundles: ")+ Util::to_string(activeBundles.size()));
-		for(map<string, Bundle *>::iterator iter = activeBundles.begin(); iter != activeBundles.end(); iter++)
-		{
-			HBSD::log->info(string("Bundle gbof: ") + iter->first + string(" ttl: ") + Util::to_string(iter->second->expiration) + string(" creation ts: ")+Util::to_string(iter->second->creationTimestamp));
-		}
+		getBundlesLock(LOCK_LOCATION);
+	}
+	size_t numberOfBundles = activeBundles.size();
+	for(map<string, Bundle *>::iterator iter = activeBundles.begin(); describe && iter != activeBundles.end(); iter++)
+	{
+		descriptions.push_back(string("Bundle gbof: ") + iter->first + string(" ttl: ") + Util::to_string(iter->second->expiration) + string(" creation ts: ")+Util::to_string(iter->second->creationTimestamp));
+	}
+	if(lock)
+	{
+		leaveBundlesLock(LOCK_LOCATION);
+	}
+
+	HBSD::log->info(string("Number of available bundles: ")+ Util::to_string(numberOfBundles));
+	for(list<string>::iterator iter = descriptions.begin(); iter != descriptions.end(); iter++)
+	{
+		HBSD::log->debug(*iter);
 	}
 }
 
-void Bundles::getBundlesLock(string x)
+void Bundles::getBundlesLock(const char * x)
 {
 	if(BUNDLES_LOCK_LOG)
 	{
@@ -1067,7 +1085,7 @@ void Bundles::getBundlesLock(string x)
 	sem_wait(&bundlesLock);
 }
 
-void Bundles::leaveBundlesLock(string x)
+void Bundles::leaveBundlesLock(const char * x)
 {
 	if(BUNDLES_LOCK_LOG)
 	{
@@ -44,6 +44,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // and EPIDEMIC_SV_2 is sent as an answer to an already received EPIDEMIC_SV_1
 #define EPIDEMIC_SV_1 "EpidemicSV1"
 #define EPIDEMIC_SV_2 "EpidemicSV2"
+// Default directory of the summary vector files handed to dtnd
+#define DEFAULT_SV_DIRECTORY "/home/amir/"
 #define BUNDLES_LOCK_FILE "bundlesLockLog"
 #define BUNDLES_LOCK_LOG false
 
@@ -198,9 +200,11 @@ public:
 	void compareAndSend(std::string remoteSv, Link *link, bool sendBack);
 
 	/*
-	 * Shows the available list of bundles
+	 * Shows the available list of bundles, each bundle at the debug level
+	 *
+	 * @param lock False if the caller already holds the bundles lock.
 	 */
-	void showAvailableBundles();
+	void showAvailableBundles(bool lock);
 
 	time_t getLastTimeBundlesStoreChanged();
 	void changeLastTimeBundlesStoreUpdate();
@@ -233,6 +237,8 @@ private:
 	std::map <std::string,Bundle *> activeBundles;
 	std::map <std::string, std::string> localidGBOFMap;
 	unsigned int maxBufferCapacity;
+	// Directory where the summary vector files are created
+	std::string svDirectory;
 
 	// An integer that indicates whether the HBSD policy is used towards increasing the network average delivery rate (equal to 0) or
 	// decreasing its average delivery delay (equal to 1)
@@ -270,17 +276,23 @@ private:
 
 
 	/**
-	 * Return the localId and a pointer to the bundle having the smallest utility value within the local buffer.
-	 * @param sb a pointer to the bundle having the smallest utility value.
+	 * Return the GBOF key and a pointer to the bundle having the smallest utility value within the local buffer.
+	 * @param sb set to the bundle having the smallest utility value.
 	 * @param metric a pointer to the smallest metric value found in the buffer
-	 * @return the bundle localid
+	 * @return the bundle GBOF key, as used by the statistics matrix
+	 */
+	std::string getBundleWithTheSmallestDRUtilityFromTheBuffer(Bundle *& sb, double * smallestUtility);
+	std::string getBundleWithTheSmallestDDUtilityFromTheBuffer(Bundle *& sb, double * smallestUtility);
+
+	/**
+	 * Asks dtnd to delete a received bundle that is not kept in the buffer, then frees it.
+	 * @param bundle The rejected bundle.
 	 */
-	std::string getBundleWithTheSmallestDRUtilityFromTheBuffer(Bundle * sb, double * smallestUtility);
-	std::string getBundleWithTheSmallestDDUtilityFromTheBuffer(Bundle * sb, double * smallestUtility);
+	bool discardBundle(Bundle *bundle);
 
 	sem_t bundlesLock;
-	void getBundlesLock(std::string x);
-	void leaveBundlesLock(std::string x);
+	void getBundlesLock(const char * x);
+	void leaveBundlesLock(const char * x);
 	sem_t storeStatus;
 	time_t lastTimeBundlesStoreChanged;
 };
@@ -87,6 +87,17 @@ public:
 	bool getBoolean(std::string key, bool dflt);
 	int getInt(std::string key, int dflt);
 
+	/**
+	 * Overrides the value of a key, e.g. for the tools that embed the router.
+	 * 
+	 * @param key Key to define.
+	 * @param value Its new value.
+	 */
+	void setValue(std::string key, std::string value)
+	{
+		mapConfig[key] = value;
+	}
+
 private:
 
 	std::string fileName;
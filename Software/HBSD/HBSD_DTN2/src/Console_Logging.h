@@ -91,7 +91,7 @@ public:
 	 * @param message Message to be logged.
 	 */
 	
-	void trace(std::string message) 
+	void trace(const std::string & message)
 	{
 		if (currentLevel >= TRACE) 
 		{
@@ -99,7 +99,7 @@ public:
 		}
 	}
 	
-	void debug(std::string message) 
+	void debug(const std::string & message)
 	{
 		if (currentLevel >= DEBUG) 
 		{
@@ -107,13 +107,13 @@ public:
 		}
 	}
 	
-	void info(std::string message) {
+	void info(const std::string & message) {
 		if (currentLevel >= INFO) {
 			output(message, "INFO");
 		}
 	}
 	
-	void warn(std::string message) 
+	void warn(const std::string & message)
 	{
 		if (currentLevel >= WARN) 
 		{
@@ -121,7 +121,7 @@ public:
 		}
 	}
 	
-	void error(std::string message) 
+	void error(const std::string & message)
 	{
 		if (currentLevel >= ERROR) 
 		{
@@ -129,7 +129,7 @@ public:
 		}
 	}
 	
-	void fatal(std::string message) 
+	void fatal(const std::string & message)
 	{
 		if (currentLevel >= FATAL) 
 		{
@@ -0,0 +1,142 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#include "ContactExecutor.h"
+#include "Link.h"
+#include "HBSD.h"
+#include <stdlib.h>
+
+using namespace std;
+
+ContactExecutor::ContactExecutor(int numberOfWorkers)
+{
+	this->numberOfWorkers = numberOfWorkers > 0 ? numberOfWorkers : 0;
+	stopping = false;
+	startedWorkers = 0;
+	workers = NULL;
+	sem_init(&readyLinksLock, 0, 1);
+	sem_init(&readyLinksCount, 0, 0);
+}
+
+ContactExecutor::~ContactExecutor()
+{
+	sem_wait(&readyLinksLock);
+	stopping = true;
+	sem_post(&readyLinksLock);
+
+	for(int i = 0; i < startedWorkers; i++)
+		sem_post(&readyLinksCount);
+	for(int i = 0; i < startedWorkers; i++)
+		pthread_join(workers[i], NULL);
+	delete [] workers;
+
+	// Sessions that did not get a worker before the stop are run here, so
+	// that their links are left with no action pending
+	while(!readyLinks.empty())
+	{
+		Link * link = readyLinks.front();
+		readyLinks.pop_front();
+		link->runActions();
+		link->release();
+	}
+
+	sem_destroy(&readyLinksLock);
+	sem_destroy(&readyLinksCount);
+}
+
+void ContactExecutor::init()
+{
+	if(numberOfWorkers == 0)
+	{
+		HBSD_LOG_INFO(string("Contact sessions run by the router thread."));
+		return;
+	}
+
+	workers = new pthread_t[numberOfWorkers];
+	for(int i = 0; i < numberOfWorkers; i++)
+	{
+		ThreadParamContact * tp = (ThreadParamContact *)malloc(sizeof(ThreadParamContact));
+		if(tp == NULL)
+		{
+			HBSD_LOG_FATAL(string("Problem occurred while allocate ContactExecutor thread parameter"));
+			exit(1);
+		}
+		tp->executor = this;
+
+		if(pthread_create(&workers[i], NULL, ContactExecutor::run, (void *)tp) != 0)
+		{
+			HBSD_LOG_FATAL(string("Unable to create a ContactExecutor thread."));
+			exit(1);
+		}
+		startedWorkers++;
+	}
+
+	HBSD_LOG_INFO(string("ContactExecutor threads loaded: ") + Util::to_string(numberOfWorkers));
+}
+
+void ContactExecutor::schedule(Link * link)
+{
+	assert(link != NULL);
+	link->acquire();
+
+	if(numberOfWorkers == 0)
+	{
+		link->runActions();
+		link->release();
+		return;
+	}
+
+	sem_wait(&readyLinksLock);
+	readyLinks.push_back(link);
+	sem_post(&readyLinksLock);
+	sem_post(&readyLinksCount);
+}
+
+void * ContactExecutor::run(void * arg)
+{
+	ThreadParamContact * recvArg = (ThreadParamContact *)arg;
+	assert(recvArg != NULL);
+	ContactExecutor * executor = recvArg->executor;
+	free(recvArg);
+
+	while(true)
+	{
+		sem_wait(&executor->readyLinksCount);
+
+		sem_wait(&executor->readyLinksLock);
+		if(executor->stopping)
+		{
+			sem_post(&executor->readyLinksLock);
+			break;
+		}
+		Link * link = executor->readyLinks.front();
+		executor->readyLinks.pop_front();
+		sem_post(&executor->readyLinksLock);
+
+		link->runActions();
+		link->release();
+	}
+
+	return NULL;
+}
@@ -0,0 +1,92 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef CONTACT_EXECUTOR_H
+#define CONTACT_EXECUTOR_H
+
+#include <deque>
+#include <pthread.h>
+#include <semaphore.h>
+
+// Worker threads running the contact sessions, 0 runs them on the calling thread
+#define DEFAULT_CONTACT_WORKERS 2
+
+class Link;
+class ContactExecutor;
+
+typedef struct ThreadParamContact
+{
+	ContactExecutor * executor;
+}ThreadParamContact;
+
+/**
+ * Shared pool of threads running the contact sessions of the links. A link
+ * is scheduled when its session gets work, and only one worker runs a given
+ * session at a time: the actions of a contact stay ordered while different
+ * contacts proceed in parallel.
+ */
+class ContactExecutor
+{
+public:
+
+	/**
+	 * @param numberOfWorkers Threads of the pool, 0 to run the sessions inline.
+	 */
+	ContactExecutor(int numberOfWorkers);
+
+	/**
+	 * Stops the workers, waiting for the sessions they are running, then
+	 * runs the sessions still queued on the calling thread.
+	 */
+	~ContactExecutor();
+
+	/**
+	 * Starts the worker threads.
+	 */
+	void init();
+
+	/**
+	 * Queues a link whose session has pending actions. Holds a reference on
+	 * the link until its session ran.
+	 */
+	void schedule(Link * link);
+
+	/**
+	 * Main loop of the worker threads.
+	 */
+	static void * run(void * arg);
+
+private:
+
+	std::deque<Link *> readyLinks;
+	sem_t readyLinksLock;
+	// Counts the queued links, plus one wake up per worker when stopping
+	sem_t readyLinksCount;
+	bool stopping;
+	int numberOfWorkers;
+	pthread_t * workers;
+	int startedWorkers;
+};
+
+#endif
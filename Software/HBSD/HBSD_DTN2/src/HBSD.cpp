@@ -36,6 +36,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Requester.h"
 #include <iostream>
 #include "ConfigFile.h"
+#include "Metrics.h"
 #include <xercesc/sax2/XMLReaderFactory.hpp>
 #include <xercesc/sax2/DefaultHandler.hpp>
 #include <xercesc/util/XMLString.hpp>
@@ -53,6 +54,8 @@ ConfigFile * HBSD::routerConf;
 string HBSD::localEID;
 Requester* HBSD::requester;
 string HBSD::hbsdRegistration;
+TraceRecorder * HBSD::recorder;
+MetricsInterface * HBSD::metricsInterface;
 
 int HBSD::dtndSocket;
 struct sockaddr_in HBSD::dtndSocketAddr;
@@ -98,6 +101,8 @@ HBSD::HBSD(int thrd)
 		// Settingup the loopbackAdr
 		LOOPBACKADR.assign("127.0.0.1");
 		requester = NULL;
+		recorder = NULL;
+		metricsInterface = NULL;
 		log = NULL;
 		routerConf = NULL;
 		// The default router End Point id
@@ -132,6 +137,8 @@ void HBSD::InitStaticMembers()
 	saxReader = NULL;
 	LOOPBACKADR.assign("127.0.0.1");
 	requester = NULL;
+	recorder = NULL;
+	metricsInterface = NULL;
 	log = NULL;
 	routerConf = NULL;
 	routerEndpoint.append("ext.rtr/HBSD");
@@ -152,6 +159,10 @@ HBSD::~HBSD()
 		delete routerConf;
 	if(requester != NULL)
 		delete requester;
+	if(recorder != NULL)
+		delete recorder;
+	if(metricsInterface != NULL)
+		delete metricsInterface;
 }
 
 // Parsing commandline options
@@ -376,6 +387,35 @@ void HBSD::startRouterLoop()
 	// Will hold the message which will be received from the DTN2 daemon
 	char msg[MAX_DTNDXML_SZ];
 
+	// Start recording before the first requests are sent
+	if(routerConf->getBoolean(string("enableTraceRecording"), false))
+	{
+		recorder = new TraceRecorder(routerConf->getstring(string("traceRecordingFile"), string(DEFAULT_TRACE_RECORDING_FILE)),
+			routerConf->getBoolean(string("traceRecordingCompression"), false),
+			routerConf->getInt(string("traceRecordingQueueSize"), DEFAULT_TRACE_RECORDING_QUEUE_SIZE));
+		if(!recorder->init())
+		{
+			delete recorder;
+			recorder = NULL;
+		}else
+		{
+			// The replayed requests are built with the same ids
+			string idBase = requester->getIdBase();
+			recorder->record(TRACE_RECORD_REQUEST_ID_BASE, idBase.data(), idBase.length());
+		}
+	}
+
+	Metrics::enabled = routerConf->getBoolean(string("enableMetrics"), true);
+	int metricsPort = routerConf->getBoolean(string("enableMetricsInterface"), false) ?
+		routerConf->getInt(string("metricsInterfacePort"), DEFAULT_METRICS_INTERFACE_PORT) : 0;
+	int metricsDumpInterval = routerConf->getInt(string("metricsDumpInterval"), DEFAULT_METRICS_DUMP_INTERVAL);
+	if(Metrics::enabled && (metricsPort > 0 || metricsDumpInterval > 0))
+	{
+		metricsInterface = new MetricsInterface(metricsPort,
+			routerConf->getstring(string("metricsDumpFile"), string(DEFAULT_METRICS_DUMP_FILE)), metricsDumpInterval);
+		metricsInterface->init();
+	}
+
 	//Initialize the HBSD Router
 	handlerHBSD->initialized();
 
@@ -389,6 +429,11 @@ void HBSD::startRouterLoop()
 			memset(msg,'\0',MAX_DTNDXML_SZ);
 			int cnt = recvfrom(dtndSocket, msg, sizeof(msg), 0, (sockaddr*)&dtndSocketAddr, (socklen_t*)&sizeAddr);
 			assert(cnt > 0);
+			uint64_t messageStart = Metrics::now();
+			Metrics::increment(METRIC_DTND_MESSAGES);
+			Metrics::increment(METRIC_DTND_BYTES, cnt);
+			if(recorder != NULL)
+				recorder->record(TRACE_RECORD_RECEIVED, msg, cnt);
 			try 
 			{
 				string s;
@@ -402,9 +447,11 @@ void HBSD::startRouterLoop()
 				MemBufInputSource inputsource((const XMLByte*)s.c_str(), s.length(), "msg", false);
 				//Parse the received xml message and fire the corresponding events
 				saxReader->parse(inputsource);
+				Metrics::observeSince(METRIC_DTND_MESSAGE_TIME, messageStart);
 			}
 			catch (SAXException &e)
 			{
+				Metrics::increment(METRIC_DTND_PARSE_ERRORS);
 				if (log->enabled(Logging::ERROR)) 
 				{
 					log->error(string("Error parsing XML packet: ") + string(XMLString::transcode(e.getMessage())));
@@ -414,6 +461,7 @@ void HBSD::startRouterLoop()
 
 			catch (exception &e) 
 			{
+				Metrics::increment(METRIC_DTND_PARSE_ERRORS);
 				if (log->enabled(Logging::ERROR)) 
 				{
 					log->error(string("Unanticipated XML parsing error: ") + string(e.what()));
@@ -33,6 +33,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "HBSD_Routing.h"
 #include <xercesc/sax2/SAX2XMLReader.hpp>
 #include "Requester.h"
+#include "TraceRecorder.h"
+#include "MetricsInterface.h"
 
 using namespace xercesc;
 
@@ -74,6 +76,10 @@ public:
 	static std::string localEID;
 	static Requester* requester;
 	static std::string hbsdRegistration;
+	// Records the messages exchanged with dtnd, NULL unless enableTraceRecording is set
+	static TraceRecorder * recorder;
+	// Answers the metrics queries and dumps, NULL unless enabled
+	static MetricsInterface * metricsInterface;
 
 	static int dtndSocket;
 	static struct sockaddr_in dtndSocketAddr;
@@ -147,5 +153,23 @@ public:
 	static bool staticInitialized;
 };
 
+// The log level grows with the verbosity: a message is written when its level is at most
+// the -log_level, so -log_level 6 (Logging::OFF) writes every message. The messages above
+// this level are compiled out, e.g. -DHBSD_MAX_LOG_LEVEL=1 keeps the TRACE and DEBUG ones.
+#ifndef HBSD_MAX_LOG_LEVEL
+#define HBSD_MAX_LOG_LEVEL 6
+#endif
+
+// Constant false for the levels compiled out, so that the message is never built
+#define HBSD_LOG_ENABLED(level) ((level) <= HBSD_MAX_LOG_LEVEL && HBSD::log->enabled(level))
+
+// Logging helpers only building their message when the level is enabled
+#define HBSD_LOG_TRACE(message) do { if(HBSD_LOG_ENABLED(Logging::TRACE)) HBSD::log->trace(message); } while(0)
+#define HBSD_LOG_DEBUG(message) do { if(HBSD_LOG_ENABLED(Logging::DEBUG)) HBSD::log->debug(message); } while(0)
+#define HBSD_LOG_INFO(message) do { if(HBSD_LOG_ENABLED(Logging::INFO)) HBSD::log->info(message); } while(0)
+#define HBSD_LOG_WARN(message) do { if(HBSD_LOG_ENABLED(Logging::WARN)) HBSD::log->warn(message); } while(0)
+#define HBSD_LOG_ERROR(message) do { if(HBSD_LOG_ENABLED(Logging::ERROR)) HBSD::log->error(message); } while(0)
+#define HBSD_LOG_FATAL(message) do { if(HBSD_LOG_ENABLED(Logging::FATAL)) HBSD::log->fatal(message); } while(0)
+
 
 #endif
@@ -205,7 +205,11 @@ try
 		// Get the link actually associated with the source node
 		Link * linkToDest = destNode->getAssociatedLink();
 		// Answer the received metadata file
-		if(type.compare(string(EPIDEMIC_SV_1)) == 0)
+		if(linkToDest == NULL)
+		{
+			// The contact ended before the meta data could be answered
+			HBSD_LOG_INFO(string("No link associated with the meta data source anymore: ") + src);
+		}else if(type.compare(string(EPIDEMIC_SV_1)) == 0)
 		{
 			if(HBSD::log->enabled(Logging::INFO))
 				HBSD::log->info(string("Meta data received EPIDEMIC_SV_1: ") + string(data));
@@ -40,6 +40,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Requester.h"
 #include <iostream>
 #include "MeDeHaInterface.h"
+#include "ContactExecutor.h"
 #include <math.h>
 #include <fstream>
 using namespace std;
@@ -56,6 +57,7 @@ HBSD_Routing::HBSD_Routing()
 	// Load and initialize both the router's policy manager and the statistics manager.
 	string routerPolicyClassName = HBSD::routerConf->getstring("routerPolicyClass", defaultPolicy);
 	enableHbsdOptimization = HBSD::routerConf->getBoolean("enableHbsdOptimization", DEFAULT_RUN_HBSD_OPTIMIZATION);
+	medehaInterface = NULL;
 
 	try 
 	{
@@ -63,11 +65,14 @@ HBSD_Routing::HBSD_Routing()
 		statisticsManager = new StatisticsManager();
 		if (!policyMgr->init(this)) 	
 		{
-			if(HBSD::log->enabled(Logging::FATAL))
-				HBSD::log->fatal(string("Unable to initialize Policy Manager: ") +	routerPolicyClassName);
+			HBSD_LOG_FATAL(string("Unable to initialize Policy Manager: ") +	routerPolicyClassName);
 			exit(1);
 		}
 
+		// The workers running the links contact sessions
+		contactExecutor = new ContactExecutor(HBSD::routerConf->getInt(string("contactWorkers"), DEFAULT_CONTACT_WORKERS));
+		contactExecutor->init();
+
 		// Verifying whether to activate or not the MeDeHa interface
 		enableMeDeHaInterface = HBSD::routerConf->getBoolean(string("enableMeDeHaInterface"), ENABLE_MEDEHA_INTERFACE);
 		if(enableMeDeHaInterface)
@@ -86,10 +91,7 @@ HBSD_Routing::HBSD_Routing()
 
 	catch (exception& e) 
 	{
-		if (HBSD::log->enabled(Logging::ERROR)) 
-		{
-			HBSD::log->error("Unable to load the Policy Manager: " + string(e.what()));
-		}
+		HBSD_LOG_ERROR("Unable to load the Policy Manager: " + string(e.what()));
 		exit(1);
 	}
 }
@@ -97,7 +99,7 @@ HBSD_Routing::HBSD_Routing()
 HBSD_Routing::~HBSD_Routing()
 {
 	// Shutting down the peerListener object
-	if(peerListener != NULL);
+	if(peerListener != NULL)
 	{
 		peerListener->stopThread();
 		delete peerListener;
@@ -109,6 +111,12 @@ HBSD_Routing::~HBSD_Routing()
 
 	if(medehaInterface != NULL)
 		delete medehaInterface;
+	// Runs the pending contact actions before the links go away
+	if(contactExecutor != NULL)
+	{
+		delete contactExecutor;
+		contactExecutor = NULL;
+	}
 	if(bundles != NULL)
 		delete bundles;
 	if(links != NULL)
@@ -148,8 +156,7 @@ void HBSD_Routing::handler_bpa_root(XMLTree *bpa)
 	if(bpa->haveAttr(string("hello_interval")))
 	{
 		// If there is some links up then start an Epidemic session
-		if(HBSD::log->enabled(Logging::INFO))
-			HBSD::log->info(string("Hello message received from dtnd."));
+		HBSD_LOG_INFO(string("Hello message received from dtnd."));
 		links->InitiateESWithAvailableLinks();
 	}
 
@@ -159,13 +166,12 @@ void HBSD_Routing::handler_bpa_root(XMLTree *bpa)
 
 		if(string("shuttingDown").compare(bpa->getAttr(string("alert"))) == 0) 
 		{
-			bool verbose = HBSD::log->enabled(Logging::INFO);
+			bool verbose = HBSD_LOG_ENABLED(Logging::INFO);
 			if (HBSD::routerConf->getBoolean(string("terminateWithDTN"),true)) 
 			{
 				if (verbose) 
 				{
-					if(HBSD::log->enabled(Logging::INFO))
-						HBSD::log->info(string("DTN daemon is terminating; HBSD will now terminate"));
+					HBSD_LOG_INFO(string("DTN daemon is terminating; HBSD will now terminate"));
 				}
 
 				// Shutting down the MeDeHa interface
@@ -209,7 +215,7 @@ void HBSD_Routing::handler_bundle_received_event(XMLTree* event, XMLTree* bpa)
 	}
 	catch (exception &e)
 	{
-		cout<<"Exception occurred at HBSD_Routing::handler_bundle_received_event: "<<e.what()<<endl;
+		HBSD_LOG_FATAL(string("Exception occurred at HBSD_Routing::handler_bundle_received_event: ") + string(e.what()));
 		exit(1);
 	}
 }
@@ -231,20 +237,17 @@ void HBSD_Routing::handler_data_transmitted_event(XMLTree* event, XMLTree* bpa)
 		Link* link = links->getById(linkId);
 		if (link == NULL) 
 		{
-			if (HBSD::log->enabled(Logging::ERROR)) 
-			{
-				HBSD::log->error("Unable to locate link id to complete transmission: " + linkId);
-			}
+			HBSD_LOG_ERROR("Unable to locate link id to complete transmission: " + linkId);
 			return;
 		}
 
+		// Accounted to the link current contact
+		link->dataTransmitted(atol(event->getAttrRequired(string("bytes_sent")).c_str()));
+
 	} 
 	catch (exception & e) 
 	{
-			if(HBSD::log->enabled(Logging::ERROR))
-			{
-				HBSD::log->error(string("Error occurred within HBSD_Routing::handler_data_transmitted_event: ") + string(e.what()));
-			}
+			HBSD_LOG_ERROR(string("Error occurred within HBSD_Routing::handler_data_transmitted_event: ") + string(e.what()));
 	}
 }
 
@@ -290,10 +293,7 @@ void HBSD_Routing::handler_bundle_delivery_event(XMLTree* event, XMLTree* bpa)
 	// sent to us from another EID. If we are the source, ignore it.
 	if (localSource(bundle)) 
 	{
-		if (HBSD::log->enabled(Logging::DEBUG)) 
-		{
-			HBSD::log->debug(string("Ignoring HBSD routing originated by this node"));
-		}
+		HBSD_LOG_DEBUG(string("Ignoring HBSD routing originated by this node"));
 		return;
 	}
 
@@ -342,15 +342,15 @@ void HBSD_Routing::handler_bundle_injected_event(XMLTree* event, XMLTree* bpa)
 
 		if(bundle->isMeDeHaBundle())
 		{
-			if(HBSD::log->enabled(Logging::INFO))
-			{
-				HBSD::log->info(string("The injected bundle is a MeDeHa one, considering it as a new received one."));
-			}
+			HBSD_LOG_INFO(string("The injected bundle is a MeDeHa one, considering it as a new received one."));
 			// Redirect and consider it as a received one
 			bundle->injected = false;
 			XMLTree* el = event->getChildElementRequired(string("request_id"));
 			((HBSD_Policy*)policyMgr)->addTheMeDeHaInjectedBundle(el->getValue(), bundle);
-			bundles->showAvailableBundles();
+			// dtnd has its own copy of the payload now
+			if(medehaInterface != NULL)
+				medehaInterface->injectionCompleted(el->getValue());
+			bundles->showAvailableBundles(true);
 
 		}else
 		{
@@ -365,8 +365,7 @@ void HBSD_Routing::handler_bundle_injected_event(XMLTree* event, XMLTree* bpa)
 	} 
 	catch (exception& e) 
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-			HBSD::log->error(string("Error parsing injected bundle element: ") + string(e.what()));
+		HBSD_LOG_ERROR(string("Error parsing injected bundle element: ") + string(e.what()));
 		exit(1);
 	}
 }
@@ -387,35 +386,10 @@ void HBSD_Routing::handler_link_opened_event(XMLTree* event, XMLTree* bpa)
 	{
 		link->opened(event);
 
-		assert(!link->remoteEID.empty());
-		assert(!link->id.empty());
-
-		//Identify the node who has the bigger ID and send the Epidemic summary vector of messages
-		if(link->remoteEID.compare(HBSD::localEID) > 0)
-		{
-			// Sending a request to DTN2 to inject the SV bundle
-			string reqId;
-
-			string remoteRouter = link->remoteEID + string("/") + HBSD::routerEndpoint;
-			reqId = HBSD::requester->requestInjectBundle(HBSD::hbsdRegistration, remoteRouter, link->id, bundles->createSV(string(EPIDEMIC_SV_1), true));
-			if(reqId.empty())
-			{
-						if(HBSD::log->enabled(Logging::ERROR))
-					HBSD::log->error(string("Unable to send the bundles summary vector to the remote peer"));
-			}else
-			{
-				if(HBSD::log->enabled(Logging::INFO))
-					HBSD::log->info(string("Summary vector is correctly sent."));
-				// Informing HBSD_Policy about that
-				((HBSD_Policy*)policyMgr)->addNewInjectedRequest(reqId, link->id, link->remoteEID);
-			}
-
-		}
-
+		// The link contact session starts the Epidemic exchange
 	} else 
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-			HBSD::log->error(string("Opened unknown link"));
+		HBSD_LOG_ERROR(string("Opened unknown link"));
 	}
 	link = NULL;
 }
@@ -438,8 +412,7 @@ void HBSD_Routing::handler_link_closed_event(XMLTree* event, XMLTree* bpa)
 		link = NULL;
 	} else 
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-			HBSD::log->error(string("Closed unknown link"));
+		HBSD_LOG_ERROR(string("Closed unknown link"));
 	}
 }
 
@@ -518,10 +491,7 @@ bool HBSD_Routing::localSource(Bundle* bundle)
 	} 
 	catch (exception& e) 
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-		{
-			HBSD::log->error(string("An exception occurred in HBSD_Routing::localSource: ") + string(e.what()));
-		}
+		HBSD_LOG_ERROR(string("An exception occurred in HBSD_Routing::localSource: ") + string(e.what()));
 		return false;
 	}
 }
@@ -545,10 +515,7 @@ bool HBSD_Routing::localDest(Bundle* bundle)
 	}
 	catch (exception& e)
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-		{
-			HBSD::log->error(string("An exception occurred in HBSD_Routing::localDest: ") + string(e.what()));
-		}
+		HBSD_LOG_ERROR(string("An exception occurred in HBSD_Routing::localDest: ") + string(e.what()));
 		return false;
 	}
 }
@@ -596,8 +563,8 @@ void HBSD_Routing::handler_link_available_event(XMLTree* event, XMLTree* bpa)
 	if (link != NULL) 
 	{
 		link->available(event);
-		// Asking DTND to open the link
-		link->requestOpen();
+		// The link contact session asks DTND to open the link
+		link->post(Link::ACTION_RUN);
 		link = NULL;
 	} else 
 	{
@@ -624,10 +591,7 @@ void HBSD_Routing::handler_link_unavailable_event(XMLTree* event, XMLTree* bpa)
 		link = NULL;
 	} else 
 	{
-		if (HBSD::log->enabled(Logging::ERROR)) 
-		{
-			HBSD::log->error(string("Unknown link became unavailable"));
-		}
+		HBSD_LOG_ERROR(string("Unknown link became unavailable"));
 	}
 }
 
@@ -641,24 +605,25 @@ void HBSD_Routing::sendWithoutscheduling(list<std::string>& listBundlesIDs, Link
 		// request to send this bundle to the remote node
 		if(HBSD::requester->requestSendBundle(bundles->getByKey(*iter), link->id, HBSD::requester->FWD_ACTION_COPY))
 		{
-			if(HBSD::log->enabled(Logging::INFO))
-				HBSD::log->info(string("The requested bundle: ") + *iter + string(" is successfully sent."));
+			HBSD_LOG_INFO(string("The requested bundle: ") + *iter + string(" is successfully sent."));
+			link->bundleSent();
 			i++;
 		}else
 		{
-			if(HBSD::log->enabled(Logging::ERROR))
-							HBSD::log->error(string("Error occurred when trying to send the scheduled bundle: ") + *iter);
+			HBSD_LOG_ERROR(string("Error occurred when trying to send the scheduled bundle: ") + *iter);
 		}
 	}
-	HBSD::log->info(Util::to_string(i) + string(" bundles was sent without scheduling."));
+	HBSD_LOG_INFO(Util::to_string(i) + string(" bundles was sent without scheduling."));
 }
 
 void HBSD_Routing::scheduleDRAndSend(list<std::string>& listBundlesIDs, Link * link)
 {
 	assert(link != NULL);
 
-	// Scheduling the bundles
-	map<double, string> sortedListWithUtilities;
+	// Scheduling the bundles, called from the PeerListener thread so only the published statistics are read
+	StatisticsSnapshotReader statistics(statisticsManager);
+	// Bundles with the same utility are all kept
+	multimap<double, string> sortedListWithUtilities;
 	for(list<string>::iterator iter = listBundlesIDs.begin(); iter != listBundlesIDs.end();iter++)
 	{
 		// Get the bundle from its ID
@@ -669,38 +634,37 @@ void HBSD_Routing::scheduleDRAndSend(list<std::string>& listBundlesIDs, Link * l
 		double ddAtT = 0;
 		double drAtT = 0;
 		double currentUtility = 0;
-		statisticsManager->getStatFromAxe(currentBundle->getElapsedTimeSinceCreation(), (char*)(*iter).c_str(), &niAtT,  &miAtT, &ddAtT, &drAtT);
+		statistics->getStatFromAxe(currentBundle->getElapsedTimeSinceCreation(), &niAtT,  &miAtT, &ddAtT, &drAtT);
 
 
 		// Calculating the DR utility of the bundle
 		// Getting the network average meeting time
-		double averageMeetingTime = statisticsManager->getAverageNetworkMeetingTime();
+		double averageMeetingTime = statistics->averageNetworkMeetingTime;
 
 		// Number of Nodes within the network
-		int numberOfNodes = statisticsManager->getApproximatedNumberOfNodes();
+		int numberOfNodes = statistics->approximatedNumberOfNodes;
 
 		double parameterAlpha = averageMeetingTime * (numberOfNodes -1);
 
 		currentUtility = (1/(parameterAlpha))*(currentBundle->expiration - currentBundle->getElapsedTimeSinceCreation())*drAtT;
 
 		// Insert it to the map
-		sortedListWithUtilities.insert(make_pair<double, string>( currentUtility, *iter));
+		sortedListWithUtilities.insert(make_pair(currentUtility, *iter));
 		currentBundle = NULL;
 	}
 
 	// The map is already sorted
 	// Cycle through the map in reverse order and send the bundles
-	for(map<double, string>::reverse_iterator riter = sortedListWithUtilities.rbegin(); riter != sortedListWithUtilities.rend(); riter++)
+	for(multimap<double, string>::reverse_iterator riter = sortedListWithUtilities.rbegin(); riter != sortedListWithUtilities.rend(); riter++)
 	{
 		// request to send this bundle to the remote node
 		if(HBSD::requester->requestSendBundle(bundles->getByKey(riter->second), link->id, HBSD::requester->FWD_ACTION_COPY))
 		{
-			if(HBSD::log->enabled(Logging::INFO))
-				HBSD::log->info(string("Requested bundle: ") + riter->second + string(" utility: ")+ Util::to_string(riter->first)+ string(" Successfully sent."));
+			HBSD_LOG_INFO(string("Requested bundle: ") + riter->second + string(" utility: ")+ Util::to_string(riter->first)+ string(" Successfully sent."));
+			link->bundleSent();
 		}else
 		{
-			if(HBSD::log->enabled(Logging::ERROR))
-							HBSD::log->error(string("Error occurred when trying to send the scheduled bundle: ") + riter->second);
+			HBSD_LOG_ERROR(string("Error occurred when trying to send the scheduled bundle: ") + riter->second);
 		}
 	}
 
@@ -712,8 +676,10 @@ void HBSD_Routing::scheduleDDAndSend(list<std::string>& listBundlesIDs, Link * l
 {
 	assert(link != NULL);
 
-	// Scheduling the bundles
-	map<double, string> sortedListWithUtilities;
+	// Scheduling the bundles, called from the PeerListener thread so only the published statistics are read
+	StatisticsSnapshotReader statistics(statisticsManager);
+	// Bundles with the same utility are all kept
+	multimap<double, string> sortedListWithUtilities;
 	for(list<string>::iterator iter = listBundlesIDs.begin(); iter != listBundlesIDs.end();iter++)
 	{
 		// Get the bundle from its ID
@@ -725,37 +691,36 @@ void HBSD_Routing::scheduleDDAndSend(list<std::string>& listBundlesIDs, Link * l
 		double ddAtT = 0;
 		double drAtT = 0;
 
-		statisticsManager->getStatFromAxe(currentBundle->getElapsedTimeSinceCreation(), (char*)(*iter).c_str(), &niAtT,  &miAtT, &ddAtT, &drAtT);
+		statistics->getStatFromAxe(currentBundle->getElapsedTimeSinceCreation(), &niAtT,  &miAtT, &ddAtT, &drAtT);
 
 		// Calculating the DD utility of the new bundle
 		// Getting the network average meeting time
-		double averageMeetingTime = statisticsManager->getAverageNetworkMeetingTime();
+		double averageMeetingTime = statistics->averageNetworkMeetingTime;
 
 		// Number of Nodes within the network
-		int numberOfNodes = statisticsManager->getApproximatedNumberOfNodes();
+		int numberOfNodes = statistics->approximatedNumberOfNodes;
 
 		double parameterAlpha = averageMeetingTime * (numberOfNodes -1);
 
-		double currentUtility = ((parameterAlpha/(numberOfNodes -1))*pow((double)ddAtT, 2.0))/(numberOfNodes - 1 - miAtT);
+		double currentUtility = ((parameterAlpha/(numberOfNodes -1))*(ddAtT * ddAtT))/(numberOfNodes - 1 - miAtT);
 
 		// Insert it to the map
-		sortedListWithUtilities.insert(make_pair<double, string>(currentUtility, *iter));
+		sortedListWithUtilities.insert(make_pair(currentUtility, *iter));
 		currentBundle = NULL;
 	}
 
 	// The map is already sorted
 	// Cycle through the map in reverse order and send the bundles
-	for(map<double, string>::reverse_iterator riter = sortedListWithUtilities.rbegin(); riter != sortedListWithUtilities.rend(); riter++)
+	for(multimap<double, string>::reverse_iterator riter = sortedListWithUtilities.rbegin(); riter != sortedListWithUtilities.rend(); riter++)
 	{
 		// request to send this bundle to the remote node
 		if(HBSD::requester->requestSendBundle(bundles->getByKey(riter->second), link->id, HBSD::requester->FWD_ACTION_COPY))
 		{
-			if(HBSD::log->enabled(Logging::INFO))
-				HBSD::log->info(string("Requested bundle: ") + riter->second + string(" utility: ")+ Util::to_string(riter->first)+ string(" Successfully sent."));
+			HBSD_LOG_INFO(string("Requested bundle: ") + riter->second + string(" utility: ")+ Util::to_string(riter->first)+ string(" Successfully sent."));
+			link->bundleSent();
 		}else
 		{
-			if(HBSD::log->enabled(Logging::ERROR))
-							HBSD::log->error(string("Error occurred when trying to send the scheduled bundle: ") + riter->second);
+			HBSD_LOG_ERROR(string("Error occurred when trying to send the scheduled bundle: ") + riter->second);
 		}
 	}
 
@@ -26,6 +26,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Handlers.h"
 #include <exception>
 #include "HBSD.h"
+#include "Metrics.h"
 #include <iostream>
 using namespace std;
 using namespace xercesc;
@@ -37,6 +38,7 @@ HBSD_SAX::HBSD_SAX(Handlers *rtrHandlers)
 	assert(rtrHandlers != NULL);
 	BPA_ELEMENT = "bpa";
 	intf = rtrHandlers;
+	numberOfEvents = 0;
 
 	// Map element names to a value that we can switch off of
 	// to call the appropriate handler.
@@ -168,10 +170,13 @@ void HBSD_SAX::callRouter(int numElements)
 			continue;
 		}
 
+		numberOfEvents++;
+		int eventType = eventHash[tmp];
+		uint64_t eventStart = Metrics::now();
 		try 
 		{
 			assert(intf != NULL);
-			switch (eventHash[tmp])
+			switch (eventType)
 			{
 				case BUNDLE_RECEIVED_EVENT:
 					intf->handler_bundle_received_event(elementRoot, xmlRoot);
@@ -220,6 +225,8 @@ void HBSD_SAX::callRouter(int numElements)
 					break;
 				
 			}
+			if(eventType <= LINK_UNAVAILABLE_EVENT)
+				Metrics::observeSince((MetricsHistogram)(METRIC_EVENT_HANDLING_TIME + eventType), eventStart);
 		} 
 		catch (exception &e) 
 		{
@@ -230,4 +237,8 @@ void HBSD_SAX::callRouter(int numElements)
 		}
 		
 	}
+
+	// Let the other threads see the statistics updated by these events
+	if(intf->statisticsManager != NULL)
+		intf->statisticsManager->publishSnapshotIfOutdated();
 }
@@ -92,6 +92,14 @@ public:
 	 */
 	void endDocument ();
 
+	/**
+	 * Returns the number of events forwarded to the router so far.
+	 */
+	unsigned long getNumberOfEvents()
+	{
+		return numberOfEvents;
+	}
+
 	static std::string BPA_ELEMENT;
 private:	
 
@@ -116,6 +124,7 @@ private:
 	std::stack<XMLTree*> elementStack;
 	Handlers * intf;
 	std::map<std::string, int> eventHash;
+	unsigned long numberOfEvents;
 	
 	// All known events that we may receive.
 	const static int BUNDLE_RECEIVED_EVENT           = 0;
@@ -49,6 +49,8 @@ Handlers::Handlers()
 	assert(nodes != NULL);
 	peerListener = new PeerListener(this);
 	assert(peerListener != NULL);
+	// Links contact sessions run inline until an executor is set up
+	contactExecutor = NULL;
 }
 
 
@@ -36,6 +36,7 @@ class XMLTree;
 class Bundles;
 class PeerListener;
 class MeDeHaInterface;
+class ContactExecutor;
 
 class Handlers
 {
@@ -67,7 +68,14 @@ public:
 	Links *links;
 	StatisticsManager * statisticsManager;
 	MeDeHaInterface * medehaInterface;
+	// Runs the links contact sessions
+	ContactExecutor * contactExecutor;
 	Bundles *bundles;
+	// Lets the offline replay drain the peer messages synchronously
+	PeerListener * getPeerListener()
+	{
+		return peerListener;
+	}
 
 protected:
 	PeerListener *peerListener;
@@ -30,6 +30,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Policy.h"
 #include "Links.h"
 #include "Util.h"
+#include "Handlers.h"
+#include "ContactExecutor.h"
+#include "HBSD_Routing.h"
+#include "HBSD_Policy.h"
+#include "Bundles.h"
+#include "Requester.h"
+#include "Metrics.h"
 
 using namespace std;
 
@@ -40,24 +47,56 @@ Link::Link(Links *links)
 	state = STATE_NONEXTANT;
 	// State should be taken from the state variables rather then this element.
 	linkManager = links;
+	currentNode = NULL;
+	attachNode = NULL;
+
+	references = 1;
+	sem_init(&sessionLock, 0, 1);
+	scheduled = false;
+	drainWaiting = false;
+	sem_init(&drained, 0, 0);
+	contactStart = 0;
+	outstandingTransmits = 0;
+	maxOutstandingTransmits = 0;
+	bundlesSent = 0;
+	bundlesTransmitted = 0;
+	bytesTransmitted = 0;
+	svSent = 0;
+	svReceived = 0;
+	svBytesReceived = 0;
 }
 
 Link::~Link()
 {
 	linkManager = NULL;
+	sem_destroy(&sessionLock);
+	sem_destroy(&drained);
 }
 	
 void Link::available(XMLTree *element) 
 {
-	openRequested = false;
+	clearOpenRequest();
 	stateChange(STATE_AVAILABLE);
 }
 
+void Link::unavailable(XMLTree *element) 
+{
+	clearOpenRequest();
+	stateChange(STATE_UNAVAILABLE);
+	post(ACTION_STOP);
+}
+
+void Link::deleted(XMLTree *element) 
+{
+	stateChange(STATE_NONEXTANT);
+	post(ACTION_STOP);
+}
+
 
 void Link::opened(XMLTree *element) 
 {
 	assert(element != NULL);
-	openRequested = false;
+	clearOpenRequest();
 	stateChange(STATE_OPEN);
 
 	// The following sets the remoteEID.
@@ -69,11 +108,27 @@ void Link::opened(XMLTree *element)
 	// link remain open with no associated node. We do have logic
 	// elsewhere that allows a node to attach later on.
 	Node* openedNode = linkManager->router->nodes->conditionalAdd(remoteEID);
-	if (!openedNode->setLink(this)) 
+	if (openedNode != NULL && !openedNode->setLink(this)) 
 	{
 		openedNode = NULL;
 	}
 	currentNode = openedNode;
+
+	// A new contact starts
+	sem_wait(&sessionLock);
+	contactStart = time(NULL);
+	outstandingTransmits = 0;
+	maxOutstandingTransmits = 0;
+	bundlesSent = 0;
+	bundlesTransmitted = 0;
+	bytesTransmitted = 0;
+	svSent = 0;
+	svReceived = 0;
+	svBytesReceived = 0;
+	sem_post(&sessionLock);
+
+	// The node having the bigger ID starts the Epidemic session
+	post(ACTION_EXCHANGE);
 }
 
 
@@ -84,8 +139,9 @@ void Link::closed(XMLTree *element)
 	{
 		HBSD::log->info(string("The link: ") + this->id + string(" is closed."));
 	}
-	openRequested = false;
+	clearOpenRequest();
 	stateChange(STATE_CLOSED);
+	post(ACTION_STOP);
 }
 
 
@@ -97,10 +153,25 @@ bool Link::associate(Node *node)
 	return true;
 }
 
+void Link::clearOpenRequest()
+{
+	sem_wait(&sessionLock);
+	openRequested = false;
+	sem_post(&sessionLock);
+}
+
 void Link::requestOpen() 
 {
+	// Claiming the request before sending it, the answer from DTN clears it
+	sem_wait(&sessionLock);
+	bool pending = openRequested;
+	int currentState = state;
+	if (!pending && (currentState == STATE_AVAILABLE || currentState == STATE_CLOSED))
+		openRequested = true;
+	sem_post(&sessionLock);
+
 	// Do we already have an open request pending?
-	if (openRequested) 
+	if (pending) 
 	{
 		if(HBSD::log->enabled(Logging::ERROR))
 			HBSD::log->error(string("An open request is pending"));
@@ -108,7 +179,7 @@ void Link::requestOpen()
 	}
 
 	// Only states we assume we can request an open from.
-	if ((state != STATE_AVAILABLE) && (state != STATE_CLOSED))
+	if ((currentState != STATE_AVAILABLE) && (currentState != STATE_CLOSED))
 	{
 		if(HBSD::log->enabled(Logging::ERROR))
 			HBSD::log->error(string("Invalid link state to request an open for"));
@@ -120,6 +191,7 @@ void Link::requestOpen()
 	{
 		if(HBSD::log->enabled(Logging::ERROR))
 			HBSD::log->error(string("Invalid link type to request an open for, type: ")+Util::to_string(type));
+		clearOpenRequest();
 		return;
 	}
 
@@ -133,8 +205,6 @@ void Link::requestOpen()
 		if(HBSD::log->enabled(Logging::ERROR))
 			HBSD::log->error(string("Request to open the link failed"));
 	}
-
-	openRequested = true;
 }
 
 bool Link::init(XMLTree *evtLinkCreated) 
@@ -234,13 +304,222 @@ void Link::stateChange(int newState)
 		}
 	}
 
-	// Setting the new state
+	// Setting the new state, read by the contact session
+	sem_wait(&sessionLock);
 	state = newState;
+	sem_post(&sessionLock);
 
 }
 	
 
 
+void Link::post(int action)
+{
+	LinkAction linkAction;
+	linkAction.action = action;
+	post(linkAction);
+}
+
+int Link::getSnapshot(string & eid)
+{
+	sem_wait(&sessionLock);
+	eid = remoteEID;
+	int currentState = state;
+	sem_post(&sessionLock);
+	return currentState;
+}
+
+void Link::post(LinkAction & action)
+{
+	bool schedule;
+	sem_wait(&sessionLock);
+	// Posted from the router thread and the peer listener
+	action.remoteEID = remoteEID;
+	actions.push_back(action);
+	schedule = !scheduled;
+	scheduled = true;
+	sem_post(&sessionLock);
+
+	if(!schedule)
+		return;
+
+	ContactExecutor * executor = linkManager->router->contactExecutor;
+	if(executor != NULL)
+	{
+		executor->schedule(this);
+	}
+	else
+	{
+		acquire();
+		runActions();
+		release();
+	}
+}
+
+void Link::runActions()
+{
+	while(true)
+	{
+		sem_wait(&sessionLock);
+		if(actions.empty())
+		{
+			scheduled = false;
+			if(drainWaiting)
+			{
+				drainWaiting = false;
+				sem_post(&drained);
+			}
+			sem_post(&sessionLock);
+			return;
+		}
+		LinkAction action = actions.front();
+		actions.pop_front();
+		int currentState = state;
+		sem_post(&sessionLock);
+
+		runAction(action, currentState);
+	}
+}
+
+void Link::drain()
+{
+	sem_wait(&sessionLock);
+	if(!scheduled)
+	{
+		sem_post(&sessionLock);
+		return;
+	}
+	drainWaiting = true;
+	sem_post(&sessionLock);
+	sem_wait(&drained);
+}
+
+void Link::runAction(LinkAction & action, int currentState)
+{
+	switch(action.action)
+	{
+	case ACTION_RUN:
+		// The contact may have started, or the link gone, since it became available.
+		// A link that is not open has no node.
+		if(currentState != STATE_AVAILABLE && currentState != STATE_CLOSED)
+			return;
+		if(!linkManager->router->policyMgr->requestLinkOpen(this, NULL))
+		{
+			HBSD_LOG_INFO(string("The policy keeps the link closed: ") + id);
+			return;
+		}
+		requestOpen();
+		break;
+	case ACTION_EXCHANGE:
+		startExchange(action, currentState);
+		break;
+	case ACTION_METADATA:
+		sem_wait(&sessionLock);
+		svReceived++;
+		svBytesReceived += action.data.length();
+		sem_post(&sessionLock);
+		linkManager->router->policyMgr->metaDataReceived(action.source, action.data, action.type);
+		break;
+	case ACTION_STOP:
+		endContact();
+		break;
+	default:
+		HBSD_LOG_ERROR(string("Unknown contact session action: ") + Util::to_string(action.action));
+	}
+}
+
+void Link::startExchange(LinkAction & action, int currentState)
+{
+	// The node having the bigger ID starts the Epidemic session
+	if(currentState != STATE_OPEN || action.remoteEID.empty() || action.remoteEID.compare(HBSD::localEID) <= 0)
+		return;
+
+	HBSD_Routing * hbsdRouter = (HBSD_Routing*)linkManager->router;
+	string sv = hbsdRouter->bundles->createSV(string(EPIDEMIC_SV_1), true);
+	if(sv.empty())
+	{
+		HBSD_LOG_ERROR(string("Unable to create the bundles summary vector for the link: ") + id);
+		return;
+	}
+
+	// Sending a request to DTN2 to inject the SV bundle
+	string remoteRouter = action.remoteEID + string("/") + HBSD::routerEndpoint;
+	string reqId = HBSD::requester->requestInjectBundle(HBSD::hbsdRegistration, remoteRouter, id, sv);
+	if(reqId.empty())
+	{
+		HBSD_LOG_ERROR(string("Unable to send the bundles summary vector to the remote peer"));
+		return;
+	}
+
+	HBSD_LOG_INFO(string("Summary vector is correctly sent."));
+	// Informing HBSD_Policy about that
+	((HBSD_Policy*)hbsdRouter->policyMgr)->addNewInjectedRequest(reqId, id, action.remoteEID);
+
+	sem_wait(&sessionLock);
+	svSent++;
+	sem_post(&sessionLock);
+}
+
+void Link::endContact()
+{
+	sem_wait(&sessionLock);
+	if(contactStart == 0)
+	{
+		sem_post(&sessionLock);
+		return;
+	}
+	time_t duration = time(NULL) - contactStart;
+	int sent = bundlesSent;
+	int transmitted = bundlesTransmitted;
+	int outstanding = outstandingTransmits;
+	int maxOutstanding = maxOutstandingTransmits;
+	long long bytes = bytesTransmitted;
+	int svs = svSent;
+	int svr = svReceived;
+	contactStart = 0;
+	outstandingTransmits = 0;
+	sem_post(&sessionLock);
+
+	Metrics::increment(METRIC_CONTACTS);
+	Metrics::increment(METRIC_CONTACT_BYTES, bytes);
+	HBSD_LOG_INFO(string("Contact ended on the link: ") + id + string(" duration: ") + Util::to_string(duration) +
+			string(" s bundles sent: ") + Util::to_string(sent) + string(" transmitted: ") + Util::to_string(transmitted) +
+			string(" bytes: ") + Util::to_string(bytes) + string(" still outstanding: ") + Util::to_string(outstanding) +
+			string(" max outstanding: ") + Util::to_string(maxOutstanding) +
+			string(" SV sent: ") + Util::to_string(svs) + string(" SV received: ") + Util::to_string(svr));
+}
+
+void Link::bundleSent()
+{
+	sem_wait(&sessionLock);
+	bundlesSent++;
+	outstandingTransmits++;
+	if(outstandingTransmits > maxOutstandingTransmits)
+		maxOutstandingTransmits = outstandingTransmits;
+	sem_post(&sessionLock);
+}
+
+void Link::dataTransmitted(long bytes)
+{
+	sem_wait(&sessionLock);
+	bundlesTransmitted++;
+	bytesTransmitted += bytes;
+	if(outstandingTransmits > 0)
+		outstandingTransmits--;
+	sem_post(&sessionLock);
+}
+
+void Link::acquire()
+{
+	__sync_add_and_fetch(&references, 1);
+}
+
+void Link::release()
+{
+	if(__sync_sub_and_fetch(&references, 1) == 0)
+		delete this;
+}
+
 //HBSD::requester->requestSendBundle(bundle, id, Requester::FWD_ACTION_COPY);
 void Link::findAndSaveAttributesContact(XMLTree *event) 
 {
@@ -286,14 +565,10 @@ void Link::findAndSaveAttributesRemoteEID(XMLTree *event)
 		XMLTree* el = event->getChildElementRequired(string("remote_eid"));
 		assert(el != NULL);
 		string uri = el->getAttrRequired(string("uri"));
-		if (remoteEID.empty()) 
-		{
-			remoteEID = uri;
-		}
-		else if (uri.compare(remoteEID) != 0)
-		{
-			remoteEID = uri;
-		}
+		// Read by the peer listener and the contact session
+		sem_wait(&sessionLock);
+		remoteEID = uri;
+		sem_post(&sessionLock);
 	}
 
 	catch (exception & e) 
@@ -27,16 +27,28 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <string>
 #include <pthread.h>
-#include <queue>
+#include <deque>
 #include <semaphore.h>
-#include <pthread.h>
+#include <time.h>
 
 class Node;
 class XMLTree;
 class Link;
 class Links;
 
-
+/**
+ * Work queued on the contact session of a link. The strings are copied when
+ * the action is posted, the session never reads them from the router thread.
+ */
+typedef struct LinkAction
+{
+	int action;
+	std::string remoteEID;
+	// Summary vector received from the peer, for ACTION_METADATA
+	std::string source;
+	std::string data;
+	std::string type;
+}LinkAction;
 
 class Link
 {
@@ -59,8 +71,23 @@ public:
 	const static int STATE_BUSY         = 6;
 	
 	
+	// Contact session actions
+	const static int ACTION_NONE = 0;
+	// The link became available: asks dtnd to open it if the policy agrees
+	const static int ACTION_RUN  = 1;
+	// The contact ended: reports and resets its accounting
+	const static int ACTION_STOP = 2;
+	// Starts the summary vector exchange of an open link
+	const static int ACTION_EXCHANGE = 3;
+	// Handles a summary vector received from the peer
+	const static int ACTION_METADATA = 4;
+
 	Link(Links *links);
 	
+	/**
+	 * Only called through release(), once the Links table and the contact
+	 * executor dropped the link.
+	 */
 	~Link();
 	
 	/**
@@ -81,11 +108,7 @@ public:
 	 * 
 	 * @param element Root XMLTree element for the event.
 	 */
-	void unavailable(XMLTree *element) 
-	{
-		openRequested = false;
-		stateChange(STATE_UNAVAILABLE);
-	}
+	void unavailable(XMLTree *element);
 	
 
 	/**
@@ -136,14 +159,13 @@ public:
 	 * 
 	 * @param element Root XMLTree element for the event.
 	 */
-	void deleted(XMLTree *element) 
-	{
-		stateChange(STATE_NONEXTANT);
-	}
+	void deleted(XMLTree *element);
 
 	bool associate(Node *node);
 
 	std::string id;
+	// Written by the router thread under the session lock, the other
+	// threads read it through getSnapshot()
 	std::string remoteEID;
 	
 	/*
@@ -152,8 +174,55 @@ public:
 	 */
 	std::string getCurrentState();
 
+	// Written by the router thread under the session lock, the other
+	// threads read it through getSnapshot()
 	int state;
 
+	/**
+	 * Copies the remote EID and the state under the session lock.
+	 *
+	 * @param eid Set to the remote EID.
+	 * @return The link state.
+	 */
+	int getSnapshot(std::string & eid);
+
+	//////////////////////////// Contact session ////////////////////////////
+
+	/**
+	 * Queues an action on the contact session, run in order by the
+	 * ContactExecutor.
+	 */
+	void post(LinkAction & action);
+	void post(int action);
+
+	/**
+	 * Runs the queued actions. Called by one executor worker at a time.
+	 */
+	void runActions();
+
+	/**
+	 * Waits until the queued actions ran. Called by the router thread before
+	 * freeing what the actions use, e.g. the node of a deleted link.
+	 */
+	void drain();
+
+	/**
+	 * A bundle was handed to dtnd for this link.
+	 */
+	void bundleSent();
+
+	/**
+	 * dtnd transmitted a bundle on this link.
+	 */
+	void dataTransmitted(long bytes);
+
+	void acquire();
+
+	/**
+	 * Drops a reference, deleting the link with the last one.
+	 */
+	void release();
+
 protected:
 	
 	int type;
@@ -188,8 +257,7 @@ private:
 
 	Links *linkManager;
 	
-	// Information about the link that is written outside of the Link
-	// thread but read/copied by the thread.
+	// Only used by the router thread, the contact session never reads them
 	Node* currentNode;
 	Node* attachNode;
 	
@@ -198,12 +266,39 @@ private:
 
 	std::string remoteAddr;
 
+	// Protected by the session lock, set by the contact session
 	bool openRequested;
-	
-	
-	const static int ACTION_NONE = 0;
-	const static int ACTION_RUN  = 1;
-	const static int ACTION_STOP = 2;
+	void clearOpenRequest();
+
+	/**
+	 * @param currentState State of the link when the action was dequeued.
+	 */
+	void runAction(LinkAction & action, int currentState);
+	void startExchange(LinkAction & action, int currentState);
+	void endContact();
+
+	// Held by the Links table and by the executor while the session is scheduled
+	volatile int references;
+
+	// Contact session, the fields below and the writes to the state are
+	// protected by the session lock
+	sem_t sessionLock;
+	std::deque<LinkAction> actions;
+	bool scheduled;
+	// Posted when the actions ran, if the router thread waits in drain()
+	bool drainWaiting;
+	sem_t drained;
+	time_t contactStart;
+	// Bundles handed to dtnd and not transmitted yet
+	int outstandingTransmits;
+	int maxOutstandingTransmits;
+	int bundlesSent;
+	int bundlesTransmitted;
+	long long bytesTransmitted;
+	// Summary vectors sent and received during the contact
+	int svSent;
+	int svReceived;
+	long long svBytesReceived;
 
 
 	/**
@@ -39,19 +39,18 @@ using namespace std;
 Links::Links(Handlers* router) 
 {
 	this->router = router;
-	sem_init(&linksLock, 0, 1);
+	pthread_rwlock_init(&linksLock, NULL);
 }
 
 Links::~Links()
 {
 	router = NULL;
-	while(!linkMap.empty())
+	for(size_t slot = linkMap.begin(); slot != linkMap.end(); slot = linkMap.next(slot))
 	{
-		map<string,Link*>::iterator iter = linkMap.begin();
-		delete iter->second;
-		linkMap.erase(iter);
+		linkMap.valueAt(slot)->release();
 	}
-	sem_destroy(&linksLock);
+	linkMap.clear();
+	pthread_rwlock_destroy(&linksLock);
 }
 
 
@@ -67,8 +66,7 @@ Link* Links::create(XMLTree* evt)
 	}
 
 	string id = evt->getAttr(string("link_id"));
-	// Do we already know about the id? The key may exist from
-	// a previous incarnation, but the object should be NULL.
+	// Do we already know about the id?
 	Link* link = getById(id);
 
 	if (link != NULL) 
@@ -110,23 +108,28 @@ void Links::deleteEvt(XMLTree* evt)
 
 	// Remove the link in a synchronized method.
 	Link* link = remove(evt);
+	if(link == NULL)
+		return;
 
-	// Call into the link to change its state to non existent
+	// Call into the link to change its state to non existent, this ends its contact
 	link->deleted(evt);
 
+	// The queued actions may still use the node, e.g. to answer a summary vector
+	link->drain();
+
 	// Removing the node currently associated with the link
 	((HBSD_Routing*)router)->nodes->removeNode(link->remoteEID);
-	if(link != NULL)
-		delete link;
+	// A contact worker may still hold the link until it left runActions()
+	link->release();
 }
 
 // Synchronized
 int Links::numLinks() 
 {
 	int tmp = 0;
-	getLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getLinksLock(LOCK_LOCATION, false);
 	tmp = linkMap.size();
-	leaveLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveLinksLock(LOCK_LOCATION);
 	return tmp;
 }
 
@@ -135,9 +138,9 @@ Link* Links::getById(string id)
 {
 	assert(!id.empty());
 	Link * tmp = NULL;
-	getLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
-	tmp = linkMap[id];;
-	leaveLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getLinksLock(LOCK_LOCATION, false);
+	tmp = linkMap.find(id);
+	leaveLinksLock(LOCK_LOCATION);
 	return tmp;
 }
 
@@ -146,20 +149,13 @@ void Links::add(Link* link)
 {
 	assert(link != NULL);
 
-	getLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
-
-	map<string,Link*>::iterator iter = linkMap.find(link->id);
-
-	if (iter != linkMap.end()) 
-	{
-		if(iter->second != NULL)
-			delete iter->second;
-		linkMap.erase(iter);
-	}
+	getLinksLock(LOCK_LOCATION);
 
-	linkMap[link->id] = link;
+	Link * previous = linkMap.insert(link->id, link);
+	if(previous != NULL)
+		previous->release();
 
-	leaveLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveLinksLock(LOCK_LOCATION);
 }
 
 // Synchronized
@@ -176,10 +172,10 @@ Link* Links::remove(XMLTree* evt)
 
 	string id = evt->getAttr(string("link_id"));
 
-	getLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getLinksLock(LOCK_LOCATION);
 
-	// Do we know about it?
-	Link* link =  linkMap[id];
+	// Do we know about it? Removing it from the hash table.
+	Link* link = linkMap.erase(id);
 
 	if (link == NULL) 
 	{
@@ -187,15 +183,11 @@ Link* Links::remove(XMLTree* evt)
 		{
 			HBSD::log->warn(string("Ignoring request to delete a non-existent link: ") + id);
 		}
-		leaveLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+		leaveLinksLock(LOCK_LOCATION);
 
 		return NULL;
 	}
-	// Now remove it from the hash table.
-
-	linkMap.erase(id);
-
-	leaveLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveLinksLock(LOCK_LOCATION);
 
 	router->policyMgr->linkDeleted(link);
 
@@ -205,89 +197,87 @@ Link* Links::remove(XMLTree* evt)
 // Synchronized
 void Links::showAvailableLinks()
 {
-	getLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	getLinksLock(LOCK_LOCATION, false);
 
 	if(HBSD::log->enabled(Logging::INFO))
 	{
 		HBSD::log->info(string("Number of available links: ")+ Util::to_string(linkMap.size()));
-		for(map<std::string,Link*>::iterator iter = linkMap.begin(); iter != linkMap.end(); iter++)
+		for(size_t slot = linkMap.begin(); slot != linkMap.end(); slot = linkMap.next(slot))
 		{
-			HBSD::log->info(string("Link Id: ") + iter->first + string(" state: ") + iter->second->getCurrentState() + string(" remote Node: ")+Util::to_string(iter->second->remoteEID));
+			Link * link = linkMap.valueAt(slot);
+			HBSD::log->info(string("Link Id: ") + linkMap.keyAt(slot) + string(" state: ") + link->getCurrentState() + string(" remote Node: ")+Util::to_string(link->remoteEID));
 		}
 	}
-	leaveLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveLinksLock(LOCK_LOCATION);
 
 }
 
 // Synchronized
 void Links::InitiateESWithAvailableLinks()
 {
-	if(HBSD::log->enabled(Logging::INFO))
+	getLinksLock(LOCK_LOCATION, false);
+
+	HBSD_LOG_INFO(string("Looking for available links and starting ES, number of available links: ") + Util::to_string(linkMap.size()) + string(" looking for opened ones."));
+
+	for(size_t slot = linkMap.begin(); slot != linkMap.end(); slot = linkMap.next(slot))
 	{
-		HBSD::log->info(string("Looking for available links and starting ES, number of available links: ") + Util::to_string(linkMap.size()) + string(" looking for opened ones."));
+		Link * link = linkMap.valueAt(slot);
+		// Starting a new ES, if the link is opened. The link contact session sends the summary vector.
+		if(link->state == Link::STATE_OPEN && link->remoteEID.compare(HBSD::localEID) > 0)
+		{
+			HBSD_LOG_INFO(string("Link : ")+link->id+string(" available, starting an ES."));
+			link->post(Link::ACTION_EXCHANGE);
+		}
 	}
 
-	getLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
+	leaveLinksLock(LOCK_LOCATION);
+}
+
+// Synchronized
+bool Links::postMetaData(string source, string data, string type)
+{
+	bool posted = false;
+	getLinksLock(LOCK_LOCATION, false);
 
-	for(map<std::string,Link*>::iterator iter = linkMap.begin(); iter != linkMap.end(); iter++)
+	for(size_t slot = linkMap.begin(); slot != linkMap.end(); slot = linkMap.next(slot))
 	{
-		// Starting a new ES, if the link is available
-		if((iter->second)->state == 5 && (iter->second)->remoteEID.compare(HBSD::localEID) > 0)
+		Link * link = linkMap.valueAt(slot);
+		// Called by the peer listener, the router thread may be updating the link
+		string remoteEID;
+		if(link->getSnapshot(remoteEID) == Link::STATE_OPEN && remoteEID.compare(source) == 0)
 		{
-			HBSD_Routing * hbsdRouter = (HBSD_Routing*)this->router;
-			Node * destNode = hbsdRouter->nodes->findNode((iter->second)->remoteEID);
-			//if(destNode->getLastSessionTime() < hbsdRouter->bundles->getLastTimeBundlesStoreChanged())
-			{
-				if(HBSD::log->enabled(Logging::INFO))
-					HBSD::log->info(string("Link : ")+iter->second->id+string(" available, starting an ES."));
-				// Sending the summary vector of bundles
-
-				string remoteRouter = iter->second->remoteEID + string("/") + HBSD::routerEndpoint;
-				string reqId;
-				if((reqId = HBSD::requester->requestInjectBundle(HBSD::hbsdRegistration, remoteRouter, iter->second->id, ((HBSD_Routing*)this->router)->bundles->createSV(string(EPIDEMIC_SV_1), true))).empty())
-				{
-					if(HBSD::log->enabled(Logging::ERROR))
-						HBSD::log->error(string("Unable to send the bundles summary vector to the remote peer"));
-				}else
-				{
-					if(HBSD::log->enabled(Logging::INFO))
-						HBSD::log->info(string("Summary vector is correctly sent."));
-					HBSD_Policy * policy = (HBSD_Policy*)((HBSD_Routing*)this->router)->policyMgr;
-					// Informing HBSD_Policy about that
-					policy->addNewInjectedRequest(reqId, iter->second->id, iter->second->remoteEID);
-					policy = NULL;
-				}
-			}
-			/*else
-			{
-				if(HBSD::log->enabled(Logging::INFO))
-				{
-					HBSD::log->info(string("No changes since we last met: ") + (iter->second)->remoteEID);
-				}
-			}
-			*/
-			destNode = NULL;
+			LinkAction action;
+			action.action = Link::ACTION_METADATA;
+			action.source = source;
+			action.data = data;
+			action.type = type;
+			link->post(action);
+			posted = true;
+			break;
 		}
 	}
 
-	leaveLinksLock(Util::to_string(__FILE__)+string(":")+Util::to_string(__LINE__));
-
+	leaveLinksLock(LOCK_LOCATION);
+	return posted;
 }
 
-void Links::getLinksLock(string place)
+void Links::getLinksLock(const char * place, bool write)
 {
 	if(LINKS_LOCK_DEBUG)
 	{
 		cout<< "Asking for links lock @: "<<place<<endl;
 	}
-	sem_wait(&linksLock);
+	if(write)
+		pthread_rwlock_wrlock(&linksLock);
+	else
+		pthread_rwlock_rdlock(&linksLock);
 }
 
-void Links::leaveLinksLock(string place )
+void Links::leaveLinksLock(const char * place)
 {
 	if(LINKS_LOCK_DEBUG)
 	{
 		cout<< "Leaving links lock @: "<<place<<endl;
 	}
-	sem_post(&linksLock);
+	pthread_rwlock_unlock(&linksLock);
 }
@@ -26,8 +26,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define LINKS_H
 
 #include <string>
-#include <map>
-#include <semaphore.h>
+#include <pthread.h>
+#include "StringHashMap.h"
 
 
 #define LINKS_LOCK_DEBUG false
@@ -60,24 +60,21 @@ public:
 	
 	
 	/**
-	 * Deletes a link. The link id key is not removed, but the object
-	 * becomes NULL.
+	 * Deletes a link, removing its id from the table.
 	 * 
 	 * @param evt Root of link deleted event.
 	 */
 	void deleteEvt(XMLTree* evt);
 	
 	/**
-	 * Returns the number of links in the linkArray. This includes
-	 * NULL links.
+	 * Returns the number of links in the linkArray.
 	 * 
 	 * @return The number of links.
 	 */
 	int numLinks();
 	
 	/**
-	 * Returns a Link given its name. Note that NULL can be returned
-	 * even if the key exists.
+	 * Returns a Link given its name.
 	 * 
 	 * @param id Name (id) of the link.
 	 * @return Link object or NULL.
@@ -90,8 +87,19 @@ public:
 
 	void InitiateESWithAvailableLinks();
 
-	void getLinksLock(std::string p);
-	void leaveLinksLock(std::string p);
+	/**
+	 * Hands the meta data received from a peer to the contact session of
+	 * the opened link towards it.
+	 *
+	 * @return false if no link is opened towards the source.
+	 */
+	bool postMetaData(std::string source, std::string data, std::string type);
+
+	/**
+	 * Takes the links lock, shared with the other readers unless write is set.
+	 */
+	void getLinksLock(const char * p, bool write = true);
+	void leaveLinksLock(const char * p);
 private: 
 
 	/**
@@ -114,8 +122,8 @@ private:
 	 */
 	Link* remove(XMLTree* evt);
 
-	std::map<std::string,Link*> linkMap;
-	sem_t linksLock;
+	StringHashMap<Link> linkMap;
+	pthread_rwlock_t linksLock;
 };
 
 
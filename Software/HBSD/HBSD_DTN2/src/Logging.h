@@ -45,6 +45,10 @@ public:
 	const static  int ERROR   = 4;
 	const static  int FATAL   = 5;
 	const static  int OFF     = 6;
+
+	virtual ~Logging()
+	{
+	}
 	
 	/**
 	 * Called once to allow the logging implementation to configure itself.
@@ -85,12 +89,20 @@ public:
 	 * 
 	 * @param message Message to be logged.
 	 */
-	virtual void trace(std::string message) = 0;
-	virtual void debug(std::string message) = 0;
-	virtual void info(std::string message) = 0;
-	virtual void warn(std::string message) = 0;
-	virtual void error(std::string message) = 0;
-	virtual void fatal(std::string message) = 0;
+	virtual void trace(const std::string & message) = 0;
+	virtual void debug(const std::string & message) = 0;
+	virtual void info(const std::string & message) = 0;
+	virtual void warn(const std::string & message) = 0;
+	virtual void error(const std::string & message) = 0;
+	virtual void fatal(const std::string & message) = 0;
+
+	/**
+	 * Waits until the messages logged so far are written, for the
+	 * implementations that write them asynchronously.
+	 */
+	virtual void flush()
+	{
+	}
 };
 
 #endif
@@ -31,6 +31,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <list>
 #include "Bundles.h"
 #include "HBSD_Policy.h"
+#include "ConfigFile.h"
+#include "Metrics.h"
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
 using namespace std;
 
 MeDeHaInterface::MeDeHaInterface(Handlers *router)
@@ -38,33 +50,118 @@ MeDeHaInterface::MeDeHaInterface(Handlers *router)
 	this->router = router;
 	this->stopInterfaceThread = false;
 	sem_init(&protectStopFlag, 0, 1);
+	sem_init(&sendQueueLock, 0, 1);
+	sem_init(&injectedPayloadsLock, 0, 1);
+	started = false;
+	waitingWritable = false;
+	listenSocket = -1;
+	outboundSocket = -1;
+	epollFd = -1;
+	wakeupFd = -1;
+
+	interfacePort = HBSD::routerConf->getInt(string("medehaInterfacePort"), DEFAULT_MEDEHA_INTERFACE_PORT);
+	batchSize = HBSD::routerConf->getInt(string("medehaBatchSize"), DEFAULT_MEDEHA_BATCH_SIZE);
+	if(batchSize <= 0)
+		batchSize = DEFAULT_MEDEHA_BATCH_SIZE;
+	int queueSize = HBSD::routerConf->getInt(string("medehaSendQueueSize"), DEFAULT_MEDEHA_SEND_QUEUE_SIZE);
+	maxSendQueueSize = queueSize > 0 ? queueSize : DEFAULT_MEDEHA_SEND_QUEUE_SIZE;
+
+	string daemonAddress = HBSD::routerConf->getstring(string("medehaDaemonAddress"), string(DEFAULT_MEDEHA_DAEMON_ADDRESS));
+	bzero(&daemonAddr, sizeof(daemonAddr));
+	daemonAddr.sin_family = AF_INET;
+	daemonAddr.sin_addr.s_addr = inet_addr(daemonAddress.c_str());
+	daemonAddr.sin_port = htons(HBSD::routerConf->getInt(string("medehaDaemonPort"), DEFAULT_MEDEHA_DAEMON_PORT));
+
+	memfdPayloads = HBSD::routerConf->getBoolean(string("medehaMemfdPayloads"), DEFAULT_MEDEHA_MEMFD_PAYLOADS);
+	payloadDirectory = HBSD::routerConf->getstring(string("medehaPayloadDirectory"), string(DEFAULT_MEDEHA_PAYLOAD_DIRECTORY));
+
+	recvBuffers = new char[batchSize * DEFAULT_MAX_DATA_LENGTH];
+	recvMsgs = new struct mmsghdr[batchSize];
+	recvIov = new struct iovec[batchSize];
+	recvAddrs = new struct sockaddr_in[batchSize];
+	sendMsgs = new struct mmsghdr[batchSize];
+	sendIov = new struct iovec[batchSize];
+	replies.resize(batchSize);
 }
 
 
 MeDeHaInterface::~MeDeHaInterface()
 {
+	if(started)
+	{
+		stopsInterfaceThread();
+		pthread_join(thread, NULL);
+	}
 	router = NULL;
+	if(listenSocket >= 0)
+		close(listenSocket);
+	if(outboundSocket >= 0)
+		close(outboundSocket);
+	if(epollFd >= 0)
+		close(epollFd);
+	if(wakeupFd >= 0)
+		close(wakeupFd);
+	for(deque<MeDeHaMessage>::iterator iter = sendQueue.begin(); iter != sendQueue.end(); iter++)
+	{
+		if(iter->payloadFd >= 0)
+			close(iter->payloadFd);
+	}
+	for(map<string, InjectedPayload>::iterator iter = injectedPayloads.begin(); iter != injectedPayloads.end(); iter++)
+		close(iter->second.fd);
+	delete [] recvBuffers;
+	delete [] recvMsgs;
+	delete [] recvIov;
+	delete [] recvAddrs;
+	delete [] sendMsgs;
+	delete [] sendIov;
 	sem_destroy(&protectStopFlag);
+	sem_destroy(&sendQueueLock);
+	sem_destroy(&injectedPayloadsLock);
 }
 
 void MeDeHaInterface::init()
 {
-	pthread_t thread;
-	pthread_attr_t threadAttr;
+	// Opening the sockets here, so that the messages queued before the thread
+	// runs are not lost
+	listenSocket = initUDPSocketListener(interfacePort);
 
-	if(pthread_attr_init(&threadAttr) != 0)
+	if ((outboundSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
 	{
 		if(HBSD::log->enabled(Logging::FATAL))
-			HBSD::log->fatal(string("Error occurred while initializing the MeDeHaInterface thread"));
+			HBSD::log->fatal(string("Error occurred while trying to open a socket towards MeDeHa daemon"));
 		exit(1);
 	}
 
-	// Creates a detached Thread
+	// Connected, the payload files are sent with sendfile which takes no address
+	if(connect(outboundSocket, (struct sockaddr *)&daemonAddr, sizeof(daemonAddr)) < 0)
+	{
+		if(HBSD::log->enabled(Logging::FATAL))
+			HBSD::log->fatal(string("Error occurred while trying to connect the socket towards MeDeHa daemon"));
+		exit(1);
+	}
+
+	if((epollFd = epoll_create(2)) < 0 || (wakeupFd = eventfd(0, EFD_NONBLOCK)) < 0)
+	{
+		if(HBSD::log->enabled(Logging::FATAL))
+			HBSD::log->fatal(string("Error occurred while creating the MeDeHaInterface epoll set"));
+		exit(1);
+	}
 
-	if(pthread_attr_setdetachstate(&threadAttr, PTHREAD_CREATE_DETACHED) != 0)
+	struct epoll_event event;
+	bzero(&event, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = listenSocket;
+	if(epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &event) < 0)
 	{
 		if(HBSD::log->enabled(Logging::FATAL))
-			HBSD::log->fatal(string("Error occurred while configuring the MeDeHaInterface thread to be detached"));
+			HBSD::log->fatal(string("Error occurred while adding the MeDeHa interface socket to the epoll set"));
+		exit(1);
+	}
+	event.data.fd = wakeupFd;
+	if(epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event) < 0)
+	{
+		if(HBSD::log->enabled(Logging::FATAL))
+			HBSD::log->fatal(string("Error occurred while adding the MeDeHa wake up descriptor to the epoll set"));
 		exit(1);
 	}
 
@@ -78,17 +175,14 @@ void MeDeHaInterface::init()
 
 	tp->medehaInterface = this;
 
-	if(tp->medehaInterface == NULL)
-	{
-		if(HBSD::log->enabled(Logging::FATAL))
-			HBSD::log->fatal(string("MeDeHaInterface thread parameter was not correctly initialized"));
-	}
-
-	if(pthread_create (&thread, &threadAttr, MeDeHaInterface::run, (void *)tp) < 0 )
+	// Joinable, the destructor waits for the thread before closing the sockets
+	if(pthread_create (&thread, NULL, MeDeHaInterface::run, (void *)tp) != 0)
 	{
 		if(HBSD::log->enabled(Logging::FATAL))
 			HBSD::log->fatal(string("Unable to create the MeDeHaInterface thread."));
+		exit(1);
 	}
+	started = true;
 
 	if(HBSD::log->enabled(Logging::INFO))
 		HBSD::log->info(string("MeDeHaInterface thread loaded."));
@@ -101,88 +195,46 @@ void * MeDeHaInterface::run(void * arg)
 	ThreadParamMeDeHA * recvArg =(ThreadParamMeDeHA*)arg;
 	assert(recvArg != NULL);
 
-	if(recvArg->medehaInterface == NULL)
+	MeDeHaInterface * medehaInterface = recvArg->medehaInterface;
+	if(medehaInterface == NULL)
 	{
-		if(HBSD::log->enabled(Logging::INFO))
-			HBSD::log->info(string("Invalid arguments passed to MeDeHaInterface thread"));
+		if(HBSD::log->enabled(Logging::ERROR))
+			HBSD::log->error(string("Invalid arguments passed to MeDeHaInterface thread"));
+		free(recvArg);
+		return NULL;
 	}
 
-	// Opening the listening socket
-	int lsock = recvArg->medehaInterface->initUDPSocketListener(DEFAULT_MEDEHA_INTERFACE_PORT);
-	char buf[DEFAULT_MAX_DATA_LENGTH];
+	struct epoll_event events[3];
 
-	while (!recvArg->medehaInterface->interfaceThreadStatus())
+	while (!medehaInterface->interfaceThreadStatus())
 	{
-		// Waiting for a new request
-		int rlen = 0, fromlen = 0;
-
-		struct  sockaddr_in from;
-		fromlen = sizeof(from);
-
-		memset(buf,'\0', DEFAULT_MAX_DATA_LENGTH);
-
-		rlen = recvfrom(lsock, buf, DEFAULT_MAX_DATA_LENGTH, 0, (struct sockaddr *)&from, (socklen_t*)&fromlen);
-
-	    if (rlen == -1)
+		int ready = epoll_wait(medehaInterface->epollFd, events, 3, MEDEHA_EPOLL_TIMEOUT);
+		if(ready < 0)
 		{
-	    	if(HBSD::log->enabled(Logging::FATAL))
-	    		HBSD::log->fatal(string("Error occurred while trying to receive a new request coming from MeDeHa"));
-			continue;
+			if(errno == EINTR)
+				continue;
+			HBSD_LOG_FATAL(string("Error occurred while waiting for the MeDeHa interface events"));
+			break;
 		}
-	    else
-		{
-	    	// A new request is received
-			// Proceeding the request
-			int commandNumber = -1;
-			bool idAvailability;
-			string listEIDS;
-			bool injected;
-
-			if(HBSD::log->enabled(Logging::INFO))
-				HBSD::log->info(string("New MeDeHa request received: ")+string(buf) );
-
-			recvArg->medehaInterface->processMeDeHaRequest(string(buf), commandNumber, idAvailability, listEIDS, injected);
 
-			switch(commandNumber)
+		for(int i = 0; i < ready; i++)
+		{
+			if(events[i].data.fd == medehaInterface->listenSocket)
 			{
-			case 1:
-					// Inject Bundle
-					if(HBSD::log->enabled(Logging::INFO))
-						HBSD::log->info("A new MedeHa request for injecting a Bundle is received");
-					break;
-			case 2:
-					// Request list EIDs
-					if(HBSD::log->enabled(Logging::INFO))
-						HBSD::log->info(string("A new MeDeHa request is received for getting  the list of available EIDs"));
-					// Send back the list of EIDs
-					if(sendto(lsock, (char *)listEIDS.c_str(), listEIDS.length(), 0, (struct sockaddr *)&from, sizeof(from)) == -1)
-					{
-						if(HBSD::log->enabled(Logging::ERROR))
-							HBSD::log->error(string("Error occurred when trying to send back the list of EIDs to MeDeHa daemon."));
-					}else
-					{
-						if(HBSD::log->enabled(Logging::INFO))
-							HBSD::log->info(string("The list of EIDs was successful sent to MeDeHa daemon: ") + listEIDS);
-					}
-					break;
-			case 3:
-					// Verify whether the EID is available or not.
-				if(HBSD::log->enabled(Logging::INFO))
-					HBSD::log->info(string("A new MeDeHa request is received to verify whether an EID exists or not"));
-				// Sending back the answer
-				if(sendto(lsock, (char*)Util::to_string(idAvailability).c_str(), Util::to_string(idAvailability).length(), 0, (struct sockaddr *)&from, sizeof(from)) == -1)
-				{
-					if(HBSD::log->enabled(Logging::ERROR))
-						HBSD::log->error(string("Error occurred when trying to send back the availability status of the requested EID."));
-				}else
-				{
-					if(HBSD::log->enabled(Logging::INFO))
-						HBSD::log->info(string("The availability status of the requested EID was successful sent to MeDeHa daemon"));
-				}
-				break;
-			default:
-				if(HBSD::log->enabled(Logging::INFO))
-					HBSD::log->error(string("Invalid request number, ignoring the request"));
+				medehaInterface->receiveRequests();
+			}
+			else if(events[i].data.fd == medehaInterface->wakeupFd)
+			{
+				uint64_t value;
+				if(read(medehaInterface->wakeupFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+					HBSD_LOG_ERROR(string("Error occurred while reading the MeDeHa wake up descriptor"));
+				if(!medehaInterface->waitingWritable)
+					medehaInterface->flushSendQueue();
+			}
+			else if(events[i].data.fd == medehaInterface->outboundSocket)
+			{
+				medehaInterface->watchOutboundSocket(false);
+				medehaInterface->flushSendQueue();
 			}
 		}
 	}
@@ -194,6 +246,102 @@ void * MeDeHaInterface::run(void * arg)
 	return NULL;
 }
 
+void MeDeHaInterface::receiveRequests()
+{
+	for(int i = 0; i < batchSize; i++)
+	{
+		recvIov[i].iov_base = recvBuffers + i * DEFAULT_MAX_DATA_LENGTH;
+		// Keeps room for the terminating null character
+		recvIov[i].iov_len = DEFAULT_MAX_DATA_LENGTH - 1;
+		bzero(&recvMsgs[i], sizeof(struct mmsghdr));
+		recvMsgs[i].msg_hdr.msg_name = &recvAddrs[i];
+		recvMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		recvMsgs[i].msg_hdr.msg_iov = &recvIov[i];
+		recvMsgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int received = recvmmsg(listenSocket, recvMsgs, batchSize, MSG_DONTWAIT, NULL);
+	if(received < 0)
+	{
+		if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			HBSD_LOG_ERROR(string("Error occurred while trying to receive a new request coming from MeDeHa"));
+		return;
+	}
+
+	int numberOfReplies = 0;
+	for(int i = 0; i < received; i++)
+	{
+		char * request = recvBuffers + i * DEFAULT_MAX_DATA_LENGTH;
+		request[recvMsgs[i].msg_len] = '\0';
+		Metrics::increment(METRIC_MEDEHA_REQUESTS);
+
+		if(handleRequest(request, recvMsgs[i].msg_len, replies[numberOfReplies]))
+		{
+			sendIov[numberOfReplies].iov_base = (void *)replies[numberOfReplies].data();
+			sendIov[numberOfReplies].iov_len = replies[numberOfReplies].length();
+			bzero(&sendMsgs[numberOfReplies], sizeof(struct mmsghdr));
+			sendMsgs[numberOfReplies].msg_hdr.msg_name = &recvAddrs[i];
+			sendMsgs[numberOfReplies].msg_hdr.msg_namelen = recvMsgs[i].msg_hdr.msg_namelen;
+			sendMsgs[numberOfReplies].msg_hdr.msg_iov = &sendIov[numberOfReplies];
+			sendMsgs[numberOfReplies].msg_hdr.msg_iovlen = 1;
+			numberOfReplies++;
+		}
+	}
+
+	// The replies are datagrams too, the ones that do not fit in the socket buffer are lost
+	int offset = 0;
+	while(offset < numberOfReplies)
+	{
+		int sent = sendmmsg(listenSocket, sendMsgs + offset, numberOfReplies - offset, MSG_DONTWAIT);
+		if(sent < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			HBSD_LOG_ERROR(string("Error occurred when trying to send back a reply to MeDeHa daemon: ") + replies[offset]);
+			sent = 1;
+		}
+		else
+		{
+			HBSD_LOG_INFO(string("Replies sent back to MeDeHa daemon: ") + Util::to_string(sent));
+		}
+		offset += sent;
+	}
+}
+
+bool MeDeHaInterface::handleRequest(const char * request, int length, string & reply)
+{
+	// Proceeding the request
+	int commandNumber = -1;
+	bool idAvailability = false;
+	string listEIDS;
+	bool injected;
+
+	HBSD_LOG_INFO(string("New MeDeHa request received: ")+string(request));
+
+	processMeDeHaRequest(string(request, length), commandNumber, idAvailability, listEIDS, injected);
+
+	switch(commandNumber)
+	{
+	case 1:
+		// Inject Bundle
+		HBSD_LOG_INFO(string("A new MedeHa request for injecting a Bundle is received"));
+		return false;
+	case 2:
+		// Request list EIDs, sending back the list of EIDs
+		HBSD_LOG_INFO(string("A new MeDeHa request is received for getting  the list of available EIDs: ") + listEIDS);
+		reply = listEIDS;
+		return true;
+	case 3:
+		// Verify whether the EID is available or not, sending back the answer
+		HBSD_LOG_INFO(string("A new MeDeHa request is received to verify whether an EID exists or not"));
+		reply = Util::to_string(idAvailability);
+		return true;
+	default:
+		HBSD_LOG_ERROR(string("Invalid request number, ignoring the request"));
+		return false;
+	}
+}
+
 int MeDeHaInterface::processMeDeHaRequest(std::string request, int & command, bool & idAvailability, string &listEIDS, bool & injected)
 {
 	// Parse the received request
@@ -213,38 +361,47 @@ int MeDeHaInterface::processMeDeHaRequest(std::string request, int & command, bo
 		if(getRequestCommandPart((char*)request.c_str(), 1, destEID) < 0)
 					return -1;
 
-		// Get the data to be sent
-		char data[DEFAULT_MAX_DATA_LENGTH];
-		if(getRequestCommandPart((char*)request.c_str(), 2, data) < 0)
-					return -1;
-
+		// The data to be sent is the rest of the request, taken as is
+		size_t dataStart = request.find('#', request.find('#') + 1);
+		if(dataStart == string::npos)
+			return -1;
+		dataStart++;
 
 		// Encapsulating the data received from MeDeHa and forwarding it
 		// Create a file to hold the bundle data
-		// Name of tmp file
-		string tmpName;
-		tmpName.append(string("/home/amir/hbsd_medeha_bundle_")+ Util::to_string(HBSD::requester->getAndIncrement()));
-
-		ofstream tmpFile;
-		tmpFile.open(tmpName.c_str());
-		tmpFile << data<<endl;
-		tmpFile.close();
-
+		int payloadFd = -1;
+		string tmpName = createPayloadFile(request.data() + dataStart, request.length() - dataStart, payloadFd);
+		if(tmpName.empty())
+			return -1;
 
 		string bundleSourceURI = HBSD::hbsdRegistration +  string("/Medeha");
 		string bundleDestURI = destEID + string("/") + HBSD::routerEndpoint + string("/Medeha");
 
 		// Injection request ID
 		string reqId;
-		HBSD::log->info(string("Injecting a medeha bundle, src: ") + bundleSourceURI + string(" dest: ") + bundleDestURI);
+		HBSD_LOG_INFO(string("Injecting a medeha bundle, src: ") + bundleSourceURI + string(" dest: ") + bundleDestURI);
 		reqId = HBSD::requester->requestInjectMeDeHaBundle(bundleSourceURI, bundleDestURI, tmpName);
 
 		if(reqId.empty())
 		{
 					if(HBSD::log->enabled(Logging::ERROR))
 				HBSD::log->error(string("Unable to inject the MeDeHa bundle"));
+			if(payloadFd >= 0)
+				close(payloadFd);
+			else
+				unlink(tmpName.c_str());
 		}else
 		{
+			if(payloadFd >= 0)
+			{
+				// dtnd reads the memory file through its /proc path, it is kept open until then
+				InjectedPayload payload;
+				payload.fd = payloadFd;
+				payload.creationTime = time(NULL);
+				sem_wait(&injectedPayloadsLock);
+				injectedPayloads[reqId] = payload;
+				sem_post(&injectedPayloadsLock);
+			}
 			((HBSD_Policy*)((HBSD_Routing*)this->router)->policyMgr)->addNewMeDeHaInjectedBundle(reqId, bundleSourceURI, bundleDestURI);
 			if(HBSD::log->enabled(Logging::INFO))
 				HBSD::log->info(string("The MeDeHa bundle is correctly injected."));
@@ -307,6 +464,88 @@ int MeDeHaInterface::processMeDeHaRequest(std::string request, int & command, bo
 
 
 
+string MeDeHaInterface::createPayloadFile(const char * data, size_t length, int & fd)
+{
+	string path;
+	fd = -1;
+
+	if(memfdPayloads)
+	{
+		// Releasing the memory payloads dtnd never asked for
+		time_t now = time(NULL);
+		sem_wait(&injectedPayloadsLock);
+		map<string, InjectedPayload>::iterator iter = injectedPayloads.begin();
+		while(iter != injectedPayloads.end())
+		{
+			if(now - iter->second.creationTime > MEDEHA_INJECTION_TIMEOUT)
+			{
+				close(iter->second.fd);
+				injectedPayloads.erase(iter++);
+			}
+			else
+				iter++;
+		}
+		sem_post(&injectedPayloadsLock);
+
+#ifdef SYS_memfd_create
+		fd = syscall(SYS_memfd_create, "hbsd_medeha_bundle", 0);
+#endif
+		if(fd >= 0)
+			path = string("/proc/") + Util::to_string(getpid()) + string("/fd/") + Util::to_string(fd);
+		else
+			HBSD_LOG_DEBUG(string("Memory files not supported, writing the MeDeHa payload on disk"));
+	}
+
+	bool onDisk = (fd < 0);
+	if(onDisk)
+	{
+		path = payloadDirectory + string("/hbsd_medeha_bundle_") + Util::to_string(HBSD::requester->getAndIncrement());
+		if((fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) < 0)
+		{
+			HBSD_LOG_ERROR(string("Unable to create the MeDeHa payload file: ") + path);
+			return string("");
+		}
+	}
+
+	size_t written = 0;
+	while(written < length)
+	{
+		ssize_t res = write(fd, data + written, length - written);
+		if(res < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			HBSD_LOG_ERROR(string("Unable to write the MeDeHa payload file: ") + path);
+			close(fd);
+			fd = -1;
+			if(onDisk)
+				unlink(path.c_str());
+			return string("");
+		}
+		written += res;
+	}
+
+	// dtnd links the file on disk into its store and removes it
+	if(onDisk)
+	{
+		close(fd);
+		fd = -1;
+	}
+	return path;
+}
+
+void MeDeHaInterface::injectionCompleted(string reqId)
+{
+	sem_wait(&injectedPayloadsLock);
+	map<string, InjectedPayload>::iterator iter = injectedPayloads.find(reqId);
+	if(iter != injectedPayloads.end())
+	{
+		close(iter->second.fd);
+		injectedPayloads.erase(iter);
+	}
+	sem_post(&injectedPayloadsLock);
+}
+
 int MeDeHaInterface::getRequestCommandPart(char *complete_request, int part_number, char * resulting_part)
 {
 
@@ -422,6 +661,7 @@ void MeDeHaInterface::stopsInterfaceThread()
 	sem_wait(&protectStopFlag);
 	stopInterfaceThread = true;
 	sem_post(&protectStopFlag);
+	wakeUp();
 }
 
 bool MeDeHaInterface::interfaceThreadStatus()
@@ -433,47 +673,241 @@ bool MeDeHaInterface::interfaceThreadStatus()
 	return tmp;
 }
 
+void MeDeHaInterface::wakeUp()
+{
+	if(wakeupFd < 0)
+		return;
+	uint64_t value = 1;
+	if(write(wakeupFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+		HBSD_LOG_ERROR(string("Error occurred while waking up the MeDeHa interface thread"));
+}
+
+void MeDeHaInterface::watchOutboundSocket(bool writable)
+{
+	if(writable == waitingWritable)
+		return;
+
+	struct epoll_event event;
+	bzero(&event, sizeof(event));
+	event.events = EPOLLOUT;
+	event.data.fd = outboundSocket;
+	if(epoll_ctl(epollFd, writable ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, outboundSocket, &event) < 0)
+	{
+		HBSD_LOG_ERROR(string("Error occurred while watching the socket towards MeDeHa daemon"));
+		return;
+	}
+	waitingWritable = writable;
+}
+
 void MeDeHaInterface::sendBackDataToMeDeHaDaemon(std::string data, std::string src)
 {
-	int     sock;
-    struct  sockaddr_in receiver_adr;
+	MeDeHaMessage message;
+	message.data.reserve(data.length() + src.length() + 1);
+	message.data.append(data);
+	message.data.append("#");
+	message.data.append(src);
+	message.payloadFd = -1;
+	message.payloadLength = 0;
+
+	if(queueMessage(message))
+		HBSD_LOG_INFO(string("Data queued for MeDeHa daemon: ") + message.data);
+	else
+		HBSD_LOG_ERROR(string("The queue towards MeDeHa daemon is full, dropping data from: ") + src);
+}
+
+bool MeDeHaInterface::sendPayloadFileToMeDeHaDaemon(std::string payloadFile, std::string src)
+{
+	MeDeHaMessage message;
+	message.data = string("#") + src;
 
-	if ((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+	if((message.payloadFd = open(payloadFile.c_str(), O_RDONLY)) < 0)
 	{
-		if(HBSD::log->enabled(Logging::FATAL))
-			HBSD::log->fatal(string("Error occurred while trying to open a socket towards MeDeHa daemon"));
-		exit(1);
-    }
+		HBSD_LOG_ERROR(string("Unable to open the MeDeHa payload file: ") + payloadFile);
+		return false;
+	}
 
-	bzero(&receiver_adr, sizeof(receiver_adr));
-	receiver_adr.sin_family = AF_INET;
-	receiver_adr.sin_addr.s_addr = inet_addr("10.0.1.26");
-	receiver_adr.sin_port = htons(DEFAULT_MEDEHA_DAEMON_PORT);
+	struct stat fileStatus;
+	if(fstat(message.payloadFd, &fileStatus) < 0 || fileStatus.st_size + message.data.length() > MEDEHA_MAX_DATAGRAM_LENGTH)
+	{
+		HBSD_LOG_ERROR(string("The MeDeHa payload file does not fit in a datagram: ") + payloadFile);
+		close(message.payloadFd);
+		Metrics::increment(METRIC_MEDEHA_MESSAGES_DROPPED);
+		return false;
+	}
+	message.payloadLength = fileStatus.st_size;
 
-	string msg;
+	// The descriptor keeps the payload readable even if dtnd deletes the bundle in the meantime
+	if(!queueMessage(message))
+	{
+		HBSD_LOG_ERROR(string("The queue towards MeDeHa daemon is full, dropping the payload from: ") + src);
+		close(message.payloadFd);
+		return false;
+	}
 
-	try
+	HBSD_LOG_INFO(string("MeDeHa payload file queued for MeDeHa daemon: ") + payloadFile);
+	return true;
+}
+
+bool MeDeHaInterface::queueMessage(MeDeHaMessage & message)
+{
+	bool wasEmpty = false;
+	bool dropped = false;
+	sem_wait(&sendQueueLock);
+	if(sendQueue.size() >= maxSendQueueSize)
 	{
-		msg.append(data);
-		msg.append("#");
-		msg.append(src);
+		dropped = true;
 	}
-	catch(exception &e)
+	else
 	{
-		if(HBSD::log->enabled(Logging::ERROR))
-			HBSD::log->error(string("Exception occured while trying to read the MeDeHa data file: ") + data);
-		close(sock);
-		return;
+		wasEmpty = sendQueue.empty();
+		sendQueue.push_back(message);
+		Metrics::setGauge(METRIC_MEDEHA_SEND_QUEUE_DEPTH, sendQueue.size());
 	}
-	if (sendto(sock, (char*)msg.c_str(), msg.length(), 0, (struct sockaddr*)&receiver_adr, sizeof(receiver_adr)) < 0)
+	sem_post(&sendQueueLock);
+
+	if(dropped)
 	{
-                close(sock);
-                if(HBSD::log->enabled(Logging::FATAL))
-                		HBSD::log->fatal(string("Error occurred while trying to bind the MeDeHa interface socket"));
-                exit(1);
-    }
+		Metrics::increment(METRIC_MEDEHA_MESSAGES_DROPPED);
+		return false;
+	}
 
-	if(HBSD::log->enabled(Logging::INFO))
-		HBSD::log->info(string("Data sent back to MeDeHa daemon: ") + msg);
+	// The interface thread drains the queue until it is empty, it is only
+	// woken up by the first message
+	if(wasEmpty)
+		wakeUp();
+	return true;
+}
+
+int MeDeHaInterface::sendPayloadMessage(MeDeHaMessage * message)
+{
+	// Corked, the file content and the source make up a single datagram. The
+	// socket is blocking so that a datagram is never left half built.
+	int cork = 1;
+	if(setsockopt(outboundSocket, IPPROTO_UDP, UDP_CORK, &cork, sizeof(cork)) < 0)
+	{
+		HBSD_LOG_ERROR(string("Error occurred while corking the socket towards MeDeHa daemon"));
+		return -1;
+	}
+
+	int result = 1;
+	off_t offset = 0;
+	while(offset < message->payloadLength)
+	{
+		ssize_t sent = sendfile(outboundSocket, message->payloadFd, &offset, message->payloadLength - offset);
+		if(sent < 0 && errno == EINTR)
+			continue;
+		if(sent <= 0)
+		{
+			result = -1;
+			break;
+		}
+	}
+
+	if(result > 0)
+	{
+		while(send(outboundSocket, message->data.data(), message->data.length(), 0) < 0)
+		{
+			if(errno != EINTR)
+			{
+				result = -1;
+				break;
+			}
+		}
+	}
+
+	cork = 0;
+	if(setsockopt(outboundSocket, IPPROTO_UDP, UDP_CORK, &cork, sizeof(cork)) < 0)
+		result = -1;
+
+	if(result < 0)
+		HBSD_LOG_ERROR(string("Error occurred while trying to send a payload file to MeDeHa daemon"));
+	return result;
+}
+
+void MeDeHaInterface::flushSendQueue()
+{
+	// Sending at most the messages already queued, the receive side gets its turn after
+	unsigned int remaining;
+	sem_wait(&sendQueueLock);
+	remaining = sendQueue.size();
+	sem_post(&sendQueueLock);
+
+	while(remaining > 0)
+	{
+		// The queued messages do not move when new ones are pushed back, they can be
+		// sent without holding the lock. The in memory messages go by batches, the
+		// file backed ones one by one.
+		int limit = remaining < (unsigned int)batchSize ? remaining : batchSize;
+		int count = 0;
+		MeDeHaMessage * payloadMessage = NULL;
+		sem_wait(&sendQueueLock);
+		if(sendQueue.front().payloadFd >= 0)
+		{
+			payloadMessage = &sendQueue.front();
+		}
+		else
+		{
+			for(; count < limit && sendQueue[count].payloadFd < 0; count++)
+			{
+				sendIov[count].iov_base = (void *)sendQueue[count].data.data();
+				sendIov[count].iov_len = sendQueue[count].data.length();
+				bzero(&sendMsgs[count], sizeof(struct mmsghdr));
+				sendMsgs[count].msg_hdr.msg_iov = &sendIov[count];
+				sendMsgs[count].msg_hdr.msg_iovlen = 1;
+			}
+		}
+		sem_post(&sendQueueLock);
+
+		int sent;
+		int removed;
+		if(payloadMessage != NULL)
+		{
+			sent = sendPayloadMessage(payloadMessage);
+			removed = 1;
+			close(payloadMessage->payloadFd);
+			if(sent < 0)
+			{
+				Metrics::increment(METRIC_MEDEHA_MESSAGES_DROPPED);
+				sent = 0;
+			}
+		}
+		else
+		{
+			sent = sendmmsg(outboundSocket, sendMsgs, count, MSG_DONTWAIT);
+			removed = sent;
+			if(sent < 0)
+			{
+				// A previous datagram was refused by the daemon host, the error is now cleared
+				if(errno == EINTR || errno == ECONNREFUSED)
+					continue;
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					// Socket buffer full, resuming once it is writable
+					watchOutboundSocket(true);
+					return;
+				}
+				// Dropping the message that could not be sent
+				HBSD_LOG_ERROR(string("Error occurred while trying to send data to MeDeHa daemon"));
+				Metrics::increment(METRIC_MEDEHA_MESSAGES_DROPPED);
+				sent = 0;
+				removed = 1;
+			}
+		}
+
+		sem_wait(&sendQueueLock);
+		for(int i = 0; i < removed; i++)
+			sendQueue.pop_front();
+		Metrics::setGauge(METRIC_MEDEHA_SEND_QUEUE_DEPTH, sendQueue.size());
+		sem_post(&sendQueueLock);
+
+		Metrics::increment(METRIC_MEDEHA_MESSAGES_SENT, sent);
+		remaining -= removed;
+	}
 
+	// Coming back for the messages queued in the meantime
+	sem_wait(&sendQueueLock);
+	bool pending = !sendQueue.empty();
+	sem_post(&sendQueueLock);
+	if(pending)
+		wakeUp();
 }
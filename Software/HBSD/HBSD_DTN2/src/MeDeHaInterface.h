@@ -28,15 +28,56 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <string>
 #include <pthread.h>
 #include <semaphore.h>
-#include <string>
+#include <deque>
+#include <vector>
+#include <map>
+#include <time.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
 
 #define DEFAULT_MEDEHA_INTERFACE_PORT 2617
 #define MAX_REQUEST_MESSAGE_PARTS 2
 #define DEFAULT_MAX_DATA_LENGTH 1024
 #define DEFAULT_MEDEHA_DAEMON_PORT 2618
+#define DEFAULT_MEDEHA_DAEMON_ADDRESS "10.0.1.26"
+// Messages waiting to be sent to the MeDeHa daemon, the new ones are dropped beyond
+#define DEFAULT_MEDEHA_SEND_QUEUE_SIZE 4096
+// Datagrams received or sent by a single recvmmsg/sendmmsg call
+#define DEFAULT_MEDEHA_BATCH_SIZE 32
+// Milliseconds between two checks of the stop flag when idle
+#define MEDEHA_EPOLL_TIMEOUT 1000
+// Whether the injected MeDeHa payloads are memory files instead of files on disk
+#define DEFAULT_MEDEHA_MEMFD_PAYLOADS true
+// Directory of the injected MeDeHa payload files, when not in memory
+#define DEFAULT_MEDEHA_PAYLOAD_DIRECTORY "/tmp"
+// Seconds after which a memory payload still not injected by dtnd is released
+#define MEDEHA_INJECTION_TIMEOUT 60
+// Largest UDP datagram sent to the MeDeHa daemon
+#define MEDEHA_MAX_DATAGRAM_LENGTH 65507
 
 class MeDeHaInterface;
 
+/**
+ * Message queued for the MeDeHa daemon. When payloadFd is valid, the datagram
+ * is the content of that file followed by data, otherwise data only.
+ */
+typedef struct MeDeHaMessage
+{
+	std::string data;
+	int payloadFd;
+	off_t payloadLength;
+}MeDeHaMessage;
+
+/**
+ * Payload of an injection request, kept open until dtnd injected the bundle.
+ */
+typedef struct InjectedPayload
+{
+	int fd;
+	time_t creationTime;
+}InjectedPayload;
+
 typedef struct ThreadParamMeDeHA
 {
 	MeDeHaInterface * medehaInterface;
@@ -69,8 +110,9 @@ public:
 	//////////////////////////// MeDeHaInterface Thread ////////////////////////////
 
 	/**
-	 * Main loop of the MeDeHaInterface thread. Wait for any coming request from the
-	 * MeDeHa overlay.
+	 * Main loop of the MeDeHaInterface thread. Waits with epoll for the requests
+	 * coming from the MeDeHa overlay and for the messages queued for the MeDeHa
+	 * daemon.
 	 */
 
 	static void  * run(void * arg);
@@ -106,12 +148,101 @@ public:
 
 	int getRequestCommandPart(char *completeRequest, int partNumber, char * resultingPart);
 
+	/**
+	 * Queues data for the MeDeHa daemon, sent by the interface thread through
+	 * its persistent socket. The data is dropped when the send queue is full.
+	 */
 	void sendBackDataToMeDeHaDaemon(std::string data, std::string src);
 
+	/**
+	 * Queues the content of a bundle payload file for the MeDeHa daemon. The
+	 * file is sent as is by the kernel, without being read by HBSD.
+	 * @return bool false if the file could not be opened or does not fit in a datagram.
+	 */
+	bool sendPayloadFileToMeDeHaDaemon(std::string payloadFile, std::string src);
+
+	/**
+	 * Releases the payload of an injection request once dtnd injected the bundle.
+	 */
+	void injectionCompleted(std::string reqId);
+
 protected:
 
+	/**
+	 * Creates the payload file of an injection request, a memory file when
+	 * supported.
+	 * @param fd set to the descriptor of the memory file, -1 for a file on disk.
+	 * @return string The path given to dtnd, empty on error.
+	 */
+	std::string createPayloadFile(const char * data, size_t length, int & fd);
+
+	// Queues a message, returns false if the queue is full
+	bool queueMessage(MeDeHaMessage & message);
+
+	/**
+	 * Sends a file backed message as a single datagram.
+	 * @return int 1 if sent, 0 if the socket is not writable, -1 if dropped.
+	 */
+	int sendPayloadMessage(MeDeHaMessage * message);
+
+	/**
+	 * Handles a request received from MeDeHa.
+	 * @return bool true if reply holds an answer to send back.
+	 */
+	bool handleRequest(const char * request, int length, std::string & reply);
+
+	/**
+	 * Receives and handles a batch of requests, then sends back the replies
+	 * with a single sendmmsg call.
+	 */
+	void receiveRequests();
+
+	/**
+	 * Sends the queued messages to the MeDeHa daemon by batches. Waits for the
+	 * socket to be writable again when its buffer is full.
+	 */
+	void flushSendQueue();
+
+	// Wakes up the interface thread
+	void wakeUp();
+
+	// Enables or disables the writable events of the outbound socket
+	void watchOutboundSocket(bool writable);
+
 	Handlers *router;
 	bool stopInterfaceThread;
 	sem_t protectStopFlag;
+	pthread_t thread;
+	bool started;
+
+	int interfacePort;
+	int batchSize;
+	unsigned int maxSendQueueSize;
+	int listenSocket;
+	int outboundSocket;
+	int epollFd;
+	int wakeupFd;
+	bool waitingWritable;
+	struct sockaddr_in daemonAddr;
+
+	// Messages for the MeDeHa daemon. Only the interface thread removes them,
+	// a queued message stays in place until it has been sent.
+	std::deque<MeDeHaMessage> sendQueue;
+	sem_t sendQueueLock;
+
+	bool memfdPayloads;
+	std::string payloadDirectory;
+	// Memory payloads waiting for their bundle_injected_event, by request id
+	std::map<std::string, InjectedPayload> injectedPayloads;
+	sem_t injectedPayloadsLock;
+
+	// recvmmsg/sendmmsg buffers, used by the interface thread only
+	char * recvBuffers;
+	struct mmsghdr * recvMsgs;
+	struct iovec * recvIov;
+	struct sockaddr_in * recvAddrs;
+	struct mmsghdr * sendMsgs;
+	struct iovec * sendIov;
+	std::vector<std::string> replies;
 };
 #endif
@@ -0,0 +1,296 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#include "Metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace std;
+
+typedef struct MetricsDescription
+{
+	const char * name;
+	// Label of the histograms sharing a name, NULL if none
+	const char * label;
+	const char * help;
+	// Divides the recorded values when exported
+	double scale;
+}MetricsDescription;
+
+static const MetricsDescription counterDescriptions[NUMBER_OF_METRICS_COUNTERS] =
+{
+	{"hbsd_dtnd_messages_total", NULL, "XML messages received from dtnd.", 1},
+	{"hbsd_dtnd_bytes_total", NULL, "Bytes received from dtnd.", 1},
+	{"hbsd_dtnd_parse_errors_total", NULL, "dtnd messages that could not be parsed.", 1},
+	{"hbsd_bundles_admitted_total", NULL, "Bundles added to the buffer.", 1},
+	{"hbsd_bundles_rejected_total", NULL, "New bundles dropped because the buffer was full.", 1},
+	{"hbsd_bundles_evicted_total", NULL, "Buffered bundles dropped to make room for a new one.", 1},
+	{"hbsd_bundles_expired_total", NULL, "Buffered bundles that expired.", 1},
+	{"hbsd_requests_sent_total", NULL, "Requests sent to dtnd.", 1},
+	{"hbsd_request_bytes_total", NULL, "Bytes sent to dtnd.", 1},
+	{"hbsd_request_errors_total", NULL, "Requests that could not be sent to dtnd.", 1},
+	{"hbsd_peer_messages_queued_total", NULL, "Peer bundles queued for the PeerListener.", 1},
+	{"hbsd_peer_messages_processed_total", NULL, "Peer bundles processed by the PeerListener.", 1},
+	{"hbsd_stat_messages_merged_total", NULL, "Messages merged from the statistics of the peers.", 1},
+	{"hbsd_trace_records_dropped_total", NULL, "Trace records dropped because the writer was late.", 1},
+	{"hbsd_log_records_dropped_total", NULL, "Log messages dropped because the logging ring buffer was full.", 1},
+	{"hbsd_medeha_requests_total", NULL, "Requests received from the MeDeHa overlay.", 1},
+	{"hbsd_medeha_messages_sent_total", NULL, "Messages sent to the MeDeHa daemon.", 1},
+	{"hbsd_medeha_messages_dropped_total", NULL, "Messages for the MeDeHa daemon dropped because the queue was full or the send failed.", 1},
+	{"hbsd_contacts_total", NULL, "Link contacts ended.", 1},
+	{"hbsd_contact_bytes_total", NULL, "Bytes transmitted by dtnd during the ended link contacts.", 1}
+};
+
+static const MetricsDescription gaugeDescriptions[NUMBER_OF_METRICS_GAUGES] =
+{
+	{"hbsd_buffer_bundles", NULL, "Bundles in the buffer.", 1},
+	{"hbsd_peer_queue_depth", NULL, "Peer bundles waiting for the PeerListener.", 1},
+	{"hbsd_stat_matrix_messages", NULL, "Messages in the statistics matrix.", 1},
+	{"hbsd_medeha_send_queue_depth", NULL, "Messages waiting to be sent to the MeDeHa daemon.", 1}
+};
+
+#define METRICS_SECONDS 1000000000.0
+
+static const MetricsDescription histogramDescriptions[NUMBER_OF_METRICS_HISTOGRAMS] =
+{
+	{"hbsd_dtnd_message_seconds", NULL, "Time to parse and handle a dtnd message.", METRICS_SECONDS},
+	{"hbsd_request_send_seconds", NULL, "Time to send a request to dtnd.", METRICS_SECONDS},
+	{"hbsd_peer_message_seconds", NULL, "Time to process a peer bundle.", METRICS_SECONDS},
+	{"hbsd_stat_refresh_seconds", NULL, "Time to refresh the statistics averages of a bin.", METRICS_SECONDS},
+	{"hbsd_stat_publish_seconds", NULL, "Time to publish a statistics snapshot.", METRICS_SECONDS},
+	{"hbsd_stat_merge_seconds", NULL, "Time to merge the statistics of a peer.", METRICS_SECONDS},
+	{"hbsd_admitted_utility", NULL, "Utility of the bundles admitted into a full buffer.", METRICS_UTILITY_SCALE},
+	{"hbsd_evicted_utility", NULL, "Utility of the bundles evicted from a full buffer.", METRICS_UTILITY_SCALE},
+	{"hbsd_event_handling_seconds", "event=\"bundle_received_event\"", "Time to handle a dtnd event.", METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"data_transmitted_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"bundle_delivered_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"bundle_delivery_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"bundle_send_cancelled_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"bundle_expired_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"bundle_injected_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"link_opened_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"link_closed_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"link_created_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"link_deleted_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"link_available_event\"", NULL, METRICS_SECONDS},
+	{"hbsd_event_handling_seconds", "event=\"link_unavailable_event\"", NULL, METRICS_SECONDS}
+};
+
+bool Metrics::enabled = true;
+volatile int64_t Metrics::gauges[NUMBER_OF_METRICS_GAUGES];
+
+// Shard of the calling thread
+static __thread MetricsShard * threadShard = NULL;
+// Every shard ever created, a thread exiting leaves its shard so that the counters never go back
+static MetricsShard * volatile shards = NULL;
+
+uint64_t Metrics::now()
+{
+	if(!enabled)
+		return 0;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+MetricsShard * Metrics::getShard()
+{
+	if(threadShard == NULL)
+		threadShard = newShard();
+	return threadShard;
+}
+
+MetricsShard * Metrics::newShard()
+{
+	MetricsShard * shard = (MetricsShard *)calloc(1, sizeof(MetricsShard));
+	if(shard == NULL)
+	{
+		fprintf(stderr, "Problem occurred while allocating a metrics shard\n");
+		exit(1);
+	}
+
+	// Push it on the list of shards, the readers only ever walk the list
+	MetricsShard * head;
+	do
+	{
+		head = shards;
+		shard->next = head;
+	}while(!__sync_bool_compare_and_swap(&shards, head, shard));
+	return shard;
+}
+
+int Metrics::getBucketIndex(uint64_t value)
+{
+	if(value < METRICS_SUB_BUCKETS)
+		return (int)value;
+
+	int exponent = 63 - __builtin_clzll(value);
+	if(exponent > METRICS_MAX_EXPONENT)
+		return METRICS_OVERFLOW_BUCKET;
+	int subBucket = (int)((value >> (exponent - METRICS_SUB_BUCKET_BITS)) & (METRICS_SUB_BUCKETS - 1));
+	return (exponent - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS + subBucket;
+}
+
+uint64_t Metrics::getBucketUpperBound(int bucket)
+{
+	if(bucket < METRICS_SUB_BUCKETS)
+		return (uint64_t)bucket;
+
+	int exponent = bucket / METRICS_SUB_BUCKETS + METRICS_SUB_BUCKET_BITS - 1;
+	uint64_t subBucket = bucket % METRICS_SUB_BUCKETS;
+	uint64_t width = 1ULL << (exponent - METRICS_SUB_BUCKET_BITS);
+	return ((METRICS_SUB_BUCKETS + subBucket) << (exponent - METRICS_SUB_BUCKET_BITS)) + width - 1;
+}
+
+uint64_t Metrics::getCounter(MetricsCounter counter)
+{
+	uint64_t total = 0;
+	for(MetricsShard * shard = shards; shard != NULL; shard = shard->next)
+		total += shard->counters[counter];
+	return total;
+}
+
+int64_t Metrics::getGauge(MetricsGauge gauge)
+{
+	return gauges[gauge];
+}
+
+uint64_t Metrics::getHistogram(MetricsHistogram histogram, uint64_t * buckets)
+{
+	uint64_t sum = 0;
+	memset(buckets, 0, METRICS_HISTOGRAM_BUCKETS * sizeof(uint64_t));
+	for(MetricsShard * shard = shards; shard != NULL; shard = shard->next)
+	{
+		for(int b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++)
+			buckets[b] += shard->buckets[histogram][b];
+		sum += shard->sums[histogram];
+	}
+	return sum;
+}
+
+static void appendHeader(string & out, const MetricsDescription & description, const char * type)
+{
+	out.append("# HELP ").append(description.name).append(" ").append(description.help).append("\n");
+	out.append("# TYPE ").append(description.name).append(" ").append(type).append("\n");
+}
+
+static void appendSample(string & out, const char * name, const char * suffix, const char * labels, double value)
+{
+	char buffer[64];
+	out.append(name).append(suffix);
+	if(labels != NULL && labels[0] != '\0')
+		out.append("{").append(labels).append("}");
+	snprintf(buffer, sizeof(buffer), " %.17g\n", value);
+	out.append(buffer);
+}
+
+void Metrics::writePrometheus(string & out)
+{
+	for(int c = 0; c < NUMBER_OF_METRICS_COUNTERS; c++)
+	{
+		appendHeader(out, counterDescriptions[c], "counter");
+		appendSample(out, counterDescriptions[c].name, "", NULL, (double)getCounter((MetricsCounter)c));
+	}
+
+	for(int g = 0; g < NUMBER_OF_METRICS_GAUGES; g++)
+	{
+		appendHeader(out, gaugeDescriptions[g], "gauge");
+		appendSample(out, gaugeDescriptions[g].name, "", NULL, (double)getGauge((MetricsGauge)g));
+	}
+
+	uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+	for(int h = 0; h < NUMBER_OF_METRICS_HISTOGRAMS; h++)
+	{
+		const MetricsDescription & description = histogramDescriptions[h];
+		// The labelled histograms sharing a name follow the one holding the help text
+		if(description.help != NULL)
+			appendHeader(out, description, "histogram");
+
+		uint64_t sum = getHistogram((MetricsHistogram)h, buckets);
+		string labels = description.label != NULL ? string(description.label) + string(",") : string("");
+
+		// The same bounds are always written, one per power of two, so that the
+		// series stay the same from one scrape to the next
+		uint64_t count = 0;
+		char le[64];
+		for(int b = 0; b < METRICS_FINITE_BUCKETS; b++)
+		{
+			count += buckets[b];
+			if(b % METRICS_SUB_BUCKETS != METRICS_SUB_BUCKETS - 1)
+				continue;
+			snprintf(le, sizeof(le), "le=\"%.9g\"", (double)getBucketUpperBound(b) / description.scale);
+			appendSample(out, description.name, "_bucket", (labels + string(le)).c_str(), (double)count);
+		}
+		count += buckets[METRICS_OVERFLOW_BUCKET];
+		appendSample(out, description.name, "_bucket", (labels + string("le=\"+Inf\"")).c_str(), (double)count);
+		appendSample(out, description.name, "_sum", description.label, (double)sum / description.scale);
+		appendSample(out, description.name, "_count", description.label, (double)count);
+	}
+}
+
+bool Metrics::getValue(string name, string & value)
+{
+	char buffer[64];
+	for(int c = 0; c < NUMBER_OF_METRICS_COUNTERS; c++)
+	{
+		if(name.compare(counterDescriptions[c].name) == 0)
+		{
+			snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)getCounter((MetricsCounter)c));
+			value.assign(buffer);
+			return true;
+		}
+	}
+
+	for(int g = 0; g < NUMBER_OF_METRICS_GAUGES; g++)
+	{
+		if(name.compare(gaugeDescriptions[g].name) == 0)
+		{
+			snprintf(buffer, sizeof(buffer), "%lld", (long long)getGauge((MetricsGauge)g));
+			value.assign(buffer);
+			return true;
+		}
+	}
+
+	// The labelled histograms are summed
+	bool found = false;
+	uint64_t count = 0;
+	uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+	for(int h = 0; h < NUMBER_OF_METRICS_HISTOGRAMS; h++)
+	{
+		if(name.compare(histogramDescriptions[h].name) != 0)
+			continue;
+		found = true;
+		getHistogram((MetricsHistogram)h, buckets);
+		for(int b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++)
+			count += buckets[b];
+	}
+	if(found)
+	{
+		snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)count);
+		value.assign(buffer);
+	}
+	return found;
+}
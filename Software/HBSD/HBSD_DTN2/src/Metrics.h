@@ -0,0 +1,220 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <stdint.h>
+
+// Sub-buckets per power of two of the log-linear histograms, as a number of bits
+#define METRICS_SUB_BUCKET_BITS 2
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKET_BITS)
+// Values up to 2^40 (about 18 minutes in nanoseconds) get their own bucket
+#define METRICS_MAX_EXPONENT 40
+#define METRICS_FINITE_BUCKETS ((METRICS_MAX_EXPONENT - METRICS_SUB_BUCKET_BITS + 2) * METRICS_SUB_BUCKETS)
+// The last bucket holds the larger values, which only count in the +Inf bucket
+#define METRICS_OVERFLOW_BUCKET METRICS_FINITE_BUCKETS
+#define METRICS_HISTOGRAM_BUCKETS (METRICS_FINITE_BUCKETS + 1)
+// Scale of the utility histograms, the utilities are recorded in millionths
+#define METRICS_UTILITY_SCALE 1000000.0
+
+/**
+ * Counters, summed over the threads that incremented them.
+ */
+enum MetricsCounter
+{
+	METRIC_DTND_MESSAGES,
+	METRIC_DTND_BYTES,
+	METRIC_DTND_PARSE_ERRORS,
+	METRIC_BUNDLES_ADMITTED,
+	METRIC_BUNDLES_REJECTED,
+	METRIC_BUNDLES_EVICTED,
+	METRIC_BUNDLES_EXPIRED,
+	METRIC_REQUESTS_SENT,
+	METRIC_REQUEST_BYTES,
+	METRIC_REQUEST_ERRORS,
+	METRIC_PEER_MESSAGES_QUEUED,
+	METRIC_PEER_MESSAGES_PROCESSED,
+	METRIC_STAT_MESSAGES_MERGED,
+	METRIC_TRACE_RECORDS_DROPPED,
+	METRIC_LOG_RECORDS_DROPPED,
+	METRIC_MEDEHA_REQUESTS,
+	METRIC_MEDEHA_MESSAGES_SENT,
+	METRIC_MEDEHA_MESSAGES_DROPPED,
+	METRIC_CONTACTS,
+	METRIC_CONTACT_BYTES,
+	NUMBER_OF_METRICS_COUNTERS
+};
+
+/**
+ * Instantaneous values, set by their single owner.
+ */
+enum MetricsGauge
+{
+	METRIC_BUFFER_OCCUPANCY,
+	METRIC_PEER_QUEUE_DEPTH,
+	METRIC_STAT_MATRIX_MESSAGES,
+	METRIC_MEDEHA_SEND_QUEUE_DEPTH,
+	NUMBER_OF_METRICS_GAUGES
+};
+
+/**
+ * Histograms. The handling time of the dtnd events follow the HBSD_SAX event
+ * numbers, from METRIC_EVENT_HANDLING_TIME on.
+ */
+enum MetricsHistogram
+{
+	METRIC_DTND_MESSAGE_TIME,
+	METRIC_REQUEST_SEND_TIME,
+	METRIC_PEER_MESSAGE_TIME,
+	METRIC_STAT_REFRESH_TIME,
+	METRIC_STAT_PUBLISH_TIME,
+	METRIC_STAT_MERGE_TIME,
+	METRIC_ADMITTED_UTILITY,
+	METRIC_EVICTED_UTILITY,
+	METRIC_EVENT_HANDLING_TIME,
+	NUMBER_OF_METRICS_HISTOGRAMS = METRIC_EVENT_HANDLING_TIME + 13
+};
+
+/**
+ * The values written by one thread. Only its owner writes them, the readers
+ * sum the shards of all the threads.
+ */
+typedef struct MetricsShard
+{
+	volatile uint64_t counters[NUMBER_OF_METRICS_COUNTERS];
+	volatile uint64_t buckets[NUMBER_OF_METRICS_HISTOGRAMS][METRICS_HISTOGRAM_BUCKETS];
+	volatile uint64_t sums[NUMBER_OF_METRICS_HISTOGRAMS];
+	struct MetricsShard * next;
+}MetricsShard;
+
+/**
+ * Registry of the HBSD metrics. Updating a metric only touches the calling
+ * thread shard, without any lock or atomic operation. The registry is
+ * exported in the Prometheus text format by the MetricsInterface.
+ */
+class Metrics
+{
+public:
+	/**
+	 * Adds to a counter of the calling thread.
+	 */
+	static void increment(MetricsCounter counter, uint64_t value = 1)
+	{
+		if(!enabled)
+			return;
+		MetricsShard * shard = getShard();
+		shard->counters[counter] = shard->counters[counter] + value;
+	}
+
+	static void setGauge(MetricsGauge gauge, int64_t value)
+	{
+		if(!enabled)
+			return;
+		gauges[gauge] = value;
+	}
+
+	/**
+	 * Records a value, in nanoseconds for the time histograms.
+	 */
+	static void observe(MetricsHistogram histogram, uint64_t value)
+	{
+		if(!enabled)
+			return;
+		MetricsShard * shard = getShard();
+		int bucket = getBucketIndex(value);
+		shard->buckets[histogram][bucket] = shard->buckets[histogram][bucket] + 1;
+		shard->sums[histogram] = shard->sums[histogram] + value;
+	}
+
+	/**
+	 * Records the time elapsed since start, a value returned by now().
+	 */
+	static void observeSince(MetricsHistogram histogram, uint64_t start)
+	{
+		if(!enabled)
+			return;
+		observe(histogram, now() - start);
+	}
+
+	static void observeUtility(MetricsHistogram histogram, double utility)
+	{
+		if(!enabled)
+			return;
+		observe(histogram, utility > 0 ? (uint64_t)(utility * METRICS_UTILITY_SCALE) : 0);
+	}
+
+	/**
+	 * @return The monotonic time in nanoseconds, 0 if the metrics are disabled.
+	 */
+	static uint64_t now();
+
+	/**
+	 * Log-linear bucketing: the values below METRICS_SUB_BUCKETS have their own
+	 * bucket, then each power of two is split into METRICS_SUB_BUCKETS. The
+	 * values from 2^(METRICS_MAX_EXPONENT+1) on go to METRICS_OVERFLOW_BUCKET.
+	 */
+	static int getBucketIndex(uint64_t value);
+
+	/**
+	 * @return The largest value falling into a finite bucket.
+	 */
+	static uint64_t getBucketUpperBound(int bucket);
+
+	static uint64_t getCounter(MetricsCounter counter);
+
+	static int64_t getGauge(MetricsGauge gauge);
+
+	/**
+	 * Sums the histogram over the threads.
+	 *
+	 * @param buckets Receives METRICS_HISTOGRAM_BUCKETS counts.
+	 * @return The sum of the recorded values.
+	 */
+	static uint64_t getHistogram(MetricsHistogram histogram, uint64_t * buckets);
+
+	/**
+	 * Appends every metric in the Prometheus text exposition format.
+	 */
+	static void writePrometheus(std::string & out);
+
+	/**
+	 * Looks up a single value by its Prometheus name, without labels. The
+	 * histograms are reported as their count.
+	 *
+	 * @return False if there is no such metric.
+	 */
+	static bool getValue(std::string name, std::string & value);
+
+	// Turns the collection on or off, on by default
+	static bool enabled;
+
+private:
+	static MetricsShard * getShard();
+	static MetricsShard * newShard();
+	static volatile int64_t gauges[NUMBER_OF_METRICS_GAUGES];
+};
+
+#endif
@@ -0,0 +1,253 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#include "MetricsInterface.h"
+#include "Metrics.h"
+#include "HBSD.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+MetricsInterface::MetricsInterface(int port, string dumpFile, int dumpInterval)
+{
+	this->port = port;
+	this->dumpFile = dumpFile;
+	this->dumpInterval = dumpInterval;
+	started = false;
+	stopInterfaceThread = false;
+	sem_init(&protectStopFlag, 0, 1);
+}
+
+MetricsInterface::~MetricsInterface()
+{
+	if(started)
+	{
+		stopsInterfaceThread();
+		pthread_join(thread, NULL);
+	}
+	sem_destroy(&protectStopFlag);
+}
+
+void MetricsInterface::init()
+{
+	ThreadParamMetrics * tp = (ThreadParamMetrics *)malloc(sizeof(ThreadParamMetrics));
+	if(tp == NULL)
+	{
+		if(HBSD::log->enabled(Logging::FATAL))
+			HBSD::log->fatal(string("Problem occurred while allocate MetricsInterface thread parameter"));
+		exit(1);
+	}
+	tp->metricsInterface = this;
+
+	if(pthread_create(&thread, NULL, MetricsInterface::run, (void *)tp) != 0)
+	{
+		if(HBSD::log->enabled(Logging::FATAL))
+			HBSD::log->fatal(string("Unable to create the MetricsInterface thread."));
+		exit(1);
+	}
+	started = true;
+
+	if(HBSD::log->enabled(Logging::INFO))
+		HBSD::log->info(string("MetricsInterface thread loaded."));
+}
+
+void * MetricsInterface::run(void * arg)
+{
+	ThreadParamMetrics * recvArg = (ThreadParamMetrics *)arg;
+	assert(recvArg != NULL);
+	recvArg->metricsInterface->serve();
+	free(recvArg);
+	return NULL;
+}
+
+void MetricsInterface::serve()
+{
+	int lsock = -1;
+	if(port > 0)
+		lsock = initUDPSocketListener(port);
+
+	char buf[MAX_METRICS_REQUEST_LENGTH];
+	time_t lastDump = time(NULL);
+
+	while(!interfaceThreadStatus())
+	{
+		// Wake up at least every second to check the stop flag and the dump
+		fd_set readSet;
+		FD_ZERO(&readSet);
+		if(lsock >= 0)
+			FD_SET(lsock, &readSet);
+		struct timeval timeout;
+		timeout.tv_sec = 1;
+		timeout.tv_usec = 0;
+		int ready = select(lsock + 1, &readSet, NULL, NULL, &timeout);
+
+		if(dumpInterval > 0 && time(NULL) - lastDump >= dumpInterval)
+		{
+			dumpMetrics();
+			lastDump = time(NULL);
+		}
+
+		if(ready <= 0 || lsock < 0 || !FD_ISSET(lsock, &readSet))
+			continue;
+
+		struct sockaddr_in from;
+		socklen_t fromlen = sizeof(from);
+		int rlen = recvfrom(lsock, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&from, &fromlen);
+		if(rlen <= 0)
+			continue;
+		buf[rlen] = '\0';
+		// Tolerate the new line of a netcat query
+		while(rlen > 0 && (buf[rlen - 1] == '\n' || buf[rlen - 1] == '\r'))
+			buf[--rlen] = '\0';
+
+		string answer;
+		if(!processMetricsRequest(string(buf), answer))
+		{
+			if(HBSD::log->enabled(Logging::WARN))
+				HBSD::log->warn(string("Unknown metrics request: ") + string(buf));
+		}
+
+		// Split the long answers on line boundaries
+		size_t offset = 0;
+		while(offset < answer.length())
+		{
+			size_t length = answer.length() - offset;
+			if(length > MAX_METRICS_DATAGRAM_LENGTH)
+			{
+				size_t lineEnd = answer.rfind('\n', offset + MAX_METRICS_DATAGRAM_LENGTH - 1);
+				length = (lineEnd == string::npos || lineEnd < offset) ? MAX_METRICS_DATAGRAM_LENGTH : lineEnd + 1 - offset;
+			}
+			if(sendto(lsock, answer.data() + offset, length, 0, (struct sockaddr *)&from, fromlen) == -1)
+			{
+				if(HBSD::log->enabled(Logging::ERROR))
+					HBSD::log->error(string("Error occurred when trying to send back the metrics."));
+				break;
+			}
+			offset += length;
+		}
+	}
+
+	if(dumpInterval > 0)
+		dumpMetrics();
+	if(lsock >= 0)
+		close(lsock);
+
+	if(HBSD::log->enabled(Logging::INFO))
+		HBSD::log->info(string("Closing Metrics Interface."));
+}
+
+bool MetricsInterface::processMetricsRequest(string request, string & answer)
+{
+	if(request.compare("METRICS") == 0)
+	{
+		Metrics::writePrometheus(answer);
+		return true;
+	}
+	else if(request.compare(0, 4, "GET#") == 0)
+	{
+		if(!Metrics::getValue(request.substr(4), answer))
+			answer.assign("UNKNOWN");
+		return true;
+	}
+	answer.assign("UNKNOWN");
+	return false;
+}
+
+bool MetricsInterface::dumpMetrics()
+{
+	string text;
+	Metrics::writePrometheus(text);
+
+	string tmpName = dumpFile + string(".tmp");
+	FILE * file = fopen(tmpName.c_str(), "w");
+	if(file == NULL)
+	{
+		if(HBSD::log->enabled(Logging::ERROR))
+			HBSD::log->error(string("Unable to write the metrics to: ") + tmpName);
+		return false;
+	}
+	bool written = fwrite(text.data(), 1, text.length(), file) == text.length();
+	written = (fclose(file) == 0) && written;
+	if(!written || rename(tmpName.c_str(), dumpFile.c_str()) != 0)
+	{
+		if(HBSD::log->enabled(Logging::ERROR))
+			HBSD::log->error(string("Unable to write the metrics to: ") + dumpFile);
+		remove(tmpName.c_str());
+		return false;
+	}
+	return true;
+}
+
+/* Listener on the loopback, the metrics are only queried locally */
+int MetricsInterface::initUDPSocketListener(int hostPort)
+{
+	int sock;
+	struct sockaddr_in servaddr;
+
+	if((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	{
+		if(HBSD::log->enabled(Logging::FATAL))
+			HBSD::log->fatal(string("Error occurred while trying to open the metrics interface socket"));
+		exit(1);
+	}
+
+	bzero(&servaddr, sizeof(servaddr));
+	servaddr.sin_family = AF_INET;
+	servaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	servaddr.sin_port = htons(hostPort);
+
+	if(bind(sock, (struct sockaddr *)&servaddr, sizeof(servaddr)) < 0)
+	{
+		close(sock);
+		if(HBSD::log->enabled(Logging::FATAL))
+			HBSD::log->fatal(string("Error occurred while trying to bind the metrics interface socket"));
+		exit(1);
+	}
+	if(HBSD::log->enabled(Logging::INFO))
+		HBSD::log->info(string("MetricsInterface thread is listening at port: ") + Util::to_string(hostPort));
+	return sock;
+}
+
+void MetricsInterface::stopsInterfaceThread()
+{
+	sem_wait(&protectStopFlag);
+	stopInterfaceThread = true;
+	sem_post(&protectStopFlag);
+}
+
+bool MetricsInterface::interfaceThreadStatus()
+{
+	bool tmp;
+	sem_wait(&protectStopFlag);
+	tmp = stopInterfaceThread;
+	sem_post(&protectStopFlag);
+	return tmp;
+}
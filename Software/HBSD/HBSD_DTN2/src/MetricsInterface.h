@@ -0,0 +1,111 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef METRICS_INTERFACE_H
+#define METRICS_INTERFACE_H
+
+#include <string>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define DEFAULT_METRICS_INTERFACE_PORT 2619
+// Seconds between two dumps of the metrics, 0 disables the dump
+#define DEFAULT_METRICS_DUMP_INTERVAL 0
+#define DEFAULT_METRICS_DUMP_FILE "/tmp/hbsd_metrics.prom"
+#define MAX_METRICS_REQUEST_LENGTH 256
+// Largest datagram of a METRICS answer, longer answers are split
+#define MAX_METRICS_DATAGRAM_LENGTH 60000
+
+class MetricsInterface;
+
+typedef struct ThreadParamMetrics
+{
+	MetricsInterface * metricsInterface;
+}ThreadParamMetrics;
+
+/**
+ * Exposes the Metrics registry. A UDP socket bound to the loopback answers:
+ *   METRICS     every metric in the Prometheus text format
+ *   GET#<name>  the value of one metric, or UNKNOWN
+ * The same thread periodically writes the Prometheus text to a file, e.g. for
+ * the node exporter textfile collector.
+ */
+class MetricsInterface
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param port UDP port of the queries, 0 to only dump the metrics.
+	 * @param dumpFile File replaced at each dump.
+	 * @param dumpInterval Seconds between two dumps, 0 to disable the dump.
+	 */
+	MetricsInterface(int port, std::string dumpFile, int dumpInterval);
+
+	/**
+	 * Destructor: stops the interface thread.
+	 */
+	~MetricsInterface();
+
+	/**
+	 * Starts the MetricsInterface thread.
+	 */
+	void init();
+
+	/**
+	 * Main loop of the MetricsInterface thread.
+	 */
+	static void * run(void * arg);
+
+	/**
+	 * Answers a query.
+	 *
+	 * @return False if the query is unknown.
+	 */
+	bool processMetricsRequest(std::string request, std::string & answer);
+
+	/**
+	 * Writes the metrics to a temporary file then renames it, so that the
+	 * readers never see a partial dump.
+	 */
+	bool dumpMetrics();
+
+	void stopsInterfaceThread();
+
+	bool interfaceThreadStatus();
+
+private:
+	int initUDPSocketListener(int hostPort);
+
+	void serve();
+
+	int port;
+	std::string dumpFile;
+	int dumpInterval;
+	bool started;
+	pthread_t thread;
+	bool stopInterfaceThread;
+	sem_t protectStopFlag;
+};
+#endif
@@ -31,8 +31,8 @@ using namespace std;
 Node::Node(Nodes *nodeManager, string eid) 
 {
 	activeLink = NULL;
-	nodeManager = nodeManager;
-	eid = eid;
+	this->nodeManager = nodeManager;
+	this->eid = eid;
 	lastSessionAt = Util::getCurrentTimeSeconds();
 }
 
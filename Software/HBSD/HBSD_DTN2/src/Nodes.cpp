@@ -33,22 +33,21 @@ using namespace std;
 Nodes::Nodes(Handlers *router) 
 {
 	assert(router != NULL);
-	sem_init(&nodesLock, 0, 1);
+	pthread_rwlock_init(&nodesLock, NULL);
 	this->router = router;
-	
+	availableNodesValid = false;
 }
 
 Nodes::~Nodes()
 {
-	sem_destroy(&nodesLock);
 	// Clearing the hash of Nodes
-	while(!nodesList.empty())
+	for(size_t slot = nodesList.begin(); slot != nodesList.end(); slot = nodesList.next(slot))
 	{
-		map <string, Node *>::iterator iter = nodesList.begin();
-		delete iter->second;
-		nodesList.erase(iter);
+		delete nodesList.valueAt(slot);
 	}
-	// Destroying the semaphore
+	nodesList.clear();
+	// Destroying the lock
+	pthread_rwlock_destroy(&nodesLock);
 }
 
 
@@ -59,47 +58,38 @@ Node *Nodes::conditionalAdd(string eid)
 	// Don't create a node for ourself.
 	if(eid.compare(HBSD::localEID) == 0)
 	{
-		if(HBSD::log->enabled(Logging::INFO))
-			HBSD::log->info(string("It is me ! Just don't create yourself"));
+		HBSD_LOG_INFO(string("It is me ! Just don't create yourself"));
 		return NULL;
 	}
 
-	// First check if it exists using the read lock. We may want to revisit this if we typically call this without the EID already existing, but this is probably the correct approach.
-
-	Node *node = NULL;
-
-	sem_wait(&nodesLock);
-
-	node = nodesList[eid];
-
+	// First check if it exists using the read lock, the node is usually already known.
+	Node *node = findNode(eid);
 	if (node != NULL) 
 	{
 		// Found it.
-		if(HBSD::log->enabled(Logging::INFO))
-			HBSD::log->info(string("we already know about this Node:")+eid);
-
-		sem_post(&nodesLock);
+		HBSD_LOG_INFO(string("we already know about this Node:")+eid);
 		return node;
 	}
 
-	bool callPolicy = false;
+	pthread_rwlock_wrlock(&nodesLock);
 
+	// Created by another thread in the meantime
+	node = nodesList.find(eid);
+	if (node != NULL) 
+	{
+		pthread_rwlock_unlock(&nodesLock);
+		return node;
+	}
 
-	// Go ahead and create the Node object without the lock and then acquire the write lock just to add it to the table.
-	if(HBSD::log->enabled(Logging::INFO))
-		HBSD::log->info(string("Creating the node: ")+eid);
+	HBSD_LOG_INFO(string("Creating the node: ")+eid);
 	node = new Node(this, eid);
-	nodesList[eid] = node;
-	callPolicy = true;
-
+	nodesList.insert(eid, node);
+	availableNodesValid = false;
 
-	if (callPolicy) 
-	{
-		// Notify the PolicyManager
-		router->policyMgr->nodeCreated(node);
-	}
+	// Notify the PolicyManager
+	router->policyMgr->nodeCreated(node);
 
-	sem_post(&nodesLock);
+	pthread_rwlock_unlock(&nodesLock);
 
 	return node;
 }
@@ -107,55 +97,63 @@ Node *Nodes::conditionalAdd(string eid)
 Node *Nodes::findNode(string eid) 
 {
 	Node *node = NULL;
-	sem_wait(&nodesLock);
-		node = nodesList[eid];
-	sem_post(&nodesLock);
+	pthread_rwlock_rdlock(&nodesLock);
+		node = nodesList.find(eid);
+	pthread_rwlock_unlock(&nodesLock);
 	return node;
 }
 
 void Nodes::allNodes(list<Node *> &listNodes) 
 {
 	// Getting the list of all the available nodes
-	sem_wait(&nodesLock);
-	for(map <string, Node *>::iterator iter = nodesList.begin();iter != nodesList.end(); iter++)
+	pthread_rwlock_rdlock(&nodesLock);
+	for(size_t slot = nodesList.begin(); slot != nodesList.end(); slot = nodesList.next(slot))
 	{
-		listNodes.push_back(iter->second);
+		listNodes.push_back(nodesList.valueAt(slot));
 	}
-	sem_post(&nodesLock);
+	pthread_rwlock_unlock(&nodesLock);
 }
 
 void Nodes::removeNode(string eid)
 {
-	sem_wait(&nodesLock);
-	map <string, Node *>::iterator iter = nodesList.find(eid);
-	if(iter != nodesList.end())
+	pthread_rwlock_wrlock(&nodesLock);
+	Node * node = nodesList.erase(eid);
+	if(node != NULL)
 	{
-		if(iter->second != NULL)
-			delete iter->second;
-		nodesList.erase(iter);
+		delete node;
+		availableNodesValid = false;
 	}
-	sem_post(&nodesLock);
+	pthread_rwlock_unlock(&nodesLock);
 }
 
 string Nodes::getListOfAvailableNodes()
 {
 	string tmp;
 
-	sem_wait(&nodesLock);
-
-	if(nodesList.empty())
-		return NULL;
-	int i = 0;
-	for(map <string, Node *>::iterator iter = nodesList.begin(); iter != nodesList.end(); iter++)
+	pthread_rwlock_rdlock(&nodesLock);
+	if(availableNodesValid)
 	{
-		if(i > 0)
-			tmp.append("#");
-		i++;
-		tmp.append(iter->first);
-		cout<<"EIDDDDDDD: "<<iter->first<<endl;
+		tmp = availableNodes;
+		pthread_rwlock_unlock(&nodesLock);
+		return tmp;
 	}
+	pthread_rwlock_unlock(&nodesLock);
 
-	sem_post(&nodesLock);
+	// Rendering the list again under the write lock, the readers share the result
+	pthread_rwlock_wrlock(&nodesLock);
+	if(!availableNodesValid)
+	{
+		availableNodes.clear();
+		for(size_t slot = nodesList.begin(); slot != nodesList.end(); slot = nodesList.next(slot))
+		{
+			if(!availableNodes.empty())
+				availableNodes.append("#");
+			availableNodes.append(nodesList.keyAt(slot));
+		}
+		availableNodesValid = true;
+	}
+	tmp = availableNodes;
+	pthread_rwlock_unlock(&nodesLock);
 
 	return tmp;
 }
@@ -27,8 +27,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <string>
 #include <list>
-#include <semaphore.h>
-#include <map>
+#include <pthread.h>
+#include "StringHashMap.h"
 
 
 
@@ -89,12 +89,23 @@ public:
 	void removeNode(std::string eid);
 
 	Handlers *router;
+
+	/**
+	 * Returns the '#' separated EIDs of the known nodes, rebuilt only after
+	 * a node was added or removed.
+	 *
+	 * @return The list of EIDs, empty if no node is known.
+	 */
 	std::string getListOfAvailableNodes();
 private:
 
-	sem_t nodesLock;
-	std::map <std::string, Node *> nodesList;
-	
+	// Readers share the lock, only adding or removing a node excludes them
+	pthread_rwlock_t nodesLock;
+	StringHashMap<Node> nodesList;
+
+	// Rendered list of EIDs, valid until the next membership change
+	std::string availableNodes;
+	bool availableNodesValid;
 };
 
 #endif
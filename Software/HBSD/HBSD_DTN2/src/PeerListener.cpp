@@ -25,11 +25,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "PeerListener.h"
 #include "XMLTree.h"
 #include "Handlers.h"
+#include "Links.h"
 #include <exception>
 #include <fstream>
 #include "HBSD.h"
 #include <assert.h>
 #include "MeDeHaInterface.h"
+#include "Metrics.h"
+#include "Tracepoints.h"
 using namespace std;
 
 PeerListener::PeerListener(Handlers *router) 
@@ -137,7 +140,9 @@ void PeerListener::eventDelivery(XMLTree *evtBundleDelivery, Bundle *bundle)
 
 			sem_wait(&msgQueueLock);
 				msgQueue.push(peerBundle);
+				Metrics::setGauge(METRIC_PEER_QUEUE_DEPTH, msgQueue.size());
 			sem_post(&msgQueueLock);
+			Metrics::increment(METRIC_PEER_MESSAGES_QUEUED);
 			peerBundle = NULL;
 
 		}
@@ -173,7 +178,9 @@ void PeerListener::eventDelivery(XMLTree *evtBundleDelivery, Bundle *bundle)
 
 			sem_wait(&msgQueueLock);
 				msgQueue.push(peerBundle);
+				Metrics::setGauge(METRIC_PEER_QUEUE_DEPTH, msgQueue.size());
 			sem_post(&msgQueueLock);
+			Metrics::increment(METRIC_PEER_MESSAGES_QUEUED);
 			peerBundle = NULL;
 		}
 
@@ -208,29 +215,11 @@ void *PeerListener::run(void *arg)
 			HBSD::log->error(string("Invalid arguments passed to PeerListener thread"));
 		exit(1);
 	}
-	PeerBundle *peerBundle = NULL;
-	
 	while (recvArg->peerListener->getStatus())
 	{
 		try 
 		{
-			recvArg->peerListener->lockMsgQueue();
-
-			if(recvArg->peerListener->msgQueue.empty())
-			{
-				recvArg->peerListener->unlockMsgQueue();
-				continue;
-			}
-
-			peerBundle = recvArg->peerListener->msgQueue.front();
-
-			recvArg->peerListener->msgQueue.pop();
-			recvArg->peerListener->unlockMsgQueue();
-
-			recvArg->peerListener->processPeerMessage(peerBundle);
-			if(peerBundle != NULL)
-				delete peerBundle;
-
+			recvArg->peerListener->processNextMessage();
 		} 
 
 		catch (exception &e) 
@@ -250,6 +239,30 @@ void *PeerListener::run(void *arg)
 	return NULL;
 }
 	
+bool PeerListener::processNextMessage()
+{
+	lockMsgQueue();
+
+	if(msgQueue.empty())
+	{
+		unlockMsgQueue();
+		return false;
+	}
+
+	PeerBundle *peerBundle = msgQueue.front();
+	msgQueue.pop();
+	Metrics::setGauge(METRIC_PEER_QUEUE_DEPTH, msgQueue.size());
+	unlockMsgQueue();
+
+	uint64_t processingStart = Metrics::now();
+	processPeerMessage(peerBundle);
+	if(peerBundle != NULL)
+		delete peerBundle;
+	Metrics::increment(METRIC_PEER_MESSAGES_PROCESSED);
+	Metrics::observeSince(METRIC_PEER_MESSAGE_TIME, processingStart);
+	return true;
+}
+	
 void PeerListener::processPeerMessage(PeerBundle *peerBundle) 
 {
 	assert(peerBundle != NULL);
@@ -261,24 +274,16 @@ void PeerListener::processPeerMessage(PeerBundle *peerBundle)
 
 		if(peerBundle->bundle->isMeDeHaBundle())
 		{
-			// Get the data from the file.
-			HBSD::log->info(string("Getting MeDeHa data from the payload file: ")+peerBundle->payloadFile);
-			ifstream dataFile;
-			dataFile.open (peerBundle->payloadFile.c_str(), ios::out);
-			string data;
-			string line;
-			while(dataFile >> line)
-			{
-					data.append(line);
-			}
-
-			dataFile.close();
-			// Forward the message to the MeDeHa daemon
-			((HBSD_Routing*)router)->medehaInterface->sendBackDataToMeDeHaDaemon(data, msgSrc);
+			// The payload file goes as is to the MeDeHa daemon, sent by the kernel
+			HBSD_LOG_INFO(string("Forwarding the MeDeHa payload file: ")+peerBundle->payloadFile);
+			if(((HBSD_Routing*)router)->medehaInterface != NULL)
+				((HBSD_Routing*)router)->medehaInterface->sendPayloadFileToMeDeHaDaemon(peerBundle->payloadFile, msgSrc);
+			else
+				HBSD_LOG_ERROR(string("The MeDeHa interface is disabled, dropping the data from: ") + msgSrc);
 		}
 		else
 		{
-			HBSD::log->info(string("Getting HBSD data from the payload file: ")+peerBundle->payloadFile);
+			HBSD_LOG_INFO(string("Getting HBSD data from the payload file: ")+peerBundle->payloadFile);
 
 			ifstream dataFile;
 			dataFile.open (peerBundle->payloadFile.c_str(), ios::out);
@@ -288,18 +293,23 @@ void PeerListener::processPeerMessage(PeerBundle *peerBundle)
 			string type;
 			dataFile >> type;
 
+			// Keep the keys separated, they are read back one by one
 			while(dataFile >> line)
 			{
 					data.append(line);
+					data.append(" ");
 			}
 
 			dataFile.close();
 			assert(!type.empty());
+			HBSD_TRACEPOINT3(sv_received, msgSrc.c_str(), type.c_str(), data.length());
 
 			// Request that the bundle be deleted. This removes the file.
 			HBSD::requester->requestDeleteBundle(peerBundle->bundle);
 
-			router->policyMgr->metaDataReceived(msgSrc, data, type);
+			// Handled within the contact session of the link towards the peer, if it is still opened
+			if(!router->links->postMetaData(msgSrc, data, type))
+				router->policyMgr->metaDataReceived(msgSrc, data, type);
 		}
 
 	}
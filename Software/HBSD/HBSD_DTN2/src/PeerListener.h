@@ -111,6 +111,14 @@ public:
 	 */
 	void processPeerMessage(PeerBundle *peerBundle);
 
+	/**
+	 * Pops the oldest received peer bundle, if any, and processes it within
+	 * the calling thread.
+	 * 
+	 * @return False if there was no bundle to process.
+	 */
+	bool processNextMessage();
+
 	bool getStatus()
 	{
 		bool tmp;
@@ -32,6 +32,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "HBSD.h"
 #include "GBOF.h"
 #include "ConfigFile.h"
+#include "Metrics.h"
+#include "Tracepoints.h"
 #include <iostream>
 #include <fstream>
 using namespace std;
@@ -45,6 +47,7 @@ string Requester::BPA_END;
 Requester::Requester()
 {
 	defaultDestPort = 0;
+	sink = NULL;
 	idBase = Util::to_string(this) + string("-") + Util::to_string(time(NULL)/1000) + string("-");
 	injectIdSeq = 0;
 	xmlBanner.assign("<?xml version=\"1.0\" encoding=\"UTF-8\"?>");
@@ -137,18 +140,33 @@ bool Requester::xmlEncapsulateAndSend(string data)
 	assert(!data.empty());
 	try 
 	{
+		uint64_t sendStart = Metrics::now();
 		string strMsg = getMsgStart() + data + BPA_END;
+		if(HBSD::recorder != NULL)
+			HBSD::recorder->record(TRACE_RECORD_SENT, strMsg.data(), strMsg.length());
+		Metrics::increment(METRIC_REQUESTS_SENT);
+		Metrics::increment(METRIC_REQUEST_BYTES, strMsg.length());
+		HBSD_TRACEPOINT2(request_sent, strMsg.c_str(), strMsg.length());
+		if(sink != NULL)
+		{
+			bool sent = sink->send(strMsg);
+			Metrics::observeSince(METRIC_REQUEST_SEND_TIME, sendStart);
+			return sent;
+		}
 		if(sendto(socketR ,strMsg.c_str(),strMsg.length(), 0,(sockaddr *)&defaultDestAddr, sizeof(defaultDestAddr))<0)
 		{
+		    Metrics::increment(METRIC_REQUEST_ERRORS);
 		    if(HBSD::log->enabled(Logging::ERROR))
 		    	perror("Requester::xmlEncapsulateAndSend sendto: ");
 		    exit(1);
     	}
+		Metrics::observeSince(METRIC_REQUEST_SEND_TIME, sendStart);
 		return true;
 	}
 	
 	catch (exception &e) 
 	{
+			Metrics::increment(METRIC_REQUEST_ERRORS);
 			if (HBSD::log->enabled(Logging::ERROR)) 
 			{
 				HBSD::log->error(string("Failed to send request to dtnd: ") + string(e.what()));
@@ -196,9 +214,10 @@ string Requester::requestInjectBundle(string source, string dest,string linkId,
 	{
 		if(HBSD::log->enabled(Logging::ERROR))
 			HBSD::log->error(string("Error occurred when asking dtnd to inject a bundle"));
-		return NULL;
+		return string("");
 	}
 
+	HBSD_TRACEPOINT3(sv_sent, dest.c_str(), linkId.c_str(), payloadFile.c_str());
 	return requestId;
 }
 
@@ -37,6 +37,24 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 class Link;
 class Bundle;
 
+/**
+ * Destination of the XML requests built by the Requester. When none is set
+ * the requests are sent to the dtnd multicast socket.
+ */
+class RequesterSink
+{
+public:
+	virtual ~RequesterSink() {}
+
+	/**
+	 * Takes a complete XML request.
+	 * 
+	 * @param msg The <bpa> document.
+	 * @return True on success, false on failure.
+	 */
+	virtual bool send(const std::string & msg) = 0;
+};
+
 class Requester 
 {
 public:	
@@ -84,6 +102,35 @@ public:
 	 */
 
 	bool xmlEncapsulateAndSend(std::string data);
+
+	/**
+	 * Redirects the requests to the given sink instead of dtnd, e.g. to
+	 * capture them in memory when replaying a trace.
+	 * 
+	 * @param s The sink, NULL to send to dtnd again. Not owned.
+	 */
+	void setSink(RequesterSink * s)
+	{
+		sink = s;
+	}
+
+	/**
+	 * Prefix of the request ids, made of the requester address and its
+	 * creation time, followed by a sequence number.
+	 */
+	std::string getIdBase()
+	{
+		return idBase;
+	}
+
+	/**
+	 * Replaces the prefix of the request ids, e.g. by the recorded one when
+	 * replaying a trace.
+	 */
+	void setIdBase(std::string base)
+	{
+		idBase = base;
+	}
 	
 	/**
 	 * Send XML element on the default port.
@@ -202,9 +249,8 @@ public:
 
 	int getAndIncrement()
 	{
-		int tmp = injectIdSeq;
-		injectIdSeq++;
-		return tmp;
+		// Called from the contact workers as well
+		return __sync_fetch_and_add(&injectIdSeq, 1);
 	}
 
 
@@ -222,6 +268,7 @@ private:
 	std::string bpaStart;
 	std::string xmlWithBpaStart;
 
+	RequesterSink * sink;
 	int socketR;
 	int defaultDestPort;
 	struct sockaddr_in defaultDestAddr;
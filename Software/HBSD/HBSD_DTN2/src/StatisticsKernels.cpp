@@ -0,0 +1,88 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#include "StatisticsKernels.h"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+using namespace std;
+
+// Bounds of the arguments whose exponential is a normal double
+#define EXP_KERNEL_MIN_ARG -708.0
+#define EXP_KERNEL_MAX_ARG 709.0
+
+// N / ln(2), and ln(2) / N split in a high part, exact in a product by k, and a low part
+static const double expInvLn2N = 92.33248261689366;
+static const double expLn2NHigh = 0.010830417275428772;
+static const double expLn2NLow = 7.420820373486988e-09;
+// Adding then removing it rounds a double to the nearest integer
+static const double expRoundShift = 6755399441055744.0;
+
+// 2^(j/N) for j in [0, N[
+static double expTable[EXP_KERNEL_TABLE_SIZE];
+
+static struct ExpTableInitializer
+{
+	ExpTableInitializer()
+	{
+		for(int j = 0; j < EXP_KERNEL_TABLE_SIZE; j++)
+		{
+			expTable[j] = ::exp2((double)j / EXP_KERNEL_TABLE_SIZE);
+		}
+	}
+}expTableInitializer;
+
+void StatisticsKernels::exp(const double * arguments, double * results, int length)
+{
+	int outOfRange = 0;
+	for(int i = 0; i < length; i++)
+	{
+		double x = arguments[i];
+		outOfRange |= !(x >= EXP_KERNEL_MIN_ARG && x <= EXP_KERNEL_MAX_ARG);
+		// Out of range arguments are clamped here and recomputed below
+		x = (x >= EXP_KERNEL_MIN_ARG) ? x : EXP_KERNEL_MIN_ARG;
+		x = (x <= EXP_KERNEL_MAX_ARG) ? x : EXP_KERNEL_MAX_ARG;
+		double kd = (x * expInvLn2N + expRoundShift) - expRoundShift;
+		int k = (int)kd;
+		double r = (x - kd * expLn2NHigh) - kd * expLn2NLow;
+		double p = 1 + r * (1 + r * (0.5 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120)))));
+		// Scales 2^(j/N) by 2^((k - j)/N) through its exponent bits
+		double scale = expTable[k & (EXP_KERNEL_TABLE_SIZE - 1)];
+		uint64_t bits;
+		memcpy(&bits, &scale, sizeof(bits));
+		bits += (uint64_t)(int64_t)(k >> EXP_KERNEL_TABLE_BITS) << 52;
+		memcpy(&scale, &bits, sizeof(bits));
+		results[i] = scale * p;
+	}
+
+	if(!outOfRange)
+		return;
+
+	// Underflows, overflows and NaNs
+	for(int i = 0; i < length; i++)
+	{
+		if(!(arguments[i] >= EXP_KERNEL_MIN_ARG && arguments[i] <= EXP_KERNEL_MAX_ARG))
+			results[i] = ::exp(arguments[i]);
+	}
+}
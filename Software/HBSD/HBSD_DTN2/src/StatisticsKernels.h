@@ -0,0 +1,54 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef STATISTICS_KERNELS_H
+#define STATISTICS_KERNELS_H
+
+// Number of entries of the 2^(j/N) table used by the exponential kernel
+#define EXP_KERNEL_TABLE_BITS 6
+#define EXP_KERNEL_TABLE_SIZE (1 << EXP_KERNEL_TABLE_BITS)
+
+/**
+ * Numerical kernels used when refreshing the statistics of a message over all
+ * the bins of the statistics axe.
+ */
+class StatisticsKernels
+{
+public:
+	/**
+	 * Computes the exponential of each argument. Table driven:
+	 * exp(x) = 2^(k/N) * exp(r) with |r| <= ln(2)/(2N). The loop body has no
+	 * branch nor library call so that the compiler can vectorise it, only the
+	 * arguments whose exponential is not a normal double go through libm.
+	 * Within 2 ulps of the libm exp().
+	 *
+	 * @param arguments Contiguous array of arguments.
+	 * @param results Contiguous array receiving the exponentials, must not
+	 *    overlap the arguments.
+	 * @param length Number of arguments.
+	 */
+	static void exp(const double * arguments, double * results, int length);
+};
+
+#endif
@@ -33,11 +33,185 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <iostream>
 #include <stdio.h>
 #include <cstring>
+#include <errno.h>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
 #include "HBSD.h"
 #include "ConfigFile.h"
+#include "StatisticsWorkers.h"
+#include "StatisticsKernels.h"
+#include "Metrics.h"
 
 using namespace std;
 
+// Partial sums of one shard of the statistics matrix at a given bin
+typedef struct StatAxePartial
+{
+	int totalNumberOfCopies;
+	int copiesMessages;
+	int totalNumberOfNodes;
+	int nodesMessages;
+	double totalDr;
+	double totalDd;
+	int validMessages;
+}StatAxePartial;
+
+// Refreshes the messages of each shard at a given bin and sums up their statistics
+class AxeRefreshTask : public StatisticsTask
+{
+public:
+	AxeRefreshTask(vector<DtnStatMessage *> & m, int b) : messages(m), binIndex(b)
+	{
+		StatAxePartial zero = {0, 0, 0, 0, 0, 0, 0};
+		partials.assign((messages.size() + STATISTICS_SHARD_SIZE - 1) / STATISTICS_SHARD_SIZE, zero);
+	}
+
+	void runShard(int shard)
+	{
+		StatAxePartial & p = partials[shard];
+		size_t end = min(messages.size(), (size_t)(shard + 1) * STATISTICS_SHARD_SIZE);
+		for(size_t i = (size_t)shard * STATISTICS_SHARD_SIZE; i < end; i++)
+		{
+			DtnStatMessage * dm = messages[i];
+			if(!dm->isValid(binIndex))
+				continue;
+			int nc = dm->getNumberOfCopiesAt(binIndex);
+			if(nc > 1)
+			{
+				p.totalNumberOfCopies += nc;
+				p.copiesMessages++;
+			}
+			int ns = dm->getNumberOfNodesThatHaveSeeniT(binIndex);
+			if(ns > 1)
+			{
+				p.totalNumberOfNodes += ns;
+				p.nodesMessages++;
+			}
+			p.totalDr += dm->getAvgDrAt(binIndex);
+			p.totalDd += dm->getAvgDdAt(binIndex);
+			p.validMessages++;
+		}
+	}
+
+	vector<DtnStatMessage *> & messages;
+	int binIndex;
+	vector<StatAxePartial> partials;
+};
+
+// Refreshes the messages of each shard and sums up their statistics at every bin
+class AxeSnapshotTask : public StatisticsTask
+{
+public:
+	AxeSnapshotTask(vector<DtnStatMessage *> & m, int l) : messages(m), axeLength(l)
+	{
+		StatAxePartial zero = {0, 0, 0, 0, 0, 0, 0};
+		partials.assign((messages.size() + STATISTICS_SHARD_SIZE - 1) / STATISTICS_SHARD_SIZE, vector<StatAxePartial>(axeLength + 1, zero));
+	}
+
+	void runShard(int shard)
+	{
+		vector<StatAxePartial> & p = partials[shard];
+		size_t end = min(messages.size(), (size_t)(shard + 1) * STATISTICS_SHARD_SIZE);
+		for(size_t i = (size_t)shard * STATISTICS_SHARD_SIZE; i < end; i++)
+		{
+			DtnStatMessage * dm = messages[i];
+			// isValid() only depends on the bin through the smallest version of the message
+			dm->isValid(0);
+			int smallerVersion = axeLength * 10;
+			if(dm->messageStatus == 0)
+				dm->getMaxVersion(smallerVersion);
+			for(int b = 0; b <= axeLength; b++)
+			{
+				if(smallerVersion < b)
+					break;
+				int nc = dm->getNumberOfCopiesAt(b);
+				if(nc > 1)
+				{
+					p[b].totalNumberOfCopies += nc;
+					p[b].copiesMessages++;
+				}
+				int ns = dm->getNumberOfNodesThatHaveSeeniT(b);
+				if(ns > 1)
+				{
+					p[b].totalNumberOfNodes += ns;
+					p[b].nodesMessages++;
+				}
+				p[b].totalDr += dm->getAvgDrAt(b);
+				p[b].totalDd += dm->getAvgDdAt(b);
+				p[b].validMessages++;
+			}
+		}
+	}
+
+	vector<DtnStatMessage *> & messages;
+	int axeLength;
+	vector<vector<StatAxePartial> > partials;
+};
+
+// Parses the messages of a received statistics string, one shard of messages at a time
+class StatIngestTask : public StatisticsTask
+{
+public:
+	StatIngestTask(StatisticsManager * s, char * r, vector<ParsedStatMessage> & p) : sm(s), recv(r), parsed(p)
+	{
+	}
+
+	void runShard(int shard)
+	{
+		size_t end = min(parsed.size(), (size_t)(shard + 1) * STATISTICS_SHARD_SIZE);
+		for(size_t i = (size_t)shard * STATISTICS_SHARD_SIZE; i < end; i++)
+		{
+			string recived_message;
+			sm->getMessageIFromStat(recv, i + 1, recived_message);
+			sm->getBundleId((char *)recived_message.c_str(), parsed[i].messageId);
+			if(parsed[i].messageId.length())
+				sm->parseStatMessage(recived_message, parsed[i]);
+		}
+	}
+
+	StatisticsManager * sm;
+	char * recv;
+	vector<ParsedStatMessage> & parsed;
+};
+
+// Snapshot records are kept 8 bytes aligned
+static size_t snapshotPadded(size_t length)
+{
+	return (length + 7) & ~((size_t)7);
+}
+
+static void snapshotAppend(string &buffer, const void * data, size_t length)
+{
+	buffer.append((const char *)data, length);
+	buffer.append(snapshotPadded(length) - length, '\0');
+}
+
+// Returns a pointer to the next length bytes of the snapshot or NULL if truncated
+static const char * snapshotRead(const char *& cursor, const char * end, size_t length)
+{
+	size_t padded = snapshotPadded(length);
+	if((size_t)(end - cursor) < padded)
+		return NULL;
+	const char * data = cursor;
+	cursor += padded;
+	return data;
+}
+
+// FNV-1a, used to detect corrupted snapshots
+static uint32_t snapshotChecksum(const char * data, size_t length)
+{
+	uint32_t h = 2166136261U;
+	for(size_t i = 0; i < length; i++)
+	{
+		h ^= (unsigned char)data[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
 /** DTN Node Entry constructor 
 */
 
@@ -670,28 +844,36 @@ try
 	{
 		drMap.clear();
 
-		double amt;
-		if(sm_->numberOfMeeting > 0)
-			amt = sm_->totalMeetingSamples/sm_->numberOfMeeting;
-		else amt = sm_->totalMeetingSamples;
-	
 		alpha = (sm_->getApproximatedNumberOfNodes() - 1) * sm_->getAverageNetworkMeetingTime() ;
-		//fprintf(stdout, "Number of nodes: %i alpha: %f number of meetings: %i total meeting samples: %f\n", sm_->get_numberOfStatNodes(), alpha, sm_->numberOfMeeting, sm_->totalMeetingSamples );
-
-		for(int i= 0;i < sm_->axeLength; i++)
+		int numberOfNodes = sm_->getApproximatedNumberOfNodes();
+		int length = sm_->axeLength;
+		if(length <= 0)
+			return;
+
+		// Gather the exponents of all the bins, then evaluate them in one pass
+		vector<double> remainingTimeBuffer;
+		const double * remainingTime = sm_->getRemainingTimeAxe(ttl, remainingTimeBuffer);
+		vector<double> factors(length);
+		vector<double> exponents(length);
+		vector<double> exponentials(length);
+		for(int i= 0;i < length; i++)
 		{
-			double lt = sm_->convertBinINdexToElapsedTime(i);
+			if(numberOfNodes > 1 && alpha > 0)
+			{	
+				factors[i] = 1 - (getNumberOfNodesThatHaveSeeniT(i) / (numberOfNodes-1) );
+				exponents[i] = -1*remainingTime[i]*getNumberOfCopiesAt(i)*(1/(alpha));
+			}
+			else 
 			{
-				if(sm_->getApproximatedNumberOfNodes() > 1 && alpha > 0)
-				{	
-					drMap[i] = (1 - (getNumberOfNodesThatHaveSeeniT(i) / (sm_->getApproximatedNumberOfNodes()-1) ) ) * exp(-1*(ttl - lt)*getNumberOfCopiesAt(i)*(1/(alpha)));
-				}
-				else 
-				{
-					drMap[i] += (1-getNumberOfNodesThatHaveSeeniT(i))*exp(-1*(ttl - lt)*getNumberOfCopiesAt(i));
-				}
+				factors[i] = 1-getNumberOfNodesThatHaveSeeniT(i);
+				exponents[i] = -1*remainingTime[i]*getNumberOfCopiesAt(i);
 			}
 		}
+		StatisticsKernels::exp(&exponents[0], &exponentials[0], length);
+		for(int i= 0;i < length; i++)
+		{
+			drMap[i] = factors[i] * exponentials[i];
+		}
 	}
 	
 
@@ -717,7 +899,9 @@ bool DtnStatMessage::isValid(int binIndex)
 	// Verify and generate the TTL version
 	if(getLifeTime() >= ttl)
 	{
-		DtnStatNode * n = mapNodes[HBSD::routerEndpoint];
+		// Looked up without inserting, a NULL node would break the maps updates
+		map<string, DtnStatNode *>::iterator iter = mapNodes.find(HBSD::routerEndpoint);
+		DtnStatNode * n = (iter != mapNodes.end()) ? iter->second : NULL;
 		
 		// Only the message owner can generates the last version
 		if(n != NULL )
@@ -754,17 +938,9 @@ bool DtnStatMessage::isValid(int binIndex)
 			mapNodes.erase(iter);
 			iter = mapNodes.begin();
 		}
-		
-		//map<string, DtnStatMessage *>::iterator  iterOldest;
-		//int nim = sm_->GetNumberOfValidMessages(iterOldest);
-	
-		//if(nim > 10000)
-		//{
-		//	toDelete = true;
-		//	sm_->someThingToClean = true;
-		//}
-	
+
 		messageStatus = 1;
+		sm_->messageCompleted(this);
 		return true;	
 	}
 	
@@ -802,6 +978,110 @@ int DtnStatMessage::getMaxVersion(int & smallerVersion)
 
 
 
+void DtnStatMessage::appendSnapshot(string &buffer)
+{
+	StatSnapshotMessageRecord record;
+	memset(&record, 0, sizeof(record));
+	record.ttl = ttl;
+	record.lifeTime = getLifeTime();
+	record.messageNumber = messageNumber;
+	record.messageStatus = messageStatus;
+	record.nodeCount = (messageStatus == 1) ? 0 : mapNodes.size();
+	record.idLength = bundleId.length();
+	snapshotAppend(buffer, &record, sizeof(record));
+	snapshotAppend(buffer, bundleId.data(), bundleId.length());
+
+	if(messageStatus == 1)
+	{
+		// The message history is complete, only its aggregated maps remain
+		for(int i = 0; i < sm_->axeLength; i++)
+		{
+			StatSnapshotBin bin;
+			bin.dd = ddMap[i];
+			bin.dr = drMap[i];
+			bin.mi = miMap[i];
+			bin.ni = niMap[i];
+			snapshotAppend(buffer, &bin, sizeof(bin));
+		}
+		return;
+	}
+
+	size_t bitsLength = (sm_->axeLength + 7) / 8;
+	string bits;
+	for(map<string, DtnStatNode *>::iterator iter = mapNodes.begin(); iter != mapNodes.end(); iter++)
+	{
+		DtnStatNode * n = iter->second;
+		StatSnapshotMessageNodeRecord nodeRecord;
+		memset(&nodeRecord, 0, sizeof(nodeRecord));
+		nodeRecord.lastMeetingTime = n->getMeetingTime();
+		nodeRecord.statVersion = n->statVersion;
+		nodeRecord.miStartIndex = n->miStartIndex;
+		nodeRecord.idLength = iter->first.length();
+		nodeRecord.miMapDone = n->miMapDone ? 1 : 0;
+		snapshotAppend(buffer, &nodeRecord, sizeof(nodeRecord));
+		snapshotAppend(buffer, iter->first.data(), iter->first.length());
+
+		// bitMap and miBitMap only hold 0/1 samples, pack them
+		bits.assign(2 * bitsLength, '\0');
+		for(int i = 0; i < sm_->axeLength; i++)
+		{
+			if(n->bitMap[i])
+				bits[i / 8] |= (char)(1 << (i % 8));
+			if(n->miBitMap[i])
+				bits[bitsLength + i / 8] |= (char)(1 << (i % 8));
+		}
+		snapshotAppend(buffer, bits.data(), bits.length());
+	}
+}
+
+bool DtnStatMessage::restoreSnapshot(const char *& cursor, const char * end, const StatSnapshotMessageRecord * record)
+{
+	messageNumber = record->messageNumber;
+	messageStatus = record->messageStatus;
+	setLifeTime(record->lifeTime);
+
+	if(messageStatus == 1)
+	{
+		for(int i = 0; i < sm_->axeLength; i++)
+		{
+			const StatSnapshotBin * bin = (const StatSnapshotBin *)snapshotRead(cursor, end, sizeof(StatSnapshotBin));
+			if(bin == NULL)
+				return false;
+			ddMap[i] = bin->dd;
+			drMap[i] = bin->dr;
+			miMap[i] = bin->mi;
+			niMap[i] = bin->ni;
+		}
+		return true;
+	}
+
+	size_t bitsLength = (sm_->axeLength + 7) / 8;
+	for(uint32_t j = 0; j < record->nodeCount; j++)
+	{
+		const StatSnapshotMessageNodeRecord * nodeRecord = (const StatSnapshotMessageNodeRecord *)snapshotRead(cursor, end, sizeof(StatSnapshotMessageNodeRecord));
+		if(nodeRecord == NULL)
+			return false;
+		const char * id = snapshotRead(cursor, end, nodeRecord->idLength);
+		const char * bits = snapshotRead(cursor, end, 2 * bitsLength);
+		if(id == NULL || bits == NULL)
+			return false;
+
+		string nodeId(id, nodeRecord->idLength);
+		DtnStatNode * n = new DtnStatNode((char*)nodeId.c_str(), nodeRecord->lastMeetingTime, sm_);
+		for(int i = 0; i < sm_->axeLength; i++)
+		{
+			n->bitMap[i] = (bits[i / 8] >> (i % 8)) & 1;
+			n->miBitMap[i] = (bits[bitsLength + i / 8] >> (i % 8)) & 1;
+		}
+		n->statVersion = nodeRecord->statVersion;
+		n->miStartIndex = nodeRecord->miStartIndex;
+		n->miMapDone = (nodeRecord->miMapDone != 0);
+		mapNodes[nodeId] = n;
+	}
+	return true;
+}
+
+
 void StatisticsAxe::initiateIntervall(double min,double max, StatisticsManager *s)
 {
 	maxLt=max;
@@ -871,12 +1151,73 @@ StatisticsManager::StatisticsManager()
 	{
 		statAxe[i].initiateIntervall(axeSubdivision*i, axeSubdivision*(i+1),this);
 	}
+	for(int i = 0; i < axeLength; i++)
+	{
+		elapsedTimeAxe.push_back(convertBinINdexToElapsedTime(i));
+	}
+	sem_init(&remainingTimeAxesLock, 0, 1);
+
+	// Warm start from the last statistics snapshot if any
+	this->enableStatSnapshot = HBSD::routerConf->getBoolean(string("enableStatSnapshot"), DEFAULT_ENABLE_STAT_SNAPSHOT);
+	this->statSnapshotFile = HBSD::routerConf->getstring(string("statSnapshotFile"), string(DEFAULT_STAT_SNAPSHOT_FILE));
+	this->statSnapshotInterval = HBSD::routerConf->getInt(string("statSnapshotInterval"), DEFAULT_STAT_SNAPSHOT_INTERVAL);
+	this->statSnapshotMaxAge = HBSD::routerConf->getInt(string("statSnapshotMaxAge"), DEFAULT_STAT_SNAPSHOT_MAX_AGE);
+	this->statSnapshotDecayTime = HBSD::routerConf->getInt(string("statSnapshotDecayTime"), DEFAULT_STAT_SNAPSHOT_DECAY_TIME);
+	lastSnapshotTime = Util::getCurrentTimeSeconds();
+
+	// Workers used to refresh the statistics of all the messages
+	deferCompletions = false;
+	sem_init(&deferredCompletionsLock, 0, 1);
+	workers = new StatisticsWorkers(HBSD::routerConf->getInt(string("statisticsWorkers"), DEFAULT_STATISTICS_WORKERS));
+
+	// Readers always find a snapshot, even an empty one
+	currentSnapshot = NULL;
+	snapshotReaders[0] = 0;
+	snapshotReaders[1] = 0;
+	snapshotReadersIndex = 0;
+	snapshotVersion = 0;
+	snapshotOutdated = true;
+
+	if(enableStatSnapshot)
+		loadSnapshot();
+	publishSnapshot();
+
+	// The periodic snapshots are written by their own thread
+	snapshotWriterStarted = false;
+	snapshotPending = false;
+	stopSnapshotWriter = false;
+	sem_init(&snapshotWriterLock, 0, 1);
+	sem_init(&snapshotWriterWakeup, 0, 0);
+	if(enableStatSnapshot)
+	{
+		if(pthread_create(&snapshotWriter, NULL, StatisticsManager::runSnapshotWriter, (void *)this) == 0)
+			snapshotWriterStarted = true;
+		else if(HBSD::log->enabled(Logging::ERROR))
+			HBSD::log->error(string("Unable to create the statistics snapshot writer, snapshots are only saved on exit"));
+	}
 }
 
 
 
 StatisticsManager::~StatisticsManager()
 {
+	if(snapshotWriterStarted)
+	{
+		sem_wait(&snapshotWriterLock);
+		stopSnapshotWriter = true;
+		sem_post(&snapshotWriterLock);
+		sem_post(&snapshotWriterWakeup);
+		pthread_join(snapshotWriter, NULL);
+	}
+	sem_destroy(&snapshotWriterWakeup);
+	sem_destroy(&snapshotWriterLock);
+	if(enableStatSnapshot)
+		saveSnapshot();
+	delete workers;
+	sem_destroy(&deferredCompletionsLock);
+	sem_destroy(&remainingTimeAxesLock);
+	if(currentSnapshot != NULL)
+		delete currentSnapshot;
 	delete [] statAxe;
 	
 }
@@ -887,52 +1228,44 @@ StatisticsManager::~StatisticsManager()
  */
 int StatisticsManager::addStatMessage(char * bundleId, char * nodeId, double lt, double ttl)
 {
-
-	// Verify if we should clear the messages matrix:
-	
-	if(getNumberOfInvalidMessages() < this->statMessagesNumber)
+	if(strlen(bundleId) == 0)
 	{
+		fprintf(stderr, "Invalid Bundle Id\n");
+		exit(1);
+	}
 
-		if(strlen(bundleId) == 0)
-		{
-			fprintf(stderr, "Invalid Bundle Id\n");
-			exit(1);
-		}
-
-		// double lt is used to identify the bin to update
-		int binIndex = convertElapsedTimeToBinIndex(lt);
+	// double lt is used to identify the bin to update
+	int binIndex = convertElapsedTimeToBinIndex(lt);
 
 
-		DtnStatMessage *bs = this->isBundleHere(bundleId);
+	DtnStatMessage *bs = this->isBundleHere(bundleId);
 
-		if(bs != NULL)
-		{
-			bs->ttl = ttl;
-			bs->updated = Util::getCurrentTimeSeconds();
-			bs->setLifeTime(lt);
-			statLastUpdate = Util::getCurrentTimeSeconds();
-			if(strlen(nodeId) > 0)
-				bs->addNode(string(nodeId), binIndex, 1, Util::getCurrentTimeSeconds(), binIndex);
-			return 1;
-		}
-		else
-		{
-			// we add the bundle to the existing node
-			numberOfStatMessages++;
-			statLastUpdate = Util::getCurrentTimeSeconds();
-			messagesMatrix[string(bundleId)] = new DtnStatMessage(bundleId,ttl, this);
-			messagesMatrix[string(bundleId)]->messageNumber = numberOfStatMessages;
-			messagesMatrix[string(bundleId)]->updated = Util::getCurrentTimeSeconds();
-			messagesMatrix[string(bundleId)]->setLifeTime(lt);
-			if(strlen(nodeId) > 0)
-				messagesMatrix[string(bundleId)]->addNode(string(nodeId), binIndex, 1, Util::getCurrentTimeSeconds(), binIndex);
-			return 1;
-		}
+	if(bs != NULL)
+	{
+		bs->ttl = ttl;
+		bs->updated = Util::getCurrentTimeSeconds();
+		bs->setLifeTime(lt);
+		statLastUpdate = Util::getCurrentTimeSeconds();
+		touchMessage(bs);
+		if(strlen(nodeId) > 0)
+			bs->addNode(string(nodeId), binIndex, 1, Util::getCurrentTimeSeconds(), binIndex);
+		snapshotOutdated = true;
+		return 1;
 	}
 	else
 	{
-		// Maximum capacity reached, the bundle will not be added
-		return 0;
+		// we add the bundle to the existing node, the MUM buffer evicts its least recently updated message if full
+		numberOfStatMessages++;
+		statLastUpdate = Util::getCurrentTimeSeconds();
+		bs = insertMessage(string(bundleId), new DtnStatMessage(bundleId,ttl, this));
+		bs->messageNumber = numberOfStatMessages;
+		bs->updated = Util::getCurrentTimeSeconds();
+		bs->setLifeTime(lt);
+		if(strlen(nodeId) > 0)
+			bs->addNode(string(nodeId), binIndex, 1, Util::getCurrentTimeSeconds(), binIndex);
+		snapshotOutdated = true;
+		checkpointIfDue();
+		return 1;
 	}
 }
 
@@ -1054,16 +1387,11 @@ void StatisticsManager::getNodeIdFromStat(char *node, string &id)
 	if(node!=NULL)
 	{
 		char *n = strchr(node,'=');
-		int nod_l = strlen(node);
-		int n_l = strlen(n);
 		if(n != NULL)
 		{
-			char n_id[nod_l-n_l];
-			strcpy(n_id,"");
-			strncat(n_id,node,nod_l-n_l);
-			strcat(n_id,"\0");
+			// The id is what precedes the '='
+			id.assign(node, n - node);
 			n=NULL;
-			id.assign(n_id);
 		}
 	}
 }
@@ -1288,34 +1616,35 @@ void StatisticsManager::updateNetworkStat(char * recv)
 	if(strlen(recv) != 0)
 	{
 		//fprintf(stdout, "Updating network stat: %s\n", recv);
+		uint64_t mergeStart = Metrics::now();
 		int nm = getNumberOfMessagesFromStat(recv);
-		int i = 1;
-		
-		// Extracting messages IDS
-		while(i <= nm)
-		{	
-			
-			string recived_message;
-			this->getMessageIFromStat(recv,i, recived_message);
 
-			string id;
-			this->getBundleId((char *)recived_message.c_str(), id);
-			//fprintf(stdout, "	message : %s message id: %s\n", recived_message.c_str(), id.c_str()); 
-			if(id.length())
+		// Parsing the received messages on the workers, the matrix is not modified meanwhile
+		vector<ParsedStatMessage> parsed(nm);
+		StatIngestTask task(this, recv, parsed);
+		workers->run(&task, (nm + STATISTICS_SHARD_SIZE - 1) / STATISTICS_SHARD_SIZE);
+
+		// Then applying them in order
+		for(int i = 0; i < nm; i++)
+		{
+			if(parsed[i].messageId.length())
 			{
 				// view if the node already exist 
 				DtnStatMessage * dm;
-				if((dm = this->isBundleHere((char*)id.c_str())) == NULL)
+				if((dm = this->isBundleHere((char*)parsed[i].messageId.c_str())) == NULL)
 				{	
-					this->addStatMessage((char*)recived_message.c_str(), (char*)id.c_str());
+					this->addParsedStatMessage(parsed[i]);
 				}
 				else 
 				{
-					this->updateMessage(recived_message, id, dm);
+					this->updateParsedStatMessage(parsed[i], dm);
 		 		}
 			}
-			i++;	
 		}
+		snapshotOutdated = true;
+		checkpointIfDue();
+		Metrics::increment(METRIC_STAT_MESSAGES_MERGED, nm);
+		Metrics::observeSince(METRIC_STAT_MERGE_TIME, mergeStart);
 	}
 }
 /** Return the number of nodes recived from Stat
@@ -1536,11 +1865,13 @@ void StatisticsManager::updateBundleStatus(char * node_id, char * bundleId, int
 	if((dm = isBundleHere(bundleId)) != NULL)
 	{	
 		dm->updated = Util::getCurrentTimeSeconds();
+		touchMessage(dm);
 		dm->addNode(string(node_id), binIndex, del, Util::getCurrentTimeSeconds(), binIndex);
 		dm->setLifeTime(lt);
 		dm->ttl=ttl;
 		statLastUpdate = Util::getCurrentTimeSeconds();
-
+		snapshotOutdated = true;
+		checkpointIfDue();
 	}
 }
 
@@ -1549,55 +1880,68 @@ void StatisticsManager::updateBundleStatus(char * node_id, char * bundleId, int
  
 void StatisticsManager::addStatMessage(char * message,char * messageId)
 {
-	string message_id(message);
+	ParsedStatMessage parsed;
+	string m(message);
+	parseStatMessage(m, parsed);
+	parsed.messageId.assign(messageId);
+	addParsedStatMessage(parsed);
+	snapshotOutdated = true;
+}
+
+void StatisticsManager::parseStatMessage(string & message, ParsedStatMessage & parsed)
+{
+	//Bunlde TTL
+	parsed.ttl = this->getBundleTtl((char*)message.c_str());
+
+	int nn = this->getNumberOfStatNodesForABundle((char*)message.c_str());
+	parsed.nodes.resize(nn);
+	for(int i = 0; i < nn; i++)
+	{
+		ParsedStatNode & n = parsed.nodes[i];
+		string node;
 
-	// first adding the message
+		//All the Bundle
+		this->getNodeFromStat((char*)message.c_str(), i+1, node);
 
-	double bundleTTL = getBundleTtl(message);
+		// His ID
+		this->getNodeIdFromStat((char *)node.c_str(), n.nodeId);
 
-	// Adding the message
-	
+		n.lastMeetingTime = this->getNodeLm((char *)node.c_str());
+		// Get the stat version
+		n.statVersion = this->getNodeStatVersion((char *)node.c_str());
+		// Get miStartIndex
+		n.miStartIndex = this->getMiIndexFromStat((char*)node.c_str());
+		this->getNodeBitMap(node, n.bitMap);
+	}
+}
 
-	DtnStatMessage *dm = this->isBundleHere(messageId);
+void StatisticsManager::addParsedStatMessage(ParsedStatMessage & parsed)
+{
+	// Adding the message
+	DtnStatMessage *dm = this->isBundleHere((char*)parsed.messageId.c_str());
 
 	if(dm != NULL)
 	{	
-		dm->ttl = bundleTTL;
+		dm->ttl = parsed.ttl;
 		dm->updated = Util::getCurrentTimeSeconds();
 		statLastUpdate = Util::getCurrentTimeSeconds();
+		touchMessage(dm);
 	}
 	else
 	{	
 		// we add the bundle to the existing node 
 		statLastUpdate = Util::getCurrentTimeSeconds();
 		numberOfStatMessages++;
-		messagesMatrix[string(messageId)] = new DtnStatMessage(messageId,bundleTTL, this);
-		messagesMatrix[string(messageId)]->messageNumber = numberOfStatMessages;
-		dm = messagesMatrix[string(messageId)];
+		dm = insertMessage(parsed.messageId, new DtnStatMessage((char*)parsed.messageId.c_str(), parsed.ttl, this));
+		dm->messageNumber = numberOfStatMessages;
 		dm->updated = Util::getCurrentTimeSeconds();
 	}
-	
 
-		
-	int nn = this->getNumberOfStatNodesForABundle(message);
-	//fprintf(stdout, "Number of nodes: %i Message id %s message %s\n\n", nn, messageId, message);
-	for(int i=0; i < nn ;i++)
+	for(size_t i = 0; i < parsed.nodes.size(); i++)
 	{
-		string tbid;
-		this->getNodeFromStat(message,i+1, tbid);
-		string bId;
-		this->getNodeIdFromStat((char*)tbid.c_str(), bId);
-		//fprintf(stdout, "	Number %i Node: %s Node Id %s Node Del %i\n",i+1, tbid.c_str(), bId.c_str(), this->get_bundle_del(((char*)tbid.c_str())));
-		this->addStatNode((char*)bId.c_str(), this->getNodeLm((char*)tbid.c_str()));
-
-		// Get the stat version
-		int statVersion = this->getNodeStatVersion((char*)tbid.c_str());
-		// Get miStartIndex
-		int miIndex = this->getMiIndexFromStat((char*)tbid.c_str());
-
-		map<int, int> tmpBitMap;
-		this->getNodeBitMap(tbid, tmpBitMap);
-		dm->addNode(bId, tmpBitMap, this->getNodeLm((char*)tbid.c_str()), statVersion, miIndex);
+		ParsedStatNode & n = parsed.nodes[i];
+		this->addStatNode((char*)n.nodeId.c_str(), n.lastMeetingTime);
+		dm->addNode(n.nodeId, n.bitMap, n.lastMeetingTime, n.statVersion, n.miStartIndex);
 	}
 }
 
@@ -1632,30 +1976,22 @@ catch(exception e)
 
 void StatisticsManager::updateMessage(string& message,string& message_id, DtnStatMessage* dm)
 {
-	int nn = this->getNumberOfStatNodesForABundle((char*)message.c_str());
-	//	fprintf(stdout, "Updating message: %s\n Number of Bundles %i\n",message.c_str(), nn); 
+	ParsedStatMessage parsed;
+	parseStatMessage(message, parsed);
+	parsed.messageId = message_id;
+	updateParsedStatMessage(parsed, dm);
+	snapshotOutdated = true;
+}
 
-	//Bunlde TTL
-	double ttl=this->getBundleTtl((char*)message.c_str());
-	dm->ttl = ttl;	
+void StatisticsManager::updateParsedStatMessage(ParsedStatMessage & parsed, DtnStatMessage * dm)
+{
+	dm->ttl = parsed.ttl;	
+	touchMessage(dm);
 
-	for(int i = 0; i < nn; i++)
+	for(size_t i = 0; i < parsed.nodes.size(); i++)
 	{
-		string node, nodeId;
-
-		//All the Bundle
-		this->getNodeFromStat((char*)message.c_str(), i+1, node);
-
-		// His ID
-		this->getNodeIdFromStat((char *)node.c_str(), nodeId);
-
-		int version = getNodeStatVersion((char *)node.c_str());
-		int miIndex = getMiIndexFromStat((char*)node.c_str());
- 
-		map<int, int> tmpBitMap;	
-		this->getNodeBitMap(node, tmpBitMap);
-
-		dm->addNode(nodeId, tmpBitMap, this->getNodeLm((char *)node.c_str()), version, miIndex);
+		ParsedStatNode & n = parsed.nodes[i];
+		dm->addNode(n.nodeId, n.bitMap, n.lastMeetingTime, n.statVersion, n.miStartIndex);
 	}
 }
 
@@ -1836,129 +2172,10 @@ void StatisticsManager::getStatFromAxe(double et,char *bid,double *ni,double *mi
 	*dd_m = 0;
 	*dr_m = 0;
 	if(numberOfStatMessages == 0) return;
-	/*
-	ResultsThreadParam *rtp1 = (ResultsThreadParam*)malloc(sizeof(ResultsThreadParam));
-	rtp1->workToDo = 1;
-	rtp1->sm_ = this;
-	rtp1->et = et;
-	pthread_t niThread;
-
-	ResultsThreadParam *rtp2 = (ResultsThreadParam*)malloc(sizeof(ResultsThreadParam));
-	rtp2->workToDo = 2;
-	rtp2->sm_ = this;
-	rtp2->et = et;
-	pthread_t miThread;
-
-	ResultsThreadParam *rtp3 = (ResultsThreadParam*)malloc(sizeof(ResultsThreadParam));
-	rtp3->workToDo = 3;
-	rtp3->sm_ = this;
-	rtp3->et = et;
-	pthread_t drThread;
-
-	ResultsThreadParam *rtp4 = (ResultsThreadParam*)malloc(sizeof(ResultsThreadParam));
-	rtp4->workToDo = 4;
-	rtp4->sm_ = this;
-	rtp4->et = et;
-	pthread_t ddThread;
-
-	if (pthread_create (&niThread,NULL, GetResultsThreadProcess, (void *)rtp1) < 0) 
-	{
-		fprintf(stderr,"pthread_create 1 error.");
-	}
-
-	if (pthread_create (&miThread,NULL, GetResultsThreadProcess, (void *)rtp2) < 0) 
-	{
-		fprintf(stderr,"pthread_create 2 error.");
-	}
-
-	if (pthread_create (&drThread,NULL, GetResultsThreadProcess, (void *)rtp3) < 0) 
-	{
-		fprintf(stderr,"pthread_create 3 error.");
-	}
-
-	if (pthread_create (&ddThread,NULL, GetResultsThreadProcess, (void *)rtp4) < 0) 
-	{
-		fprintf(stderr,"pthread_create 4 error.");
-	}
-
-	void *status;
-	int r = 0;
-	if(r = pthread_join(ddThread, &status))
-	{
-		fprintf(stderr, "Error joining dd thread: %i\n", r);
-		free(rtp4);
-		exit(1);
-	}else
-	{
-		*dd_m = rtp4->floatRes;
-		free(rtp4);	
-	}
-
-	r = 0;
-	if(r = pthread_join(drThread, &status))
-	{
-		fprintf(stderr, "Error joining dr thread: %i\n", r);
-		free(rtp3);
-		exit(1);
-	}else
-	{
-		*dr_m = rtp3->floatRes;	
-		free(rtp3);
-	}
 
- 	r = 0;
-	if(r = pthread_join(miThread, &status))
-	{
-		fprintf(stderr, "Error joining mi thread: %i\n", r);
-		free(rtp2);
-		exit(1);
-	}else
-	{
-		*mi = rtp2->intRes;
-		free(rtp2);	
-	}
- 	r = 0;
-	if(r = pthread_join(niThread, &status))
-	{
-		fprintf(stderr, "Error joining ni thread: %i\n", r);
-		free(rtp1);
-		exit(1);
-	}else
-	{
-		*ni = rtp1->intRes;
-		free(rtp1);	
-	}
-
-	
-	*/	
-	*ni = getAvgNumberOfCopies(et);
-	*mi = getAvgNumberOfStatNodesThatHaveSeenIt(et);
-	*dr_m = getAvgDrAt(et);
-	*dd_m = getAvgDdAt(et);
-	
+	refreshAverages(convertElapsedTimeToBinIndex(et), ni, mi, dd_m, dr_m);
 
 	//fprintf(stdout, "ni: %f mi: %f dr: %f dd: %f\n", *ni, *mi, *dr_m, *dd_m);	
-	
-	// clean stat messages to delete 
-	/*
-	map<string, DtnStatMessage *>::iterator iter = messagesMatrix.begin();
-	if(someThingToClean)
-	{
-		while(iter != messagesMatrix.end())
-		{
-			if((iter->second)->toDelete)
-			{
-				fprintf(stdout, "#################################     deleting a message \n");
-				delete iter->second;
-				messagesMatrix.erase(iter);
-				statLastUpdate = Util::getCurrentTimeSeconds();
-			
-			}
-			iter++;
-		}
-		someThingToClean = false;
-	}
-	*/
 }	
 
 
@@ -1966,10 +2183,7 @@ void StatisticsManager::getStatFromAxe(int binIndex, double *ni, double *mi, dou
 {
 	//ShowAllMessagesStatistics();
 	//ShowAvgStatistics();
-	*ni = getAvgNumberOfCopies(binIndex);
-	*mi = getAvgNumberOfStatNodesThatHaveSeenIt(binIndex);
-	*dr_m = getAvgDrAt(binIndex);
-	*dd_m = getAvgDdAt(binIndex);
+	refreshAverages(binIndex, ni, mi, dd_m, dr_m);
 	*et = convertBinINdexToElapsedTime(binIndex);
 }
 
@@ -2025,12 +2239,9 @@ double StatisticsManager::convertBinINdexToElapsedTime(int binIndex)
 {
 	if(binIndex == 0) return 0;
 	
-	for(int i = 0; i < axeLength; i++)
-	{	
-		if(i == binIndex) 
-		{
-			return statAxe[i].minLt + 1;
-		}
+	if(binIndex > 0 && binIndex < axeLength)
+	{
+		return statAxe[binIndex].minLt + 1;
 	}
 
 	fprintf(stdout, "invalid binIndex: %i Line: %i file %s\n",binIndex, __LINE__, __FILE__);
@@ -2038,36 +2249,53 @@ double StatisticsManager::convertBinINdexToElapsedTime(int binIndex)
 	
 }
 
+const double * StatisticsManager::getRemainingTimeAxe(double ttl, vector<double> & buffer)
+{
+	// Messages may be refreshed by several workers at once
+	const double * axe = NULL;
+	sem_wait(&remainingTimeAxesLock);
+	map<double, vector<double> >::iterator iter = remainingTimeAxes.find(ttl);
+	if(iter == remainingTimeAxes.end() && (int)remainingTimeAxes.size() < MAX_TTL_CLASSES)
+	{
+		iter = remainingTimeAxes.insert(make_pair(ttl, vector<double>())).first;
+		for(int i = 0; i < axeLength; i++)
+		{
+			iter->second.push_back(ttl - elapsedTimeAxe[i]);
+		}
+	}
+	if(iter != remainingTimeAxes.end() && axeLength > 0)
+		axe = &(iter->second[0]);
+	sem_post(&remainingTimeAxesLock);
+
+	if(axe == NULL)
+	{
+		buffer.clear();
+		for(int i = 0; i < axeLength; i++)
+		{
+			buffer.push_back(ttl - elapsedTimeAxe[i]);
+		}
+		axe = buffer.empty() ? NULL : &buffer[0];
+	}
+	return axe;
+}
+
 
 
 int StatisticsManager::getNumberOfInvalidMessages()
 {
-	int n = 0;
-	if(messagesMatrix.empty()) return 0;
-	for(map<string, DtnStatMessage *>::iterator iter = messagesMatrix.begin(); iter!= messagesMatrix.end();iter++)
-	{
-		if(!isMessageValid(string((iter->second)->getBstatId())))
-			n++;
-	}
-	return n;
+	// Messages still under monitoring
+	return mumMessages.size();
 }
 
 int StatisticsManager::getNumberOfValidMessages(map<string, DtnStatMessage *>::iterator & iterOldest)
 {
-	int n = 0;
-	int oldest = 9999;
+	// Messages with a complete history, the oldest one being the next to be evicted
 	if(messagesMatrix.empty()) return 0;
-	for(map<string, DtnStatMessage *>::iterator iter = messagesMatrix.begin(); iter!= messagesMatrix.end();iter++)
-	{
-		if((iter->second)->messageNumber < oldest)
-		{
-			iterOldest = iter;
-			oldest =  (iter->second)->messageNumber;
-		}
-		if((iter->second)->isValid(axeLength))
-			n++;
-	}
-	return n;
+	if(!mchMessages.empty())
+		iterOldest = mchMessages.front();
+	else
+		iterOldest = mumMessages.front();
+	return mchMessages.size();
 }
 
 bool StatisticsManager::isMessageValid(string msgId)
@@ -2087,8 +2315,11 @@ void StatisticsManager::clearMessages()
 		messagesMatrix.erase(iter);
 	}
 	messagesMatrix.clear();
+	mumMessages.clear();
+	mchMessages.clear();
 	numberOfStatMessages = 0;
 	statLastUpdate = Util::getCurrentTimeSeconds();
+	snapshotOutdated = true;
 }
 
 
@@ -2105,10 +2336,281 @@ double StatisticsManager::getNodeMeetingTime(string nodeId)
 
 void StatisticsManager::deleteMessage(map<string, DtnStatMessage *>::iterator & iterOldest)
 {
-	delete iterOldest->second; 
+	DtnStatMessage * dm = iterOldest->second;
+	if(dm->messageStatus == 1)
+		mchMessages.erase(dm->tierPosition);
+	else
+		mumMessages.erase(dm->tierPosition);
+	delete dm; 
 	messagesMatrix.erase(iterOldest);
 }
 
+DtnStatMessage * StatisticsManager::insertMessage(string id, DtnStatMessage * dm)
+{
+	map<string, DtnStatMessage *>::iterator iter = messagesMatrix.insert(make_pair(id, dm)).first;
+	if(dm->messageStatus == 1)
+	{
+		dm->tierPosition = mchMessages.insert(mchMessages.end(), iter);
+		enforceCapacity(mchMessages, statMessagesNumber);
+	}
+	else
+	{
+		dm->tierPosition = mumMessages.insert(mumMessages.end(), iter);
+		enforceCapacity(mumMessages, mumBuffercapacity);
+	}
+	return dm;
+}
+
+void StatisticsManager::touchMessage(DtnStatMessage * dm)
+{
+	if(dm->messageStatus == 0)
+		mumMessages.splice(mumMessages.end(), mumMessages, dm->tierPosition);
+}
+
+void StatisticsManager::refreshAverages(int binIndex, double *ni, double *mi, double *dd_m, double *dr_m)
+{
+	*ni = 1;
+	*mi = 1;
+	*dd_m = 0;
+	*dr_m = 0;
+	if(messagesMatrix.empty())
+		return;
+
+	uint64_t refreshStart = Metrics::now();
+	vector<DtnStatMessage *> messages;
+	messages.reserve(messagesMatrix.size());
+	for(map<string, DtnStatMessage *>::iterator iter = messagesMatrix.begin(); iter != messagesMatrix.end(); iter++)
+		messages.push_back(iter->second);
+
+	// Each message is only touched by the worker owning its shard, the buffers are updated afterwards
+	AxeRefreshTask task(messages, binIndex);
+	deferCompletions = true;
+	workers->run(&task, task.partials.size());
+	deferCompletions = false;
+	applyDeferredCompletions();
+
+	// Reduce the shards in order so that the result does not depend on the workers
+	StatAxePartial total = {0, 0, 0, 0, 0, 0, 0};
+	for(size_t i = 0; i < task.partials.size(); i++)
+	{
+		total.totalNumberOfCopies += task.partials[i].totalNumberOfCopies;
+		total.copiesMessages += task.partials[i].copiesMessages;
+		total.totalNumberOfNodes += task.partials[i].totalNumberOfNodes;
+		total.nodesMessages += task.partials[i].nodesMessages;
+		total.totalDr += task.partials[i].totalDr;
+		total.totalDd += task.partials[i].totalDd;
+		total.validMessages += task.partials[i].validMessages;
+	}
+
+	if(total.copiesMessages > 0)
+		*ni = (double)total.totalNumberOfCopies / (double)total.copiesMessages;
+	if(total.nodesMessages > 0)
+		*mi = (double)total.totalNumberOfNodes / (double)total.nodesMessages;
+	if(total.validMessages > 0)
+	{
+		*dr_m = total.totalDr / (double)total.validMessages;
+		*dd_m = total.totalDd / (double)total.validMessages;
+	}
+	Metrics::observeSince(METRIC_STAT_REFRESH_TIME, refreshStart);
+}
+
+// Atomic loads of the values shared between the publisher and the snapshot readers
+static int snapshotLoad(volatile int * value)
+{
+	return __sync_fetch_and_add(value, 0);
+}
+
+static StatisticsSnapshot * snapshotLoad(StatisticsSnapshot * volatile * value)
+{
+	return __sync_val_compare_and_swap(value, (StatisticsSnapshot *)NULL, (StatisticsSnapshot *)NULL);
+}
+
+void StatisticsManager::publishSnapshot()
+{
+	uint64_t publishStart = Metrics::now();
+	snapshotOutdated = false;
+	StatisticsSnapshot * snapshot = new StatisticsSnapshot(axeLength, axeSubdivision);
+	snapshot->version = ++snapshotVersion;
+	snapshot->numberOfMessages = numberOfStatMessages;
+	snapshot->averageNetworkMeetingTime = getAverageNetworkMeetingTime();
+	snapshot->approximatedNumberOfNodes = getApproximatedNumberOfNodes();
+
+	if(numberOfStatMessages > 0 && !messagesMatrix.empty())
+	{
+		vector<DtnStatMessage *> messages;
+		messages.reserve(messagesMatrix.size());
+		for(map<string, DtnStatMessage *>::iterator iter = messagesMatrix.begin(); iter != messagesMatrix.end(); iter++)
+			messages.push_back(iter->second);
+
+		AxeSnapshotTask task(messages, axeLength);
+		deferCompletions = true;
+		workers->run(&task, task.partials.size());
+		deferCompletions = false;
+		applyDeferredCompletions();
+
+		for(int b = 0; b <= axeLength; b++)
+		{
+			StatAxePartial total = {0, 0, 0, 0, 0, 0, 0};
+			for(size_t i = 0; i < task.partials.size(); i++)
+			{
+				total.totalNumberOfCopies += task.partials[i][b].totalNumberOfCopies;
+				total.copiesMessages += task.partials[i][b].copiesMessages;
+				total.totalNumberOfNodes += task.partials[i][b].totalNumberOfNodes;
+				total.nodesMessages += task.partials[i][b].nodesMessages;
+				total.totalDr += task.partials[i][b].totalDr;
+				total.totalDd += task.partials[i][b].totalDd;
+				total.validMessages += task.partials[i][b].validMessages;
+			}
+			if(total.copiesMessages > 0)
+				snapshot->ni[b] = (double)total.totalNumberOfCopies / (double)total.copiesMessages;
+			if(total.nodesMessages > 0)
+				snapshot->mi[b] = (double)total.totalNumberOfNodes / (double)total.nodesMessages;
+			if(total.validMessages > 0)
+			{
+				snapshot->dr[b] = total.totalDr / (double)total.validMessages;
+				snapshot->dd[b] = total.totalDd / (double)total.validMessages;
+			}
+		}
+	}
+
+	// Swap the snapshots, then release the previous one once its readers are gone
+	// Only this thread publishes, the full barrier of the swap orders the snapshot content before its pointer
+	StatisticsSnapshot * previous = snapshotLoad(&currentSnapshot);
+	__sync_bool_compare_and_swap(&currentSnapshot, previous, snapshot);
+	if(previous != NULL)
+	{
+		synchronizeSnapshotReaders();
+		delete previous;
+	}
+	Metrics::setGauge(METRIC_STAT_MATRIX_MESSAGES, snapshot->numberOfMessages);
+	Metrics::observeSince(METRIC_STAT_PUBLISH_TIME, publishStart);
+}
+
+void StatisticsManager::publishSnapshotIfOutdated()
+{
+	if(snapshotOutdated)
+		publishSnapshot();
+}
+
+void StatisticsManager::synchronizeSnapshotReaders()
+{
+	// A reader that read the index just before a flip may register on the old index
+	// after we saw it empty, flipping twice makes sure it did see the new snapshot.
+	for(int flip = 0; flip < 2; flip++)
+	{
+		int index = snapshotLoad(&snapshotReadersIndex);
+		__sync_bool_compare_and_swap(&snapshotReadersIndex, index, 1 - index);
+		while(snapshotLoad(&snapshotReaders[index]) != 0)
+			sched_yield();
+	}
+}
+
+int StatisticsManager::enterSnapshotRead(const StatisticsSnapshot *& snapshot)
+{
+	int index = snapshotLoad(&snapshotReadersIndex);
+	__sync_fetch_and_add(&snapshotReaders[index], 1);
+	// The published snapshot stays valid until leaveSnapshotRead
+	snapshot = snapshotLoad(&currentSnapshot);
+	return index;
+}
+
+void StatisticsManager::leaveSnapshotRead(int readersIndex)
+{
+	__sync_fetch_and_sub(&snapshotReaders[readersIndex], 1);
+}
+
+StatisticsSnapshot::StatisticsSnapshot(int axeLength, int axeSubdivision)
+{
+	version = 0;
+	this->axeLength = axeLength;
+	this->axeSubdivision = axeSubdivision;
+	numberOfMessages = 0;
+	averageNetworkMeetingTime = 0;
+	approximatedNumberOfNodes = 0;
+	ni.assign(axeLength + 1, 1);
+	mi.assign(axeLength + 1, 1);
+	dd.assign(axeLength + 1, 0);
+	dr.assign(axeLength + 1, 0);
+}
+
+void StatisticsSnapshot::getStatFromAxe(double et, double *ni, double *mi, double *dd_m, double *dr_m) const
+{
+	*ni = 0;
+	*mi = 0;
+	*dd_m = 0;
+	*dr_m = 0;
+	if(numberOfMessages == 0) return;
+
+	// Bin i covers the elapsed times in ]i * axeSubdivision, (i + 1) * axeSubdivision]
+	int binIndex = 0;
+	if(et > (double)axeSubdivision * axeLength)
+		binIndex = axeLength;
+	else if(et > 0)
+		binIndex = (int)ceil(et / axeSubdivision) - 1;
+
+	*ni = this->ni[binIndex];
+	*mi = this->mi[binIndex];
+	*dd_m = this->dd[binIndex];
+	*dr_m = this->dr[binIndex];
+}
+
+StatisticsSnapshotReader::StatisticsSnapshotReader(StatisticsManager * sm)
+{
+	sm_ = sm;
+	readersIndex = sm_->enterSnapshotRead(snapshot);
+}
+
+StatisticsSnapshotReader::~StatisticsSnapshotReader()
+{
+	sm_->leaveSnapshotRead(readersIndex);
+}
+
+static bool olderMessage(DtnStatMessage * a, DtnStatMessage * b)
+{
+	return a->messageNumber < b->messageNumber;
+}
+
+void StatisticsManager::applyDeferredCompletions()
+{
+	if(deferredCompletions.empty())
+		return;
+	sort(deferredCompletions.begin(), deferredCompletions.end(), olderMessage);
+	// Still in the MUM buffer, so none of them can be evicted by the MCH one meanwhile
+	for(size_t i = 0; i < deferredCompletions.size(); i++)
+		messageCompleted(deferredCompletions[i]);
+	deferredCompletions.clear();
+}
+
+void StatisticsManager::messageCompleted(DtnStatMessage * dm)
+{
+	if(deferCompletions)
+	{
+		sem_wait(&deferredCompletionsLock);
+		deferredCompletions.push_back(dm);
+		sem_post(&deferredCompletionsLock);
+		return;
+	}
+
+	// Called from isValid(), possibly while iterating over the matrix: the evicted
+	// messages are always older than the one that just completed.
+	mchMessages.splice(mchMessages.end(), mumMessages, dm->tierPosition);
+	enforceCapacity(mchMessages, statMessagesNumber);
+}
+
+void StatisticsManager::enforceCapacity(StatMessagesTier & tier, int capacity)
+{
+	// Keep at least the message we just added
+	if(capacity < 1)
+		capacity = 1;
+	while((int)tier.size() > capacity)
+	{
+		map<string, DtnStatMessage *>::iterator iterOldest = tier.front();
+		if(HBSD::log->enabled(Logging::DEBUG))
+			HBSD::log->debug(string("Evicting the statistics of message: ") + iterOldest->first);
+		deleteMessage(iterOldest);
+	}
+}
+
 
 double StatisticsManager::getAverageNetworkMeetingTime()
 {
@@ -2157,3 +2659,325 @@ string StatisticsManager::getListOfAvailableStatNodes()
 
 	return tmp;
 }
+
+
+void StatisticsManager::checkpointIfDue()
+{
+	if(!enableStatSnapshot || !snapshotWriterStarted)
+		return;
+	if(Util::getCurrentTimeSeconds() - lastSnapshotTime < statSnapshotInterval)
+		return;
+
+	string data;
+	serializeSnapshot(data);
+
+	sem_wait(&snapshotWriterLock);
+	pendingSnapshot.swap(data);
+	snapshotPending = true;
+	sem_post(&snapshotWriterLock);
+	sem_post(&snapshotWriterWakeup);
+}
+
+void * StatisticsManager::runSnapshotWriter(void * arg)
+{
+	StatisticsManager * sm = (StatisticsManager *)arg;
+	string data;
+	while(true)
+	{
+		sem_wait(&sm->snapshotWriterWakeup);
+		sem_wait(&sm->snapshotWriterLock);
+		bool stop = sm->stopSnapshotWriter;
+		bool pending = sm->snapshotPending;
+		if(pending)
+		{
+			data.swap(sm->pendingSnapshot);
+			sm->pendingSnapshot.clear();
+			sm->snapshotPending = false;
+		}
+		sem_post(&sm->snapshotWriterLock);
+
+		if(stop)
+			break;
+		if(pending)
+			sm->writeSnapshot(data);
+	}
+	return NULL;
+}
+
+bool StatisticsManager::saveSnapshot()
+{
+	string data;
+	serializeSnapshot(data);
+	return writeSnapshot(data);
+}
+
+void StatisticsManager::serializeSnapshot(string & data)
+{
+	lastSnapshotTime = Util::getCurrentTimeSeconds();
+
+	StatSnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, STAT_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = STAT_SNAPSHOT_VERSION;
+	header.headerSize = sizeof(header);
+	header.axeLength = axeLength;
+	header.axeSubdivision = axeSubdivision;
+	header.numberOfMeeting = numberOfMeeting;
+	header.totalMeetingSamples = totalMeetingSamples;
+	header.savedAt = lastSnapshotTime;
+	header.numberOfStatMessages = numberOfStatMessages;
+	header.nodeCount = nodesMatrix.size();
+	header.messageCount = messagesMatrix.size();
+
+	string payload;
+	for(map<string, double>::iterator iter = nodesMatrix.begin(); iter != nodesMatrix.end(); iter++)
+	{
+		StatSnapshotNodeRecord record;
+		memset(&record, 0, sizeof(record));
+		record.lastMeetingTime = iter->second;
+		record.idLength = iter->first.length();
+		snapshotAppend(payload, &record, sizeof(record));
+		snapshotAppend(payload, iter->first.data(), iter->first.length());
+	}
+	for(map<string, DtnStatMessage *>::iterator iter = messagesMatrix.begin(); iter != messagesMatrix.end(); iter++)
+	{
+		(iter->second)->appendSnapshot(payload);
+	}
+	header.payloadSize = payload.length();
+	header.checksum = snapshotChecksum(payload.data(), payload.length());
+
+	data.assign((const char *)&header, sizeof(header));
+	data.append(payload);
+}
+
+bool StatisticsManager::writeSnapshot(const string & data)
+{
+	StatSnapshotHeader header;
+	memcpy(&header, data.data(), sizeof(header));
+
+	string tmpFile = statSnapshotFile + string(".tmp");
+	int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		if(HBSD::log->enabled(Logging::ERROR))
+			HBSD::log->error(string("Unable to create the statistics snapshot: ") + tmpFile + string(" ") + string(strerror(errno)));
+		return false;
+	}
+
+	size_t written = 0;
+	while(written < data.length())
+	{
+		ssize_t r = write(fd, data.data() + written, data.length() - written);
+		if(r < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(HBSD::log->enabled(Logging::ERROR))
+				HBSD::log->error(string("Unable to write the statistics snapshot: ") + string(strerror(errno)));
+			close(fd);
+			unlink(tmpFile.c_str());
+			return false;
+		}
+		written += r;
+	}
+
+	// The snapshot must be on disk before it replaces the previous one
+	if(fsync(fd) != 0 || close(fd) != 0)
+	{
+		if(HBSD::log->enabled(Logging::ERROR))
+			HBSD::log->error(string("Unable to sync the statistics snapshot: ") + string(strerror(errno)));
+		unlink(tmpFile.c_str());
+		return false;
+	}
+
+	if(rename(tmpFile.c_str(), statSnapshotFile.c_str()) != 0)
+	{
+		if(HBSD::log->enabled(Logging::ERROR))
+			HBSD::log->error(string("Unable to rename the statistics snapshot: ") + string(strerror(errno)));
+		unlink(tmpFile.c_str());
+		return false;
+	}
+
+	// Sync the directory so that the rename itself survives a crash
+	size_t slash = statSnapshotFile.rfind('/');
+	string dir = (slash == string::npos) ? string(".") : (slash == 0 ? string("/") : statSnapshotFile.substr(0, slash));
+	int dirFd = open(dir.c_str(), O_RDONLY);
+	if(dirFd >= 0)
+	{
+		fsync(dirFd);
+		close(dirFd);
+	}
+
+	if(HBSD::log->enabled(Logging::INFO))
+		HBSD::log->info(string("Statistics snapshot saved, messages: ") + Util::to_string(header.messageCount) + string(" nodes: ") + Util::to_string(header.nodeCount));
+	return true;
+}
+
+bool StatisticsManager::loadSnapshot()
+{
+	int fd = open(statSnapshotFile.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		if(HBSD::log->enabled(Logging::INFO))
+			HBSD::log->info(string("No statistics snapshot to load: ") + statSnapshotFile);
+		return false;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(StatSnapshotHeader))
+	{
+		close(fd);
+		if(HBSD::log->enabled(Logging::WARN))
+			HBSD::log->warn(string("Ignoring truncated statistics snapshot: ") + statSnapshotFile);
+		return false;
+	}
+
+	void * mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapped == MAP_FAILED)
+	{
+		if(HBSD::log->enabled(Logging::ERROR))
+			HBSD::log->error(string("Unable to map the statistics snapshot: ") + string(strerror(errno)));
+		return false;
+	}
+
+	const char * base = (const char *)mapped;
+	StatSnapshotHeader header;
+	memcpy(&header, base, sizeof(header));
+	const char * cursor = base + sizeof(StatSnapshotHeader);
+	const char * end = base + st.st_size;
+	string reason;
+
+	if(memcmp(header.magic, STAT_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != STAT_SNAPSHOT_VERSION || header.headerSize != sizeof(StatSnapshotHeader))
+		reason = string("unknown format");
+	else if(header.payloadSize != (uint64_t)(end - cursor) || header.checksum != snapshotChecksum(cursor, end - cursor))
+		reason = string("corrupted payload");
+	else if(header.axeLength != axeLength || header.axeSubdivision != axeSubdivision)
+		reason = string("different statistics axe");
+
+	double now = Util::getCurrentTimeSeconds();
+	double age = now - header.savedAt;
+	if(reason.empty() && (age < 0 || age > statSnapshotMaxAge))
+		reason = string("too old, age: ") + Util::to_string(age);
+
+	if(!reason.empty())
+	{
+		if(HBSD::log->enabled(Logging::WARN))
+			HBSD::log->warn(string("Ignoring statistics snapshot ") + statSnapshotFile + string(": ") + reason);
+		munmap(mapped, st.st_size);
+		return false;
+	}
+
+	// The restored history loses weight with the time spent down
+	double weight = (statSnapshotDecayTime > 0) ? exp(-age / statSnapshotDecayTime) : 1;
+	numberOfMeeting = (int)(header.numberOfMeeting * weight + 0.5);
+	totalMeetingSamples = (numberOfMeeting > 0 && header.numberOfMeeting > 0) ? header.totalMeetingSamples * numberOfMeeting / header.numberOfMeeting : 0;
+
+	bool truncated = false;
+	for(uint32_t i = 0; i < header.nodeCount && !truncated; i++)
+	{
+		const StatSnapshotNodeRecord * record = (const StatSnapshotNodeRecord *)snapshotRead(cursor, end, sizeof(StatSnapshotNodeRecord));
+		const char * id = (record != NULL) ? snapshotRead(cursor, end, record->idLength) : NULL;
+		if(id == NULL)
+		{
+			truncated = true;
+			break;
+		}
+		// Forget the nodes we did not meet for too long
+		if(now - record->lastMeetingTime <= statSnapshotMaxAge)
+			nodesMatrix[string(id, record->idLength)] = record->lastMeetingTime;
+	}
+
+	// Only the most recent completed messages are kept, proportionally to the weight
+	const char * messagesStart = cursor;
+	vector<int> completed;
+	for(uint32_t i = 0; i < header.messageCount && !truncated; i++)
+	{
+		const StatSnapshotMessageRecord * record = (const StatSnapshotMessageRecord *)snapshotRead(cursor, end, sizeof(StatSnapshotMessageRecord));
+		if(record == NULL || snapshotRead(cursor, end, record->idLength) == NULL)
+		{
+			truncated = true;
+			break;
+		}
+		if(record->messageStatus == 1)
+		{
+			completed.push_back(record->messageNumber);
+			truncated = (snapshotRead(cursor, end, axeLength * sizeof(StatSnapshotBin)) == NULL);
+		}
+		else
+		{
+			for(uint32_t j = 0; j < record->nodeCount && !truncated; j++)
+			{
+				const StatSnapshotMessageNodeRecord * nodeRecord = (const StatSnapshotMessageNodeRecord *)snapshotRead(cursor, end, sizeof(StatSnapshotMessageNodeRecord));
+				truncated = (nodeRecord == NULL || snapshotRead(cursor, end, nodeRecord->idLength) == NULL || snapshotRead(cursor, end, 2 * ((axeLength + 7) / 8)) == NULL);
+			}
+		}
+	}
+	int minCompletedNumber = 0;
+	size_t keep = (size_t)ceil(completed.size() * weight);
+	if(!completed.empty() && keep < completed.size())
+	{
+		sort(completed.begin(), completed.end());
+		minCompletedNumber = (keep > 0) ? completed[completed.size() - keep] : completed.back() + 1;
+	}
+
+	cursor = messagesStart;
+	vector<pair<int, DtnStatMessage *> > restoredMessages;
+	for(uint32_t i = 0; i < header.messageCount && !truncated; i++)
+	{
+		const StatSnapshotMessageRecord * record = (const StatSnapshotMessageRecord *)snapshotRead(cursor, end, sizeof(StatSnapshotMessageRecord));
+		string id(snapshotRead(cursor, end, record->idLength), record->idLength);
+		DtnStatMessage * dm = new DtnStatMessage((char*)id.c_str(), record->ttl, this);
+		if(!dm->restoreSnapshot(cursor, end, record))
+		{
+			delete dm;
+			truncated = true;
+			break;
+		}
+
+		// Messages under monitoring keep aging while we are down, drop the ones that expired meanwhile
+		bool stale = (record->messageStatus == 1) ? (record->messageNumber < minCompletedNumber) : (record->lifeTime + age >= record->ttl);
+		if(stale || messagesMatrix.find(id) != messagesMatrix.end())
+		{
+			delete dm;
+			continue;
+		}
+		if(record->messageStatus != 1)
+			dm->setLifeTime(record->lifeTime + age);
+		dm->updated = now;
+		restoredMessages.push_back(make_pair(record->messageNumber, dm));
+	}
+
+	munmap(mapped, st.st_size);
+
+	// Rebuild the MUM and MCH buffers in age order, their capacity may have changed since
+	sort(restoredMessages.begin(), restoredMessages.end());
+	for(size_t i = 0; i < restoredMessages.size(); i++)
+	{
+		if(truncated)
+			delete restoredMessages[i].second;
+		else
+			insertMessage(string(restoredMessages[i].second->getBstatId()), restoredMessages[i].second);
+	}
+	int restored = messagesMatrix.size();
+
+	if(truncated)
+	{
+		if(HBSD::log->enabled(Logging::WARN))
+			HBSD::log->warn(string("Statistics snapshot truncated, dropping it: ") + statSnapshotFile);
+		clearMessages();
+		nodesMatrix.clear();
+		numberOfStatNodes = 0;
+		numberOfMeeting = 0;
+		totalMeetingSamples = 0;
+		return false;
+	}
+
+	numberOfStatNodes = nodesMatrix.size();
+	numberOfStatMessages = max(header.numberOfStatMessages, (int32_t)messagesMatrix.size());
+	statLastUpdate = now;
+
+	if(HBSD::log->enabled(Logging::INFO))
+		HBSD::log->info(string("Statistics snapshot loaded, age: ") + Util::to_string(age) + string(" weight: ") + Util::to_string(weight) + string(" messages: ") + Util::to_string(restored) + string(" nodes: ") + Util::to_string(numberOfStatNodes));
+	return true;
+}
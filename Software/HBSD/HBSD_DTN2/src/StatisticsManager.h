@@ -28,6 +28,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <string>
 #include <map>
 #include <list>
+#include <vector>
+#include <stdint.h>
+#include <semaphore.h>
+#include <pthread.h>
 #include "Util.h"
 
 // Default values used if there is no values already specified in the config file
@@ -38,6 +42,84 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define DEFAULT_NUMBER_OF_NODES_WITHIN_THE_NETWORK 20
 #define USE_AXE_SUBDIVISION_AS_AVG_MEETING_TIME true
 #define USE_ONLINE_APPROXIMATED_NUMBER_OF_NODES true
+#define DEFAULT_ENABLE_STAT_SNAPSHOT false
+#define DEFAULT_STAT_SNAPSHOT_FILE "/tmp/hbsd_statistics.snapshot"
+#define DEFAULT_STAT_SNAPSHOT_INTERVAL 300
+#define DEFAULT_STAT_SNAPSHOT_MAX_AGE 86400
+#define DEFAULT_STAT_SNAPSHOT_DECAY_TIME 3600
+
+// Number of TTL values whose remaining time axe is kept by the statistics manager
+#define MAX_TTL_CLASSES 64
+
+// Statistics snapshot file identification
+#define STAT_SNAPSHOT_MAGIC "HBSDSTS"
+#define STAT_SNAPSHOT_VERSION 1
+
+/**
+ * On disk layout of a statistics snapshot. The file is written in host byte
+ * order and every record starts on an 8 bytes boundary so that the loader can
+ * walk it directly from a read only mapping:
+ *
+ *   StatSnapshotHeader
+ *   nodeCount    x (StatSnapshotNodeRecord, node id)
+ *   messageCount x (StatSnapshotMessageRecord, message id,
+ *                   axeLength x StatSnapshotBin        if messageStatus == 1
+ *                   nodeCount x (StatSnapshotMessageNodeRecord, node id,
+ *                                bitMap bits, miBitMap bits)   otherwise)
+ *
+ * Strings are stored without their terminating NUL and padded to 8 bytes.
+ */
+typedef struct StatSnapshotHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint64_t payloadSize;
+	uint32_t checksum;
+	int32_t axeLength;
+	int32_t axeSubdivision;
+	int32_t numberOfMeeting;
+	double totalMeetingSamples;
+	double savedAt;
+	int32_t numberOfStatMessages;
+	uint32_t nodeCount;
+	uint32_t messageCount;
+	uint32_t reserved;
+}StatSnapshotHeader;
+
+typedef struct StatSnapshotNodeRecord
+{
+	double lastMeetingTime;
+	uint32_t idLength;
+	uint32_t reserved;
+}StatSnapshotNodeRecord;
+
+typedef struct StatSnapshotMessageRecord
+{
+	double ttl;
+	double lifeTime;
+	int32_t messageNumber;
+	int32_t messageStatus;
+	uint32_t nodeCount;
+	uint32_t idLength;
+}StatSnapshotMessageRecord;
+
+typedef struct StatSnapshotBin
+{
+	double dd;
+	double dr;
+	int32_t mi;
+	int32_t ni;
+}StatSnapshotBin;
+
+typedef struct StatSnapshotMessageNodeRecord
+{
+	double lastMeetingTime;
+	int32_t statVersion;
+	int32_t miStartIndex;
+	uint32_t idLength;
+	uint32_t miMapDone;
+}StatSnapshotMessageNodeRecord;
 
 typedef struct NodeVersion{
 	std::string nodeId;
@@ -47,6 +129,29 @@ typedef struct NodeVersion{
 typedef std::list<NodeVersion> NodeVersionList;
 
 class StatisticsManager;
+class DtnStatMessage;
+class StatisticsWorkers;
+
+// A node entry of a received statistics message, once parsed
+typedef struct ParsedStatNode
+{
+	std::string nodeId;
+	double lastMeetingTime;
+	int statVersion;
+	int miStartIndex;
+	std::map<int, int> bitMap;
+}ParsedStatNode;
+
+// A received statistics message, once parsed
+typedef struct ParsedStatMessage
+{
+	std::string messageId;
+	double ttl;
+	std::vector<ParsedStatNode> nodes;
+}ParsedStatMessage;
+
+// A storage tier of the statistics matrix (MUM or MCH), kept in eviction order
+typedef std::list<std::map<std::string, DtnStatMessage *>::iterator> StatMessagesTier;
 
 class StatisticsAxe{
 public :
@@ -189,6 +294,11 @@ public:
 	void immediateUpdateDdMap();
 	void immediateUpdateDrMap();
 
+	// Appends the message snapshot record to the given buffer
+	void appendSnapshot(std::string &buffer);
+	// Restores the message maps and nodes from a snapshot record, returns false if the record is truncated
+	bool restoreSnapshot(const char *& cursor, const char * end, const StatSnapshotMessageRecord * record);
+
 	// Returns the number of nodes that have seen the current message at a given bin
 	int getNumberOfNodesThatHaveSeeniT(int binIndex);
 	// Returns the number of copies of the current message at a given bin
@@ -241,6 +351,8 @@ public:
 	int messageNumber;
 	// Indicates whether the current statistics node should be deleted or not
 	bool toDelete;
+	// The message position within its storage tier (MUM while under monitoring, MCH once complete)
+	StatMessagesTier::iterator tierPosition;
 private :
 	// A pointer to the statistics manager
 	StatisticsManager * sm_;
@@ -257,6 +369,58 @@ private :
 };
 
 
+/**
+ * Immutable per-bin aggregates of the statistics matrix. A new snapshot is
+ * published by the StatisticsManager after each update so that threads other
+ * than the updating one can read consistent statistics without locking.
+ */
+class StatisticsSnapshot
+{
+public:
+	StatisticsSnapshot(int axeLength, int axeSubdivision);
+
+	/**
+	 * Returns the averages at the bin matching the given elapsed time, same
+	 * results as StatisticsManager::getStatFromAxe() at publication time.
+	 */
+	void getStatFromAxe(double et, double *ni, double *mi, double *dd_m, double *dr_m) const;
+
+	// Publication number, increases with each update
+	unsigned long version;
+	int axeLength;
+	int axeSubdivision;
+	int numberOfMessages;
+	double averageNetworkMeetingTime;
+	int approximatedNumberOfNodes;
+	// Per bin averages, the last entry stands for the elapsed times beyond the axe
+	std::vector<double> ni;
+	std::vector<double> mi;
+	std::vector<double> dd;
+	std::vector<double> dr;
+};
+
+/**
+ * Gives access to the current statistics snapshot for the lifetime of the
+ * object. Entering and leaving are wait-free, the snapshot is not released
+ * while a reader may still be using it.
+ */
+class StatisticsSnapshotReader
+{
+public:
+	StatisticsSnapshotReader(StatisticsManager * sm);
+	~StatisticsSnapshotReader();
+
+	const StatisticsSnapshot * operator->() const
+	{
+		return snapshot;
+	}
+
+private:
+	StatisticsManager * sm_;
+	int readersIndex;
+	const StatisticsSnapshot * snapshot;
+};
+
 // The statistics manager
 class StatisticsManager{
 
@@ -322,10 +486,18 @@ public :
 	// Called from the outside to update the collected statistics	
 	void updateNetworkStat(char * recived_stat);
 	void updateMessage( std::string&,std::string&, DtnStatMessage*);
+	// Parses a received message description, does not modify the matrix so it can run on the workers
+	void parseStatMessage(std::string & message, ParsedStatMessage & parsed);
+	// Adds or updates a message starting from its parsed description
+	void addParsedStatMessage(ParsedStatMessage & parsed);
+	void updateParsedStatMessage(ParsedStatMessage & parsed, DtnStatMessage * dm);
 
 	// Convert an elapsed time to a bin index
 	int convertElapsedTimeToBinIndex(double et);
 	double convertBinINdexToElapsedTime(int binIndex);
+	// Returns the (ttl - elapsed time) of each bin, shared by the messages with the same TTL.
+	// Filled within the buffer once MAX_TTL_CLASSES TTL values are kept.
+	const double * getRemainingTimeAxe(double ttl, std::vector<double> & buffer);
 	// Returns a bloom filter of all messages	
 	void getMessagesBloomFilter(std::string & bf);
 	int getNumberOfMessages(){return messagesMatrix.size();}
@@ -334,6 +506,25 @@ public :
 	int getNumberOfInvalidMessages();
 	int getNumberOfValidMessages(std::map<std::string, DtnStatMessage *>::iterator & iterOldest);
 	void deleteMessage(std::map<std::string, DtnStatMessage *>::iterator & iterOldest);
+	// Moves a message whose history is complete from the MUM to the MCH buffer
+	void messageCompleted(DtnStatMessage * dm);
+	// Computes the four averages at binIndex in a single pass sharded over the workers
+	void refreshAverages(int binIndex, double *ni, double *mi, double *dd_m, double *dr_m);
+
+	/**
+	 * Computes the averages of every bin and publishes them as the new
+	 * snapshot. Updates only mark the snapshot as outdated, the router
+	 * publishes it once the events of a dtnd message have been handled.
+	 * Only called by the thread updating the statistics; waits
+	 * until the previous snapshot has no more readers before releasing it.
+	 */
+	void publishSnapshot();
+	// Publishes a new snapshot if the statistics were updated since the last one
+	void publishSnapshotIfOutdated();
+
+	// Used by StatisticsSnapshotReader
+	int enterSnapshotRead(const StatisticsSnapshot *& snapshot);
+	void leaveSnapshotRead(int readersIndex);
 	bool isMessageValid(std::string msgId);
 	void clearMessages();
 	void logAvgStatistics();
@@ -341,6 +532,35 @@ public :
 	double getAverageNetworkMeetingTime();
     int getApproximatedNumberOfNodes();
 
+	/**
+	 * Writes the statistics matrix to the snapshot file from the calling
+	 * thread. Used on shutdown, once the snapshot writer has stopped.
+	 *
+	 * @return True if the snapshot was written, else false.
+	 */
+	bool saveSnapshot();
+
+	/**
+	 * Loads the statistics matrix from the snapshot file, decaying the
+	 * restored history with respect to the snapshot age.
+	 *
+	 * @return True if a snapshot was restored, else false.
+	 */
+	bool loadSnapshot();
+
+	/**
+	 * Hands a copy of the statistics matrix to the snapshot writer if
+	 * snapshots are enabled and statSnapshotInterval seconds went by since
+	 * the last one. The router thread only serializes the matrix, the
+	 * writer thread does the file I/O.
+	 */
+	void checkpointIfDue();
+
+	/**
+	 * Main loop of the snapshot writer thread.
+	 */
+	static void * runSnapshotWriter(void * arg);
+
     StatisticsAxe *statAxe;
 
 
@@ -356,10 +576,68 @@ public :
 	bool useBinSizeForAvgMeeting;
 	bool useOnlineAproximatedNumberOfNodes;
 	unsigned int clearFlag;
+	bool enableStatSnapshot;
+	std::string statSnapshotFile;
+	int statSnapshotInterval;
+	int statSnapshotMaxAge;
+	int statSnapshotDecayTime;
+	double lastSnapshotTime;
 
 private :
+	// Applies the completions deferred while the workers were running
+	void applyDeferredCompletions();
+
+	// Waits until no reader can still see a snapshot published before the current one
+	void synchronizeSnapshotReaders();
+
+	// Serializes the statistics matrix, header included, into the given buffer
+	void serializeSnapshot(std::string & data);
+	/**
+	 * Writes a serialized snapshot to the snapshot file. The snapshot is
+	 * first written to a temporary file, synced and then renamed over the
+	 * previous one so that a crash never leaves a partial snapshot behind.
+	 */
+	bool writeSnapshot(const std::string & data);
+
+	// Snapshot writer thread, the router thread hands it the serialized
+	// matrix in pendingSnapshot. A newer snapshot replaces one not written yet.
+	pthread_t snapshotWriter;
+	bool snapshotWriterStarted;
+	sem_t snapshotWriterLock;
+	sem_t snapshotWriterWakeup;
+	std::string pendingSnapshot;
+	bool snapshotPending;
+	bool stopSnapshotWriter;
+
+	StatisticsWorkers * workers;
+	// Elapsed time of each bin, and the derived (ttl - elapsed time) axes per TTL
+	std::vector<double> elapsedTimeAxe;
+	std::map<double, std::vector<double> > remainingTimeAxes;
+	sem_t remainingTimeAxesLock;
+	// The published snapshot and the two reader counters, readers register on the current index
+	StatisticsSnapshot * volatile currentSnapshot;
+	volatile int snapshotReaders[2];
+	volatile int snapshotReadersIndex;
+	unsigned long snapshotVersion;
+	bool snapshotOutdated;
+	// Set while the workers run, isValid() completions are then queued
+	bool deferCompletions;
+	std::vector<DtnStatMessage *> deferredCompletions;
+	sem_t deferredCompletionsLock;
+
 	
+	// Adds a new message to the matrix and to the buffer matching its status, evicting if needed
+	DtnStatMessage * insertMessage(std::string id, DtnStatMessage * dm);
+	// Marks a message under monitoring as the most recently used one
+	void touchMessage(DtnStatMessage * dm);
+	// Evicts the oldest messages of a buffer until it fits the given capacity
+	void enforceCapacity(StatMessagesTier & tier, int capacity);
+
 	std::map<std::string, DtnStatMessage *> messagesMatrix;
+	// Messages under monitoring, least recently updated first
+	StatMessagesTier mumMessages;
+	// Messages with complete history, oldest completed first
+	StatMessagesTier mchMessages;
 	std::map<std::string, double > nodesMatrix;
 	int numberOfStatNodes;
 	int numberOfStatMessages;
@@ -0,0 +1,133 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#include "StatisticsWorkers.h"
+#include "HBSD.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+using namespace std;
+
+StatisticsWorkers::StatisticsWorkers(int numberOfWorkers)
+{
+	stop = false;
+	currentTask = NULL;
+	numberOfShards = 0;
+	nextShard = 0;
+	sem_init(&taskAvailable, 0, 0);
+	sem_init(&taskDone, 0, 0);
+
+	numberOfThreads = (numberOfWorkers > 1) ? numberOfWorkers - 1 : 0;
+	threads = NULL;
+	if(numberOfThreads == 0)
+		return;
+
+	threads = new pthread_t[numberOfThreads];
+	for(int i = 0; i < numberOfThreads; i++)
+	{
+		WorkerThreadParam * tp = (WorkerThreadParam *)malloc(sizeof(WorkerThreadParam));
+		tp->workers = this;
+		if(pthread_create(&threads[i], NULL, StatisticsWorkers::workerRun, (void *)tp) != 0)
+		{
+			if(HBSD::log->enabled(Logging::FATAL))
+				HBSD::log->fatal(string("Unable to create a statistics worker thread"));
+			exit(1);
+		}
+	}
+
+	if(HBSD::log->enabled(Logging::INFO))
+		HBSD::log->info(string("Statistics workers started: ") + Util::to_string(numberOfThreads));
+}
+
+StatisticsWorkers::~StatisticsWorkers()
+{
+	// Wake up every worker with the stop flag set
+	stop = true;
+	for(int i = 0; i < numberOfThreads; i++)
+		sem_post(&taskAvailable);
+	for(int i = 0; i < numberOfThreads; i++)
+		pthread_join(threads[i], NULL);
+	if(threads != NULL)
+		delete [] threads;
+	sem_destroy(&taskAvailable);
+	sem_destroy(&taskDone);
+}
+
+void StatisticsWorkers::run(StatisticsTask * task, int numberOfShards)
+{
+	assert(task != NULL);
+	if(numberOfShards <= 0)
+		return;
+
+	// Not worth waking up the workers
+	if(numberOfThreads == 0 || numberOfShards == 1)
+	{
+		for(int i = 0; i < numberOfShards; i++)
+			task->runShard(i);
+		return;
+	}
+
+	currentTask = task;
+	this->numberOfShards = numberOfShards;
+	nextShard = 0;
+	__sync_synchronize();
+
+	for(int i = 0; i < numberOfThreads; i++)
+		sem_post(&taskAvailable);
+
+	// The calling thread works as well
+	processShards();
+
+	// Each wake up is matched by a done, so the task is over once we got them all
+	for(int i = 0; i < numberOfThreads; i++)
+		sem_wait(&taskDone);
+
+	currentTask = NULL;
+}
+
+void StatisticsWorkers::processShards()
+{
+	int shard;
+	while((shard = __sync_fetch_and_add(&nextShard, 1)) < numberOfShards)
+	{
+		currentTask->runShard(shard);
+	}
+}
+
+void * StatisticsWorkers::workerRun(void * arg)
+{
+	WorkerThreadParam * tp = (WorkerThreadParam *)arg;
+	StatisticsWorkers * workers = tp->workers;
+	free(tp);
+
+	while(true)
+	{
+		sem_wait(&workers->taskAvailable);
+		if(workers->stop)
+			break;
+		workers->processShards();
+		sem_post(&workers->taskDone);
+	}
+	return NULL;
+}
@@ -0,0 +1,110 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef STATISTICS_WORKERS_H
+#define STATISTICS_WORKERS_H
+
+#include <pthread.h>
+#include <semaphore.h>
+
+// Default number of threads taking part in a statistics refresh, the calling one included
+#define DEFAULT_STATISTICS_WORKERS 1
+// Number of messages handled by a single unit of work
+#define STATISTICS_SHARD_SIZE 32
+
+class StatisticsWorkers;
+
+typedef struct WorkerThreadParam
+{
+	StatisticsWorkers * workers;
+}WorkerThreadParam;
+
+/**
+ * A unit of parallel work over the statistics matrix. The matrix is split in
+ * fixed size shards so that the partial results, and thus the reduced ones,
+ * do not depend on the number of workers or on the scheduling.
+ */
+class StatisticsTask
+{
+public:
+	virtual ~StatisticsTask() {}
+
+	/**
+	 * Processes one shard. Called concurrently for distinct shards.
+	 *
+	 * @param shard Index of the shard to process.
+	 */
+	virtual void runShard(int shard) = 0;
+};
+
+/**
+ * Persistent pool of threads used by the StatisticsManager to refresh the
+ * statistics of all the messages. Idle workers, as well as the calling thread,
+ * keep taking the next unprocessed shard until none is left.
+ */
+class StatisticsWorkers
+{
+public:
+	/**
+	 * Constructor: starts the worker threads.
+	 *
+	 * @param numberOfWorkers Number of threads taking part in a run, the
+	 *    calling one included. 1 means that everything runs in the caller.
+	 */
+	StatisticsWorkers(int numberOfWorkers);
+	~StatisticsWorkers();
+
+	/**
+	 * Runs the task over all the shards and returns once they are all done.
+	 *
+	 * @param task Task to run.
+	 * @param numberOfShards Number of shards of the task.
+	 */
+	void run(StatisticsTask * task, int numberOfShards);
+
+	int getNumberOfWorkers()
+	{
+		return numberOfThreads + 1;
+	}
+
+	/**
+	 * Main loop of the worker threads.
+	 */
+	static void * workerRun(void * arg);
+
+private:
+	// Processes shards of the current task until none is left
+	void processShards();
+
+	pthread_t * threads;
+	int numberOfThreads;
+	bool stop;
+	sem_t taskAvailable;
+	sem_t taskDone;
+	StatisticsTask * currentTask;
+	int numberOfShards;
+	volatile int nextShard;
+};
+
+#endif
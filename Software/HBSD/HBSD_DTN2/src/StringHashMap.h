@@ -0,0 +1,252 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef STRING_HASH_MAP_H
+#define STRING_HASH_MAP_H
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STRING_HASH_MAP_INITIAL_CAPACITY 16
+
+/**
+ * Hash table from strings to objects, with open addressing and linear probing.
+ * Only the pointers are stored, a NULL value is never stored. The table is not
+ * synchronized, its owner locks it.
+ *
+ * The slots are iterated with begin(), next() and end():
+ *   for(size_t slot = map.begin(); slot != map.end(); slot = map.next(slot))
+ */
+template <class T>
+class StringHashMap
+{
+public:
+
+	StringHashMap()
+	{
+		capacity = STRING_HASH_MAP_INITIAL_CAPACITY;
+		slots = new Slot[capacity];
+		count = 0;
+		deleted = 0;
+	}
+
+	~StringHashMap()
+	{
+		delete [] slots;
+	}
+
+	/**
+	 * @return The value stored under the key, NULL if none.
+	 */
+	T * find(const std::string & key) const
+	{
+		size_t slot = lookup(key, hashKey(key));
+		return slots[slot].state == SLOT_FULL ? slots[slot].value : NULL;
+	}
+
+	/**
+	 * Stores a value, replacing the one stored under the same key.
+	 * @return The replaced value, NULL if none.
+	 */
+	T * insert(const std::string & key, T * value)
+	{
+		// Rehashing past 3/4 of the slots used, growing when the live keys fill half of them,
+		// else only dropping the deleted slots
+		if((count + deleted + 1) * 4 > capacity * 3)
+			resize(count * 2 >= capacity ? capacity * 2 : capacity);
+
+		uint64_t hash = hashKey(key);
+		size_t slot = lookup(key, hash);
+		if(slots[slot].state == SLOT_FULL)
+		{
+			T * previous = slots[slot].value;
+			slots[slot].value = value;
+			return previous;
+		}
+
+		// Reusing the first deleted slot on the probing sequence
+		size_t mask = capacity - 1;
+		size_t target = hash & mask;
+		while(slots[target].state == SLOT_FULL)
+			target = (target + 1) & mask;
+		if(slots[target].state == SLOT_DELETED)
+			deleted--;
+		slots[target].state = SLOT_FULL;
+		slots[target].hash = hash;
+		slots[target].key = key;
+		slots[target].value = value;
+		count++;
+		return NULL;
+	}
+
+	/**
+	 * Removes a key.
+	 * @return The removed value, NULL if the key was not stored.
+	 */
+	T * erase(const std::string & key)
+	{
+		size_t slot = lookup(key, hashKey(key));
+		if(slots[slot].state != SLOT_FULL)
+			return NULL;
+		T * value = slots[slot].value;
+		slots[slot].state = SLOT_DELETED;
+		slots[slot].key.clear();
+		slots[slot].value = NULL;
+		count--;
+		deleted++;
+		return value;
+	}
+
+	void clear()
+	{
+		delete [] slots;
+		capacity = STRING_HASH_MAP_INITIAL_CAPACITY;
+		slots = new Slot[capacity];
+		count = 0;
+		deleted = 0;
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	bool empty() const
+	{
+		return count == 0;
+	}
+
+	size_t begin() const
+	{
+		return next((size_t)-1);
+	}
+
+	size_t end() const
+	{
+		return capacity;
+	}
+
+	size_t next(size_t slot) const
+	{
+		for(slot++; slot < capacity; slot++)
+		{
+			if(slots[slot].state == SLOT_FULL)
+				break;
+		}
+		return slot;
+	}
+
+	const std::string & keyAt(size_t slot) const
+	{
+		return slots[slot].key;
+	}
+
+	T * valueAt(size_t slot) const
+	{
+		return slots[slot].value;
+	}
+
+private:
+
+	enum SlotState
+	{
+		SLOT_EMPTY,
+		SLOT_FULL,
+		SLOT_DELETED
+	};
+
+	typedef struct Slot
+	{
+		std::string key;
+		T * value;
+		uint64_t hash;
+		char state;
+		Slot() : value(NULL), hash(0), state(SLOT_EMPTY) {}
+	}Slot;
+
+	// FNV-1a
+	static uint64_t hashKey(const std::string & key)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		const char * data = key.data();
+		for(size_t i = 0; i < key.length(); i++)
+		{
+			hash ^= (unsigned char)data[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	/**
+	 * @return The slot holding the key, or the empty slot ending its probing sequence.
+	 */
+	size_t lookup(const std::string & key, uint64_t hash) const
+	{
+		size_t mask = capacity - 1;
+		size_t slot = hash & mask;
+		while(slots[slot].state != SLOT_EMPTY)
+		{
+			if(slots[slot].state == SLOT_FULL && slots[slot].hash == hash && slots[slot].key == key)
+				break;
+			slot = (slot + 1) & mask;
+		}
+		return slot;
+	}
+
+	// Rebuilds the table without its deleted slots
+	void resize(size_t newCapacity)
+	{
+		Slot * oldSlots = slots;
+		size_t oldCapacity = capacity;
+		capacity = newCapacity;
+		slots = new Slot[capacity];
+		size_t mask = capacity - 1;
+		for(size_t i = 0; i < oldCapacity; i++)
+		{
+			if(oldSlots[i].state != SLOT_FULL)
+				continue;
+			size_t slot = oldSlots[i].hash & mask;
+			while(slots[slot].state == SLOT_FULL)
+				slot = (slot + 1) & mask;
+			slots[slot].state = SLOT_FULL;
+			slots[slot].hash = oldSlots[i].hash;
+			slots[slot].key.swap(oldSlots[i].key);
+			slots[slot].value = oldSlots[i].value;
+		}
+		deleted = 0;
+		delete [] oldSlots;
+	}
+
+	// Not copyable
+	StringHashMap(const StringHashMap &);
+	StringHashMap & operator=(const StringHashMap &);
+
+	Slot * slots;
+	size_t capacity;
+	size_t count;
+	size_t deleted;
+};
+
+#endif
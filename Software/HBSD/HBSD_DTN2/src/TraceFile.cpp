@@ -0,0 +1,186 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#include "TraceFile.h"
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+using namespace std;
+
+// End of a <bpa> document within a plain text trace
+#define TRACE_BPA_END "</bpa>"
+#define TRACE_READ_SIZE 65536
+
+uint64_t traceMonotonicTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+TraceWriter::TraceWriter()
+{
+	file = NULL;
+}
+
+TraceWriter::~TraceWriter()
+{
+	close();
+}
+
+bool TraceWriter::open(string fileName, bool compress)
+{
+	close();
+	// "T" writes without compression
+	file = gzopen(fileName.c_str(), compress ? "wb6" : "wbT");
+	if(file == NULL)
+		return false;
+
+	TraceFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_FILE_VERSION;
+	header.flags = 0;
+	if(gzwrite(file, &header, sizeof(header)) != (int)sizeof(header))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool TraceWriter::append(const char * data, uint32_t length, uint64_t timestamp, uint32_t type)
+{
+	if(file == NULL)
+		return false;
+
+	TraceRecordHeader record;
+	record.length = length;
+	record.type = type;
+	record.timestamp = timestamp;
+	if(gzwrite(file, &record, sizeof(record)) != (int)sizeof(record))
+		return false;
+	return length == 0 || gzwrite(file, data, length) == (int)length;
+}
+
+bool TraceWriter::flush()
+{
+	if(file == NULL)
+		return false;
+	return gzflush(file, Z_SYNC_FLUSH) == Z_OK;
+}
+
+void TraceWriter::close()
+{
+	if(file != NULL)
+	{
+		gzclose(file);
+		file = NULL;
+	}
+}
+
+TraceReader::TraceReader()
+{
+	file = NULL;
+	binary = false;
+}
+
+TraceReader::~TraceReader()
+{
+	close();
+}
+
+bool TraceReader::open(string fileName)
+{
+	close();
+	// Uncompressed files are read as is
+	file = gzopen(fileName.c_str(), "rb");
+	if(file == NULL)
+		return false;
+
+	TraceFileHeader header;
+	int read = gzread(file, &header, sizeof(header));
+	if(read < 0)
+	{
+		close();
+		return false;
+	}
+	binary = (read == (int)sizeof(header) && memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic)) == 0);
+	if(binary && header.version != TRACE_FILE_VERSION)
+	{
+		close();
+		return false;
+	}
+	if(!binary)
+		pending.assign((char *)&header, read);
+	return true;
+}
+
+bool TraceReader::next(string & datagram, uint64_t & timestamp, uint32_t & type)
+{
+	if(file == NULL)
+		return false;
+
+	if(binary)
+	{
+		TraceRecordHeader record;
+		if(gzread(file, &record, sizeof(record)) != (int)sizeof(record))
+			return false;
+		datagram.resize(record.length);
+		if(record.length > 0 && gzread(file, &datagram[0], record.length) != (int)record.length)
+			return false;
+		timestamp = record.timestamp;
+		type = record.type;
+		return true;
+	}
+
+	// Plain text, cut after each </bpa>
+	timestamp = 0;
+	type = TRACE_RECORD_RECEIVED;
+	vector<char> buffer(TRACE_READ_SIZE);
+	size_t end;
+	while((end = pending.find(TRACE_BPA_END)) == string::npos)
+	{
+		int read = gzread(file, &buffer[0], buffer.size());
+		if(read <= 0)
+			return false;
+		pending.append(&buffer[0], read);
+	}
+	end += strlen(TRACE_BPA_END);
+	size_t start = pending.find_first_not_of(" \t\r\n");
+	datagram.assign(pending, start, end - start);
+	pending.erase(0, end);
+	return true;
+}
+
+void TraceReader::close()
+{
+	if(file != NULL)
+	{
+		gzclose(file);
+		file = NULL;
+	}
+	pending.clear();
+}
@@ -0,0 +1,138 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <string>
+#include <stdint.h>
+#include <zlib.h>
+
+// Trace file identification
+#define TRACE_FILE_MAGIC "HBSDTRC"
+#define TRACE_FILE_VERSION 1
+// Type of a trace record
+#define TRACE_RECORD_RECEIVED 0
+#define TRACE_RECORD_SENT 1
+// Prefix of the request ids built by the recorded Requester, so that the
+// replayed requests carry the same ids as the recorded ones
+#define TRACE_RECORD_REQUEST_ID_BASE 2
+
+/**
+ * Layout of a trace of the XML messages received from dtnd. Host byte order:
+ *
+ *   TraceFileHeader
+ *   n x (TraceRecordHeader, length bytes of the datagram)
+ *
+ * The whole file may be gzip compressed. Files that do not start with the
+ * magic are read as plain text made of concatenated <bpa>...</bpa> documents,
+ * e.g. hand written traces.
+ */
+typedef struct TraceFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+}TraceFileHeader;
+
+typedef struct TraceRecordHeader
+{
+	uint32_t length;
+	// TRACE_RECORD_RECEIVED for the messages from dtnd, TRACE_RECORD_SENT for the requests,
+	// TRACE_RECORD_REQUEST_ID_BASE for the request ids prefix
+	uint32_t type;
+	// Monotonic clock reading at reception or sending, in nanoseconds
+	uint64_t timestamp;
+}TraceRecordHeader;
+
+/**
+ * Appends datagrams to a trace file.
+ */
+class TraceWriter
+{
+public:
+	TraceWriter();
+	~TraceWriter();
+
+	/**
+	 * Creates, or truncates, the trace file and writes its header.
+	 *
+	 * @param compress Gzip the file.
+	 * @return False if the file cannot be written.
+	 */
+	bool open(std::string fileName, bool compress = false);
+
+	/**
+	 * Appends a datagram.
+	 *
+	 * @param timestamp Monotonic time of the datagram in nanoseconds.
+	 * @param type TRACE_RECORD_RECEIVED or TRACE_RECORD_SENT.
+	 * @return False on a write error.
+	 */
+	bool append(const char * data, uint32_t length, uint64_t timestamp, uint32_t type = TRACE_RECORD_RECEIVED);
+
+	/**
+	 * Pushes the appended records to the file, so that they survive a crash.
+	 */
+	bool flush();
+	void close();
+
+private:
+	gzFile file;
+};
+
+/**
+ * Reads back the datagrams of a trace file, binary or plain text.
+ */
+class TraceReader
+{
+public:
+	TraceReader();
+	~TraceReader();
+
+	bool open(std::string fileName);
+
+	/**
+	 * Reads the next datagram. Plain text traces only hold received messages
+	 * and have no timestamps, 0 is returned instead.
+	 *
+	 * @param type Set to TRACE_RECORD_RECEIVED or TRACE_RECORD_SENT.
+	 * @return False at the end of the trace or on a truncated record.
+	 */
+	bool next(std::string & datagram, uint64_t & timestamp, uint32_t & type);
+	void close();
+
+private:
+	gzFile file;
+	bool binary;
+	// Plain text read ahead
+	std::string pending;
+};
+
+/**
+ * Returns the current monotonic time in nanoseconds.
+ */
+uint64_t traceMonotonicTime();
+
+#endif
@@ -0,0 +1,175 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#include "TraceRecorder.h"
+#include "HBSD.h"
+#include "Metrics.h"
+#include <stdlib.h>
+
+using namespace std;
+
+TraceRecorder::TraceRecorder(string fileName, bool compress, int maxQueueSize)
+{
+	this->fileName = fileName;
+	this->compress = compress;
+	this->maxQueueSize = maxQueueSize;
+	started = false;
+	stop = false;
+	droppedRecords = 0;
+	queuedRecords = 0;
+	sem_init(&recordsQueueLock, 0, 1);
+	sem_init(&recordsAvailable, 0, 0);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	if(started)
+	{
+		sem_wait(&recordsQueueLock);
+		stop = true;
+		sem_post(&recordsQueueLock);
+		sem_post(&recordsAvailable);
+		pthread_join(thread, NULL);
+	}
+	while(!recordsQueue.empty())
+	{
+		delete recordsQueue.front();
+		recordsQueue.pop_front();
+	}
+	writer.close();
+	sem_destroy(&recordsQueueLock);
+	sem_destroy(&recordsAvailable);
+}
+
+bool TraceRecorder::init()
+{
+	if(!writer.open(fileName, compress))
+	{
+		if(HBSD::log->enabled(Logging::ERROR))
+			HBSD::log->error(string("Unable to create the trace file: ") + fileName);
+		return false;
+	}
+
+	RecorderThreadParam * tp = (RecorderThreadParam *)malloc(sizeof(RecorderThreadParam));
+	if(tp == NULL)
+	{
+		if(HBSD::log->enabled(Logging::FATAL))
+			HBSD::log->fatal(string("Problem occurred while allocate TraceRecorder thread parameter"));
+		exit(1);
+	}
+	tp->recorder = this;
+
+	if(pthread_create(&thread, NULL, TraceRecorder::run, (void *)tp) != 0)
+	{
+		if(HBSD::log->enabled(Logging::FATAL))
+			HBSD::log->fatal(string("Unable to create the TraceRecorder thread."));
+		exit(1);
+	}
+	started = true;
+
+	if(HBSD::log->enabled(Logging::INFO))
+		HBSD::log->info(string("Recording the dtnd messages to: ") + fileName);
+	return true;
+}
+
+void TraceRecorder::record(uint32_t type, const char * data, uint32_t length)
+{
+	sem_wait(&recordsQueueLock);
+	if(queuedRecords >= maxQueueSize)
+	{
+		droppedRecords++;
+		Metrics::increment(METRIC_TRACE_RECORDS_DROPPED);
+		sem_post(&recordsQueueLock);
+		return;
+	}
+	sem_post(&recordsQueueLock);
+
+	// Built out of the lock, the queue may grow slightly beyond its maximum
+	TraceRecord * record = new TraceRecord();
+	record->type = type;
+	record->data.assign(data, length);
+
+	// Timestamped while queuing so that the timestamps follow the order of the trace
+	sem_wait(&recordsQueueLock);
+	record->timestamp = traceMonotonicTime();
+	recordsQueue.push_back(record);
+	queuedRecords++;
+	sem_post(&recordsQueueLock);
+	sem_post(&recordsAvailable);
+}
+
+unsigned long TraceRecorder::getNumberOfDroppedRecords()
+{
+	unsigned long tmp;
+	sem_wait(&recordsQueueLock);
+	tmp = droppedRecords;
+	sem_post(&recordsQueueLock);
+	return tmp;
+}
+
+void * TraceRecorder::run(void * arg)
+{
+	RecorderThreadParam * tp = (RecorderThreadParam *)arg;
+	TraceRecorder * recorder = tp->recorder;
+	free(tp);
+	recorder->writeRecords();
+	return NULL;
+}
+
+void TraceRecorder::writeRecords()
+{
+	bool failed = false;
+	while(true)
+	{
+		sem_wait(&recordsAvailable);
+
+		// Take all the queued records at once, the callers are only blocked while swapping
+		list<TraceRecord *> records;
+		sem_wait(&recordsQueueLock);
+		records.swap(recordsQueue);
+		queuedRecords = 0;
+		bool stopping = stop;
+		sem_post(&recordsQueueLock);
+
+		// The semaphore is posted once per record, the later wake ups may find nothing to write
+		bool written = !records.empty();
+		while(!records.empty())
+		{
+			TraceRecord * record = records.front();
+			records.pop_front();
+			if(!failed && !writer.append(record->data.data(), record->data.length(), record->timestamp, record->type))
+			{
+				failed = true;
+				if(HBSD::log->enabled(Logging::ERROR))
+					HBSD::log->error(string("Unable to write the trace file, recording stopped: ") + fileName);
+			}
+			delete record;
+		}
+		if(written && !failed)
+			writer.flush();
+
+		if(stopping)
+			break;
+	}
+}
@@ -0,0 +1,117 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <string>
+#include <list>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include "TraceFile.h"
+
+// Default trace file of the recording mode
+#define DEFAULT_TRACE_RECORDING_FILE "/tmp/hbsd_trace.trc"
+// Default maximum number of records waiting for the writer thread
+#define DEFAULT_TRACE_RECORDING_QUEUE_SIZE 4096
+
+class TraceRecorder;
+
+typedef struct RecorderThreadParam
+{
+	TraceRecorder * recorder;
+}RecorderThreadParam;
+
+typedef struct TraceRecord
+{
+	uint32_t type;
+	uint64_t timestamp;
+	std::string data;
+}TraceRecord;
+
+/**
+ * Records the messages exchanged with dtnd into a trace file, to be replayed
+ * by HBSD_Replay. The callers only timestamp and queue the datagrams, a
+ * background thread writes them.
+ */
+class TraceRecorder
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param fileName Trace file, truncated by init().
+	 * @param compress Gzip the trace.
+	 * @param maxQueueSize Records waiting to be written beyond which the new
+	 *    ones are dropped rather than delaying the router.
+	 */
+	TraceRecorder(std::string fileName, bool compress, int maxQueueSize);
+
+	/**
+	 * Destructor: writes the queued records and closes the trace.
+	 */
+	~TraceRecorder();
+
+	/**
+	 * Opens the trace and starts the writer thread.
+	 *
+	 * @return False if the trace cannot be created.
+	 */
+	bool init();
+
+	/**
+	 * Queues a copy of a datagram, timestamped with the current monotonic
+	 * time. Thread safe.
+	 *
+	 * @param type TRACE_RECORD_RECEIVED or TRACE_RECORD_SENT.
+	 */
+	void record(uint32_t type, const char * data, uint32_t length);
+
+	unsigned long getNumberOfDroppedRecords();
+
+	/**
+	 * Main loop of the writer thread.
+	 */
+	static void * run(void * arg);
+
+private:
+	// Writes the queued records until stopped
+	void writeRecords();
+
+	std::string fileName;
+	bool compress;
+	int maxQueueSize;
+	TraceWriter writer;
+	bool started;
+	bool stop;
+	pthread_t thread;
+	unsigned long droppedRecords;
+	std::list<TraceRecord *> recordsQueue;
+	int queuedRecords;
+	sem_t recordsQueueLock;
+	sem_t recordsAvailable;
+};
+
+#endif
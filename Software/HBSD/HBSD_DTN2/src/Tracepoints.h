@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2010  INRIA, Planete Team
+
+Authors:
+--------------------------------------------------------------
+Amir Krifa			:  Amir.Krifa@sophia.inria.fr
+Chadi Barakat			: Chadi.Barakat@sophia.inria.fr
+Thrasyvoulos Spyropoulos	: spyropoulos@tik.ee.ethz.ch
+--------------------------------------------------------------
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 3
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef TRACEPOINTS_H
+#define TRACEPOINTS_H
+
+/**
+ * Static tracepoints (USDT) of the provider "hbsd", for perf or bpftrace, e.g.
+ *   bpftrace -e 'usdt:./bin/HBSD_Router:hbsd:bundle_evicted { @[arg1] = count(); }'
+ * A tracepoint is a single nop until a tracer attaches to it. Built when the
+ * Makefile finds <sys/sdt.h> (HBSD_USDT), the macros are empty otherwise.
+ *
+ * The tracepoints and their arguments:
+ *   bundle_admitted(key, utility)  bundle added to the buffer
+ *   bundle_evicted(key, utility)   buffered bundle dropped for a new one
+ *   bundle_rejected(key, utility)  new bundle dropped, the buffer being full
+ *   sv_sent(dest, link, file)      summary vector injected towards a peer
+ *   sv_received(source, type, length)
+ *   request_sent(data, length)     XML request sent to dtnd
+ * The keys and identifiers are C strings. The utilities are in millionths,
+ * -1 when the buffer had room and no utility was computed.
+ */
+
+#ifdef HBSD_USDT
+#include <sys/sdt.h>
+#define HBSD_TRACEPOINT2(name, a1, a2) DTRACE_PROBE2(hbsd, name, a1, a2)
+#define HBSD_TRACEPOINT3(name, a1, a2, a3) DTRACE_PROBE3(hbsd, name, a1, a2, a3)
+#else
+#define HBSD_TRACEPOINT2(name, a1, a2) do {} while(0)
+#define HBSD_TRACEPOINT3(name, a1, a2, a3) do {} while(0)
+#endif
+
+// Utility argument of the bundle tracepoints
+#define HBSD_TRACE_UTILITY(utility) ((long long)((utility) * 1000000.0))
+
+#endif
@@ -29,6 +29,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <sstream>
 #include <time.h>
 
+#define HBSD_STRINGIFY_VALUE(x) #x
+#define HBSD_STRINGIFY(x) HBSD_STRINGIFY_VALUE(x)
+// Location given to the lock functions, a literal built at compile time
+#define LOCK_LOCATION __FILE__ ":" HBSD_STRINGIFY(__LINE__)
+
 class Util
 {
 public:
@@ -26,6 +26,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <list>
 #include <string>
 #include "Console_Logging.h"
+#include "Async_Logging.h"
+#include "ConfigFile.h"
 #include <iostream>
 #include <signal.h>
 #include <unistd.h>
@@ -42,6 +44,7 @@ void exitHBSD(int sig)
 		HBSD::log->info(string("Signal Ctrl + C: Shutting down the HBSD external router."));
 	if(mainRouter != NULL)
 		delete mainRouter;
+	HBSD::log->flush();
 }
 
 int main(int argc, const char** argv) 
@@ -69,7 +72,15 @@ int main(int argc, const char** argv)
 	// logging system defaults to.
 	try 
 	{
-		HBSD::log = (Logging*) new Console_Logging();
+		if (HBSD::loggingClass.compare("Async_Logging") == 0)
+		{
+			HBSD::log = (Logging*) new Async_Logging(HBSD::routerConf->getInt(string("asyncLoggingBufferSize"), DEFAULT_ASYNC_LOGGING_BUFFER_SIZE));
+		} else
+		{
+			if (HBSD::loggingClass.compare("Console_Logging") != 0)
+				cerr << "Unknown logging class " << HBSD::loggingClass << ", using Console_Logging" << endl;
+			HBSD::log = (Logging*) new Console_Logging();
+		}
 		if (HBSD::logConfiguration.empty()) 
 		{
 			HBSD::log->conf();